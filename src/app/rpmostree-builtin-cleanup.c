@@ -97,11 +97,10 @@ rpmostree_builtin_cleanup (int             argc,
                                 cancellable, &os_proxy, error))
     return FALSE;
 
-  if (!rpmostree_os_call_cleanup_sync (os_proxy,
-                                       (const char *const*)cleanup_types->pdata,
-                                       &transaction_address,
-                                       cancellable,
-                                       error))
+  if (!rpmostree_call_txn_method_sync (os_proxy, "Cleanup",
+                                       g_variant_new ("(^as)", (char**)cleanup_types->pdata),
+                                       NULL, &transaction_address,
+                                       cancellable, error))
     return FALSE;
 
   if (!rpmostree_transaction_get_response_sync (sysroot_proxy,
@@ -107,12 +107,10 @@ rpmostree_builtin_deploy (int            argc,
 
   if (opt_preview)
     {
-      if (!rpmostree_os_call_download_deploy_rpm_diff_sync (os_proxy,
-                                                            revision,
-                                                            packages,
-                                                            &transaction_address,
-                                                            cancellable,
-                                                            error))
+      if (!rpmostree_call_txn_method_sync (os_proxy, "DownloadDeployRpmDiff",
+                                           g_variant_new ("(s^as)", revision, (char**)packages),
+                                           NULL, &transaction_address,
+                                           cancellable, error))
         return FALSE;
     }
   else
@@ -147,14 +145,10 @@ rpmostree_builtin_deploy (int            argc,
         }
       else
         {
-          if (!rpmostree_os_call_deploy_sync (os_proxy,
-                                              revision,
-                                              options,
-                                              NULL,
-                                              &transaction_address,
-                                              NULL,
-                                              cancellable,
-                                              error))
+          if (!rpmostree_call_txn_method_sync (os_proxy, "Deploy",
+                                               g_variant_new ("(s@a{sv})", revision, options),
+                                               NULL, &transaction_address,
+                                               cancellable, error))
             return FALSE;
         }
     }
@@ -86,11 +86,10 @@ rpmostree_builtin_finalize_deployment (int             argc,
   g_autoptr(GVariant) options = g_variant_ref_sink (g_variant_dict_end (&dict));
 
   g_autofree char *transaction_address = NULL;
-  if (!rpmostree_os_call_finalize_deployment_sync (os_proxy,
-                                                   options,
-                                                   &transaction_address,
-                                                   cancellable,
-                                                   error))
+  if (!rpmostree_call_txn_method_sync (os_proxy, "FinalizeDeployment",
+                                       g_variant_new ("(@a{sv})", options),
+                                       NULL, &transaction_address,
+                                       cancellable, error))
     return FALSE;
 
   if (!rpmostree_transaction_get_response_sync (sysroot_proxy,
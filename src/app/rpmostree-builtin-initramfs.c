@@ -139,13 +139,11 @@ rpmostree_builtin_initramfs (int             argc,
       g_autoptr(GVariant) options = g_variant_ref_sink (g_variant_dict_end (&dict));
 
       g_autofree char *transaction_address = NULL;
-      if (!rpmostree_os_call_set_initramfs_state_sync (os_proxy,
-                                                       opt_enable,
-                                                       (const char *const*)opt_add_arg,
-                                                       options,
-                                                       &transaction_address,
-                                                       cancellable,
-                                                       error))
+      if (!rpmostree_call_txn_method_sync (os_proxy, "SetInitramfsState",
+                                           g_variant_new ("(b^as@a{sv})", opt_enable,
+                                                          opt_add_arg, options),
+                                           NULL, &transaction_address,
+                                           cancellable, error))
         return FALSE;
 
       if (!rpmostree_transaction_get_response_sync (sysroot_proxy,
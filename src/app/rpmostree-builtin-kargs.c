@@ -302,15 +302,13 @@ rpmostree_builtin_kargs (int            argc,
        * and kept other strvs empty, because the existing kernel arguments
        * is already enough for the update
        */
-      if (!rpmostree_os_call_kernel_args_sync (os_proxy,
-                                               current_kernel_arg_string,
-                                               (const char* const*) empty_strv,
-                                               (const char* const*) empty_strv,
-                                               (const char* const*) empty_strv,
-                                               options,
-                                               &transaction_address,
-                                               cancellable,
-                                               error))
+      if (!rpmostree_call_txn_method_sync (os_proxy, "KernelArgs",
+                                           g_variant_new ("(s^as^as^as@a{sv})",
+                                                          current_kernel_arg_string,
+                                                          empty_strv, empty_strv, empty_strv,
+                                                          options),
+                                           NULL, &transaction_address,
+                                           cancellable, error))
         return FALSE;
     }
   else
@@ -326,15 +324,15 @@ rpmostree_builtin_kargs (int            argc,
         opt_kernel_delete_strings = empty_strv;
 
       /* call the generearted dbus-function */
-      if (!rpmostree_os_call_kernel_args_sync (os_proxy,
-                                               old_kernel_arg_string,
-                                               (const char* const*) opt_kernel_append_strings,
-                                               (const char* const*) opt_kernel_replace_strings,
-                                               (const char* const*) opt_kernel_delete_strings,
-                                               options,
-                                               &transaction_address,
-                                               cancellable,
-                                               error))
+      if (!rpmostree_call_txn_method_sync (os_proxy, "KernelArgs",
+                                           g_variant_new ("(s^as^as^as@a{sv})",
+                                                          old_kernel_arg_string,
+                                                          opt_kernel_append_strings,
+                                                          opt_kernel_replace_strings,
+                                                          opt_kernel_delete_strings,
+                                                          options),
+                                           NULL, &transaction_address,
+                                           cancellable, error))
         return FALSE;
     }
 
@@ -31,11 +31,13 @@
 
 static gboolean opt_dry_run;
 static gboolean opt_replace;
+static gboolean opt_fine_grained;
 static gboolean opt_consented;
 
 static GOptionEntry option_entries[] = {
   { "dry-run", 'n', 0, G_OPTION_ARG_NONE, &opt_dry_run, "Only perform analysis, do not make changes", NULL },
   { "i-like-danger", 0, 0, G_OPTION_ARG_NONE, &opt_consented, "Consent to the dangers that livefs may pose", NULL },
+  { "fine-grained", 0, 0, G_OPTION_ARG_NONE, &opt_fine_grained, "Replace only changed files in /usr; allows updating and removing packages", NULL },
   /* Known broken with kernel updates; see https://github.com/projectatomic/rpm-ostree/issues/1495 */
   { "dangerous-do-not-use-replace", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_NONE, &opt_replace, "Completely replace all files in /usr (known broken)", NULL },
   { NULL }
@@ -49,6 +51,7 @@ get_args_variant (void)
   g_variant_dict_init (&dict, NULL);
   g_variant_dict_insert (&dict, "dry-run", "b", opt_dry_run);
   g_variant_dict_insert (&dict, "replace", "b", opt_replace);
+  g_variant_dict_insert (&dict, "fine-grained", "b", opt_fine_grained);
 
   return g_variant_dict_end (&dict);
 }
@@ -87,11 +90,10 @@ rpmostree_ex_builtin_livefs (int             argc,
     return FALSE;
 
   g_autofree char *transaction_address = NULL;
-  if (!rpmostree_osexperimental_call_live_fs_sync (osexperimental_proxy,
-                                                   get_args_variant (),
-                                                   &transaction_address,
-                                                   cancellable,
-                                                   error))
+  if (!rpmostree_call_txn_method_sync (osexperimental_proxy, "LiveFs",
+                                       g_variant_new ("(@a{sv})", get_args_variant ()),
+                                       NULL, &transaction_address,
+                                       cancellable, error))
     return FALSE;
 
   if (!rpmostree_transaction_get_response_sync (sysroot_proxy,
@@ -210,15 +210,11 @@ rpmostree_builtin_rebase (int             argc,
           options = g_variant_ref_sink (g_variant_dict_end (&dict));
         }
 
-      if (!rpmostree_os_call_rebase_sync (os_proxy,
-                                          options,
-                                          new_provided_refspec,
-                                          packages,
-                                          NULL,
-                                          &transaction_address,
-                                          NULL,
-                                          cancellable,
-                                          error))
+      if (!rpmostree_call_txn_method_sync (os_proxy, "Rebase",
+                                           g_variant_new ("(@a{sv}s^as)", options,
+                                                          new_provided_refspec, packages),
+                                           NULL, &transaction_address,
+                                           cancellable, error))
         return FALSE;
     }
 
@@ -81,11 +81,10 @@ rpmostree_builtin_refresh_md (int             argc,
                                 cancellable, &os_proxy, error))
     return FALSE;
 
-  if (!rpmostree_os_call_refresh_md_sync (os_proxy,
-                                          get_args_variant (),
-                                          &transaction_address,
-                                          cancellable,
-                                          error))
+  if (!rpmostree_call_txn_method_sync (os_proxy, "RefreshMd",
+                                       g_variant_new ("(@a{sv})", get_args_variant ()),
+                                       NULL, &transaction_address,
+                                       cancellable, error))
     return FALSE;
 
   if (!rpmostree_transaction_get_response_sync (sysroot_proxy,
@@ -83,11 +83,10 @@ rpmostree_builtin_rollback (int             argc,
   g_variant_dict_insert (&dict, "reboot", "b", opt_reboot);
   g_autoptr(GVariant) options = g_variant_ref_sink (g_variant_dict_end (&dict));
 
-  if (!rpmostree_os_call_rollback_sync (os_proxy,
-                                        get_args_variant (),
-                                        &transaction_address,
-                                        cancellable,
-                                        error))
+  if (!rpmostree_call_txn_method_sync (os_proxy, "Rollback",
+                                       g_variant_new ("(@a{sv})", get_args_variant ()),
+                                       NULL, &transaction_address,
+                                       cancellable, error))
     return FALSE;
 
   return rpmostree_transaction_client_run (invocation, sysroot_proxy, os_proxy,
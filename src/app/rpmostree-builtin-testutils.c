@@ -101,10 +101,13 @@ rpmostree_testutils_builtin_inject_pkglist (int argc, char **argv,
   g_assert (rsack->tmpdir.initialized);
 
   g_autoptr(GVariant) pkglist = NULL;
-  if (!rpmostree_create_rpmdb_pkglist_variant (rsack->tmpdir.fd, ".", &pkglist, NULL, error))
+  g_autoptr(GVariant) pkgindex = NULL;
+  if (!rpmostree_create_rpmdb_pkglist_variant (rsack->tmpdir.fd, ".", &pkglist, &pkgindex,
+                                               NULL, error))
     return FALSE;
 
   g_variant_dict_insert_value (meta_dict, "rpmostree.rpmdb.pkglist", pkglist);
+  g_variant_dict_insert_value (meta_dict, "rpmostree.rpmdb.pkgindex", pkgindex);
   g_autoptr(GVariant) new_meta = g_variant_ref_sink (g_variant_dict_end (meta_dict));
 
   g_autoptr(GFile) root = NULL;
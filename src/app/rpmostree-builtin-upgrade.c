@@ -145,13 +145,14 @@ rpmostree_builtin_upgrade (int             argc,
       g_autoptr(GVariant) options = g_variant_ref_sink (g_variant_dict_end (&dict));
 
       gboolean auto_updates_enabled;
-      if (!rpmostree_os_call_automatic_update_trigger_sync (os_proxy,
-                                                            options,
-                                                            &auto_updates_enabled,
-                                                            &transaction_address,
-                                                            cancellable,
-                                                            error))
+      /* No timeout, since it may be queued; see rpmostree_call_txn_method_sync() */
+      g_autoptr(GVariant) ret =
+        g_dbus_proxy_call_sync (G_DBUS_PROXY (os_proxy), "AutomaticUpdateTrigger",
+                                g_variant_new ("(@a{sv})", options),
+                                G_DBUS_CALL_FLAGS_NONE, G_MAXINT, cancellable, error);
+      if (!ret)
         return FALSE;
+      g_variant_get (ret, "(bs)", &auto_updates_enabled, &transaction_address);
 
       if (!auto_updates_enabled)
         {
@@ -192,13 +193,10 @@ rpmostree_builtin_upgrade (int             argc,
         }
       else
         {
-          if (!rpmostree_os_call_upgrade_sync (os_proxy,
-                                               options,
-                                               NULL,
-                                               &transaction_address,
-                                               NULL,
-                                               cancellable,
-                                               error))
+          if (!rpmostree_call_txn_method_sync (os_proxy, "Upgrade",
+                                               g_variant_new ("(@a{sv})", options),
+                                               NULL, &transaction_address,
+                                               cancellable, error))
             return FALSE;
         }
     }
@@ -534,12 +534,13 @@ impl_write_rojig (RpmOstreeRojigCompose *self,
 
   if (self->treefile)
     {
+      g_autoptr(RpmOstreeOwnerIndex) owner_index = NULL;
       if (!rpmostree_check_passwd (self->repo, self->rootfs_dfd, self->treefile_rs, self->treefile,
-                                   NULL, cancellable, error))
+                                   NULL, &owner_index, cancellable, error))
         return glnx_prefix_error (error, "Handling passwd db");
 
       if (!rpmostree_check_groups (self->repo, self->rootfs_dfd, self->treefile_rs, self->treefile,
-                                   NULL, cancellable, error))
+                                   NULL, &owner_index, cancellable, error))
         return glnx_prefix_error (error, "Handling group db");
     }
 
@@ -550,6 +551,7 @@ impl_write_rojig (RpmOstreeRojigCompose *self,
   g_autofree char *new_revision = NULL;
   if (!rpmostree_compose_commit (self->rootfs_dfd, self->repo, NULL,
                                  metadata, NULL, selinux, self->devino_cache,
+                                 rpmostree_context_get_selabel_cache (self->corectx),
                                  &new_revision, cancellable, error))
     return FALSE;
 
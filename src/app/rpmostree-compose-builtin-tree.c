@@ -47,6 +47,7 @@
 #include "rpmostree-package-variants.h"
 #include "rpmostree-libbuiltin.h"
 #include "rpmostree-rpm-util.h"
+#include "rpmostree-phase-stats.h"
 #include "rpmostree-rust.h"
 
 #include "libglnx.h"
@@ -146,6 +147,12 @@ typedef struct {
   JsonNode *treefile_rootval; /* Unowned */
   JsonObject *treefile; /* Unowned */
   RpmOstreeTreespec   *treespec;
+
+  /* For the "timing" section of --write-composejson-to */
+  RpmOstreePhaseStats *phase_stats;
+  guint64 download_size;
+  guint n_imported;
+  GVariant *script_timings;
 } RpmOstreeTreeComposeContext;
 
 static void
@@ -173,6 +180,12 @@ rpm_ostree_tree_compose_context_free (RpmOstreeTreeComposeContext *ctx)
   g_clear_pointer (&ctx->treefile_rs, (GDestroyNotify) ror_treefile_free);
   g_clear_object (&ctx->treefile_parser);
   g_clear_object (&ctx->treespec);
+  if (ctx->phase_stats)
+    {
+      rpmostree_output_set_callback (NULL, NULL);
+      rpmostree_phase_stats_free (ctx->phase_stats);
+    }
+  g_clear_pointer (&ctx->script_timings, g_variant_unref);
   g_free (ctx);
 }
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(RpmOstreeTreeComposeContext, rpm_ostree_tree_compose_context_free)
@@ -401,6 +414,7 @@ install_packages (RpmOstreeTreeComposeContext  *self,
   /* --- Downloading packages --- */
   if (!rpmostree_context_download (self->corectx, cancellable, error))
     return FALSE;
+  self->download_size = rpmostree_context_get_download_size (self->corectx);
 
   if (opt_download_only || opt_download_only_rpms)
     {
@@ -422,6 +436,9 @@ install_packages (RpmOstreeTreeComposeContext  *self,
     {
       if (!rpmostree_context_import (self->corectx, cancellable, error))
         return FALSE;
+      { g_autoptr(GPtrArray) imported = rpmostree_context_get_packages_to_import (self->corectx);
+        self->n_imported = imported->len;
+      }
       rpmostree_context_set_tmprootfs_dfd (self->corectx, rootfs_dfd);
       if (!rpmostree_context_assemble (self->corectx, cancellable, error))
         return FALSE;
@@ -439,6 +456,9 @@ install_packages (RpmOstreeTreeComposeContext  *self,
 
       if (!rpmostree_context_force_relabel (self->corectx, cancellable, error))
         return FALSE;
+
+      self->script_timings =
+        g_variant_ref_sink (rpmostree_context_get_script_timings (self->corectx));
     }
   else
     {
@@ -475,6 +495,8 @@ install_packages (RpmOstreeTreeComposeContext  *self,
       if (!rpmostree_composeutil_legacy_prep_dev (rootfs_dfd, error))
         return FALSE;
 
+      g_auto(RpmOstreePhase) phase = { 0, };
+      rpmostree_output_phase_begin (&phase, "assemble");
       if (!dnf_transaction_commit (dnf_context_get_transaction (dnfctx),
                                    dnf_context_get_goal (dnfctx),
                                    hifstate, error))
@@ -581,6 +603,12 @@ rpm_ostree_compose_context_new (const char    *treefile_pathstr,
 
   /* Init fds to -1 */
   self->workdir_dfd = self->rootfs_dfd = self->cachedir_dfd = -1;
+  /* Account the phases marked by the core for the compose JSON */
+  if (opt_write_composejson_to)
+    {
+      self->phase_stats = rpmostree_phase_stats_new ();
+      rpmostree_output_set_callback (rpmostree_phase_stats_output_cb, self->phase_stats);
+    }
   /* Test whether or not bwrap is going to work - we will fail inside e.g. a Docker
    * container without --privileged or userns exposed.
    */
@@ -932,10 +960,13 @@ impl_install_tree (RpmOstreeTreeComposeContext *self,
     return FALSE;
 
   /* Start postprocessing */
-  if (!rpmostree_treefile_postprocessing (self->rootfs_dfd, self->treefile_rs, self->treefile,
-                                          next_version, self->unified_core_and_fuse,
-                                          cancellable, error))
-    return glnx_prefix_error (error, "Postprocessing");
+  { g_auto(RpmOstreePhase) phase = { 0, };
+    rpmostree_output_phase_begin (&phase, "postprocess");
+    if (!rpmostree_treefile_postprocessing (self->rootfs_dfd, self->treefile_rs, self->treefile,
+                                            next_version, self->unified_core_and_fuse,
+                                            cancellable, error))
+      return glnx_prefix_error (error, "Postprocessing");
+  }
 
   /* Until here, we targeted "rootfs.tmp" in the working directory. Most
    * user-configured postprocessing has run. Now, we need to perform required
@@ -1047,26 +1078,40 @@ impl_commit_tree (RpmOstreeTreeComposeContext *self,
                            g_variant_ref_sink (v));
     }
 
+  /* The changelogs for `db diff --changelogs` live in the detached metadata;
+   * the commit metadata vouches for them */
+  g_autoptr(GVariant) changelogs = NULL;
+  if (!rpmostree_create_rpmdb_changelogs_variant (self->rootfs_dfd, ".", &changelogs,
+                                                  cancellable, error))
+    return FALSE;
+  g_hash_table_insert (self->metadata, g_strdup ("rpmostree.rpmdb.changelogs-sha256"),
+                       g_variant_ref_sink (g_variant_new_take_string (
+                         rpmostree_changelogs_checksum (changelogs))));
+
   /* Convert metadata hash to GVariant */
   g_autoptr(GVariant) metadata = rpmostree_composeutil_finalize_metadata (self->metadata, self->rootfs_dfd, error);
   if (!metadata)
     return FALSE;
-  if (!rpmostree_rootfs_postprocess_common (self->rootfs_dfd, cancellable, error))
-    return FALSE;
-  if (!rpmostree_postprocess_final (self->rootfs_dfd, self->treefile_rs,
-                                    self->treefile, self->unified_core_and_fuse,
-                                    cancellable, error))
-    return FALSE;
+  { g_auto(RpmOstreePhase) phase = { 0, };
+    rpmostree_output_phase_begin (&phase, "postprocess");
+    if (!rpmostree_rootfs_postprocess_common (self->rootfs_dfd, cancellable, error))
+      return FALSE;
+    if (!rpmostree_postprocess_final (self->rootfs_dfd, self->treefile_rs,
+                                      self->treefile, self->unified_core_and_fuse,
+                                      cancellable, error))
+      return FALSE;
+  }
 
   if (self->treefile_rs)
     {
+      g_autoptr(RpmOstreeOwnerIndex) owner_index = NULL;
       if (!rpmostree_check_passwd (self->repo, self->rootfs_dfd, self->treefile_rs,
-                                   self->treefile, self->previous_checksum,
+                                   self->treefile, self->previous_checksum, &owner_index,
                                    cancellable, error))
         return glnx_prefix_error (error, "Handling passwd db");
 
       if (!rpmostree_check_groups (self->repo, self->rootfs_dfd, self->treefile_rs,
-                                   self->treefile, self->previous_checksum,
+                                   self->treefile, self->previous_checksum, &owner_index,
                                    cancellable, error))
         return glnx_prefix_error (error, "Handling group db");
     }
@@ -1102,9 +1147,14 @@ impl_commit_tree (RpmOstreeTreeComposeContext *self,
   g_autofree char *new_revision = NULL;
   if (!rpmostree_compose_commit (self->rootfs_dfd, self->build_repo, parent_revision,
                                  metadata, gpgkey, selinux, self->devino_cache,
+                                 rpmostree_context_get_selabel_cache (self->corectx),
                                  &new_revision, cancellable, error))
     return FALSE;
 
+  if (!rpmostree_commit_write_changelogs (self->build_repo, new_revision, changelogs,
+                                          cancellable, error))
+    return FALSE;
+
   OstreeRepoTransactionStats stats = { 0, };
   OstreeRepoTransactionStats *statsp = NULL;
 
@@ -1143,6 +1193,13 @@ impl_commit_tree (RpmOstreeTreeComposeContext *self,
   else
     g_print ("Wrote commit: %s\n", new_revision);
 
+  if (self->phase_stats)
+    g_variant_builder_add (&composemeta_builder, "{sv}", "timing",
+                           rpmostree_composeutil_timing_variant (self->phase_stats, statsp,
+                                                                 self->download_size,
+                                                                 self->n_imported,
+                                                                 self->script_timings));
+
   if (!rpmostree_composeutil_write_composejson (self->repo,
                                                 opt_write_composejson_to, statsp,
                                                 new_revision, new_commit,
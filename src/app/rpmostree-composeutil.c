@@ -353,10 +353,12 @@ rpmostree_composeutil_finalize_metadata (GHashTable *metadata,
    * pending updates. once we only support unified core composes, this can easily be much
    * more readily injected during assembly */
   g_autoptr(GVariant) rpmdb_v = NULL;
-  if (!rpmostree_create_rpmdb_pkglist_variant (rootfs_dfd, ".", &rpmdb_v,
+  g_autoptr(GVariant) rpmdb_index_v = NULL;
+  if (!rpmostree_create_rpmdb_pkglist_variant (rootfs_dfd, ".", &rpmdb_v, &rpmdb_index_v,
                                                NULL, error))
     return FALSE;
   g_variant_builder_add (metadata_builder, "{sv}", "rpmostree.rpmdb.pkglist", rpmdb_v);
+  g_variant_builder_add (metadata_builder, "{sv}", "rpmostree.rpmdb.pkgindex", rpmdb_index_v);
 
   g_autoptr(GVariant) ret = g_variant_ref_sink (g_variant_builder_end (metadata_builder));
   /* Canonicalize to big endian, like OSTree does. Without this, any numbers
@@ -374,6 +376,86 @@ rpmostree_composeutil_finalize_metadata (GHashTable *metadata,
   return g_steal_pointer (&ret);
 }
 
+static double
+usec_to_seconds (guint64 usec)
+{
+  return ((double)usec) / G_USEC_PER_SEC;
+}
+
+static GVariant *
+phase_seconds (RpmOstreePhaseStats *phase_stats,
+               const char          *name)
+{
+  RpmOstreeUsage usage = { 0, };
+  (void) rpmostree_phase_stats_lookup (phase_stats, name, &usage);
+  return g_variant_new_double (usec_to_seconds (usage.elapsed_usec));
+}
+
+/* Build the "timing" section of the compose JSON from the phases marked with
+ * rpmostree_output_phase_begin() during the compose, plus some throughput
+ * numbers; this is intended to make it easy to see where a slow compose spent
+ * its time.  Returns a floating a{sv}.
+ */
+GVariant *
+rpmostree_composeutil_timing_variant (RpmOstreePhaseStats *phase_stats,
+                                      const OstreeRepoTransactionStats *stats,
+                                      guint64     download_size,
+                                      guint       n_imported,
+                                      GVariant   *script_timings)
+{
+  rpmostree_phase_stats_finish (phase_stats);
+  RpmOstreeUsage total;
+  rpmostree_phase_stats_get_total (phase_stats, &total);
+
+  g_autoptr(GVariantDict) dict = g_variant_dict_new (NULL);
+  g_variant_dict_insert (dict, "total", "d", usec_to_seconds (total.elapsed_usec));
+  g_variant_dict_insert (dict, "peak-rss-kb", "t", total.maxrss_kb);
+  const char *phases[] = { "depsolve", "download", "import", "relabel", "assemble",
+                           "checkout", "scripts", "postprocess", "count-filesizes",
+                           "commit" };
+  for (guint i = 0; i < G_N_ELEMENTS (phases); i++)
+    g_variant_dict_insert_value (dict, phases[i], phase_seconds (phase_stats, phases[i]));
+
+  RpmOstreeUsage usage = { 0, };
+  g_variant_dict_insert (dict, "download-bytes", "t", download_size);
+  if (rpmostree_phase_stats_lookup (phase_stats, "download", &usage) && usage.elapsed_usec > 0)
+    g_variant_dict_insert (dict, "download-bytes-per-second", "d",
+                           download_size / usec_to_seconds (usage.elapsed_usec));
+  g_variant_dict_insert (dict, "import-packages", "u", n_imported);
+  if (rpmostree_phase_stats_lookup (phase_stats, "import", &usage) && usage.elapsed_usec > 0)
+    g_variant_dict_insert (dict, "import-packages-per-second", "d",
+                           n_imported / usec_to_seconds (usage.elapsed_usec));
+  const char *counters[] = { "selinux-label-lookups", "selinux-label-cache-hits",
+                             "selinux-policy-builds", "selinux-policy-cache-hits" };
+  for (guint i = 0; i < G_N_ELEMENTS (counters); i++)
+    g_variant_dict_insert (dict, counters[i], "t",
+                           rpmostree_phase_stats_get_counter (phase_stats, counters[i]));
+
+  g_auto(GVariantBuilder) scripts;
+  g_variant_builder_init (&scripts, G_VARIANT_TYPE ("a{sv}"));
+  if (script_timings)
+    {
+      GVariantIter iter;
+      const char *pkgname;
+      guint64 usec;
+      g_variant_iter_init (&iter, script_timings);
+      while (g_variant_iter_loop (&iter, "{&st}", &pkgname, &usec))
+        g_variant_builder_add (&scripts, "{sv}", pkgname,
+                               g_variant_new_double (usec_to_seconds (usec)));
+    }
+  g_variant_dict_insert_value (dict, "scripts-per-package", g_variant_builder_end (&scripts));
+
+  if (stats)
+    {
+      guint objects_total = stats->metadata_objects_total + stats->content_objects_total;
+      guint objects_written = stats->metadata_objects_written + stats->content_objects_written;
+      g_variant_dict_insert (dict, "commit-objects-written", "u", objects_written);
+      g_variant_dict_insert (dict, "commit-objects-reused", "u", objects_total - objects_written);
+    }
+
+  return g_variant_dict_end (dict);
+}
+
 /* Implements --write-composejson-to, and also prints values.
  * If `path` is NULL, we'll just print some data.
  */
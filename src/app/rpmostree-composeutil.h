@@ -23,6 +23,7 @@
 #include <ostree.h>
 
 #include "rpmostree-core.h"
+#include "rpmostree-phase-stats.h"
 #include "rpmostree-rust.h"
 
 G_BEGIN_DECLS
@@ -64,6 +65,13 @@ rpmostree_composeutil_finalize_metadata (GHashTable *metadata,
                                          int         rootfs_dfd,
                                          GError    **error);
 
+GVariant *
+rpmostree_composeutil_timing_variant (RpmOstreePhaseStats *phase_stats,
+                                      const OstreeRepoTransactionStats *stats,
+                                      guint64     download_size,
+                                      guint       n_imported,
+                                      GVariant   *script_timings);
+
 gboolean
 rpmostree_composeutil_write_composejson (OstreeRepo  *repo,
                                          const char *path,
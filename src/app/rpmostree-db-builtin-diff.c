@@ -69,8 +69,46 @@ print_diff (OstreeRepo   *repo,
   g_autoptr(GPtrArray) modified_from = NULL;
   g_autoptr(GPtrArray) modified_to = NULL;
 
-  /* we still use the old API for changelogs; should enhance libdnf for this */
+  /* composes store changelogs in the detached metadata and source RPMs in the
+   * pkgindex; otherwise we still need the full rpmdb for changelogs */
+  g_autoptr(GVariant) from_pkgindex = NULL;
+  g_autoptr(GVariant) to_pkgindex = NULL;
+  g_autoptr(GVariant) from_changelogs = NULL;
+  g_autoptr(GVariant) to_changelogs = NULL;
   if (!is_diff_format && opt_changelogs)
+    {
+      g_autoptr(GVariant) from_commit = NULL;
+      g_autoptr(GVariant) to_commit = NULL;
+      if (!ostree_repo_load_commit (repo, from_checksum, &from_commit, NULL, error))
+        return FALSE;
+      if (!ostree_repo_load_commit (repo, to_checksum, &to_commit, NULL, error))
+        return FALSE;
+      from_pkgindex = rpmostree_commit_get_pkgindex (from_commit);
+      to_pkgindex = rpmostree_commit_get_pkgindex (to_commit);
+    }
+  if (from_pkgindex && to_pkgindex)
+    {
+      if (!rpmostree_commit_load_changelogs (repo, from_checksum, &from_changelogs,
+                                             cancellable, error))
+        return FALSE;
+      if (from_changelogs &&
+          !rpmostree_commit_load_changelogs (repo, to_checksum, &to_changelogs,
+                                             cancellable, error))
+        return FALSE;
+    }
+
+  if (from_changelogs && to_changelogs)
+    {
+      if (!rpm_ostree_db_diff (repo, from_checksum, to_checksum,
+                               &removed, &added, &modified_from, &modified_to,
+                               cancellable, error))
+        return FALSE;
+
+      rpmostree_diff_print_changelogs (from_pkgindex, to_pkgindex,
+                                       from_changelogs, to_changelogs,
+                                       removed, added, modified_from, modified_to);
+    }
+  else if (!is_diff_format && opt_changelogs)
     {
       g_autoptr(RpmRevisionData) rpmrev1 =
         rpmrev_new (repo, from_checksum, NULL, cancellable, error);
@@ -27,6 +27,61 @@ static GOptionEntry option_entries[] = {
   { NULL }
 };
 
+/* Fast path for `db list REV NAME...`: if @checksum has a pkgindex and every
+ * pattern is a plain package name in it, print those packages without
+ * checking out the rpmdb. Sets @out_listed to %FALSE if the caller needs to
+ * fall back to matching patterns against the rpmdb headers.
+ */
+static gboolean
+list_from_pkgindex (OstreeRepo      *repo,
+                    const char      *checksum,
+                    const GPtrArray *patterns,
+                    gboolean        *out_listed,
+                    GError         **error)
+{
+  *out_listed = FALSE;
+
+  g_autoptr(GVariant) commit = NULL;
+  if (!ostree_repo_load_commit (repo, checksum, &commit, NULL, error))
+    return FALSE;
+  g_autoptr(GVariant) pkgindex = rpmostree_commit_get_pkgindex (commit);
+  if (!pkgindex)
+    return TRUE;
+
+  g_autoptr(GVariant) entries = g_variant_get_child_value (pkgindex, 1);
+  g_autofree gboolean *matched = g_new0 (gboolean, g_variant_n_children (entries));
+  for (guint i = 0; i < patterns->len; i++)
+    {
+      const char *pattern = patterns->pdata[i];
+      guint first, n;
+      if (strpbrk (pattern, "*?[") ||
+          !rpmostree_pkgindex_lookup (pkgindex, pattern, &first, &n))
+        return TRUE; /* globs, NEVRAs, etc... need the full matcher */
+      for (guint j = first; j < first + n; j++)
+        matched[j] = TRUE;
+    }
+
+  /* print in index order, like rpmhdrs_list() does for the rpmdb */
+  const guint n_entries = g_variant_n_children (entries);
+  for (guint i = 0; i < n_entries; i++)
+    {
+      if (!matched[i])
+        continue;
+      const char *name, *epoch, *version, *release, *arch;
+      g_variant_get_child (entries, i, "(&s&s&s&s&sttss)", &name, &epoch, &version,
+                           &release, &arch, NULL, NULL, NULL, NULL);
+      g_autofree char *nevra =
+        rpmostree_custom_nevra_strdup (name, g_ascii_strtoull (epoch, NULL, 10),
+                                       version, release, arch,
+                                       PKG_NEVRA_FLAGS_NAME | PKG_NEVRA_FLAGS_EVR |
+                                       PKG_NEVRA_FLAGS_ARCH);
+      g_print (" %s\n", nevra);
+    }
+
+  *out_listed = TRUE;
+  return TRUE;
+}
+
 static gboolean
 _builtin_db_list (OstreeRepo      *repo,
                   GPtrArray       *revs,
@@ -85,6 +140,12 @@ _builtin_db_list (OstreeRepo      *repo,
         }
       else
         {
+          gboolean listed;
+          if (!list_from_pkgindex (repo, checksum, patterns, &listed, error))
+            return FALSE;
+          if (listed)
+            continue;
+
           g_autoptr(RpmRevisionData) rpmrev = NULL;
           rpmrev = rpmrev_new (repo, checksum, patterns, cancellable, error);
           if (!rpmrev)
@@ -216,6 +216,8 @@ rpmostree_load_sysroot (gchar *sysroot,
         g_variant_builder_new (G_VARIANT_TYPE ("a{sv}"));
       const char *clientid = g_getenv ("RPMOSTREE_CLIENT_ID") ?: RPMOSTREE_CLI_ID;
       g_variant_builder_add (options_builder, "{sv}", "id", g_variant_new_string (clientid));
+      /* Wait behind other transactions rather than failing; see rpmostree_call_txn_method_sync() */
+      g_variant_builder_add (options_builder, "{sv}", "queue-transactions", g_variant_new_boolean (TRUE));
       g_autoptr(GVariant) res =
         g_dbus_connection_call_sync (connection, bus_name, sysroot_objpath,
                                      "org.projectatomic.rpmostree1.Sysroot",
@@ -324,6 +326,31 @@ rpmostree_load_os_proxies (RPMOSTreeSysroot *sysroot_proxy,
   return TRUE;
 }
 
+/* Call the transaction method @method_name on @proxy, which returns the
+ * transaction address. Since we register with `queue-transactions`, the daemon
+ * may queue the request behind another transaction, and the reply only comes
+ * once ours starts; so unlike the generated wrappers, this call has no
+ * timeout. Other calls on @proxy keep the default one.
+ */
+gboolean
+rpmostree_call_txn_method_sync (gpointer      proxy,
+                                const char   *method_name,
+                                GVariant     *parameters,
+                                GUnixFDList  *fd_list,
+                                char        **out_transaction_address,
+                                GCancellable *cancellable,
+                                GError      **error)
+{
+  g_autoptr(GVariant) ret =
+    g_dbus_proxy_call_with_unix_fd_list_sync (G_DBUS_PROXY (proxy), method_name, parameters,
+                                              G_DBUS_CALL_FLAGS_NONE, G_MAXINT, fd_list,
+                                              NULL, cancellable, error);
+  if (!ret)
+    return FALSE;
+  g_variant_get (ret, "(s)", out_transaction_address);
+  return TRUE;
+}
+
 gboolean
 rpmostree_load_os_proxy (RPMOSTreeSysroot *sysroot_proxy,
                          gchar *opt_osname,
@@ -1204,14 +1231,10 @@ rpmostree_update_deployment (RPMOSTreeOS  *os_proxy,
                               &modifiers, &fd_list, error))
     return FALSE;
 
-  return rpmostree_os_call_update_deployment_sync (os_proxy,
-                                                   modifiers,
-                                                   options,
-                                                   fd_list,
-                                                   out_transaction_address,
-                                                   NULL,
-                                                   cancellable,
-                                                   error);
+  return rpmostree_call_txn_method_sync (os_proxy, "UpdateDeployment",
+                                         g_variant_new ("(@a{sv}@a{sv})", modifiers, options),
+                                         fd_list, out_transaction_address,
+                                         cancellable, error);
 }
 
 static void
@@ -1451,6 +1474,15 @@ rpmostree_print_diff_advisories (GVariant         *rpm_diff,
         rpmostree_print_kv ("Diff", max_key_len, diff_summary);
     }
 
+  gint64 installsize_delta;
+  if (g_variant_dict_lookup (&rpm_diff_dict, "installsize-delta", "x", &installsize_delta) &&
+      installsize_delta != 0)
+    {
+      g_autofree char *size = g_format_size ((guint64)ABS (installsize_delta));
+      g_autofree char *delta = g_strdup_printf ("%c%s", installsize_delta > 0 ? '+' : '-', size);
+      rpmostree_print_kv ("InstallSize", max_key_len, delta);
+    }
+
   return TRUE;
 }
 
@@ -60,6 +60,15 @@ rpmostree_load_os_proxies                    (RPMOSTreeSysroot *sysroot_proxy,
                                               RPMOSTreeOSExperimental **out_osexperimental_proxy,
                                               GError **error);
 
+gboolean
+rpmostree_call_txn_method_sync               (gpointer      proxy,
+                                              const char   *method_name,
+                                              GVariant     *parameters,
+                                              GUnixFDList  *fd_list,
+                                              char        **out_transaction_address,
+                                              GCancellable *cancellable,
+                                              GError      **error);
+
 gboolean
 rpmostree_transaction_connect_active         (RPMOSTreeSysroot *sysroot_proxy,
                                               char                 **out_path,
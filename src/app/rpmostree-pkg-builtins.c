@@ -124,15 +124,11 @@ pkg_change (RpmOstreeCommandInvocation *invocation,
     }
   else
     {
-      if (!rpmostree_os_call_pkg_change_sync (os_proxy,
-                                              options,
-                                              packages_to_add,
-                                              packages_to_remove,
-                                              NULL,
-                                              &transaction_address,
-                                              NULL,
-                                              cancellable,
-                                              error))
+      if (!rpmostree_call_txn_method_sync (os_proxy, "PkgChange",
+                                           g_variant_new ("(@a{sv}^as^as)", options,
+                                                          packages_to_add, packages_to_remove),
+                                           NULL, &transaction_address,
+                                           cancellable, error))
         return FALSE;
     }
 
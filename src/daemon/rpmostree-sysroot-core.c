@@ -135,6 +135,58 @@ add_package_refs_to_set (RpmOstreeRefSack *rsack,
   return TRUE;
 }
 
+/* Like add_package_refs_to_set(), but using the `rpmostree.rpmdb.pkglist`
+ * embedded in the commit metadata rather than loading an rpmdb. Sets
+ * @out_found to %FALSE if the commit predates that metadata, in which case the
+ * caller needs to fall back to the rpmdb.
+ */
+static gboolean
+add_commit_package_refs_to_set (OstreeRepo   *repo,
+                                const char   *checksum,
+                                gboolean      is_rojig,
+                                GHashTable   *referenced_pkgs,
+                                gboolean     *out_found,
+                                GCancellable *cancellable,
+                                GError      **error)
+{
+  g_autoptr(GVariant) commit = NULL;
+  if (!ostree_repo_load_commit (repo, checksum, &commit, NULL, error))
+    return FALSE;
+
+  g_autoptr(GVariant) meta = g_variant_get_child_value (commit, 0);
+  g_autoptr(GVariantDict) meta_dict = g_variant_dict_new (meta);
+  g_autoptr(GVariant) pkglist_v =
+    g_variant_dict_lookup_value (meta_dict, "rpmostree.rpmdb.pkglist",
+                                 G_VARIANT_TYPE ("a(sssss)"));
+  if (!pkglist_v)
+    {
+      *out_found = FALSE;
+      return TRUE;
+    }
+
+  const guint n = g_variant_n_children (pkglist_v);
+  if (n == 0)
+    sd_journal_print (LOG_WARNING, "Failed to find any packages in commit %s", checksum);
+
+  for (guint i = 0; i < n; i++)
+    {
+      const char *name, *epoch, *version, *release, *arch;
+      g_variant_get_child (pkglist_v, i, "(&s&s&s&s&s)",
+                           &name, &epoch, &version, &release, &arch);
+      /* same libdnf convention as _rpm_ostree_package_new_from_variant() */
+      g_autofree char *evr = g_str_equal (epoch, "0")
+        ? g_strdup_printf ("%s-%s", version, release)
+        : g_strdup_printf ("%s:%s-%s", epoch, version, release);
+      g_autofree char *pkgref = is_rojig
+        ? rpmostree_get_rojig_branch_for_n_evr_a (name, evr, arch)
+        : rpmostree_get_cache_branch_for_n_evr_a (name, evr, arch);
+      g_hash_table_add (referenced_pkgs, g_steal_pointer (&pkgref));
+    }
+
+  *out_found = TRUE;
+  return TRUE;
+}
+
 /* Loop over all deployments, gathering all referenced NEVRAs for
  * layered packages.  Then delete any cached pkg refs that aren't in
  * that set.
@@ -171,20 +223,27 @@ generate_pkgcache_refs (OstreeSysroot            *sysroot,
        */
       if (base_commit)
         {
-          g_autofree char *deployment_dirpath =
-            ostree_sysroot_get_deployment_dirpath (sysroot, deployment);
-
-          /* We could do this via the commit object, but it's faster
-           * to reuse the existing rpmdb checkout.
-           */
-          g_autoptr(RpmOstreeRefSack) rsack =
-            rpmostree_get_refsack_for_root (ostree_sysroot_get_fd (sysroot),
-                                            deployment_dirpath, error);
-          if (rsack == NULL)
+          /* Layered commits embed their full package list in the metadata;
+           * that's far cheaper than loading the rpmdb. */
+          gboolean found = FALSE;
+          if (!add_commit_package_refs_to_set (repo, current_checksum, FALSE, referenced_pkgs,
+                                               &found, cancellable, error))
             return FALSE;
 
-          if (!add_package_refs_to_set (rsack, FALSE, referenced_pkgs, cancellable, error))
-            return FALSE;
+          if (!found)
+            {
+              /* Older layered commit; fall back to the existing rpmdb checkout */
+              g_autofree char *deployment_dirpath =
+                ostree_sysroot_get_deployment_dirpath (sysroot, deployment);
+              g_autoptr(RpmOstreeRefSack) rsack =
+                rpmostree_get_refsack_for_root (ostree_sysroot_get_fd (sysroot),
+                                                deployment_dirpath, error);
+              if (rsack == NULL)
+                return FALSE;
+
+              if (!add_package_refs_to_set (rsack, FALSE, referenced_pkgs, cancellable, error))
+                return FALSE;
+            }
         }
       /* In rojig mode, we need to also reference packages from the base; this
        * is a different refspec format.
@@ -192,13 +251,22 @@ generate_pkgcache_refs (OstreeSysroot            *sysroot,
       if (rpmostree_origin_is_rojig (origin))
         {
           const char *actual_base_commit = base_commit ?: current_checksum;
-          g_autoptr(RpmOstreeRefSack) base_rsack =
-            rpmostree_get_base_refsack_for_commit (repo, actual_base_commit, cancellable, error);
-          if (base_rsack == NULL)
+          gboolean found = FALSE;
+          if (!add_commit_package_refs_to_set (repo, actual_base_commit, TRUE, referenced_pkgs,
+                                               &found, cancellable, error))
             return FALSE;
 
-          if (!add_package_refs_to_set (base_rsack, TRUE, referenced_pkgs, cancellable, error))
-            return FALSE;
+          if (!found)
+            {
+              g_autoptr(RpmOstreeRefSack) base_rsack =
+                rpmostree_get_base_refsack_for_commit (repo, actual_base_commit,
+                                                       cancellable, error);
+              if (base_rsack == NULL)
+                return FALSE;
+
+              if (!add_package_refs_to_set (base_rsack, TRUE, referenced_pkgs, cancellable, error))
+                return FALSE;
+            }
         }
 
       /* also add any inactive local replacements */
@@ -250,7 +318,9 @@ generate_pkgcache_refs (OstreeSysroot            *sysroot,
 static gboolean
 syscore_regenerate_refs (OstreeSysroot            *sysroot,
                          OstreeRepo               *repo,
+                         RpmOstreeSyscoreCleanupFlags flags,
                          guint                    *out_n_pkgcache_freed,
+                         guint64                  *out_pkgcache_ms,
                          GCancellable             *cancellable,
                          GError                  **error)
 {
@@ -266,12 +336,25 @@ syscore_regenerate_refs (OstreeSysroot            *sysroot,
     return FALSE;
 
   /* And the pkgcache refs */
+  const guint64 pkgcache_start_ms = g_get_monotonic_time () / 1000;
   if (!generate_pkgcache_refs (sysroot, repo, out_n_pkgcache_freed, cancellable, error))
     return FALSE;
+  *out_pkgcache_ms = g_get_monotonic_time () / 1000 - pkgcache_start_ms;
 
   /* Delete our temporary ref */
   ostree_repo_transaction_set_ref (repo, NULL, RPMOSTREE_TMP_BASE_REF, NULL);
 
+  /* And the prepared commits, if asked; they're only kept for reuse */
+  if (flags & RPMOSTREE_SYSCORE_CLEANUP_FLAGS_ASSEMBLED)
+    {
+      g_autoptr(GHashTable) refs = NULL;
+      if (!ostree_repo_list_refs_ext (repo, RPMOSTREE_ASSEMBLED_REF_PREFIX, &refs,
+                                      OSTREE_REPO_LIST_REFS_EXT_NONE, cancellable, error))
+        return FALSE;
+      GLNX_HASH_TABLE_FOREACH (refs, const char*, ref)
+        ostree_repo_transaction_set_ref (repo, NULL, ref, NULL);
+    }
+
   if (!ostree_repo_commit_transaction (repo, NULL, cancellable, error))
     return FALSE;
 
@@ -282,13 +365,15 @@ syscore_regenerate_refs (OstreeSysroot            *sysroot,
  * but is now used by the cleanup txn.
  */
 gboolean
-rpmostree_syscore_cleanup (OstreeSysroot            *sysroot,
-                           OstreeRepo               *repo,
-                           GCancellable             *cancellable,
-                           GError                  **error)
+rpmostree_syscore_cleanup_full (OstreeSysroot            *sysroot,
+                                OstreeRepo               *repo,
+                                RpmOstreeSyscoreCleanupFlags flags,
+                                GCancellable             *cancellable,
+                                GError                  **error)
 {
   GLNX_AUTO_PREFIX_ERROR ("syscore cleanup", error);
   int repo_dfd = ostree_repo_get_dfd (repo); /* borrowed */
+  const guint64 start_time_ms = g_get_monotonic_time () / 1000;
 
   /* Basic cleanup without pruning */
   if (!ostree_sysroot_prepare_cleanup (sysroot, cancellable, error))
@@ -301,12 +386,15 @@ rpmostree_syscore_cleanup (OstreeSysroot            *sysroot,
   /* also delete extra history entries */
   if (!ror_history_prune (error))
     return glnx_prefix_error (error, "pruning history");
+  const guint64 prepare_end_ms = g_get_monotonic_time () / 1000;
 
   /* Regenerate all refs */
   guint n_pkgcache_freed = 0;
-  if (!syscore_regenerate_refs (sysroot, repo, &n_pkgcache_freed,
+  guint64 pkgcache_ms = 0;
+  if (!syscore_regenerate_refs (sysroot, repo, flags, &n_pkgcache_freed, &pkgcache_ms,
                                 cancellable, error))
     return FALSE;
+  const guint64 refs_end_ms = g_get_monotonic_time () / 1000;
 
   /* And do a prune */
   guint64 freed_space;
@@ -318,6 +406,20 @@ rpmostree_syscore_cleanup (OstreeSysroot            *sysroot,
                                             cancellable, error))
       return glnx_prefix_error (error, "pruning");
   }
+  const guint64 end_time_ms = g_get_monotonic_time () / 1000;
+
+  const guint64 prepare_ms = prepare_end_ms - start_time_ms;
+  const guint64 refs_ms = refs_end_ms - prepare_end_ms;
+  const guint64 prune_ms = end_time_ms - refs_end_ms;
+  const guint64 elapsed_ms = end_time_ms - start_time_ms;
+  sd_journal_send ("MESSAGE=Cleanup completed in %" G_GUINT64_FORMAT "ms", elapsed_ms,
+                   "CLEANUP_PREPARE_MS=%" G_GUINT64_FORMAT, prepare_ms,
+                   "CLEANUP_REFS_MS=%" G_GUINT64_FORMAT, refs_ms,
+                   "CLEANUP_PKGCACHE_MS=%" G_GUINT64_FORMAT, pkgcache_ms,
+                   "CLEANUP_PRUNE_MS=%" G_GUINT64_FORMAT, prune_ms,
+                   "CLEANUP_PKGCACHE_FREED=%u", n_pkgcache_freed,
+                   "CLEANUP_OBJECTS_PRUNED=%d", n_objects_pruned,
+                   NULL);
 
   if (n_pkgcache_freed > 0 || freed_space > 0)
     {
@@ -326,8 +428,26 @@ rpmostree_syscore_cleanup (OstreeSysroot            *sysroot,
                                 freed_space_str, n_pkgcache_freed);
     }
 
+  if (flags & RPMOSTREE_SYSCORE_CLEANUP_FLAGS_PRINT_TIMING)
+    rpmostree_output_message ("Cleanup timing: prepare %" G_GUINT64_FORMAT "ms, "
+                              "refs %" G_GUINT64_FORMAT "ms (pkgcache %" G_GUINT64_FORMAT "ms), "
+                              "prune %" G_GUINT64_FORMAT "ms (%d/%d objects)",
+                              prepare_ms, refs_ms, pkgcache_ms, prune_ms,
+                              n_objects_pruned, n_objects_total);
+
   return TRUE;
 }
+
+gboolean
+rpmostree_syscore_cleanup (OstreeSysroot            *sysroot,
+                           OstreeRepo               *repo,
+                           GCancellable             *cancellable,
+                           GError                  **error)
+{
+  return rpmostree_syscore_cleanup_full (sysroot, repo, RPMOSTREE_SYSCORE_CLEANUP_FLAGS_NONE,
+                                         cancellable, error);
+}
+
 /* This is like ostree_sysroot_get_merge_deployment() except we explicitly
  * ignore the magical "booted" behavior. For rpm-ostree we're trying something
  * different now where we are a bit more stateful and pick up changes from the
@@ -24,6 +24,9 @@
 
 /* Used by the upgrader to hold a strong ref temporarily to a base commit */
 #define RPMOSTREE_TMP_BASE_REF "rpmostree/base/tmp"
+/* Index of assembled layered commits kept for reuse, keyed by their
+ * assembly inputs; see record_assembled_commit() in the upgrader */
+#define RPMOSTREE_ASSEMBLED_REF_PREFIX "rpmostree/assembled"
 /* Diretory that is defined to have 0700 mode always, used for checkouts */
 #define RPMOSTREE_TMP_PRIVATE_DIR "extensions/rpmostree/private"
 /* Where we check out a new rootfs */
@@ -41,6 +44,20 @@ rpmostree_syscore_cleanup (OstreeSysroot            *sysroot,
                            GCancellable             *cancellable,
                            GError                  **error);
 
+typedef enum {
+  RPMOSTREE_SYSCORE_CLEANUP_FLAGS_NONE = 0,
+  RPMOSTREE_SYSCORE_CLEANUP_FLAGS_PRINT_TIMING = (1 << 0),
+  /* Also drop the index of assembled commits (RPMOSTREE_ASSEMBLED_REF_PREFIX) */
+  RPMOSTREE_SYSCORE_CLEANUP_FLAGS_ASSEMBLED = (1 << 1),
+} RpmOstreeSyscoreCleanupFlags;
+
+gboolean
+rpmostree_syscore_cleanup_full (OstreeSysroot            *sysroot,
+                                OstreeRepo               *repo,
+                                RpmOstreeSyscoreCleanupFlags flags,
+                                GCancellable             *cancellable,
+                                GError                  **error);
+
 OstreeDeployment *rpmostree_syscore_get_origin_merge_deployment (OstreeSysroot *self, const char *osname);
 
 gboolean rpmostree_syscore_bump_mtime (OstreeSysroot *self, GError **error);
@@ -26,6 +26,7 @@
 #include "rpmostree-util.h"
 
 #include "rpmostree-sysroot-upgrader.h"
+#include "rpmostree-sysroot-core.h"
 #include "rpmostree-core.h"
 #include "rpmostree-origin.h"
 #include "rpmostree-kernel.h"
@@ -87,6 +88,8 @@ struct RpmOstreeSysrootUpgrader {
   gboolean pkgs_imported; /* Whether pkgs to be layered have been downloaded & imported */
   char *base_revision; /* Non-layered replicated commit */
   char *final_revision; /* Computed by layering; if NULL, only using base_revision */
+  char *assembly_key; /* Key for prepared layered commits; NULL if not eligible */
+  char *prepared_revision; /* Previously assembled commit matching assembly_key */
 
   char **kargs_strv; /* Kernel argument list to be written into deployment  */
 };
@@ -216,6 +219,8 @@ rpmostree_sysroot_upgrader_finalize (GObject *object)
   g_clear_pointer (&self->origin, (GDestroyNotify)rpmostree_origin_unref);
   g_free (self->base_revision);
   g_free (self->final_revision);
+  g_free (self->assembly_key);
+  g_free (self->prepared_revision);
   g_strfreev (self->kargs_strv);
   g_clear_pointer (&self->overlay_packages, (GDestroyNotify)g_ptr_array_unref);
   g_clear_pointer (&self->override_remove_packages, (GDestroyNotify)g_ptr_array_unref);
@@ -430,6 +435,8 @@ rpmostree_sysroot_upgrader_pull_base (RpmOstreeSysrootUpgrader  *self,
                                                                                 (const char *const *)&override_commit, 1)));
 
             g_autoptr(GVariant) opts = g_variant_ref_sink (g_variant_builder_end (optbuilder));
+            g_auto(RpmOstreePhase) phase = { 0, };
+            rpmostree_output_phase_begin (&phase, "pull");
             if (!ostree_repo_pull_with_options (self->repo, origin_remote, opts, progress,
                                                 cancellable, error))
               return FALSE;
@@ -925,6 +932,257 @@ prepare_context_for_assembly (RpmOstreeSysrootUpgrader *self,
   return TRUE;
 }
 
+/* Compute the key under which a layered commit built from the current inputs
+ * is stored.  The state checksum covers the treespec and the depsolved package
+ * set, but not the base commit or the passwd/group data from the merge
+ * deployment which scripts see, so fold those in too.
+ */
+static gboolean
+compute_assembly_key (RpmOstreeSysrootUpgrader *self,
+                      char                    **out_key,
+                      GCancellable             *cancellable,
+                      GError                  **error)
+{
+  g_autofree char *state_sha512 = NULL;
+  if (!rpmostree_context_get_state_sha512 (self->ctx, &state_sha512, error))
+    return FALSE;
+
+  g_autoptr(GChecksum) checksum = g_checksum_new (G_CHECKSUM_SHA256);
+  g_checksum_update (checksum, (guint8*)self->base_revision, strlen (self->base_revision) + 1);
+  g_checksum_update (checksum, (guint8*)state_sha512, strlen (state_sha512) + 1);
+
+  g_autofree char *cfg_root =
+    rpmostree_get_deployment_root (self->sysroot, self->cfg_merge_deployment);
+  glnx_autofd int cfg_root_dfd = -1;
+  if (!glnx_opendirat (AT_FDCWD, cfg_root, TRUE, &cfg_root_dfd, error))
+    return FALSE;
+  const char *passwd_files[] = { "etc/passwd", "etc/group" };
+  for (guint i = 0; i < G_N_ELEMENTS (passwd_files); i++)
+    {
+      if (!glnx_fstatat_allow_noent (cfg_root_dfd, passwd_files[i], NULL, 0, error))
+        return FALSE;
+      if (errno == ENOENT)
+        continue;
+      gsize len;
+      g_autofree char *contents =
+        glnx_file_get_contents_utf8_at (cfg_root_dfd, passwd_files[i], &len,
+                                        cancellable, error);
+      if (!contents)
+        return FALSE;
+      g_checksum_update (checksum, (guint8*)contents, len);
+    }
+
+  *out_key = g_strdup (g_checksum_get_string (checksum));
+  return TRUE;
+}
+
+/* Fetch the commit for @ref from a local remote, if it has one, and add it to
+ * our own index.  Since the remote is local, we can cheaply check for the ref
+ * first rather than attempting a pull that usually fails.
+ */
+static gboolean
+pull_assembled_commit (RpmOstreeSysrootUpgrader *self,
+                       const char               *remote,
+                       const char               *ref,
+                       char                    **out_rev,
+                       GCancellable             *cancellable,
+                       GError                  **error)
+{
+  g_autofree char *url = NULL;
+  if (!ostree_repo_remote_get_url (self->repo, remote, &url, error))
+    return FALSE;
+  if (!g_str_has_prefix (url, "file://"))
+    return glnx_throw (error, "AssembledCommitRemote %s is not a file:// remote", remote);
+
+  g_autoptr(GFile) remote_repo_path = g_file_new_for_uri (url);
+  g_autoptr(OstreeRepo) remote_repo = ostree_repo_new (remote_repo_path);
+  if (!ostree_repo_open (remote_repo, cancellable, error))
+    return FALSE;
+  g_autofree char *remote_rev = NULL;
+  if (!ostree_repo_resolve_rev_ext (remote_repo, ref, TRUE, 0, &remote_rev, error))
+    return FALSE;
+  if (!remote_rev)
+    {
+      *out_rev = NULL;
+      return TRUE;
+    }
+
+  /* This goes through the regular pull path, so the remote's gpg-verify
+   * settings apply */
+  { g_auto(RpmOstreeProgress) task = { 0, };
+    rpmostree_output_task_begin (&task, "Fetching prepared commit from %s", remote);
+    const char *refs[] = { ref, NULL };
+    if (!ostree_repo_pull (self->repo, remote, (char**)refs, OSTREE_REPO_PULL_FLAGS_NONE,
+                           NULL, cancellable, error))
+      return FALSE;
+  }
+
+  /* Move it from the remote ref to our index */
+  if (!ostree_repo_set_ref_immediate (self->repo, NULL, ref, remote_rev,
+                                      cancellable, error))
+    return FALSE;
+  if (!ostree_repo_set_ref_immediate (self->repo, remote, ref, NULL,
+                                      cancellable, error))
+    return FALSE;
+
+  *out_rev = g_steal_pointer (&remote_rev);
+  return TRUE;
+}
+
+/* Check that @rev really is the result of assembling our current inputs */
+static gboolean
+validate_assembled_commit (RpmOstreeSysrootUpgrader *self,
+                           const char               *rev,
+                           gboolean                 *out_valid,
+                           GError                  **error)
+{
+  *out_valid = FALSE;
+
+  g_autoptr(GVariant) commit = NULL;
+  OstreeRepoCommitState commitstate;
+  if (!ostree_repo_load_commit (self->repo, rev, &commit, &commitstate, error))
+    return FALSE;
+  if (commitstate & OSTREE_REPO_COMMIT_STATE_PARTIAL)
+    return TRUE;
+
+  g_autofree char *parent = ostree_commit_get_parent (commit);
+  if (g_strcmp0 (parent, self->base_revision) != 0)
+    return TRUE;
+
+  g_autoptr(GVariant) metadata = g_variant_get_child_value (commit, 0);
+  g_autoptr(GVariantDict) metadata_dict = g_variant_dict_new (metadata);
+  const char *prepared_state_sha512 = NULL;
+  if (!g_variant_dict_lookup (metadata_dict, "rpmostree.state-sha512", "&s",
+                              &prepared_state_sha512))
+    return TRUE;
+  g_autofree char *state_sha512 = NULL;
+  if (!rpmostree_context_get_state_sha512 (self->ctx, &state_sha512, error))
+    return FALSE;
+
+  *out_valid = g_str_equal (prepared_state_sha512, state_sha512);
+  return TRUE;
+}
+
+/* Look for a layered commit previously assembled from the same inputs, either
+ * in our own index or from the configured remote.  If there's a valid one,
+ * remember it so we can skip the import and assembly.
+ */
+static gboolean
+lookup_prepared_commit (RpmOstreeSysrootUpgrader *self,
+                        GCancellable             *cancellable,
+                        GError                  **error)
+{
+  g_assert (self->assembly_key);
+
+  g_autofree char *ref =
+    g_strconcat (RPMOSTREE_ASSEMBLED_REF_PREFIX "/", self->assembly_key, NULL);
+  g_autofree char *rev = NULL;
+  if (!ostree_repo_resolve_rev_ext (self->repo, ref, TRUE, 0, &rev, error))
+    return FALSE;
+
+  const char *remote = rpmostreed_get_assembled_commit_remote (rpmostreed_daemon_get ());
+  if (!rev && remote)
+    {
+      /* The remote is just an optimization; fall back to assembling locally */
+      g_autoptr(GError) local_error = NULL;
+      if (!pull_assembled_commit (self, remote, ref, &rev, cancellable, &local_error))
+        sd_journal_print (LOG_WARNING, "Failed to fetch prepared commit from %s: %s",
+                          remote, local_error->message);
+    }
+  if (!rev)
+    return TRUE;
+
+  gboolean valid = FALSE;
+  if (!validate_assembled_commit (self, rev, &valid, error))
+    return FALSE;
+  if (!valid)
+    {
+      /* The key covers everything we check, so this shouldn't happen */
+      sd_journal_print (LOG_WARNING, "Ignoring invalid prepared commit %s", rev);
+      return ostree_repo_set_ref_immediate (self->repo, NULL, ref, NULL,
+                                            cancellable, error);
+    }
+
+  self->prepared_revision = g_steal_pointer (&rev);
+  return TRUE;
+}
+
+typedef struct {
+  const char *ref;
+  struct timespec last_used;
+} AssembledEntry;
+
+static gint
+compare_entries_most_recent_first (gconstpointer a,
+                                   gconstpointer b)
+{
+  const AssembledEntry *entry_a = *((AssembledEntry**)a);
+  const AssembledEntry *entry_b = *((AssembledEntry**)b);
+  if (entry_a->last_used.tv_sec != entry_b->last_used.tv_sec)
+    return entry_a->last_used.tv_sec > entry_b->last_used.tv_sec ? -1 : 1;
+  if (entry_a->last_used.tv_nsec != entry_b->last_used.tv_nsec)
+    return entry_a->last_used.tv_nsec > entry_b->last_used.tv_nsec ? -1 : 1;
+  return 0;
+}
+
+/* Add the final commit to the index of assembled commits, keeping at most
+ * @max_entries of them. This is also called when a prepared commit gets
+ * used, so the ref is rewritten each time and its mtime tracks the last use;
+ * the least recently used entries are dropped first.
+ */
+static gboolean
+record_assembled_commit (RpmOstreeSysrootUpgrader *self,
+                         guint                     max_entries,
+                         GCancellable             *cancellable,
+                         GError                  **error)
+{
+  g_assert (self->assembly_key);
+  g_assert (self->final_revision);
+
+  g_autofree char *ref =
+    g_strconcat (RPMOSTREE_ASSEMBLED_REF_PREFIX "/", self->assembly_key, NULL);
+  if (!ostree_repo_set_ref_immediate (self->repo, NULL, ref, self->final_revision,
+                                      cancellable, error))
+    return FALSE;
+
+  g_autoptr(GHashTable) refs = NULL;
+  if (!ostree_repo_list_refs_ext (self->repo, RPMOSTREE_ASSEMBLED_REF_PREFIX, &refs,
+                                  OSTREE_REPO_LIST_REFS_EXT_NONE, cancellable, error))
+    return FALSE;
+  if (g_hash_table_size (refs) <= max_entries)
+    return TRUE;
+
+  const int repo_dfd = ostree_repo_get_dfd (self->repo);
+  g_autoptr(GPtrArray) entries = g_ptr_array_new_with_free_func (g_free);
+  GLNX_HASH_TABLE_FOREACH (refs, const char*, entry_ref)
+    {
+      if (g_str_equal (entry_ref, ref))
+        continue;
+      g_autofree char *entry_path = g_strconcat ("refs/heads/", entry_ref, NULL);
+      struct stat stbuf;
+      if (!glnx_fstatat_allow_noent (repo_dfd, entry_path, &stbuf, AT_SYMLINK_NOFOLLOW, error))
+        return FALSE;
+      if (errno == ENOENT)
+        continue;
+      AssembledEntry *entry = g_new0 (AssembledEntry, 1);
+      entry->ref = entry_ref;
+      entry->last_used = stbuf.st_mtim;
+      g_ptr_array_add (entries, entry);
+    }
+  g_ptr_array_sort (entries, compare_entries_most_recent_first);
+
+  /* The entry we just recorded counts against the limit too */
+  for (guint i = MAX (max_entries, 1) - 1; i < entries->len; i++)
+    {
+      AssembledEntry *entry = entries->pdata[i];
+      if (!ostree_repo_set_ref_immediate (self->repo, NULL, entry->ref, NULL,
+                                          cancellable, error))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
 /* Initialize libdnf context from our configuration */
 static gboolean
 prep_local_assembly (RpmOstreeSysrootUpgrader *self,
@@ -1022,6 +1280,18 @@ prep_local_assembly (RpmOstreeSysrootUpgrader *self,
        definitely changed */
     self->layering_changed = TRUE;
 
+  /* Regenerating the initramfs pulls in the host's /etc, which the key doesn't
+   * capture; don't try to reuse prepared commits in that case. */
+  if (self->layering_type == RPMOSTREE_SYSROOT_UPGRADER_LAYERING_RPMMD_REPOS &&
+      !rpmostree_origin_get_regenerate_initramfs (self->origin) &&
+      !(self->flags & RPMOSTREE_SYSROOT_UPGRADER_FLAGS_DRY_RUN))
+    {
+      if (!compute_assembly_key (self, &self->assembly_key, cancellable, error))
+        return FALSE;
+      if (!lookup_prepared_commit (self, cancellable, error))
+        return FALSE;
+    }
+
   return TRUE;
 }
 
@@ -1038,6 +1308,17 @@ perform_local_assembly (RpmOstreeSysrootUpgrader *self,
   if (self->layering_type == RPMOSTREE_SYSROOT_UPGRADER_LAYERING_NONE)
     return TRUE;
 
+  if (self->prepared_revision)
+    {
+      rpmostree_output_message ("Using prepared commit %s", self->prepared_revision);
+      g_free (self->final_revision);
+      self->final_revision = g_strdup (self->prepared_revision);
+      /* See below */
+      g_clear_object (&self->ctx);
+      glnx_close_fd (&self->tmprootfs_dfd);
+      return TRUE;
+    }
+
   rpmostree_context_set_devino_cache (self->ctx, self->devino_cache);
   rpmostree_context_set_tmprootfs_dfd (self->ctx, self->tmprootfs_dfd);
 
@@ -1118,7 +1399,9 @@ perform_local_assembly (RpmOstreeSysrootUpgrader *self,
       g_ptr_array_add (initramfs_args, NULL);
 
       g_auto(RpmOstreeProgress) task = { 0, };
+      g_auto(RpmOstreePhase) phase = { 0, };
       rpmostree_output_task_begin (&task, "Generating initramfs");
+      rpmostree_output_phase_begin (&phase, "dracut");
 
       g_assert (kernel_state && kernel_path);
 
@@ -1235,6 +1518,10 @@ rpmostree_sysroot_upgrader_import_pkgs (RpmOstreeSysrootUpgrader *self,
   if (self->layering_type == RPMOSTREE_SYSROOT_UPGRADER_LAYERING_NONE)
     return TRUE;
 
+  /* Everything we'd import is already in the prepared commit */
+  if (self->prepared_revision)
+    return TRUE;
+
   if (self->layering_type == RPMOSTREE_SYSROOT_UPGRADER_LAYERING_RPMMD_REPOS)
     {
       if (!rpmostree_context_download (self->ctx, cancellable, error))
@@ -1246,6 +1533,62 @@ rpmostree_sysroot_upgrader_import_pkgs (RpmOstreeSysrootUpgrader *self,
   return TRUE;
 }
 
+/**
+ * rpmostree_sysroot_upgrader_assemble:
+ * @self: Self
+ * @out_revision: (out) (optional): return location for the prepared commit
+ * @cancellable: Cancellable
+ * @error: Error
+ *
+ * Like rpmostree_sysroot_upgrader_deploy(), but stop after generating the
+ * layered commit, and keep it around so that a later deploy from the same
+ * inputs can use it directly.  If there is nothing to assemble, or the origin
+ * isn't eligible (e.g. it regenerates the initramfs), @out_revision is set to
+ * %NULL.
+ */
+gboolean
+rpmostree_sysroot_upgrader_assemble (RpmOstreeSysrootUpgrader *self,
+                                     char                    **out_revision,
+                                     GCancellable             *cancellable,
+                                     GError                  **error)
+{
+  if (!self->layering_initialized)
+    {
+      RpmOstreeSysrootUpgraderLayeringType layering_type;
+      gboolean layering_changed = FALSE;
+      if (!rpmostree_sysroot_upgrader_prep_layering (self, &layering_type, &layering_changed,
+                                                     cancellable, error))
+        return FALSE;
+    }
+
+  if (!self->assembly_key)
+    {
+      if (out_revision)
+        *out_revision = NULL;
+      return TRUE;
+    }
+
+  if (!self->pkgs_imported)
+    {
+      if (!rpmostree_sysroot_upgrader_import_pkgs (self, cancellable, error))
+        return FALSE;
+    }
+
+  if (!perform_local_assembly (self, cancellable, error))
+    return FALSE;
+  g_assert (self->final_revision);
+
+  /* Unlike in the deploy path, always keep this one, it's the whole point */
+  guint max_entries =
+    rpmostreed_get_assembled_commit_cache_size (rpmostreed_daemon_get ());
+  if (!record_assembled_commit (self, MAX (max_entries, 1), cancellable, error))
+    return FALSE;
+
+  if (out_revision)
+    *out_revision = g_strdup (self->final_revision);
+  return TRUE;
+}
+
 /**
  * rpmostree_sysroot_upgrader_set_kargs:
  * @self: Self
@@ -1371,6 +1714,15 @@ rpmostree_sysroot_upgrader_deploy (RpmOstreeSysrootUpgrader *self,
   if (!perform_local_assembly (self, cancellable, error))
     return FALSE;
 
+  /* And remember it, so that assembling the same inputs again is free */
+  guint max_entries =
+    rpmostreed_get_assembled_commit_cache_size (rpmostreed_daemon_get ());
+  if (self->assembly_key && max_entries > 0)
+    {
+      if (!record_assembled_commit (self, max_entries, cancellable, error))
+        return FALSE;
+    }
+
   /* make sure we have a known target to deploy */
   const char *target_revision = self->final_revision ?: self->base_revision;
   g_assert (target_revision);
@@ -1392,6 +1744,8 @@ rpmostree_sysroot_upgrader_deploy (RpmOstreeSysrootUpgrader *self,
   g_autoptr(GKeyFile) origin = rpmostree_origin_dup_keyfile (self->origin);
   g_autoptr(OstreeDeployment) new_deployment = NULL;
 
+  g_auto(RpmOstreePhase) phase = { 0, };
+  rpmostree_output_phase_begin (&phase, "deploy");
   if (use_staging)
     {
       /* touch file *before* we stage to avoid races */
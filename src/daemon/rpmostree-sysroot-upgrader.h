@@ -126,6 +126,12 @@ rpmostree_sysroot_upgrader_pull_repos (RpmOstreeSysrootUpgrader  *self,
 
 
 
+gboolean
+rpmostree_sysroot_upgrader_assemble (RpmOstreeSysrootUpgrader *self,
+                                     char                    **out_revision,
+                                     GCancellable             *cancellable,
+                                     GError                  **error);
+
 gboolean
 rpmostree_sysroot_upgrader_deploy (RpmOstreeSysrootUpgrader *self,
                                    const char               *initiating_command_line,
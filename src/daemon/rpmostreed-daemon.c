@@ -37,7 +37,7 @@
 #define EXPERIMENTAL_CONFIG_GROUP "Experimental"
 
 struct RpmOstreeClient;
-static struct RpmOstreeClient *client_new (RpmostreedDaemon *self, const char *address, const char *id);
+static struct RpmOstreeClient *client_new (RpmostreedDaemon *self, const char *address, const char *id, gboolean quiet, gboolean queue_txns);
 
 /**
  * SECTION: daemon
@@ -69,6 +69,11 @@ struct _RpmostreedDaemon {
 
   /* Settings from the config file */
   guint idle_exit_timeout;
+  guint64 progress_signal_interval; /* usec; 0 means unlimited */
+  gboolean auto_update_background;
+  guint background_import_workers; /* 0 means unlimited */
+  guint assembled_commit_cache_size;
+  char *assembled_commit_remote;
   RpmostreedAutomaticUpdatePolicy auto_update_policy;
 
   GDBusConnection *connection;
@@ -106,6 +111,10 @@ struct RpmOstreeClient {
   gboolean pid_valid;
   pid_t pid;
   char *sd_unit;
+  /* Only wants task boundaries, not progress; see transaction_emit_signal() */
+  gboolean quiet;
+  /* Wants conflicting transaction requests queued; see rpmostreed_sysroot_prep_for_txn() */
+  gboolean queue_txns;
 };
 
 static void
@@ -136,6 +145,8 @@ rpmostree_client_to_string (struct RpmOstreeClient *client)
     g_string_append_printf (buf, " uid:%lu", (unsigned long) client->uid);
   else
     g_string_append (buf, " uid:<unknown>");
+  if (client->quiet)
+    g_string_append (buf, " quiet");
   g_string_append_c (buf, ')');
   return g_string_free (g_steal_pointer (&buf), FALSE);
 }
@@ -165,6 +176,7 @@ daemon_finalize (GObject *object)
     g_source_remove (self->rerender_status_id);
 
   g_free (self->sysroot_path);
+  g_free (self->assembled_commit_remote);
   G_OBJECT_CLASS (rpmostreed_daemon_parent_class)->finalize (object);
 
   _daemon_instance = NULL;
@@ -250,7 +262,7 @@ on_active_txn_changed (GObject *object,
            * then let's gather the relevant client info now.
            */
           if (!clientdata)
-            clientdata = clientdata_owned = client_new (self, sender, NULL);
+            clientdata = clientdata_owned = client_new (self, sender, NULL, FALSE, FALSE);
           g_autofree char *client_str = rpmostree_client_to_string (clientdata);
           g_autofree char *client_data_msg = NULL;
           if (clientdata->uid_valid)
@@ -380,6 +392,41 @@ rpmostreed_get_automatic_update_policy (RpmostreedDaemon *self)
   return self->auto_update_policy;
 }
 
+/* Whether AutomaticUpdateTrigger transactions run at background priority by default */
+gboolean
+rpmostreed_get_automatic_update_background (RpmostreedDaemon *self)
+{
+  return self->auto_update_background;
+}
+
+/* Cap on parallel package imports for background transactions */
+guint
+rpmostreed_get_background_import_workers (RpmostreedDaemon *self)
+{
+  return self->background_import_workers;
+}
+
+/* Number of assembled layered commits kept for reuse */
+guint
+rpmostreed_get_assembled_commit_cache_size (RpmostreedDaemon *self)
+{
+  return self->assembled_commit_cache_size;
+}
+
+/* Local remote to fetch prebuilt layered commits from, or NULL */
+const char *
+rpmostreed_get_assembled_commit_remote (RpmostreedDaemon *self)
+{
+  return self->assembled_commit_remote;
+}
+
+/* Minimum time between two progress signals of the same kind, in usec */
+guint64
+rpmostreed_get_progress_signal_interval (RpmostreedDaemon *self)
+{
+  return self->progress_signal_interval;
+}
+
 /* in-place version of g_ascii_strdown */
 static inline void
 ascii_strdown_inplace (char *str)
@@ -401,6 +448,27 @@ rpmostreed_daemon_reload_config (RpmostreedDaemon *self,
    * follow-up requests are more responsive */
   guint64 idle_exit_timeout = get_config_uint64 (config, "IdleExitTimeout", 60);
 
+  /* Progress ticks beyond what a human can read are just bus traffic */
+  guint64 progress_max_rate = get_config_uint64 (config, "ProgressSignalMaxRate", 10);
+
+  gboolean auto_update_background = FALSE;
+  g_autofree char *auto_update_priority_str =
+    get_config_str (config, "AutomaticUpdatePriority", "normal");
+  ascii_strdown_inplace (auto_update_priority_str);
+  if (g_str_equal (auto_update_priority_str, "background"))
+    auto_update_background = TRUE;
+  else if (!g_str_equal (auto_update_priority_str, "normal"))
+    return glnx_throw (error, "Invalid AutomaticUpdatePriority: %s", auto_update_priority_str);
+
+  guint64 background_import_workers = get_config_uint64 (config, "BackgroundImportWorkers", 1);
+
+  guint64 assembled_commit_cache_size =
+    get_config_uint64 (config, "AssembledCommitCacheSize", 3);
+  g_autofree char *assembled_commit_remote =
+    get_config_str (config, "AssembledCommitRemote", NULL);
+  if (assembled_commit_remote && !*assembled_commit_remote)
+    g_clear_pointer (&assembled_commit_remote, g_free);
+
   /* default to off for now; we will change it to "check" in a later release */
   RpmostreedAutomaticUpdatePolicy auto_update_policy =
     RPMOSTREED_AUTOMATIC_UPDATE_POLICY_NONE;
@@ -418,6 +486,13 @@ rpmostreed_daemon_reload_config (RpmostreedDaemon *self,
   /* don't update changed for this; it's contained to RpmostreedDaemon so no other objects
    * need to be reloaded if it changes */
   self->idle_exit_timeout = idle_exit_timeout;
+  self->progress_signal_interval =
+    progress_max_rate > 0 ? G_USEC_PER_SEC / MIN (progress_max_rate, G_USEC_PER_SEC) : 0;
+  self->auto_update_background = auto_update_background;
+  self->background_import_workers = MIN (background_import_workers, G_MAXUINT);
+  self->assembled_commit_cache_size = MIN (assembled_commit_cache_size, G_MAXUINT);
+  g_free (self->assembled_commit_remote);
+  self->assembled_commit_remote = g_steal_pointer (&assembled_commit_remote);
 
   gboolean changed = FALSE;
 
@@ -661,11 +736,13 @@ get_client_pid (RpmostreedDaemon *self,
 /* Given a DBus address, load metadata for it */
 static struct RpmOstreeClient *
 client_new (RpmostreedDaemon *self, const char *address,
-            const char *client_id)
+            const char *client_id, gboolean quiet, gboolean queue_txns)
 {
   struct RpmOstreeClient *client = g_new0 (struct RpmOstreeClient, 1);
   client->address = g_strdup (address);
   client->id = g_strdup (client_id);
+  client->quiet = quiet;
+  client->queue_txns = queue_txns;
   if (rpmostreed_get_client_uid (self, address, &client->uid))
     client->uid_valid = TRUE;
   if (get_client_pid (self, address, &client->pid))
@@ -683,12 +760,14 @@ client_new (RpmostreedDaemon *self, const char *address,
 void
 rpmostreed_daemon_add_client (RpmostreedDaemon *self,
                               const char       *client,
-                              const char       *client_id)
+                              const char       *client_id,
+                              gboolean          quiet,
+                              gboolean          queue_txns)
 {
   if (g_hash_table_lookup (self->bus_clients, client))
     return;
 
-  struct RpmOstreeClient *clientdata = client_new (self, client, client_id);
+  struct RpmOstreeClient *clientdata = client_new (self, client, client_id, quiet, queue_txns);
   clientdata->name_watch_id =
     g_dbus_connection_signal_subscribe (self->connection,
                                         "org.freedesktop.DBus",
@@ -721,6 +800,34 @@ rpmostreed_daemon_client_get_string (RpmostreedDaemon *self, const char *client)
     return rpmostree_client_to_string (clientdata);
 }
 
+/* Returns %TRUE if the bus name @client registered and asked to only be sent
+ * task boundaries for the transactions it starts.
+ */
+gboolean
+rpmostreed_daemon_client_is_quiet (RpmostreedDaemon *self,
+                                   const char       *client)
+{
+  /* No sender on peer connections */
+  if (!client)
+    return FALSE;
+  struct RpmOstreeClient *clientdata = g_hash_table_lookup (self->bus_clients, client);
+  return clientdata && clientdata->quiet;
+}
+
+/* Returns %TRUE if the bus name @client registered and asked for its
+ * transaction requests to be queued behind conflicting ones.
+ */
+gboolean
+rpmostreed_daemon_client_queues_txns (RpmostreedDaemon *self,
+                                      const char       *client)
+{
+  /* No sender on peer connections */
+  if (!client)
+    return FALSE;
+  struct RpmOstreeClient *clientdata = g_hash_table_lookup (self->bus_clients, client);
+  return clientdata && clientdata->queue_txns;
+}
+
 void
 rpmostreed_daemon_remove_client (RpmostreedDaemon *self,
                                  const char       *client)
@@ -733,6 +840,9 @@ rpmostreed_daemon_remove_client (RpmostreedDaemon *self,
   g_dbus_connection_signal_unsubscribe (self->connection, clientdata->name_watch_id);
   g_autofree char *clientstr = rpmostree_client_to_string (clientdata);
   g_hash_table_remove (self->bus_clients, client);
+  /* Nobody would be around to watch those transactions */
+  if (self->sysroot)
+    rpmostreed_sysroot_drop_queued_txns (self->sysroot, client);
   const guint remaining = g_hash_table_size (self->bus_clients);
   sd_journal_print (LOG_INFO, "%s vanished; remaining=%u", clientstr, remaining);
   update_status (self);
@@ -35,7 +35,13 @@ gboolean           rpmostreed_get_client_uid        (RpmostreedDaemon *self,
                                                      uid_t            *out_uid);
 void               rpmostreed_daemon_add_client     (RpmostreedDaemon *self,
                                                      const char *client,
-                                                     const char *client_id);
+                                                     const char *client_id,
+                                                     gboolean quiet,
+                                                     gboolean queue_txns);
+gboolean           rpmostreed_daemon_client_is_quiet (RpmostreedDaemon *self,
+                                                      const char *client);
+gboolean           rpmostreed_daemon_client_queues_txns (RpmostreedDaemon *self,
+                                                         const char *client);
 void               rpmostreed_daemon_remove_client  (RpmostreedDaemon *self,
                                                      const char *client);
 char *             rpmostreed_daemon_client_get_string (RpmostreedDaemon *self,
@@ -55,3 +61,13 @@ gboolean           rpmostreed_daemon_reload_config  (RpmostreedDaemon *self,
 
 RpmostreedAutomaticUpdatePolicy
 rpmostreed_get_automatic_update_policy (RpmostreedDaemon *self);
+guint64
+rpmostreed_get_progress_signal_interval (RpmostreedDaemon *self);
+gboolean
+rpmostreed_get_automatic_update_background (RpmostreedDaemon *self);
+guint
+rpmostreed_get_background_import_workers (RpmostreedDaemon *self);
+guint
+rpmostreed_get_assembled_commit_cache_size (RpmostreedDaemon *self);
+const char *
+rpmostreed_get_assembled_commit_remote (RpmostreedDaemon *self);
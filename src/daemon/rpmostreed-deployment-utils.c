@@ -232,6 +232,7 @@ filter_commit_meta (GVariant *commit_meta)
   g_variant_dict_init (&dict, commit_meta);
   /* for now we just blacklist, but we may want to whitelist in the future */
   g_variant_dict_remove (&dict, "rpmostree.rpmdb.pkglist");
+  g_variant_dict_remove (&dict, "rpmostree.rpmdb.pkgindex");
   return g_variant_dict_end (&dict);
 }
 
@@ -524,6 +525,8 @@ typedef struct {
   GPtrArray *downgraded;
   GPtrArray *removed;
   GPtrArray *added;
+  gboolean   has_installsize_delta;
+  gint64     installsize_delta;
 } RpmDiff;
 
 static void
@@ -546,6 +549,8 @@ rpm_diff_clear (RpmDiff *diff)
   g_clear_pointer (&diff->downgraded, (GDestroyNotify)g_ptr_array_unref);
   g_clear_pointer (&diff->removed, (GDestroyNotify)g_ptr_array_unref);
   g_clear_pointer (&diff->added, (GDestroyNotify)g_ptr_array_unref);
+  diff->has_installsize_delta = FALSE;
+  diff->installsize_delta = 0;
   diff->initialized = FALSE;
 }
 
@@ -620,6 +625,24 @@ rpm_diff_add_db_diff (RpmDiff      *diff,
   if (!removed)
     return TRUE; /* NB: early return */
 
+  /* the pkgindex also has installed sizes, so we can tell how much the new
+   * deployment grows or shrinks */
+  g_autoptr(GVariant) old_commit = NULL;
+  if (!ostree_repo_load_commit (repo, old_checksum, &old_commit, NULL, error))
+    return FALSE;
+  g_autoptr(GVariant) new_commit = NULL;
+  if (!ostree_repo_load_commit (repo, new_checksum, &new_commit, NULL, error))
+    return FALSE;
+  g_autoptr(GVariant) old_pkgindex = rpmostree_commit_get_pkgindex (old_commit);
+  g_autoptr(GVariant) new_pkgindex = rpmostree_commit_get_pkgindex (new_commit);
+  if (old_pkgindex && new_pkgindex)
+    {
+      diff->has_installsize_delta = TRUE;
+      diff->installsize_delta +=
+        (gint64)rpmostree_pkgindex_get_installsize (new_pkgindex) -
+        (gint64)rpmostree_pkgindex_get_installsize (old_pkgindex);
+    }
+
   g_assert_cmpuint (modified_old->len, ==, modified_new->len);
   for (guint i = 0; i < removed->len; i++)
     g_ptr_array_add (diff->removed, single_pkg_variant_new (type, removed->pdata[i]));
@@ -707,6 +730,8 @@ rpm_diff_variant_new (RpmDiff *diff)
                                  RPMOSTREE_DIFF_SINGLE_GVARIANT_STRING, diff->removed));
   g_variant_dict_insert_value (&dict, "added", array_to_variant_new (
                                  RPMOSTREE_DIFF_SINGLE_GVARIANT_STRING, diff->added));
+  if (diff->has_installsize_delta)
+    g_variant_dict_insert (&dict, "installsize-delta", "x", diff->installsize_delta);
   return g_variant_dict_end (&dict);
 }
 
@@ -127,6 +127,8 @@ livefs_flags_from_options (GVariant *options)
     ret |= RPMOSTREE_TRANSACTION_LIVEFS_FLAG_DRY_RUN;
   if (g_variant_dict_lookup (&options_dict, "replace", "b", &opt) && opt)
     ret |= RPMOSTREE_TRANSACTION_LIVEFS_FLAG_REPLACE;
+  if (g_variant_dict_lookup (&options_dict, "fine-grained", "b", &opt) && opt)
+    ret |= RPMOSTREE_TRANSACTION_LIVEFS_FLAG_FINE_GRAINED;
 
   g_variant_dict_clear (&options_dict);
 
@@ -145,8 +147,11 @@ osexperimental_handle_live_fs (RPMOSTreeOSExperimental *interface,
   /* try to merge with an existing transaction, otherwise start a new one */
   glnx_unref_object RpmostreedTransaction *transaction = NULL;
   RpmostreedSysroot *rsysroot = rpmostreed_sysroot_get ();
-  if (!rpmostreed_sysroot_prep_for_txn (rsysroot, invocation, &transaction, &local_error))
+  gboolean queued = FALSE;
+  if (!rpmostreed_sysroot_prep_for_txn (rsysroot, invocation, &transaction, &queued, &local_error))
     goto out;
+  if (queued)
+    return TRUE; /* Dispatched again once it reaches the head of the queue */
   if (transaction)
     goto out;
 
@@ -479,8 +479,11 @@ os_handle_download_update_rpm_diff (RPMOSTreeOS *interface,
   /* try to merge with an existing transaction, otherwise start a new one */
   glnx_unref_object RpmostreedTransaction *transaction = NULL;
   RpmostreedSysroot *rsysroot = rpmostreed_sysroot_get ();
-  if (!rpmostreed_sysroot_prep_for_txn (rsysroot, invocation, &transaction, &local_error))
+  gboolean queued = FALSE;
+  if (!rpmostreed_sysroot_prep_for_txn (rsysroot, invocation, &transaction, &queued, &local_error))
     goto out;
+  if (queued)
+    return TRUE; /* Dispatched again once it reaches the head of the queue */
   if (transaction)
     goto out;
 
@@ -568,8 +571,11 @@ os_merge_or_start_deployment_txn (RPMOSTreeOS            *interface,
   /* try to merge with an existing transaction, otherwise start a new one */
   glnx_unref_object RpmostreedTransaction *transaction = NULL;
   RpmostreedSysroot *rsysroot = rpmostreed_sysroot_get ();
-  if (!rpmostreed_sysroot_prep_for_txn (rsysroot, invocation, &transaction, &local_error))
+  gboolean queued = FALSE;
+  if (!rpmostreed_sysroot_prep_for_txn (rsysroot, invocation, &transaction, &queued, &local_error))
     goto err;
+  if (queued)
+    return TRUE; /* Dispatched again once it reaches the head of the queue */
 
   if (!transaction)
     {
@@ -586,14 +592,26 @@ os_merge_or_start_deployment_txn (RPMOSTreeOS            *interface,
       if (!transaction)
         goto err;
 
+      /* Automatic updates default to the configured priority, and assembling
+       * ahead is always background work; callers can ask for either explicitly */
+      const char *method_name = g_dbus_method_invocation_get_method_name (invocation);
+      g_auto(GVariantDict) options_dict;
+      g_variant_dict_init (&options_dict, options);
+      gboolean background = g_str_equal (method_name, "AutomaticUpdateTrigger") &&
+        (rpmostreed_get_automatic_update_background (rpmostreed_daemon_get ()) ||
+         (default_flags & RPMOSTREE_TRANSACTION_DEPLOY_FLAG_ASSEMBLE_ONLY));
+      rpmostreed_transaction_set_background (transaction,
+        vardict_lookup_bool (&options_dict, "background", background));
+
       rpmostreed_sysroot_set_txn (rsysroot, transaction);
 
-      /* For the AutomaticUpdateTrigger "check" case, we want to make sure we refresh
-       * the CachedUpdate property; "stage" will do this through sysroot_changed */
-      const char *method_name = g_dbus_method_invocation_get_method_name (invocation);
+      /* For the AutomaticUpdateTrigger "check" and "assemble" cases, we want to make
+       * sure we refresh the CachedUpdate property; "stage" will do this through
+       * sysroot_changed */
       if (g_str_equal (method_name, "AutomaticUpdateTrigger") &&
           (default_flags & (RPMOSTREE_TRANSACTION_DEPLOY_FLAG_DOWNLOAD_ONLY |
-                            RPMOSTREE_TRANSACTION_DEPLOY_FLAG_DOWNLOAD_METADATA_ONLY)))
+                            RPMOSTREE_TRANSACTION_DEPLOY_FLAG_DOWNLOAD_METADATA_ONLY |
+                            RPMOSTREE_TRANSACTION_DEPLOY_FLAG_ASSEMBLE_ONLY)))
         g_signal_connect (transaction, "closed", G_CALLBACK (on_auto_update_done), self);
     }
 
@@ -779,6 +797,9 @@ os_handle_automatic_update_trigger (RPMOSTreeOS *interface,
       break;
     case RPMOSTREED_AUTOMATIC_UPDATE_POLICY_STAGE:
       break;
+    case RPMOSTREED_AUTOMATIC_UPDATE_POLICY_ASSEMBLE:
+      dfault = RPMOSTREE_TRANSACTION_DEPLOY_FLAG_ASSEMBLE_ONLY;
+      break;
     default:
       g_assert_not_reached ();
     }
@@ -817,8 +838,11 @@ os_handle_rollback (RPMOSTreeOS *interface,
   /* try to merge with an existing transaction, otherwise start a new one */
   glnx_unref_object RpmostreedTransaction *transaction = NULL;
   RpmostreedSysroot *rsysroot = rpmostreed_sysroot_get ();
-  if (!rpmostreed_sysroot_prep_for_txn (rsysroot, invocation, &transaction, &local_error))
+  gboolean queued = FALSE;
+  if (!rpmostreed_sysroot_prep_for_txn (rsysroot, invocation, &transaction, &queued, &local_error))
     goto out;
+  if (queued)
+    return TRUE; /* Dispatched again once it reaches the head of the queue */
   if (transaction)
     goto out;
 
@@ -882,8 +906,11 @@ os_handle_refresh_md (RPMOSTreeOS *interface,
   /* try to merge with an existing transaction, otherwise start a new one */
   glnx_unref_object RpmostreedTransaction *transaction = NULL;
   RpmostreedSysroot *rsysroot = rpmostreed_sysroot_get ();
-  if (!rpmostreed_sysroot_prep_for_txn (rsysroot, invocation, &transaction, &local_error))
+  gboolean queued = FALSE;
+  if (!rpmostreed_sysroot_prep_for_txn (rsysroot, invocation, &transaction, &queued, &local_error))
     goto out;
+  if (queued)
+    return TRUE; /* Dispatched again once it reaches the head of the queue */
   if (transaction)
     goto out;
 
@@ -939,8 +966,11 @@ os_handle_modify_yum_repo (RPMOSTreeOS *interface,
   /* try to merge with an existing transaction, otherwise start a new one */
   glnx_unref_object RpmostreedTransaction *transaction = NULL;
   RpmostreedSysroot *rsysroot = rpmostreed_sysroot_get ();
-  if (!rpmostreed_sysroot_prep_for_txn (rsysroot, invocation, &transaction, &local_error))
+  gboolean queued = FALSE;
+  if (!rpmostreed_sysroot_prep_for_txn (rsysroot, invocation, &transaction, &queued, &local_error))
     goto out;
+  if (queued)
+    return TRUE; /* Dispatched again once it reaches the head of the queue */
   if (transaction)
     goto out;
 
@@ -993,8 +1023,11 @@ os_handle_finalize_deployment (RPMOSTreeOS *interface,
   /* try to merge with an existing transaction, otherwise start a new one */
   RpmostreedSysroot *rsysroot = rpmostreed_sysroot_get ();
 
-  if (!rpmostreed_sysroot_prep_for_txn (rsysroot, invocation, &transaction, &local_error))
+  gboolean queued = FALSE;
+  if (!rpmostreed_sysroot_prep_for_txn (rsysroot, invocation, &transaction, &queued, &local_error))
     goto out;
+  if (queued)
+    return TRUE; /* Dispatched again once it reaches the head of the queue */
   if (transaction)
     goto out;
 
@@ -1040,8 +1073,11 @@ os_handle_clear_rollback_target (RPMOSTreeOS *interface,
   /* try to merge with an existing transaction, otherwise start a new one */
   glnx_unref_object RpmostreedTransaction *transaction = NULL;
   RpmostreedSysroot *rsysroot = rpmostreed_sysroot_get ();
-  if (!rpmostreed_sysroot_prep_for_txn (rsysroot, invocation, &transaction, &local_error))
+  gboolean queued = FALSE;
+  if (!rpmostreed_sysroot_prep_for_txn (rsysroot, invocation, &transaction, &queued, &local_error))
     goto out;
+  if (queued)
+    return TRUE; /* Dispatched again once it reaches the head of the queue */
   if (transaction)
     goto out;
 
@@ -1093,8 +1129,11 @@ os_handle_set_initramfs_state (RPMOSTreeOS *interface,
   /* try to merge with an existing transaction, otherwise start a new one */
   glnx_unref_object RpmostreedTransaction *transaction = NULL;
   RpmostreedSysroot *rsysroot = rpmostreed_sysroot_get ();
-  if (!rpmostreed_sysroot_prep_for_txn (rsysroot, invocation, &transaction, &local_error))
+  gboolean queued = FALSE;
+  if (!rpmostreed_sysroot_prep_for_txn (rsysroot, invocation, &transaction, &queued, &local_error))
     goto out;
+  if (queued)
+    return TRUE; /* Dispatched again once it reaches the head of the queue */
   if (transaction)
     goto out;
 
@@ -1151,8 +1190,11 @@ os_handle_kernel_args (RPMOSTreeOS *interface,
   /* try to merge with an existing transaction, otherwise start a new one */
   glnx_unref_object RpmostreedTransaction *transaction = NULL;
   RpmostreedSysroot *rsysroot = rpmostreed_sysroot_get ();
-  if (!rpmostreed_sysroot_prep_for_txn (rsysroot, invocation, &transaction, &local_error))
+  gboolean queued = FALSE;
+  if (!rpmostreed_sysroot_prep_for_txn (rsysroot, invocation, &transaction, &queued, &local_error))
     goto out;
+  if (queued)
+    return TRUE; /* Dispatched again once it reaches the head of the queue */
   if (transaction)
     goto out;
 
@@ -1290,8 +1332,11 @@ os_handle_cleanup (RPMOSTreeOS *interface,
   /* try to merge with an existing transaction, otherwise start a new one */
   glnx_unref_object RpmostreedTransaction *transaction = NULL;
   RpmostreedSysroot *rsysroot = rpmostreed_sysroot_get ();
-  if (!rpmostreed_sysroot_prep_for_txn (rsysroot, invocation, &transaction, &local_error))
+  gboolean queued = FALSE;
+  if (!rpmostreed_sysroot_prep_for_txn (rsysroot, invocation, &transaction, &queued, &local_error))
     goto out;
+  if (queued)
+    return TRUE; /* Dispatched again once it reaches the head of the queue */
   if (transaction)
     goto out;
 
@@ -1434,8 +1479,11 @@ os_handle_download_rebase_rpm_diff (RPMOSTreeOS *interface,
   /* try to merge with an existing transaction, otherwise start a new one */
   glnx_unref_object RpmostreedTransaction *transaction = NULL;
   RpmostreedSysroot *rsysroot = rpmostreed_sysroot_get ();
-  if (!rpmostreed_sysroot_prep_for_txn (rsysroot, invocation, &transaction, &local_error))
+  gboolean queued = FALSE;
+  if (!rpmostreed_sysroot_prep_for_txn (rsysroot, invocation, &transaction, &queued, &local_error))
     goto out;
+  if (queued)
+    return TRUE; /* Dispatched again once it reaches the head of the queue */
   if (transaction)
     goto out;
 
@@ -1575,8 +1623,11 @@ os_handle_download_deploy_rpm_diff (RPMOSTreeOS *interface,
   /* try to merge with an existing transaction, otherwise start a new one */
   glnx_unref_object RpmostreedTransaction *transaction = NULL;
   RpmostreedSysroot *rsysroot = rpmostreed_sysroot_get ();
-  if (!rpmostreed_sysroot_prep_for_txn (rsysroot, invocation, &transaction, &local_error))
+  gboolean queued = FALSE;
+  if (!rpmostreed_sysroot_prep_for_txn (rsysroot, invocation, &transaction, &queued, &local_error))
     goto out;
+  if (queued)
+    return TRUE; /* Dispatched again once it reaches the head of the queue */
   if (transaction)
     goto out;
 
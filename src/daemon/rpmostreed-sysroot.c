@@ -41,6 +41,13 @@
 /* Avoid clients leaking their bus connections keeping the transaction open */
 #define FORCE_CLOSE_TXN_TIMEOUT_SECS 30
 
+/* How many transactions to keep in the RecentTransactions property */
+#define RECENT_TXNS_MAX 10
+
+/* Maximum number of distinct requests waiting behind the active transaction;
+ * compatible requests merge into a single entry and don't count twice. */
+#define TXN_QUEUE_MAX 16
+
 static gboolean
 sysroot_reload_ostree_configs_and_deployments (RpmostreedSysroot *self,
                                                gboolean *out_changed,
@@ -78,6 +85,14 @@ struct _RpmostreedSysroot {
 
   GFileMonitor *monitor;
   guint sig_changed;
+
+  GQueue recent_txns; /* GVariant a{sv}, newest first */
+
+  /* GPtrArray<GDBusMethodInvocation> of compatible requests, oldest first */
+  GQueue txn_queue;
+  guint txn_queue_idle_id;
+  /* The queued invocation currently being re-dispatched, if any */
+  GDBusMethodInvocation *dispatching;
 };
 
 struct _RpmostreedSysrootClass {
@@ -114,6 +129,27 @@ sysroot_output_cb (RpmOstreeOutputType type, void *data, void *opaque)
   static bool progress_state_percent;
   static guint progress_state_n_items;
 
+  /* Phases and counters are only used for accounting, regardless of where
+   * output goes */
+  if (type == RPMOSTREE_OUTPUT_COUNTER)
+    {
+      RpmOstreeOutputCounter *counter = data;
+      if (self->transaction)
+        rpmostreed_transaction_add_counter (self->transaction, counter->name, counter->value);
+      return;
+    }
+  else if (type == RPMOSTREE_OUTPUT_PHASE_BEGIN || type == RPMOSTREE_OUTPUT_PHASE_END)
+    {
+      RpmOstreeOutputPhase *phase = data;
+      if (!self->transaction)
+        return;
+      if (type == RPMOSTREE_OUTPUT_PHASE_BEGIN)
+        rpmostreed_transaction_phase_begin (self->transaction, phase->name);
+      else
+        rpmostreed_transaction_phase_end (self->transaction, phase->name);
+      return;
+    }
+
   if (self->transaction)
     g_object_get (self->transaction, "output-to-self", &output_to_self, NULL);
 
@@ -123,11 +159,11 @@ sysroot_output_cb (RpmOstreeOutputType type, void *data, void *opaque)
       return;
     }
 
-  RPMOSTreeTransaction *transaction = RPMOSTREE_TRANSACTION (self->transaction);
+  RpmostreedTransaction *transaction = self->transaction;
   switch (type)
   {
   case RPMOSTREE_OUTPUT_MESSAGE:
-    rpmostree_transaction_emit_message (transaction, ((RpmOstreeOutputMessage*)data)->text);
+    rpmostreed_transaction_emit_message (transaction, ((RpmOstreeOutputMessage*)data)->text);
     break;
   case RPMOSTREE_OUTPUT_PROGRESS_BEGIN:
     {
@@ -138,7 +174,7 @@ sysroot_output_cb (RpmOstreeOutputType type, void *data, void *opaque)
       if (begin->percent)
         {
           progress_str = g_strdup (begin->prefix);
-          rpmostree_transaction_emit_percent_progress (transaction, progress_str, 0);
+          rpmostreed_transaction_emit_percent_progress (transaction, progress_str, 0);
           progress_state_percent = true;
         }
       else if (begin->n > 0)
@@ -146,11 +182,11 @@ sysroot_output_cb (RpmOstreeOutputType type, void *data, void *opaque)
           progress_str = g_strdup (begin->prefix);
           progress_state_n_items = begin->n;
           /* For backcompat, this is a percentage.  See below */
-          rpmostree_transaction_emit_percent_progress (transaction, progress_str, 0);
+          rpmostreed_transaction_emit_percent_progress (transaction, progress_str, 0);
         }
       else
         {
-          rpmostree_transaction_emit_task_begin (transaction, begin->prefix);
+          rpmostreed_transaction_emit_task_begin (transaction, begin->prefix);
         }
     }
     break;
@@ -166,11 +202,11 @@ sysroot_output_cb (RpmOstreeOutputType type, void *data, void *opaque)
           int percentage = (update->c == progress_state_n_items) ? 100 :
             (((double)(update->c)) / (progress_state_n_items) * 100);
           g_autofree char *newtext = g_strdup_printf ("%s (%u/%u)", progress_str, update->c, progress_state_n_items);
-          rpmostree_transaction_emit_percent_progress (transaction, newtext, percentage);
+          rpmostreed_transaction_emit_percent_progress (transaction, newtext, percentage);
         }
       else
         {
-          rpmostree_transaction_emit_percent_progress (transaction, progress_str, update->c);
+          rpmostreed_transaction_emit_percent_progress (transaction, progress_str, update->c);
         }
     }
     break;
@@ -183,14 +219,18 @@ sysroot_output_cb (RpmOstreeOutputType type, void *data, void *opaque)
     {
       if (progress_state_percent || progress_state_n_items > 0)
         {
-          rpmostree_transaction_emit_progress_end (transaction);
+          rpmostreed_transaction_emit_progress_end (transaction);
         }
       else
         {
-          rpmostree_transaction_emit_task_end (transaction, "done");
+          rpmostreed_transaction_emit_task_end (transaction, "done");
         }
     }
     break;
+  case RPMOSTREE_OUTPUT_PHASE_BEGIN:
+  case RPMOSTREE_OUTPUT_PHASE_END:
+  case RPMOSTREE_OUTPUT_COUNTER:
+    g_assert_not_reached ();
   }
 }
 
@@ -382,8 +422,12 @@ handle_register_client (RPMOSTreeSysroot *object,
   g_autoptr(GVariantDict) optdict = g_variant_dict_new (arg_options);
   const char *client_id = NULL;
   g_variant_dict_lookup (optdict, "id", "&s", &client_id);
+  gboolean quiet = FALSE;
+  g_variant_dict_lookup (optdict, "quiet", "b", &quiet);
+  gboolean queue_txns = FALSE;
+  g_variant_dict_lookup (optdict, "queue-transactions", "b", &queue_txns);
 
-  rpmostreed_daemon_add_client (rpmostreed_daemon_get (), sender, client_id);
+  rpmostreed_daemon_add_client (rpmostreed_daemon_get (), sender, client_id, quiet, queue_txns);
   rpmostree_sysroot_complete_register_client (object, invocation);
 
   return TRUE;
@@ -519,6 +563,19 @@ sysroot_dispose (GObject *object)
   g_hash_table_remove_all (self->os_interfaces);
   g_hash_table_remove_all (self->osexperimental_interfaces);
 
+  if (self->txn_queue_idle_id > 0)
+    g_source_remove (self->txn_queue_idle_id);
+  self->txn_queue_idle_id = 0;
+  GPtrArray *invocations;
+  while ((invocations = g_queue_pop_head (&self->txn_queue)) != NULL)
+    {
+      for (guint i = 0; i < invocations->len; i++)
+        g_dbus_method_invocation_return_error_literal (invocations->pdata[i], G_DBUS_ERROR,
+                                                       G_DBUS_ERROR_FAILED,
+                                                       "Daemon is shutting down");
+      g_ptr_array_unref (invocations);
+    }
+
   g_clear_object (&self->transaction);
   g_clear_object (&self->authority);
 
@@ -536,6 +593,8 @@ sysroot_finalize (GObject *object)
 
   g_clear_object (&self->monitor);
 
+  g_queue_clear_full (&self->recent_txns, (GDestroyNotify)g_variant_unref);
+
   rpmostree_output_set_callback (NULL, NULL);
 
   G_OBJECT_CLASS (rpmostreed_sysroot_parent_class)->finalize (object);
@@ -554,6 +613,13 @@ rpmostreed_sysroot_init (RpmostreedSysroot *self)
 
   self->monitor = NULL;
 
+  g_queue_init (&self->recent_txns);
+  rpmostree_sysroot_set_recent_transactions ((RPMOSTreeSysroot*)self,
+                                             g_variant_new ("aa{sv}", NULL));
+  g_queue_init (&self->txn_queue);
+  rpmostree_sysroot_set_queued_transactions ((RPMOSTreeSysroot*)self,
+                                             g_variant_new ("a(sss)", NULL));
+
   if (g_getenv ("RPMOSTREE_USE_SESSION_BUS") != NULL)
     self->on_session_bus = TRUE;
 
@@ -825,12 +891,149 @@ rpmostreed_sysroot_load_state (RpmostreedSysroot *self,
   return TRUE;
 }
 
+/* Same test as rpmostreed_transaction_is_compatible() */
+static gboolean
+invocations_are_compatible (GDBusMethodInvocation *a,
+                            GDBusMethodInvocation *b)
+{
+  return g_str_equal (g_dbus_method_invocation_get_method_name (a),
+                      g_dbus_method_invocation_get_method_name (b)) &&
+         g_str_equal (g_dbus_method_invocation_get_object_path (a),
+                      g_dbus_method_invocation_get_object_path (b)) &&
+         g_variant_equal (g_dbus_method_invocation_get_parameters (a),
+                          g_dbus_method_invocation_get_parameters (b));
+}
+
+static void
+sync_queued_transactions (RpmostreedSysroot *self)
+{
+  g_auto(GVariantBuilder) builder;
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sss)"));
+  for (GList *l = self->txn_queue.head; l; l = l->next)
+    {
+      GPtrArray *invocations = l->data;
+      for (guint i = 0; i < invocations->len; i++)
+        {
+          GDBusMethodInvocation *invocation = invocations->pdata[i];
+          g_variant_builder_add (&builder, "(sss)",
+                                 g_dbus_method_invocation_get_method_name (invocation),
+                                 g_dbus_method_invocation_get_sender (invocation),
+                                 g_dbus_method_invocation_get_object_path (invocation));
+        }
+    }
+  rpmostree_sysroot_set_queued_transactions ((RPMOSTreeSysroot*)self,
+                                             g_variant_builder_end (&builder));
+}
+
+/* Run a queued method call through its interface's handler again, as if it
+ * had just arrived; it was already authorized the first time around. */
+static void
+redispatch_invocation (RpmostreedSysroot     *self,
+                       GDBusMethodInvocation *invocation)
+{
+  GDBusInterfaceSkeleton *skeleton = g_dbus_method_invocation_get_user_data (invocation);
+  GDBusInterfaceVTable *vtable = g_dbus_interface_skeleton_get_vtable (skeleton);
+
+  self->dispatching = invocation;
+  /* This takes over the ref the queue inherited from the first dispatch */
+  vtable->method_call (g_dbus_method_invocation_get_connection (invocation),
+                       g_dbus_method_invocation_get_sender (invocation),
+                       g_dbus_method_invocation_get_object_path (invocation),
+                       g_dbus_method_invocation_get_interface_name (invocation),
+                       g_dbus_method_invocation_get_method_name (invocation),
+                       g_dbus_method_invocation_get_parameters (invocation),
+                       invocation, skeleton);
+  self->dispatching = NULL;
+}
+
+static gboolean
+on_txn_queue_idle (gpointer data)
+{
+  RpmostreedSysroot *self = data;
+  self->txn_queue_idle_id = 0;
+
+  /* If a handler fails before starting a transaction, move on to the next
+   * entry; otherwise wait for this one to finish. */
+  while (!self->transaction && !g_queue_is_empty (&self->txn_queue))
+    {
+      g_autoptr(GPtrArray) invocations = g_queue_pop_head (&self->txn_queue);
+      sync_queued_transactions (self);
+      /* The first one starts the transaction, the rest merge into it */
+      for (guint i = 0; i < invocations->len; i++)
+        redispatch_invocation (self, invocations->pdata[i]);
+    }
+
+  return FALSE;
+}
+
+static void
+maybe_schedule_txn_queue (RpmostreedSysroot *self)
+{
+  if (self->txn_queue_idle_id == 0 && !g_queue_is_empty (&self->txn_queue))
+    self->txn_queue_idle_id = g_idle_add (on_txn_queue_idle, self);
+}
+
+/* Drop the queued method calls from the bus name @sender, e.g. because it
+ * went away; otherwise they'd start transactions nobody will ever Start().
+ */
+void
+rpmostreed_sysroot_drop_queued_txns (RpmostreedSysroot *self,
+                                     const char        *sender)
+{
+  gboolean changed = FALSE;
+  GList *l = self->txn_queue.head;
+  while (l)
+    {
+      GList *next = l->next;
+      GPtrArray *invocations = l->data;
+      for (guint i = 0; i < invocations->len; )
+        {
+          GDBusMethodInvocation *invocation = invocations->pdata[i];
+          if (g_strcmp0 (g_dbus_method_invocation_get_sender (invocation), sender) == 0)
+            {
+              /* This drops the ref the queue held */
+              g_dbus_method_invocation_return_error_literal (invocation, G_DBUS_ERROR,
+                                                             G_DBUS_ERROR_FAILED,
+                                                             "Client went away");
+              g_ptr_array_remove_index (invocations, i);
+              changed = TRUE;
+            }
+          else
+            i++;
+        }
+      if (invocations->len == 0)
+        {
+          g_ptr_array_unref (invocations);
+          g_queue_delete_link (&self->txn_queue, l);
+        }
+      l = next;
+    }
+
+  if (!changed)
+    return;
+  sd_journal_print (LOG_INFO, "Dropped queued transaction requests from %s", sender);
+  sync_queued_transactions (self);
+}
+
+/* Check whether the method call @invocation can start a new transaction.
+ * If a compatible one is already active, it's returned in @out_compat_txn.
+ * Otherwise if another transaction is active (or other requests are waiting)
+ * and the caller registered with the `queue-transactions` option, the call
+ * is queued and @out_queued is set; the caller must return without
+ * completing @invocation, and its handler will be invoked again when it
+ * reaches the head of the queue.  Other callers get an error if a
+ * transaction is active.
+ */
 gboolean
 rpmostreed_sysroot_prep_for_txn (RpmostreedSysroot     *self,
                                  GDBusMethodInvocation *invocation,
                                  RpmostreedTransaction **out_compat_txn,
+                                 gboolean              *out_queued,
                                  GError               **error)
 {
+  *out_compat_txn = NULL;
+  *out_queued = FALSE;
+
   if (self->transaction)
     {
       if (rpmostreed_transaction_is_compatible (self->transaction, invocation))
@@ -838,10 +1041,61 @@ rpmostreed_sysroot_prep_for_txn (RpmostreedSysroot     *self,
           *out_compat_txn = g_object_ref (self->transaction);
           return TRUE;
         }
-      const char *title = rpmostree_transaction_get_title ((RPMOSTreeTransaction*)(self->transaction));
-      return glnx_throw (error, "Transaction in progress: %s", title);
     }
-  *out_compat_txn = NULL;
+  else if (g_queue_is_empty (&self->txn_queue) || invocation == self->dispatching)
+    return TRUE;
+
+  /* The reply only comes once a queued request's transaction starts, which
+   * would blow through the default D-Bus timeout of most clients; so queueing
+   * is opt-in. */
+  if (!rpmostreed_daemon_client_queues_txns (rpmostreed_daemon_get (),
+                                             g_dbus_method_invocation_get_sender (invocation)))
+    {
+      if (self->transaction)
+        {
+          const char *title = rpmostree_transaction_get_title ((RPMOSTreeTransaction*)(self->transaction));
+          return glnx_throw (error, "Transaction in progress: %s", title);
+        }
+      /* Between two transactions; don't jump ahead of the queued ones */
+      return glnx_throw (error, "Transactions queued: %u", g_queue_get_length (&self->txn_queue));
+    }
+
+  for (GList *l = self->txn_queue.head; l; l = l->next)
+    {
+      GPtrArray *invocations = l->data;
+      if (invocations_are_compatible (invocations->pdata[0], invocation))
+        {
+          g_ptr_array_add (invocations, invocation);
+          sync_queued_transactions (self);
+          *out_queued = TRUE;
+          return TRUE;
+        }
+    }
+
+  if (g_queue_get_length (&self->txn_queue) >= TXN_QUEUE_MAX)
+    {
+      if (self->transaction)
+        {
+          const char *title = rpmostree_transaction_get_title ((RPMOSTreeTransaction*)(self->transaction));
+          return glnx_throw (error, "Transaction in progress: %s (queue full)", title);
+        }
+      return glnx_throw (error, "Transaction queue full");
+    }
+
+  GPtrArray *invocations = g_ptr_array_new ();
+  g_ptr_array_add (invocations, invocation);
+  g_queue_push_tail (&self->txn_queue, invocations);
+  sync_queued_transactions (self);
+  /* In case we're between two transactions */
+  if (!self->transaction)
+    maybe_schedule_txn_queue (self);
+
+  g_autofree char *client = rpmostreed_daemon_client_get_string (rpmostreed_daemon_get (),
+                                                                 g_dbus_method_invocation_get_sender (invocation));
+  sd_journal_print (LOG_INFO, "Queued %s for %s; position %u",
+                    g_dbus_method_invocation_get_method_name (invocation), client,
+                    g_queue_get_length (&self->txn_queue));
+  *out_queued = TRUE;
   return TRUE;
 }
 
@@ -916,6 +1170,9 @@ rpmostreed_sysroot_set_txn (RpmostreedSysroot     *self,
       g_autoptr(GVariant) v = g_variant_ref_sink (g_variant_new ("(sss)", "", "", ""));
       rpmostree_sysroot_set_active_transaction ((RPMOSTreeSysroot *)self, v);
       rpmostree_sysroot_set_active_transaction_path ((RPMOSTreeSysroot *)self, "");
+
+      /* Not directly, since we may be called from the closed handler */
+      maybe_schedule_txn_queue (self);
     }
 }
 
@@ -927,6 +1184,24 @@ rpmostreed_sysroot_finish_txn (RpmostreedSysroot     *self,
   rpmostreed_sysroot_set_txn (self, NULL);
 }
 
+/* Record the Statistics of a completed transaction into the RecentTransactions
+ * property. */
+void
+rpmostreed_sysroot_record_txn_statistics (RpmostreedSysroot *self,
+                                          GVariant          *statistics)
+{
+  g_queue_push_head (&self->recent_txns, g_variant_ref (statistics));
+  while (g_queue_get_length (&self->recent_txns) > RECENT_TXNS_MAX)
+    g_variant_unref (g_queue_pop_tail (&self->recent_txns));
+
+  g_auto(GVariantBuilder) builder;
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("aa{sv}"));
+  for (GList *l = self->recent_txns.head; l; l = l->next)
+    g_variant_builder_add_value (&builder, l->data);
+  rpmostree_sysroot_set_recent_transactions ((RPMOSTreeSysroot*)self,
+                                             g_variant_builder_end (&builder));
+}
+
 OstreeSysroot *
 rpmostreed_sysroot_get_root (RpmostreedSysroot *self)
 {
@@ -52,13 +52,20 @@ gboolean            rpmostreed_sysroot_load_state       (RpmostreedSysroot *self
 gboolean            rpmostreed_sysroot_prep_for_txn (RpmostreedSysroot     *self,
                                                      GDBusMethodInvocation *invocation,
                                                      RpmostreedTransaction **out_compat_txn,
+                                                     gboolean              *out_queued,
                                                      GError               **error);
 
+void                rpmostreed_sysroot_drop_queued_txns (RpmostreedSysroot *self,
+                                                         const char        *sender);
+
 gboolean            rpmostreed_sysroot_has_txn (RpmostreedSysroot     *self);
 
 void                rpmostreed_sysroot_finish_txn (RpmostreedSysroot     *self,
                                                    RpmostreedTransaction *txn);
 
+void                rpmostreed_sysroot_record_txn_statistics (RpmostreedSysroot *self,
+                                                              GVariant          *statistics);
+
 void                rpmostreed_sysroot_set_txn (RpmostreedSysroot     *self,
                                                 RpmostreedTransaction *txn);
 
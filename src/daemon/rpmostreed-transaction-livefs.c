@@ -34,6 +34,8 @@
 #include "rpmostree-db.h"
 #include "rpmostree-output.h"
 #include "rpmostree-core.h"
+#include "rpmostree-pathrules.h"
+#include "rpmostree-sched.h"
 #include "rpmostreed-utils.h"
 
 #define RPMOSTREE_MESSAGE_LIVEFS_BEGIN SD_ID128_MAKE(30,60,1f,0b,bb,fe,4c,bd,a7,87,23,53,a2,ed,75,81)
@@ -69,19 +71,34 @@ typedef enum {
   COMMIT_DIFF_FLAGS_REPLACEMENT = (1 << 3)  /* Files in /usr were replaced */
 } CommitDiffFlags;
 
+/* A changed path; for directories, added ones include their contents, but
+ * removed ones don't, and modified ones just have different metadata. */
+typedef struct {
+  char *path; /* Absolute */
+  gboolean is_dir; /* In the new commit, or the old one if removed */
+} CommitDiffEntry;
+
+static void
+commit_diff_entry_free (CommitDiffEntry *entry)
+{
+  g_free (entry->path);
+  g_free (entry);
+}
+
 typedef struct {
   guint refcount;
   CommitDiffFlags flags;
   guint n_usretc;
   guint n_tmpfilesd;
+  gboolean rpmdb_changed;
 
   char *from;
   char *to;
 
   /* Files */
-  GPtrArray *added; /* Set<GFile> */
-  GPtrArray *modified; /* Set<OstreeDiffItem> */
-  GPtrArray *removed; /* Set<GFile> */
+  GPtrArray *added; /* Set<CommitDiffEntry> */
+  GPtrArray *modified; /* Set<CommitDiffEntry> */
+  GPtrArray *removed; /* Set<CommitDiffEntry> */
 
   /* Package view */
   GPtrArray *removed_pkgs;
@@ -108,38 +125,24 @@ commit_diff_unref (CommitDiff *diff)
 }
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(CommitDiff, commit_diff_unref);
 
-static gboolean
-path_is_boot (const char *path)
-{
-  return g_str_has_prefix (path, "/boot/") ||
-    g_str_has_prefix (path, "/usr/lib/ostree-boot/");
-}
-
-static gboolean
-path_is_usretc (const char *path)
-{
-  return g_str_has_prefix (path, "/usr/etc/");
-}
-
-static gboolean
-path_is_rpmdb (const char *path)
-{
-  return g_str_has_prefix (path, "/" RPMOSTREE_RPMDB_LOCATION "/");
-}
-
-static gboolean
-path_is_rootfs (const char *path)
+static CommitDiff *
+commit_diff_new (void)
 {
-  return !g_str_has_prefix (path, "/usr/");
+  CommitDiff *diff = g_new0 (CommitDiff, 1);
+  diff->refcount = 1;
+  diff->added = g_ptr_array_new_with_free_func ((GDestroyNotify) commit_diff_entry_free);
+  diff->modified = g_ptr_array_new_with_free_func ((GDestroyNotify) commit_diff_entry_free);
+  diff->removed = g_ptr_array_new_with_free_func ((GDestroyNotify) commit_diff_entry_free);
+  return diff;
 }
 
 static gboolean
-path_is_ignored_for_diff (const char *path)
+path_is_ignored_for_diff (guint32 path_flags)
 {
   /* /proc SELinux labeling is broken, ignore it
    * https://github.com/ostreedev/ostree/pull/768
    */
-  return strcmp (path, "/proc") == 0;
+  return (path_flags & RPMOSTREE_PATH_FLAG_PROC) > 0;
 }
 
 typedef enum {
@@ -155,19 +158,21 @@ static FileDiffResult
 diff_one_path (CommitDiff        *diff,
                const char        *path)
 {
-  if (path_is_ignored_for_diff (path) ||
-      path_is_rpmdb (path))
+  const guint32 path_flags =
+    rpmostree_path_rules_match (rpmostree_path_rules_get_default (), path);
+  if (path_is_ignored_for_diff (path_flags) ||
+      path_flags & RPMOSTREE_PATH_FLAG_RPMDB)
     return FILE_DIFF_RESULT_OMIT;
-  else if (path_is_usretc (path))
+  else if (path_flags & RPMOSTREE_PATH_FLAG_USR_ETC)
     {
       diff->flags |= COMMIT_DIFF_FLAGS_ETC;
       diff->n_usretc++;
     }
-  else if (g_str_has_prefix (path, "/usr/lib/tmpfiles.d"))
+  else if (path_flags & RPMOSTREE_PATH_FLAG_TMPFILES_D)
     diff->n_tmpfilesd++;
-  else if (path_is_boot (path))
+  else if (path_flags & (RPMOSTREE_PATH_FLAG_BOOT | RPMOSTREE_PATH_FLAG_OSTREE_BOOT))
     diff->flags |= COMMIT_DIFF_FLAGS_BOOT;
-  else if (path_is_rootfs (path))
+  else if (!(path_flags & RPMOSTREE_PATH_FLAG_USR))
     diff->flags |= COMMIT_DIFF_FLAGS_ROOTFS;
   return FILE_DIFF_RESULT_KEEP;
 }
@@ -197,14 +202,15 @@ copy_new_config_files (OstreeRepo          *repo,
   if (!glnx_opendirat (new_deployment_dfd, "etc", TRUE, &deployment_etc_dfd, error))
     return FALSE;
 
+  RpmOstreePathRules *rules = rpmostree_path_rules_get_default ();
   guint n_added = 0;
   /* Avoid checking out added subdirs recursively */
   g_autoptr(GPtrArray) added_subdirs = g_ptr_array_new_with_free_func (g_free);
   for (guint i = 0; i < diff->added->len; i++)
     {
-      GFile *added_f = diff->added->pdata[i];
-      const char *path = gs_file_get_path_cached (added_f);
-      if (!g_str_has_prefix (path, "/usr/etc/"))
+      CommitDiffEntry *added = diff->added->pdata[i];
+      const char *path = added->path;
+      if (!(rpmostree_path_rules_match (rules, path) & RPMOSTREE_PATH_FLAG_USR_ETC))
         continue;
       const char *etc_path = path + strlen ("/usr");
 
@@ -223,16 +229,10 @@ copy_new_config_files (OstreeRepo          *repo,
       if (rpmostree_str_has_prefix_in_ptrarray (sub_etc_relpath, added_subdirs))
         continue;
 
-      g_autoptr(GFileInfo) finfo = g_file_query_info (added_f, "standard::type",
-                                                      G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
-                                                      cancellable, error);
-      if (!finfo)
-        return FALSE;
-
       /* If this is a directory, add it to our "added subdirs" set. See above.  Add
        * a trailing / to ensure we don't match other file prefixes.
        */
-      const gboolean is_dir = g_file_info_get_file_type (finfo) == G_FILE_TYPE_DIRECTORY;
+      const gboolean is_dir = added->is_dir;
       if (is_dir)
         g_ptr_array_add (added_subdirs, g_strconcat (sub_etc_relpath, "/", NULL));
 
@@ -270,78 +270,425 @@ copy_new_config_files (OstreeRepo          *repo,
   return TRUE;
 }
 
-/* Generate a CommitDiff */
+/* Subtrees at this depth (e.g. /usr/share/doc) and below are diffed in
+ * parallel; the first levels are tiny, but everything hangs off them. */
+#define DIFF_FANOUT_DEPTH 3
+
+/* Directories we skip entirely; we only care whether they @changed (i.e.
+ * were added, removed, or differ in contents or metadata).
+ */
 static gboolean
-analyze_commit_diff (OstreeRepo      *repo,
-                     const char      *from_rev,
-                     const char      *to_rev,
-                     CommitDiff     **out_diff,
-                     GCancellable    *cancellable,
-                     GError         **error)
+diff_prune_dir (CommitDiff *diff,
+                const char *path,
+                gboolean    changed)
 {
-  g_autoptr(CommitDiff) diff = g_new0(CommitDiff, 1);
-  diff->refcount = 1;
+  if (g_str_equal (path, "/" RPMOSTREE_RPMDB_LOCATION))
+    {
+      if (changed)
+        diff->rpmdb_changed = TRUE;
+      return TRUE;
+    }
+  else if (g_str_equal (path, "/boot"))
+    {
+      if (changed)
+        diff->flags |= COMMIT_DIFF_FLAGS_BOOT;
+      return TRUE;
+    }
+  RpmOstreePathRules *rules = rpmostree_path_rules_get_default ();
+  return path_is_ignored_for_diff (rpmostree_path_rules_match (rules, path));
+}
 
-  diff->from = g_strdup (from_rev);
-  diff->to = g_strdup (to_rev);
+static void
+diff_add_entry (CommitDiff *diff,
+                GPtrArray  *entries,
+                char       *path, /* transfer full */
+                gboolean    is_dir)
+{
+  if (diff_one_path (diff, path) == FILE_DIFF_RESULT_OMIT)
+    {
+      g_free (path);
+      return;
+    }
+  CommitDiffEntry *entry = g_new0 (CommitDiffEntry, 1);
+  entry->path = path;
+  entry->is_dir = is_dir;
+  g_ptr_array_add (entries, entry);
+}
 
-  /* Read the "from" and "to" commits */
-  glnx_unref_object GFile *from_tree = NULL;
-  if (!ostree_repo_read_commit (repo, from_rev, &from_tree, NULL,
-                                cancellable, error))
+/* A pair of directories with different contents, left for a worker */
+typedef struct {
+  char *path;
+  char *from_contents;
+  char *to_contents;
+} DiffSubtree;
+
+static void
+diff_subtree_free (DiffSubtree *subtree)
+{
+  g_free (subtree->path);
+  g_free (subtree->from_contents);
+  g_free (subtree->to_contents);
+  g_free (subtree);
+}
+
+static gboolean
+load_dirtree (OstreeRepo  *repo,
+              const char  *contents_csum,
+              GVariant   **out_files,
+              GVariant   **out_dirs,
+              GError     **error)
+{
+  g_autoptr(GVariant) dirtree = NULL;
+  if (!ostree_repo_load_variant (repo, OSTREE_OBJECT_TYPE_DIR_TREE, contents_csum,
+                                 &dirtree, error))
     return FALSE;
-  glnx_unref_object GFile *to_tree = NULL;
-  if (!ostree_repo_read_commit (repo, to_rev, &to_tree, NULL,
-                                cancellable, error))
+  *out_files = g_variant_get_child_value (dirtree, 0);
+  *out_dirs = g_variant_get_child_value (dirtree, 1);
+  return TRUE;
+}
+
+static gboolean
+csum_v_equal (GVariant *a,
+              GVariant *b)
+{
+  return g_variant_get_size (a) == g_variant_get_size (b) &&
+    memcmp (g_variant_get_data (a), g_variant_get_data (b), g_variant_get_size (a)) == 0;
+}
+
+/* Record all of the contents of a new directory as added */
+static gboolean
+diff_add_dirtree (OstreeRepo   *repo,
+                  const char   *path,
+                  const char   *contents_csum,
+                  CommitDiff   *diff,
+                  GCancellable *cancellable,
+                  GError      **error)
+{
+  g_autoptr(GVariant) files = NULL;
+  g_autoptr(GVariant) dirs = NULL;
+  if (!load_dirtree (repo, contents_csum, &files, &dirs, error))
     return FALSE;
 
-  /* Diff the two commits at the filesystem level */
-  g_autoptr(GPtrArray) modified = g_ptr_array_new_with_free_func ((GDestroyNotify) ostree_diff_item_unref);
-  g_autoptr(GPtrArray) removed = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
-  g_autoptr(GPtrArray) added = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
-  if (!ostree_diff_dirs (0, from_tree, to_tree, modified, removed, added,
-                         cancellable, error))
+  const guint n_files = g_variant_n_children (files);
+  for (guint i = 0; i < n_files; i++)
+    {
+      const char *name;
+      g_variant_get_child (files, i, "(&s@ay)", &name, NULL);
+      diff_add_entry (diff, diff->added, g_strconcat (path, "/", name, NULL), FALSE);
+    }
+
+  const guint n_dirs = g_variant_n_children (dirs);
+  for (guint i = 0; i < n_dirs; i++)
+    {
+      const char *name;
+      g_autoptr(GVariant) contents_v = NULL;
+      g_variant_get_child (dirs, i, "(&s@ay@ay)", &name, &contents_v, NULL);
+      g_autofree char *subpath = g_strconcat (path, "/", name, NULL);
+      if (diff_prune_dir (diff, subpath, TRUE))
+        continue;
+      diff_add_entry (diff, diff->added, g_strdup (subpath), TRUE);
+      g_autofree char *contents = ostree_checksum_from_bytes_v (contents_v);
+      if (!diff_add_dirtree (repo, subpath, contents, diff, cancellable, error))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Diff two versions of the directory at @path.  Subdirectories whose
+ * contents are identical are skipped without loading them; once we're
+ * @depth levels down, changed ones are appended to @deferred (if set)
+ * rather than recursed into.
+ */
+static gboolean
+diff_dirtrees (OstreeRepo   *repo,
+               const char   *path,
+               const char   *from_contents,
+               const char   *to_contents,
+               guint         depth,
+               GPtrArray    *deferred,
+               CommitDiff   *diff,
+               GCancellable *cancellable,
+               GError      **error)
+{
+  if (g_cancellable_set_error_if_cancelled (cancellable, error))
     return FALSE;
 
-  /* We'll filter these arrays below. */
-  diff->modified = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
-  diff->removed = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
-  diff->added = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+  g_autoptr(GVariant) from_files = NULL;
+  g_autoptr(GVariant) from_dirs = NULL;
+  if (!load_dirtree (repo, from_contents, &from_files, &from_dirs, error))
+    return FALSE;
+  g_autoptr(GVariant) to_files = NULL;
+  g_autoptr(GVariant) to_dirs = NULL;
+  if (!load_dirtree (repo, to_contents, &to_files, &to_dirs, error))
+    return FALSE;
 
-  /* Analyze the differences */
-  for (guint i = 0; i < modified->len; i++)
+  /* Both lists are sorted by name, so we can just merge them.  Note that a
+   * file replaced by a directory (or vice versa) shows up as a removal here
+   * and an addition in the directory pass. */
+  const guint n_from_files = g_variant_n_children (from_files);
+  const guint n_to_files = g_variant_n_children (to_files);
+  guint i = 0, j = 0;
+  while (i < n_from_files || j < n_to_files)
     {
-      OstreeDiffItem *diffitem = modified->pdata[i];
-      const char *path = gs_file_get_path_cached (diffitem->src);
+      const char *from_name = NULL;
+      const char *to_name = NULL;
+      g_autoptr(GVariant) from_csum = NULL;
+      g_autoptr(GVariant) to_csum = NULL;
+      if (i < n_from_files)
+        g_variant_get_child (from_files, i, "(&s@ay)", &from_name, &from_csum);
+      if (j < n_to_files)
+        g_variant_get_child (to_files, j, "(&s@ay)", &to_name, &to_csum);
+
+      int c = !from_name ? 1 : !to_name ? -1 : strcmp (from_name, to_name);
+      if (c < 0)
+        {
+          diff_add_entry (diff, diff->removed, g_strconcat (path, "/", from_name, NULL), FALSE);
+          i++;
+        }
+      else if (c > 0)
+        {
+          diff_add_entry (diff, diff->added, g_strconcat (path, "/", to_name, NULL), FALSE);
+          j++;
+        }
+      else
+        {
+          if (!csum_v_equal (from_csum, to_csum))
+            diff_add_entry (diff, diff->modified, g_strconcat (path, "/", to_name, NULL), FALSE);
+          i++;
+          j++;
+        }
+    }
+
+  const guint n_from_dirs = g_variant_n_children (from_dirs);
+  const guint n_to_dirs = g_variant_n_children (to_dirs);
+  i = j = 0;
+  while (i < n_from_dirs || j < n_to_dirs)
+    {
+      const char *from_name = NULL;
+      const char *to_name = NULL;
+      g_autoptr(GVariant) from_tree = NULL;
+      g_autoptr(GVariant) from_meta = NULL;
+      g_autoptr(GVariant) to_tree = NULL;
+      g_autoptr(GVariant) to_meta = NULL;
+      if (i < n_from_dirs)
+        g_variant_get_child (from_dirs, i, "(&s@ay@ay)", &from_name, &from_tree, &from_meta);
+      if (j < n_to_dirs)
+        g_variant_get_child (to_dirs, j, "(&s@ay@ay)", &to_name, &to_tree, &to_meta);
+
+      int c = !from_name ? 1 : !to_name ? -1 : strcmp (from_name, to_name);
+      const char *name = c < 0 ? from_name : to_name;
+      g_autofree char *subpath = g_strconcat (path, "/", name, NULL);
+      gboolean changed = TRUE;
+      if (c < 0)
+        i++;
+      else if (c > 0)
+        j++;
+      else
+        {
+          changed = !csum_v_equal (from_tree, to_tree) || !csum_v_equal (from_meta, to_meta);
+          i++;
+          j++;
+        }
 
-      if (diff_one_path (diff, path) == FILE_DIFF_RESULT_KEEP)
-        g_ptr_array_add (diff->modified, g_object_ref (diffitem->src));
+      if (diff_prune_dir (diff, subpath, changed))
+        continue;
+
+      if (c < 0)
+        diff_add_entry (diff, diff->removed, g_steal_pointer (&subpath), TRUE);
+      else if (c > 0)
+        {
+          diff_add_entry (diff, diff->added, g_strdup (subpath), TRUE);
+          g_autofree char *contents = ostree_checksum_from_bytes_v (to_tree);
+          if (!diff_add_dirtree (repo, subpath, contents, diff, cancellable, error))
+            return FALSE;
+        }
+      else
+        {
+          if (!csum_v_equal (from_meta, to_meta))
+            diff_add_entry (diff, diff->modified, g_strdup (subpath), TRUE);
+          /* The common case; nothing to do for this whole subtree */
+          if (csum_v_equal (from_tree, to_tree))
+            continue;
+
+          g_autofree char *from_sub = ostree_checksum_from_bytes_v (from_tree);
+          g_autofree char *to_sub = ostree_checksum_from_bytes_v (to_tree);
+          if (deferred && depth + 1 >= DIFF_FANOUT_DEPTH)
+            {
+              DiffSubtree *subtree = g_new0 (DiffSubtree, 1);
+              subtree->path = g_steal_pointer (&subpath);
+              subtree->from_contents = g_steal_pointer (&from_sub);
+              subtree->to_contents = g_steal_pointer (&to_sub);
+              g_ptr_array_add (deferred, subtree);
+            }
+          else if (!diff_dirtrees (repo, subpath, from_sub, to_sub, depth + 1,
+                                   deferred, diff, cancellable, error))
+            return FALSE;
+        }
     }
 
-  for (guint i = 0; i < removed->len; i++)
+  return TRUE;
+}
+
+typedef struct {
+  OstreeRepo *repo;
+  GPtrArray *subtrees; /* DiffSubtree */
+  CommitDiff **results; /* One per subtree */
+  volatile gint next;
+  GCancellable *cancellable;
+  GMutex lock;
+  GError *error; /* First error; protected by lock */
+} DiffWorkers;
+
+static gpointer
+diff_worker_thread (gpointer data)
+{
+  DiffWorkers *workers = data;
+  rpmostree_sched_thread_enter ();
+  while (TRUE)
     {
-      GFile *gfpath = removed->pdata[i];
-      const char *path = gs_file_get_path_cached (gfpath);
+      guint i = g_atomic_int_add (&workers->next, 1);
+      if (i >= workers->subtrees->len)
+        break;
+      DiffSubtree *subtree = workers->subtrees->pdata[i];
+      g_autoptr(CommitDiff) result = commit_diff_new ();
+      g_autoptr(GError) local_error = NULL;
+      if (!diff_dirtrees (workers->repo, subtree->path, subtree->from_contents,
+                          subtree->to_contents, DIFF_FANOUT_DEPTH, NULL, result,
+                          workers->cancellable, &local_error))
+        {
+          g_mutex_lock (&workers->lock);
+          if (!workers->error)
+            workers->error = g_steal_pointer (&local_error);
+          g_mutex_unlock (&workers->lock);
+          /* Make the other workers stop too */
+          g_atomic_int_set (&workers->next, workers->subtrees->len);
+          break;
+        }
+      workers->results[i] = g_steal_pointer (&result);
+    }
+  rpmostree_sched_thread_leave ();
+  return NULL;
+}
 
-      if (diff_one_path (diff, path) == FILE_DIFF_RESULT_KEEP)
-        g_ptr_array_add (diff->removed, g_object_ref (gfpath));
+static void
+commit_diff_merge (CommitDiff *diff,
+                   CommitDiff *other)
+{
+  diff->flags |= other->flags;
+  diff->n_usretc += other->n_usretc;
+  diff->n_tmpfilesd += other->n_tmpfilesd;
+  diff->rpmdb_changed = diff->rpmdb_changed || other->rpmdb_changed;
+  GPtrArray *pairs[][2] = { { diff->added, other->added },
+                            { diff->modified, other->modified },
+                            { diff->removed, other->removed } };
+  for (guint i = 0; i < G_N_ELEMENTS (pairs); i++)
+    {
+      GPtrArray *src = pairs[i][1];
+      for (guint j = 0; j < src->len; j++)
+        g_ptr_array_add (pairs[i][0], src->pdata[j]);
+      /* Ownership was transferred above */
+      g_ptr_array_set_free_func (src, NULL);
+      g_ptr_array_set_size (src, 0);
     }
+}
 
-  for (guint i = 0; i < added->len; i++)
+/* Diff the deferred subtrees on a few threads, and merge the results in order */
+static gboolean
+diff_subtrees_parallel (OstreeRepo   *repo,
+                        GPtrArray    *subtrees,
+                        CommitDiff   *diff,
+                        GCancellable *cancellable,
+                        GError      **error)
+{
+  if (subtrees->len == 0)
+    return TRUE;
+
+  DiffWorkers workers = { .repo = repo, .subtrees = subtrees, .cancellable = cancellable };
+  g_autofree CommitDiff **results = g_new0 (CommitDiff*, subtrees->len);
+  workers.results = results;
+  g_mutex_init (&workers.lock);
+
+  const guint n_threads =
+    MIN (subtrees->len, rpmostree_sched_get_max_workers (g_get_num_processors ()));
+  g_autoptr(GPtrArray) threads = g_ptr_array_new ();
+  for (guint i = 0; i < n_threads; i++)
+    g_ptr_array_add (threads, g_thread_new ("livefs-diff", diff_worker_thread, &workers));
+  for (guint i = 0; i < threads->len; i++)
+    g_thread_join (threads->pdata[i]);
+  g_mutex_clear (&workers.lock);
+
+  for (guint i = 0; i < subtrees->len; i++)
     {
-      GFile *added_f = added->pdata[i];
-      const char *path = gs_file_get_path_cached (added_f);
+      if (!results[i])
+        continue;
+      if (!workers.error)
+        commit_diff_merge (diff, results[i]);
+      commit_diff_unref (results[i]);
+    }
 
-      if (diff_one_path (diff, path) == FILE_DIFF_RESULT_KEEP)
-        g_ptr_array_add (diff->added, g_object_ref (added_f));
+  if (workers.error)
+    {
+      g_propagate_error (error, workers.error);
+      return FALSE;
     }
+  return TRUE;
+}
+
+/* Generate a CommitDiff.  We work directly on the dirtree objects rather than
+ * ostree_diff_dirs(), since that way we skip identical subtrees just by
+ * comparing their checksums, and only ever look at the changed parts.
+ */
+static gboolean
+analyze_commit_diff (OstreeRepo      *repo,
+                     const char      *from_rev,
+                     const char      *to_rev,
+                     CommitDiff     **out_diff,
+                     GCancellable    *cancellable,
+                     GError         **error)
+{
+  g_autoptr(CommitDiff) diff = commit_diff_new ();
 
-  /* And gather the RPM level changes */
-  if (!rpm_ostree_db_diff (repo, from_rev, to_rev,
-                           &diff->removed_pkgs, &diff->added_pkgs,
-                           &diff->modified_pkgs_old, &diff->modified_pkgs_new,
-                           cancellable, error))
+  diff->from = g_strdup (from_rev);
+  diff->to = g_strdup (to_rev);
+
+  /* Read the "from" and "to" commits */
+  g_autoptr(GVariant) from_commit = NULL;
+  if (!ostree_repo_load_commit (repo, from_rev, &from_commit, NULL, error))
+    return FALSE;
+  g_autoptr(GVariant) to_commit = NULL;
+  if (!ostree_repo_load_commit (repo, to_rev, &to_commit, NULL, error))
+    return FALSE;
+  g_autoptr(GVariant) from_root_v = g_variant_get_child_value (from_commit, 6);
+  g_autoptr(GVariant) to_root_v = g_variant_get_child_value (to_commit, 6);
+  g_autofree char *from_root = ostree_checksum_from_bytes_v (from_root_v);
+  g_autofree char *to_root = ostree_checksum_from_bytes_v (to_root_v);
+
+  /* Diff the two commits at the filesystem level */
+  g_autoptr(GPtrArray) subtrees =
+    g_ptr_array_new_with_free_func ((GDestroyNotify) diff_subtree_free);
+  if (!diff_dirtrees (repo, "", from_root, to_root, 0, subtrees, diff,
+                      cancellable, error))
     return FALSE;
+  if (!diff_subtrees_parallel (repo, subtrees, diff, cancellable, error))
+    return FALSE;
+
+  /* And gather the RPM level changes; if the rpmdb is the same, there aren't any */
+  if (diff->rpmdb_changed)
+    {
+      if (!rpm_ostree_db_diff (repo, from_rev, to_rev,
+                               &diff->removed_pkgs, &diff->added_pkgs,
+                               &diff->modified_pkgs_old, &diff->modified_pkgs_new,
+                               cancellable, error))
+        return FALSE;
+    }
+  else
+    {
+      diff->removed_pkgs = g_ptr_array_new ();
+      diff->added_pkgs = g_ptr_array_new ();
+      diff->modified_pkgs_old = g_ptr_array_new ();
+      diff->modified_pkgs_new = g_ptr_array_new ();
+    }
   g_assert (diff->modified_pkgs_old->len == diff->modified_pkgs_new->len);
 
   *out_diff = g_steal_pointer (&diff);
@@ -625,6 +972,226 @@ replace_usr (OstreeRepo *repo,
   return TRUE;
 }
 
+/* Move @name from @src_dfd over @relpath in the deployment.  This is atomic
+ * when replacing a non-directory with another; otherwise we exchange the two
+ * and delete the old one afterwards.
+ */
+static gboolean
+swap_into_place (int           src_dfd,
+                 const char   *name,
+                 int           deployment_dfd,
+                 const char   *relpath,
+                 GCancellable *cancellable,
+                 GError      **error)
+{
+  struct stat src_stbuf;
+  if (!glnx_fstatat (src_dfd, name, &src_stbuf, AT_SYMLINK_NOFOLLOW, error))
+    return FALSE;
+  struct stat stbuf;
+  if (!glnx_fstatat_allow_noent (deployment_dfd, relpath, &stbuf, AT_SYMLINK_NOFOLLOW, error))
+    return FALSE;
+  if (errno == ENOENT || (!S_ISDIR (stbuf.st_mode) && !S_ISDIR (src_stbuf.st_mode)))
+    return glnx_renameat (src_dfd, name, deployment_dfd, relpath, error);
+
+  if (glnx_renameat2_exchange (src_dfd, name, deployment_dfd, relpath) < 0)
+    return glnx_throw_errno_prefix (error, "rename(..., RENAME_EXCHANGE) for %s", relpath);
+  return glnx_shutil_rm_rf_at (src_dfd, name, cancellable, error);
+}
+
+/* Shared libraries go first and executables last, to narrow the window in
+ * which a new program could run against an old library. */
+static guint
+swap_order_class (const char *path)
+{
+  const char *bname = glnx_basename (path);
+  if (g_str_has_suffix (bname, ".so") || strstr (bname, ".so.") != NULL)
+    return 0;
+  if (strstr (path, "/bin/") || strstr (path, "/sbin/") ||
+      g_str_has_prefix (path, "/usr/libexec/"))
+    return 2;
+  return 1;
+}
+
+static guint
+path_depth (const char *path)
+{
+  guint depth = 0;
+  for (const char *p = path; *p; p++)
+    depth += (*p == '/');
+  return depth;
+}
+
+/* Within a class, deepest (leaf) paths first */
+static gint
+compare_swap_order (gconstpointer a,
+                    gconstpointer b)
+{
+  const CommitDiffEntry *entry_a = *((CommitDiffEntry**)a);
+  const CommitDiffEntry *entry_b = *((CommitDiffEntry**)b);
+  const guint class_a = swap_order_class (entry_a->path);
+  const guint class_b = swap_order_class (entry_b->path);
+  if (class_a != class_b)
+    return class_a < class_b ? -1 : 1;
+  const guint depth_a = path_depth (entry_a->path);
+  const guint depth_b = path_depth (entry_b->path);
+  if (depth_a != depth_b)
+    return depth_a > depth_b ? -1 : 1;
+  return strcmp (entry_a->path, entry_b->path);
+}
+
+/* Whether any parent directory of @path is in @dirs */
+static gboolean
+path_has_parent_in_set (const char *path,
+                        GHashTable *dirs)
+{
+  g_autofree char *buf = g_strdup (path);
+  for (char *slash = strrchr (buf, '/'); slash && slash != buf; slash = strrchr (buf, '/'))
+    {
+      *slash = '\0';
+      if (g_hash_table_contains (dirs, buf))
+        return TRUE;
+    }
+  return FALSE;
+}
+
+/* Sync the ownership, mode and xattrs of an existing directory */
+static gboolean
+apply_dir_metadata (GFile        *target_root,
+                    int           deployment_dfd,
+                    const char   *path,
+                    GCancellable *cancellable,
+                    GError      **error)
+{
+  g_autoptr(GFile) f = g_file_resolve_relative_path (target_root, path + 1);
+  if (!ostree_repo_file_ensure_resolved ((OstreeRepoFile*)f, error))
+    return FALSE;
+  GVariant *dirmeta = ostree_repo_file_tree_get_metadata ((OstreeRepoFile*)f);
+  guint32 uid, gid, mode;
+  g_autoptr(GVariant) xattrs = NULL;
+  g_variant_get (dirmeta, "(uuu@a(ayay))", &uid, &gid, &mode, &xattrs);
+
+  glnx_autofd int dfd = -1;
+  if (!glnx_opendirat (deployment_dfd, path + 1, FALSE, &dfd, error))
+    return FALSE;
+  if (fchown (dfd, GUINT32_FROM_BE (uid), GUINT32_FROM_BE (gid)) < 0)
+    return glnx_throw_errno_prefix (error, "fchown(%s)", path);
+  if (fchmod (dfd, GUINT32_FROM_BE (mode) & 07777) < 0)
+    return glnx_throw_errno_prefix (error, "fchmod(%s)", path);
+  if (!glnx_fd_set_all_xattrs (dfd, xattrs, cancellable, error))
+    return FALSE;
+  return TRUE;
+}
+
+/* The lightweight alternative to replace_usr(): only touch what the diff says
+ * changed.  Each added or modified path is checked out (hardlinked from the
+ * repo) into its own slot in @tmpdir and then swapped into place; new
+ * directories are swapped in whole.  Then we update changed directory
+ * metadata, delete removed paths, and finally swap in the new rpmdb.
+ */
+static gboolean
+apply_commit_diff (OstreeRepo   *repo,
+                   int           deployment_dfd,
+                   GLnxTmpDir   *tmpdir,
+                   CommitDiff   *diff,
+                   const char   *target_csum,
+                   GCancellable *cancellable,
+                   GError      **error)
+{
+  /* New directories are checked out with all their contents, so skip
+   * anything under them. */
+  g_autoptr(GHashTable) added_dirs = g_hash_table_new (g_str_hash, g_str_equal);
+  g_autoptr(GHashTable) added_paths = g_hash_table_new (g_str_hash, g_str_equal);
+  g_autoptr(GPtrArray) to_swap = g_ptr_array_new ();
+  for (guint i = 0; i < diff->added->len; i++)
+    {
+      CommitDiffEntry *entry = diff->added->pdata[i];
+      g_hash_table_add (added_paths, entry->path);
+      if (entry->is_dir)
+        g_hash_table_add (added_dirs, entry->path);
+    }
+  for (guint i = 0; i < diff->added->len; i++)
+    {
+      CommitDiffEntry *entry = diff->added->pdata[i];
+      if (!path_has_parent_in_set (entry->path, added_dirs))
+        g_ptr_array_add (to_swap, entry);
+    }
+  for (guint i = 0; i < diff->modified->len; i++)
+    {
+      CommitDiffEntry *entry = diff->modified->pdata[i];
+      if (!entry->is_dir)
+        g_ptr_array_add (to_swap, entry);
+    }
+  g_ptr_array_sort (to_swap, compare_swap_order);
+
+  for (guint i = 0; i < to_swap->len; i++)
+    {
+      CommitDiffEntry *entry = to_swap->pdata[i];
+      const char *relpath = entry->path + 1;
+      const char *bname = glnx_basename (relpath);
+
+      g_autofree char *slot = g_strdup_printf ("%u", i);
+      if (!glnx_ensure_dir (tmpdir->fd, slot, 0700, error))
+        return FALSE;
+      glnx_autofd int slot_dfd = -1;
+      if (!glnx_opendirat (tmpdir->fd, slot, TRUE, &slot_dfd, error))
+        return FALSE;
+
+      /* See replace_subpath() for the nondir vs dir checkout semantics */
+      OstreeRepoCheckoutAtOptions checkout_opts = { .mode = OSTREE_REPO_CHECKOUT_MODE_NONE,
+                                                    .no_copy_fallback = TRUE,
+                                                    .subpath = entry->path };
+      if (!ostree_repo_checkout_at (repo, &checkout_opts, slot_dfd,
+                                    entry->is_dir ? bname : ".",
+                                    target_csum, cancellable, error))
+        return glnx_prefix_error (error, "Checking out %s", entry->path);
+      if (!swap_into_place (slot_dfd, bname, deployment_dfd, relpath,
+                            cancellable, error))
+        return FALSE;
+    }
+
+  g_autoptr(GFile) target_root = NULL;
+  for (guint i = 0; i < diff->modified->len; i++)
+    {
+      CommitDiffEntry *entry = diff->modified->pdata[i];
+      if (!entry->is_dir)
+        continue;
+      if (!target_root &&
+          !ostree_repo_read_commit (repo, target_csum, &target_root, NULL,
+                                    cancellable, error))
+        return FALSE;
+      if (!apply_dir_metadata (target_root, deployment_dfd, entry->path,
+                               cancellable, error))
+        return FALSE;
+    }
+
+  /* Deepest first; a path that was removed and added changed type, and
+   * swap_into_place() already took care of it. */
+  g_autoptr(GPtrArray) to_remove = g_ptr_array_new ();
+  for (guint i = 0; i < diff->removed->len; i++)
+    {
+      CommitDiffEntry *entry = diff->removed->pdata[i];
+      if (!g_hash_table_contains (added_paths, entry->path))
+        g_ptr_array_add (to_remove, entry);
+    }
+  g_ptr_array_sort (to_remove, compare_swap_order);
+  for (guint i = 0; i < to_remove->len; i++)
+    {
+      CommitDiffEntry *entry = to_remove->pdata[i];
+      if (!glnx_shutil_rm_rf_at (deployment_dfd, entry->path + 1, cancellable, error))
+        return FALSE;
+    }
+
+  if (diff->rpmdb_changed)
+    {
+      if (!replace_subpath (repo, deployment_dfd, tmpdir, target_csum,
+                            "/" RPMOSTREE_RPMDB_LOCATION, cancellable, error))
+        return FALSE;
+    }
+
+  rpmostree_output_message ("Swapped in %u paths, removed %u", to_swap->len, to_remove->len);
+  return TRUE;
+}
+
 /* Update the origin for @booted with new livefs state */
 static gboolean
 write_livefs_state (OstreeSysroot    *sysroot,
@@ -725,14 +1292,20 @@ livefs_transaction_execute_inner (LiveFsTransaction *self,
   print_commit_diff (diff);
 
   const gboolean replacing = (self->flags & RPMOSTREE_TRANSACTION_LIVEFS_FLAG_REPLACE) > 0;
+  const gboolean fine_grained = (self->flags & RPMOSTREE_TRANSACTION_LIVEFS_FLAG_FINE_GRAINED) > 0;
   const gboolean requires_etc_merge = (diff->flags & COMMIT_DIFF_FLAGS_ETC) > 0;
   const gboolean adds_packages = diff->added_pkgs->len > 0;
   const gboolean modifies_packages = diff->removed_pkgs->len > 0 || diff->modified_pkgs_new->len > 0;
   if ((diff->flags & COMMIT_DIFF_FLAGS_ROOTFS) > 0)
     return glnx_throw (error, "livefs update would modify non-/usr content");
+  if (replacing && fine_grained)
+    return glnx_throw (error, "Cannot specify both replace and fine-grained");
+  /* We can swap in new modules, but not the running kernel */
+  if (fine_grained && (diff->flags & COMMIT_DIFF_FLAGS_BOOT) > 0)
+    return glnx_throw (error, "livefs update would change the kernel; cannot apply");
   /* Is this a dry run? */
  /* Error out in various cases if we're not doing a replacement */
-  if (!replacing)
+  if (!replacing && !fine_grained)
     {
       if (!adds_packages)
         return glnx_throw (error, "No packages added; cannot apply");
@@ -753,8 +1326,9 @@ livefs_transaction_execute_inner (LiveFsTransaction *self,
   if (resuming_overlay)
     g_string_append (journal_msg, " (resuming)");
 
-  if (replacing)
-    g_string_append_printf (journal_msg, " replacement; %u/%u/%u pkgs (added, removed, modified); %u/%u/%u files",
+  if (replacing || fine_grained)
+    g_string_append_printf (journal_msg, " %s; %u/%u/%u pkgs (added, removed, modified); %u/%u/%u files",
+                            replacing ? "replacement" : "fine-grained replacement",
                             diff->added_pkgs->len, diff->removed_pkgs->len, diff->modified_pkgs_old->len,
                             diff->added->len, diff->removed->len, diff->modified->len);
   else
@@ -800,7 +1374,16 @@ livefs_transaction_execute_inner (LiveFsTransaction *self,
                        &replace_tmpdir, error))
     return FALSE;
 
-  if (!replacing)
+  if (fine_grained)
+    {
+      g_auto(RpmOstreeProgress) task = { 0, };
+      rpmostree_output_task_begin (&task, "Replacing changed files in /usr");
+      if (!apply_commit_diff (repo, deployment_dfd, &replace_tmpdir,
+                              diff, target_csum,
+                              cancellable, error))
+        return FALSE;
+    }
+  else if (!replacing)
     {
       g_auto(RpmOstreeProgress) task = { 0, };
       rpmostree_output_task_begin (&task, "Overlaying /usr");
@@ -357,7 +357,7 @@ package_diff_transaction_execute (RpmostreedTransaction *transaction,
       if (!apply_revision_override (transaction, repo, progress, origin,
                                     self->revision, cancellable, error))
         return FALSE;
-      rpmostree_transaction_emit_progress_end (RPMOSTREE_TRANSACTION (transaction));
+      rpmostreed_transaction_emit_progress_end (transaction);
     }
   else if (upgrading)
     {
@@ -378,7 +378,7 @@ package_diff_transaction_execute (RpmostreedTransaction *transaction,
                                                0, progress, &changed,
                                                cancellable, error))
       return FALSE;
-    rpmostree_transaction_emit_progress_end (RPMOSTREE_TRANSACTION (transaction));
+    rpmostreed_transaction_emit_progress_end (transaction);
   }
 
   if (!changed)
@@ -809,6 +809,9 @@ deploy_transaction_execute (RpmostreedTransaction *transaction,
    * amount of metadata only to check if there's an upgrade */
   const gboolean download_metadata_only =
     ((self->flags & RPMOSTREE_TRANSACTION_DEPLOY_FLAG_DOWNLOAD_METADATA_ONLY) > 0);
+  /* Used to prepare the layered commit ahead of time, without deploying it */
+  const gboolean assemble_only =
+    ((self->flags & RPMOSTREE_TRANSACTION_DEPLOY_FLAG_ASSEMBLE_ONLY) > 0);
   const gboolean allow_inactive = deploy_has_bool_option (self, "allow-inactive");
 
   gboolean is_install = FALSE;
@@ -848,7 +851,14 @@ deploy_transaction_execute (RpmostreedTransaction *transaction,
       /* special-case the automatic one, otherwise just use verbatim as title */
       const char *title = command_line;
       if (strstr (command_line, "--trigger-automatic-update-policy"))
-        title = download_metadata_only ? "automatic (check)" : "automatic (stage)";
+        {
+          if (download_metadata_only)
+            title = "automatic (check)";
+          else if (assemble_only)
+            title = "automatic (assemble)";
+          else
+            title = "automatic (stage)";
+        }
       rpmostree_transaction_set_title (RPMOSTREE_TRANSACTION (transaction), title);
     }
   else
@@ -900,6 +910,9 @@ deploy_transaction_execute (RpmostreedTransaction *transaction,
    * ever run into these conflicting options */
   if (download_metadata_only)
     g_assert (!(no_pull_base || cache_only || download_only));
+  /* Same for ASSEMBLE_ONLY */
+  if (assemble_only)
+    g_assert (!(no_pull_base || download_only || download_metadata_only));
 
   if (cache_only)
     {
@@ -975,7 +988,7 @@ deploy_transaction_execute (RpmostreedTransaction *transaction,
       if (!ostree_repo_pull (repo, local_repo_uri, (char**)refs_to_fetch,
                              OSTREE_REPO_PULL_FLAGS_NONE, progress, cancellable, error))
         return FALSE;
-      rpmostree_transaction_emit_progress_end (RPMOSTREE_TRANSACTION (transaction));
+      rpmostreed_transaction_emit_progress_end (transaction);
 
       /* as far as the rest of the code is concerned, we're rebasing to :SHA256 now */
       g_clear_pointer (&self->refspec, g_free);
@@ -1000,7 +1013,7 @@ deploy_transaction_execute (RpmostreedTransaction *transaction,
       if (!apply_revision_override (transaction, repo, progress, origin,
                                     self->revision, cancellable, error))
         return FALSE;
-      rpmostree_transaction_emit_progress_end (RPMOSTREE_TRANSACTION (transaction));
+      rpmostreed_transaction_emit_progress_end (transaction);
     }
   else
     {
@@ -1213,7 +1226,7 @@ deploy_transaction_execute (RpmostreedTransaction *transaction,
       if (!rpmostree_sysroot_upgrader_pull_base (upgrader, NULL, flags, progress,
                                                  &base_changed, cancellable, error))
         return FALSE;
-      rpmostree_transaction_emit_progress_end (RPMOSTREE_TRANSACTION (transaction));
+      rpmostreed_transaction_emit_progress_end (transaction);
 
       if (base_changed)
         changed = TRUE;
@@ -1341,6 +1354,30 @@ deploy_transaction_execute (RpmostreedTransaction *transaction,
   /* TODO - better logic for "changed" based on deployments */
   if (changed || self->refspec)
     {
+      /* Note early return; we prepare the layered commit but don't deploy it */
+      if (assemble_only)
+        {
+          g_autofree char *prepared_revision = NULL;
+          if (!rpmostree_sysroot_upgrader_assemble (upgrader, &prepared_revision,
+                                                    cancellable, error))
+            return FALSE;
+          if (prepared_revision)
+            rpmostree_output_message ("Update assembled: %s", prepared_revision);
+          else if (changed)
+            rpmostree_output_message ("Update downloaded.");
+          else
+            rpmostree_output_message ("No changes.");
+
+          /* Like the "check" policy, refresh the cached update */
+          OstreeDeployment *booted_deployment =
+            ostree_sysroot_get_booted_deployment (sysroot);
+          DnfSack *sack = rpmostree_sysroot_upgrader_get_sack (upgrader, error);
+          if (!generate_update_variant (repo, booted_deployment, NULL, sack,
+                                        cancellable, error))
+            return FALSE;
+          return TRUE;
+        }
+
       /* Note early return; we stop short of actually writing the deployment */
       if (self->flags & RPMOSTREE_TRANSACTION_DEPLOY_FLAG_DOWNLOAD_ONLY)
         {
@@ -1918,10 +1955,23 @@ cleanup_transaction_execute (RpmostreedTransaction *transaction,
         {
           rpmostree_output_message ("Deployments unchanged.");
         }
+
+      /* Prepared commits are updates waiting to be deployed; drop them along
+       * with the pending/rollback deployments */
+      g_autoptr(GHashTable) assembled_refs = NULL;
+      if (!ostree_repo_list_refs_ext (repo, RPMOSTREE_ASSEMBLED_REF_PREFIX, &assembled_refs,
+                                      OSTREE_REPO_LIST_REFS_EXT_NONE, cancellable, error))
+        return FALSE;
+      if (g_hash_table_size (assembled_refs) > 0)
+        self->flags |= RPMOSTREE_TRANSACTION_CLEANUP_BASE;
     }
   if (self->flags & RPMOSTREE_TRANSACTION_CLEANUP_BASE)
     {
-      if (!rpmostree_syscore_cleanup (sysroot, repo, cancellable, error))
+      RpmOstreeSyscoreCleanupFlags syscore_flags = RPMOSTREE_SYSCORE_CLEANUP_FLAGS_PRINT_TIMING;
+      if (cleanup_pending || cleanup_rollback)
+        syscore_flags |= RPMOSTREE_SYSCORE_CLEANUP_FLAGS_ASSEMBLED;
+      if (!rpmostree_syscore_cleanup_full (sysroot, repo, syscore_flags,
+                                           cancellable, error))
         return FALSE;
     }
   if (self->flags & RPMOSTREE_TRANSACTION_CLEANUP_REPOMD)
@@ -55,6 +55,7 @@ typedef enum {
   RPMOSTREE_TRANSACTION_DEPLOY_FLAG_DRY_RUN = (1 << 5),
   RPMOSTREE_TRANSACTION_DEPLOY_FLAG_DOWNLOAD_ONLY = (1 << 8),
   RPMOSTREE_TRANSACTION_DEPLOY_FLAG_DOWNLOAD_METADATA_ONLY = (1 << 9),
+  RPMOSTREE_TRANSACTION_DEPLOY_FLAG_ASSEMBLE_ONLY = (1 << 10),
 } RpmOstreeTransactionDeployFlags;
 
 
@@ -105,6 +106,7 @@ rpmostreed_transaction_new_cleanup       (GDBusMethodInvocation *invocation,
 typedef enum {
   RPMOSTREE_TRANSACTION_LIVEFS_FLAG_DRY_RUN = (1 << 0),
   RPMOSTREE_TRANSACTION_LIVEFS_FLAG_REPLACE = (1 << 1),
+  RPMOSTREE_TRANSACTION_LIVEFS_FLAG_FINE_GRAINED = (1 << 2),
 } RpmOstreeTransactionLiveFsFlags;
 
 RpmostreedTransaction *
@@ -26,6 +26,26 @@
 #include "rpmostreed-errors.h"
 #include "rpmostreed-sysroot.h"
 #include "rpmostreed-daemon.h"
+#include "rpmostree-phase-stats.h"
+#include "rpmostree-probes.h"
+#include "rpmostree-sched.h"
+
+/* Progress signals are coalesced per kind: within the configured interval
+ * only the latest state is kept, and it's sent on the next tick after the
+ * interval elapses, before anything else is emitted, or when the flush timer
+ * fires, so clients always see the latest state of a progress bar.
+ */
+typedef enum {
+  PROGRESS_PERCENT,  /* PercentProgress */
+  PROGRESS_DOWNLOAD, /* DownloadProgress, and pull status Messages */
+  N_PROGRESS_KINDS
+} ProgressKind;
+
+typedef struct {
+  gint64 last_emit;
+  const char *pending_name;
+  GVariant *pending;
+} ProgressSlot;
 
 struct _RpmostreedTransactionPrivate {
   GDBusMethodInvocation *invocation;
@@ -45,9 +65,31 @@ struct _RpmostreedTransactionPrivate {
 
   GDBusServer *server;
   GHashTable *peer_connections;
+  /* Subset of the above registered as quiet; see transaction_emit_signal() */
+  GHashTable *quiet_peers;
+  /* The initiating bus client registered as quiet, and hasn't connected yet */
+  gboolean initiator_quiet_pending;
+
+  /* Progress signals are emitted from the worker thread; this guards
+   * the peer tables and the coalescing state below. */
+  GMutex progress_lock;
+  guint64 progress_interval; /* usec; 0 means no rate limit */
+  ProgressSlot progress[N_PROGRESS_KINDS];
+  /* Sends held back progress if no further tick comes; on the main context */
+  GSource *progress_flush_source;
 
   /* For emitting Finished signals to late connections. */
   GVariant *finished_params;
+  /* Likewise, the Statistics signal which precedes it */
+  GVariant *statistics;
+
+  /* Resource accounting; see rpmostreed_transaction_phase_begin() */
+  RpmOstreePhaseStats *phase_stats;
+  guint64 start_time; /* Wall clock, in seconds */
+
+  /* Run at idle IO/CPU priority; see rpmostreed_transaction_set_background() */
+  gboolean background;
+  guint background_import_workers;
 
   guint watch_id;
 };
@@ -117,7 +159,10 @@ transaction_connection_closed_cb (GDBusConnection *connection,
   g_debug ("%s (%p): Client disconnected",
            G_OBJECT_TYPE_NAME (self), self);
 
+  g_mutex_lock (&priv->progress_lock);
+  g_hash_table_remove (priv->quiet_peers, connection);
   g_hash_table_remove (priv->peer_connections, connection);
+  g_mutex_unlock (&priv->progress_lock);
 
   transaction_maybe_emit_closed (self);
 }
@@ -145,10 +190,20 @@ transaction_new_connection_cb (GDBusServer *server,
                            G_CALLBACK (transaction_connection_closed_cb),
                            self, 0);
 
+  g_mutex_lock (&priv->progress_lock);
+  /* Peer connections are private and carry no bus name, so the quiet setting
+   * of the initiating client applies to the first peer: the client connects as
+   * soon as it gets the address back from its method call, before anyone else
+   * is likely to notice the transaction. */
+  const gboolean quiet = priv->initiator_quiet_pending;
+  priv->initiator_quiet_pending = FALSE;
   g_hash_table_add (priv->peer_connections, g_object_ref (connection));
+  if (quiet)
+    g_hash_table_add (priv->quiet_peers, connection);
+  g_mutex_unlock (&priv->progress_lock);
 
-  g_debug ("%s (%p): Client connected",
-           G_OBJECT_TYPE_NAME (self), self);
+  g_debug ("%s (%p): Client connected%s",
+           G_OBJECT_TYPE_NAME (self), self, quiet ? " (quiet)" : "");
 
   return TRUE;
 }
@@ -172,9 +227,159 @@ transaction_owner_vanished_cb (GDBusConnection *connection,
     }
 }
 
+/* Emit @signal_name on every peer connection. Quiet peers only get task
+ * boundaries (@boundary is %TRUE); this is why we bypass the skeleton's
+ * emitters, which broadcast to all connections. Called with progress_lock held.
+ */
+static void
+transaction_emit_signal_locked (RpmostreedTransaction *self,
+                                const char            *signal_name,
+                                GVariant              *params,
+                                gboolean               boundary)
+{
+  RpmostreedTransactionPrivate *priv = rpmostreed_transaction_get_private (self);
+  g_autoptr(GVariant) owned_params = g_variant_ref_sink (params);
+
+  GLNX_HASH_TABLE_FOREACH (priv->peer_connections, GDBusConnection*, connection)
+    {
+      if (!boundary && g_hash_table_contains (priv->quiet_peers, connection))
+        continue;
+      /* Errors here just mean the peer went away; we'll get a closed signal */
+      (void) g_dbus_connection_emit_signal (connection, NULL, "/",
+                                            "org.projectatomic.rpmostree1.Transaction",
+                                            signal_name, owned_params, NULL);
+    }
+}
+
+/* Send out any progress state held back by the rate limit */
+static void
+transaction_flush_progress_locked (RpmostreedTransaction *self)
+{
+  RpmostreedTransactionPrivate *priv = rpmostreed_transaction_get_private (self);
+
+  for (guint i = 0; i < N_PROGRESS_KINDS; i++)
+    {
+      ProgressSlot *slot = &priv->progress[i];
+      if (!slot->pending)
+        continue;
+      g_autoptr(GVariant) pending = g_steal_pointer (&slot->pending);
+      transaction_emit_signal_locked (self, slot->pending_name, pending, FALSE);
+      slot->last_emit = g_get_monotonic_time ();
+    }
+}
+
+static gboolean
+transaction_progress_flush_cb (gpointer user_data)
+{
+  RpmostreedTransaction *self = user_data;
+  RpmostreedTransactionPrivate *priv = rpmostreed_transaction_get_private (self);
+
+  g_mutex_lock (&priv->progress_lock);
+  g_clear_pointer (&priv->progress_flush_source, g_source_unref);
+  transaction_flush_progress_locked (self);
+  g_mutex_unlock (&priv->progress_lock);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+transaction_emit_signal (RpmostreedTransaction *self,
+                         const char            *signal_name,
+                         GVariant              *params,
+                         gboolean               boundary)
+{
+  RpmostreedTransactionPrivate *priv = rpmostreed_transaction_get_private (self);
+
+  g_mutex_lock (&priv->progress_lock);
+  transaction_flush_progress_locked (self);
+  transaction_emit_signal_locked (self, signal_name, params, boundary);
+  g_mutex_unlock (&priv->progress_lock);
+}
+
+/* Rate-limited emission of a progress signal of @kind; unless @force is set,
+ * ticks arriving faster than the configured interval replace each other.
+ */
+static void
+transaction_emit_progress (RpmostreedTransaction *self,
+                           ProgressKind           kind,
+                           const char            *signal_name,
+                           GVariant              *params,
+                           gboolean               force)
+{
+  RpmostreedTransactionPrivate *priv = rpmostreed_transaction_get_private (self);
+  ProgressSlot *slot = &priv->progress[kind];
+  const gint64 now = g_get_monotonic_time ();
+
+  g_mutex_lock (&priv->progress_lock);
+  if (!force && priv->progress_interval > 0 &&
+      now - slot->last_emit < (gint64) priv->progress_interval)
+    {
+      g_clear_pointer (&slot->pending, g_variant_unref);
+      slot->pending_name = signal_name;
+      slot->pending = g_variant_ref_sink (params);
+
+      /* Don't leave it stale if this was the last tick for a while */
+      if (!priv->progress_flush_source)
+        {
+          const gint64 remaining = priv->progress_interval - (now - slot->last_emit);
+          priv->progress_flush_source = g_timeout_source_new (MAX (remaining / 1000, 1));
+          g_source_set_callback (priv->progress_flush_source, transaction_progress_flush_cb,
+                                 g_object_ref (self), g_object_unref);
+          g_source_attach (priv->progress_flush_source, NULL);
+        }
+    }
+  else
+    {
+      g_clear_pointer (&slot->pending, g_variant_unref);
+      transaction_emit_signal_locked (self, signal_name, params, FALSE);
+      slot->last_emit = now;
+    }
+  g_mutex_unlock (&priv->progress_lock);
+}
+
+/* The wrappers below replace the skeleton's rpmostree_transaction_emit_*()
+ * for the informational signals. */
+void
+rpmostreed_transaction_emit_message (RpmostreedTransaction *self,
+                                     const char            *text)
+{
+  transaction_emit_signal (self, "Message", g_variant_new ("(s)", text), FALSE);
+}
+
+void
+rpmostreed_transaction_emit_task_begin (RpmostreedTransaction *self,
+                                        const char            *text)
+{
+  transaction_emit_signal (self, "TaskBegin", g_variant_new ("(s)", text), TRUE);
+}
+
+void
+rpmostreed_transaction_emit_task_end (RpmostreedTransaction *self,
+                                      const char            *text)
+{
+  transaction_emit_signal (self, "TaskEnd", g_variant_new ("(s)", text), TRUE);
+}
+
+void
+rpmostreed_transaction_emit_percent_progress (RpmostreedTransaction *self,
+                                              const char            *text,
+                                              guint                  percentage)
+{
+  /* Always send the start and end of a bar */
+  const gboolean force = (percentage == 0 || percentage >= 100);
+  transaction_emit_progress (self, PROGRESS_PERCENT, "PercentProgress",
+                             g_variant_new ("(su)", text, percentage), force);
+}
+
+void
+rpmostreed_transaction_emit_progress_end (RpmostreedTransaction *self)
+{
+  transaction_emit_signal (self, "ProgressEnd", g_variant_new ("()"), TRUE);
+}
+
 static void
 transaction_progress_changed_cb (OstreeAsyncProgress *progress,
-                                 RPMOSTreeTransaction *transaction)
+                                 RpmostreedTransaction *transaction)
 {
   guint64 start_time = ostree_async_progress_get_uint64 (progress, "start-time");
   guint64 elapsed_secs = 0;
@@ -209,7 +414,8 @@ transaction_progress_changed_cb (OstreeAsyncProgress *progress,
   /* If there is a status that is all we output */
   status = ostree_async_progress_get_status (progress);
   if (status) {
-    rpmostree_transaction_emit_message (transaction, g_strdup (status));
+    transaction_emit_progress (transaction, PROGRESS_DOWNLOAD, "Message",
+                               g_variant_new ("(s)", status), FALSE);
     return;
   }
 
@@ -247,21 +453,23 @@ transaction_progress_changed_cb (OstreeAsyncProgress *progress,
                                 bytes_transferred,
                                 bytes_sec);
 
-  /* This sinks the floating GVariant refs (I think...). */
-  rpmostree_transaction_emit_download_progress (transaction,
-                                                arg_time,
-                                                arg_outstanding,
-                                                arg_metadata,
-                                                arg_delta,
-                                                arg_content,
-                                                arg_transfer);
+  /* This sinks the floating GVariant refs */
+  transaction_emit_progress (transaction, PROGRESS_DOWNLOAD, "DownloadProgress",
+                             g_variant_new ("(@(tt)@(uu)@(uuu)@(uuut)@(uu)@(tt))",
+                                            arg_time,
+                                            arg_outstanding,
+                                            arg_metadata,
+                                            arg_delta,
+                                            arg_content,
+                                            arg_transfer),
+                             FALSE);
 }
 
 static void
 transaction_gpg_verify_result_cb (OstreeRepo *repo,
                                   const char *checksum,
                                   OstreeGpgVerifyResult *result,
-                                  RPMOSTreeTransaction *transaction)
+                                  RpmostreedTransaction *transaction)
 {
   guint n, i;
   GVariantBuilder builder;
@@ -276,9 +484,87 @@ transaction_gpg_verify_result_cb (OstreeRepo *repo,
       ostree_gpg_verify_result_get_all (result, i));
     }
 
-  rpmostree_transaction_emit_signature_progress (transaction,
-                                                 g_variant_builder_end (&builder),
-                                                 g_strdup (checksum));
+  transaction_emit_signal (transaction, "SignatureProgress",
+                           g_variant_new ("(@avs)", g_variant_builder_end (&builder),
+                                          checksum),
+                           FALSE);
+}
+
+/* Start accounting wall clock time and resource usage against @name; this is
+ * driven by rpmostree_output_phase_begin() via the sysroot output callback.
+ */
+void
+rpmostreed_transaction_phase_begin (RpmostreedTransaction *self,
+                                    const char            *name)
+{
+  RpmostreedTransactionPrivate *priv = rpmostreed_transaction_get_private (self);
+  if (priv->phase_stats)
+    rpmostree_phase_stats_begin (priv->phase_stats, name);
+}
+
+void
+rpmostreed_transaction_phase_end (RpmostreedTransaction *self,
+                                  const char            *name)
+{
+  RpmostreedTransactionPrivate *priv = rpmostreed_transaction_get_private (self);
+  if (priv->phase_stats)
+    rpmostree_phase_stats_end (priv->phase_stats, name);
+}
+
+/* Driven by rpmostree_output_counter(), like phases */
+void
+rpmostreed_transaction_add_counter (RpmostreedTransaction *self,
+                                    const char            *name,
+                                    guint64                value)
+{
+  RpmostreedTransactionPrivate *priv = rpmostreed_transaction_get_private (self);
+  if (priv->phase_stats)
+    rpmostree_phase_stats_add_counter (priv->phase_stats, name, value);
+}
+
+/* Build the a{sv} emitted in the Statistics signal and recorded in the
+ * sysroot's RecentTransactions. */
+static GVariant *
+transaction_build_statistics (RpmostreedTransaction *self,
+                              gboolean               success)
+{
+  RpmostreedTransactionPrivate *priv = rpmostreed_transaction_get_private (self);
+
+  g_autoptr(GVariant) usage = g_variant_ref_sink (rpmostree_phase_stats_to_variant (priv->phase_stats));
+  g_autoptr(GVariantDict) dict = g_variant_dict_new (usage);
+  g_variant_dict_insert (dict, "method", "s",
+                         g_dbus_method_invocation_get_method_name (priv->invocation));
+  g_variant_dict_insert (dict, "path", "s",
+                         g_dbus_method_invocation_get_object_path (priv->invocation));
+  g_variant_dict_insert (dict, "client", "s", priv->client_description ?: "");
+  g_variant_dict_insert (dict, "success", "b", success);
+  g_variant_dict_insert (dict, "start-time", "t", priv->start_time);
+  g_variant_dict_insert (dict, "background", "b", priv->background);
+  return g_variant_ref_sink (g_variant_dict_end (dict));
+}
+
+/* Log the statistics as structured journal fields, for aggregation */
+static void
+transaction_log_statistics (RpmostreedTransaction *self)
+{
+  RpmostreedTransactionPrivate *priv = rpmostreed_transaction_get_private (self);
+  RpmOstreeUsage usage;
+  rpmostree_phase_stats_get_total (priv->phase_stats, &usage);
+  g_autofree char *phases_summary = rpmostree_phase_stats_to_summary (priv->phase_stats);
+
+  const char *method = g_dbus_method_invocation_get_method_name (priv->invocation);
+  sd_journal_send ("MESSAGE=Txn %s on %s took %" G_GUINT64_FORMAT "ms",
+                   method, g_dbus_method_invocation_get_object_path (priv->invocation),
+                   usage.elapsed_usec / 1000,
+                   "TXN_METHOD=%s", method,
+                   "TXN_ELAPSED_MS=%" G_GUINT64_FORMAT, usage.elapsed_usec / 1000,
+                   "TXN_UTIME_MS=%" G_GUINT64_FORMAT, usage.utime_usec / 1000,
+                   "TXN_STIME_MS=%" G_GUINT64_FORMAT, usage.stime_usec / 1000,
+                   "TXN_INBLOCK=%" G_GUINT64_FORMAT, usage.inblock,
+                   "TXN_OUBLOCK=%" G_GUINT64_FORMAT, usage.oublock,
+                   "TXN_MAXRSS_KB=%" G_GUINT64_FORMAT, usage.maxrss_kb,
+                   "TXN_PHASES_MS=%s", phases_summary,
+                   NULL);
 }
 
 static void
@@ -301,9 +587,27 @@ transaction_execute_thread (GTask *task,
    */
   g_main_context_push_thread_default (mctx);
 
+  priv->start_time = g_get_real_time () / G_USEC_PER_SEC;
+  priv->phase_stats = rpmostree_phase_stats_new ();
+
+  /* There's only ever one transaction executing, so it owns the policy */
+  rpmostree_sched_set_background (priv->background, priv->background_import_workers);
+  rpmostree_sched_thread_enter ();
+  RPMOSTREE_PROBE2 (txn__start, g_dbus_method_invocation_get_method_name (priv->invocation),
+                    g_dbus_method_invocation_get_object_path (priv->invocation));
+
   if (class->execute != NULL)
     success = class->execute (self, cancellable, &local_error);
 
+  rpmostree_sched_thread_leave ();
+  rpmostree_sched_set_background (FALSE, 0);
+
+  rpmostree_phase_stats_finish (priv->phase_stats);
+  RpmOstreeUsage usage;
+  rpmostree_phase_stats_get_total (priv->phase_stats, &usage);
+  RPMOSTREE_PROBE3 (txn__done, g_dbus_method_invocation_get_method_name (priv->invocation),
+                    local_error == NULL && success, usage.elapsed_usec);
+
   if (local_error != NULL)
     {
       /* Also log to journal in addition to the client, so it's recorded
@@ -363,6 +667,18 @@ transaction_execute_done_cb (GObject *source_object,
            success ? "" : error_message,
            success ? "" : ")");
 
+  /* Emitted just before Finished (rather than as part of it) so that
+   * existing clients of the (bs) Finished signature keep working. */
+  /* Any progress state held back by the rate limit goes out first */
+  g_mutex_lock (&priv->progress_lock);
+  transaction_flush_progress_locked (self);
+  g_mutex_unlock (&priv->progress_lock);
+
+  priv->statistics = transaction_build_statistics (self, success);
+  transaction_log_statistics (self);
+  rpmostreed_sysroot_record_txn_statistics (rpmostreed_sysroot_get (), priv->statistics);
+  rpmostree_transaction_emit_statistics (RPMOSTREE_TRANSACTION (self), priv->statistics);
+
   rpmostree_transaction_emit_finished (RPMOSTREE_TRANSACTION (self),
                                        success, error_message);
 
@@ -438,7 +754,17 @@ transaction_dispose (GObject *object)
   RpmostreedTransaction *self = RPMOSTREED_TRANSACTION (object);
   RpmostreedTransactionPrivate *priv = rpmostreed_transaction_get_private (self);
 
+  g_mutex_lock (&priv->progress_lock);
+  g_hash_table_remove_all (priv->quiet_peers);
   g_hash_table_remove_all (priv->peer_connections);
+  for (guint i = 0; i < N_PROGRESS_KINDS; i++)
+    g_clear_pointer (&priv->progress[i].pending, g_variant_unref);
+  if (priv->progress_flush_source)
+    {
+      g_source_destroy (priv->progress_flush_source);
+      g_clear_pointer (&priv->progress_flush_source, g_source_unref);
+    }
+  g_mutex_unlock (&priv->progress_lock);
 
   g_clear_object (&priv->invocation);
   g_clear_object (&priv->cancellable);
@@ -447,6 +773,7 @@ transaction_dispose (GObject *object)
   g_clear_pointer (&priv->sysroot_path, g_free);
 
   g_clear_pointer (&priv->finished_params, (GDestroyNotify) g_variant_unref);
+  g_clear_pointer (&priv->statistics, (GDestroyNotify) g_variant_unref);
 
   G_OBJECT_CLASS (rpmostreed_transaction_parent_class)->dispose (object);
 }
@@ -465,10 +792,14 @@ transaction_finalize (GObject *object)
   if (priv->watch_id > 0)
     g_bus_unwatch_name (priv->watch_id);
 
+  g_hash_table_destroy (priv->quiet_peers);
   g_hash_table_destroy (priv->peer_connections);
+  g_mutex_clear (&priv->progress_lock);
 
   g_free (priv->client_description);
 
+  g_clear_pointer (&priv->phase_stats, rpmostree_phase_stats_free);
+
   G_OBJECT_CLASS (rpmostreed_transaction_parent_class)->finalize (object);
 }
 
@@ -501,6 +832,8 @@ transaction_constructed (GObject *object)
                                                        NULL);
 
       priv->client_description = rpmostreed_daemon_client_get_string (rpmostreed_daemon_get(), sender);
+      priv->initiator_quiet_pending =
+        rpmostreed_daemon_client_is_quiet (rpmostreed_daemon_get (), sender);
       rpmostree_transaction_set_initiating_client_description ((RPMOSTreeTransaction*)self, priv->client_description);
     }
 }
@@ -521,7 +854,10 @@ rpmostreed_transaction_force_close (RpmostreedTransaction *transaction)
   RpmostreedTransactionPrivate *priv = rpmostreed_transaction_get_private (transaction);
   g_assert (priv->executed);
   g_dbus_server_stop (priv->server);
+  g_mutex_lock (&priv->progress_lock);
+  g_hash_table_remove_all (priv->quiet_peers);
   g_hash_table_foreach_remove (priv->peer_connections, foreach_close_peer, NULL);
+  g_mutex_unlock (&priv->progress_lock);
 }
 
 static void
@@ -529,7 +865,7 @@ on_sysroot_journal_msg (OstreeSysroot *sysroot,
                         const char    *msg,
                         void          *opaque)
 {
-  rpmostree_transaction_emit_message (RPMOSTREE_TRANSACTION (opaque), msg);
+  rpmostreed_transaction_emit_message (RPMOSTREED_TRANSACTION (opaque), msg);
 }
 
 
@@ -672,6 +1008,15 @@ transaction_handle_start (RPMOSTreeTransaction *transaction,
       object_path = g_dbus_method_invocation_get_object_path (invocation);
       interface_name = g_dbus_method_invocation_get_interface_name (invocation);
 
+      if (priv->statistics != NULL)
+        g_dbus_connection_emit_signal (connection,
+                                       NULL,
+                                       object_path,
+                                       interface_name,
+                                       "Statistics",
+                                       g_variant_new ("(@a{sv})", priv->statistics),
+                                       NULL);
+
       g_dbus_connection_emit_signal (connection,
                                      NULL,
                                      object_path,
@@ -775,6 +1120,11 @@ rpmostreed_transaction_init (RpmostreedTransaction *self)
                                                         g_direct_equal,
                                                         g_object_unref,
                                                         NULL);
+  /* Borrows the refs held by peer_connections */
+  self->priv->quiet_peers = g_hash_table_new (g_direct_hash, g_direct_equal);
+  g_mutex_init (&self->priv->progress_lock);
+  self->priv->progress_interval =
+    rpmostreed_get_progress_signal_interval (rpmostreed_daemon_get ());
 }
 
 gboolean
@@ -835,6 +1185,21 @@ rpmostreed_transaction_get_client_address (RpmostreedTransaction *transaction)
   return g_dbus_server_get_client_address (priv->server);
 }
 
+/* Run the transaction at idle IO priority and low CPU priority, with a cap on
+ * parallel package imports (BackgroundImportWorkers=). This covers the
+ * transaction thread, our import and relabel workers, and scripts and dracut.
+ * Must be called before the transaction is started.
+ */
+void
+rpmostreed_transaction_set_background (RpmostreedTransaction *transaction,
+                                       gboolean               background)
+{
+  RpmostreedTransactionPrivate *priv = rpmostreed_transaction_get_private (transaction);
+  priv->background = background;
+  priv->background_import_workers =
+    rpmostreed_get_background_import_workers (rpmostreed_daemon_get ());
+}
+
 gboolean
 rpmostreed_transaction_is_compatible (RpmostreedTransaction *transaction,
                                       GDBusMethodInvocation *invocation)
@@ -58,3 +58,23 @@ void            rpmostreed_transaction_connect_signature_progress
                                                            (RpmostreedTransaction *transaction,
                                                             OstreeRepo *repo);
 void            rpmostreed_transaction_force_close         (RpmostreedTransaction *transaction);
+void            rpmostreed_transaction_set_background      (RpmostreedTransaction *transaction,
+                                                            gboolean background);
+void            rpmostreed_transaction_phase_begin         (RpmostreedTransaction *transaction,
+                                                            const char *name);
+void            rpmostreed_transaction_phase_end           (RpmostreedTransaction *transaction,
+                                                            const char *name);
+void            rpmostreed_transaction_add_counter         (RpmostreedTransaction *transaction,
+                                                            const char *name,
+                                                            guint64 value);
+void            rpmostreed_transaction_emit_message        (RpmostreedTransaction *transaction,
+                                                            const char *text);
+void            rpmostreed_transaction_emit_task_begin     (RpmostreedTransaction *transaction,
+                                                            const char *text);
+void            rpmostreed_transaction_emit_task_end       (RpmostreedTransaction *transaction,
+                                                            const char *text);
+void            rpmostreed_transaction_emit_percent_progress
+                                                           (RpmostreedTransaction *transaction,
+                                                            const char *text,
+                                                            guint percentage);
+void            rpmostreed_transaction_emit_progress_end   (RpmostreedTransaction *transaction);
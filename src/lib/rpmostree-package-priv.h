@@ -29,6 +29,11 @@ RpmOstreePackage * _rpm_ostree_package_new (RpmOstreeRefSack *rsack, DnfPackage
 
 RpmOstreePackage * _rpm_ostree_package_new_from_variant (GVariant *gv_nevra);
 
+guint64 _rpm_ostree_package_get_installsize (RpmOstreePackage *p);
+guint64 _rpm_ostree_package_get_buildtime (RpmOstreePackage *p);
+const char *_rpm_ostree_package_get_sourcerpm (RpmOstreePackage *p);
+const char *_rpm_ostree_package_get_digest (RpmOstreePackage *p);
+
 gboolean
 _rpm_ostree_package_list_for_commit (OstreeRepo   *repo,
                                      const char   *rev,
@@ -47,14 +47,16 @@ struct RpmOstreePackage
   /* libdnf-based pkg */
   RpmOstreeRefSack *sack;
   DnfPackage *hypkg;
-  /* gvariant-based pkg */
+  /* gvariant-based pkg; either an rpmdb.pkglist or an rpmdb.pkgindex entry */
   GVariant *gv_nevra;
+  gboolean gv_is_index_entry;
   /* deconstructed/cached values */
   char *nevra;
   const char *name;
   const char *evr;
   char *evr_owned;
   const char *arch;
+  char *digest;
 };
 
 G_DEFINE_TYPE(RpmOstreePackage, rpm_ostree_package, G_TYPE_OBJECT)
@@ -69,6 +71,7 @@ rpm_ostree_package_finalize (GObject *object)
 
   g_clear_pointer (&pkg->nevra, g_free);
   g_clear_pointer (&pkg->evr_owned, g_free);
+  g_clear_pointer (&pkg->digest, g_free);
 
   G_OBJECT_CLASS (rpm_ostree_package_parent_class)->finalize (object);
 }
@@ -199,7 +202,14 @@ _rpm_ostree_package_new_from_variant (GVariant *gv_nevra)
   const char *version;
   const char *release;
 
-  g_variant_get (p->gv_nevra, "(&s&s&s&s&s)", &p->name, &epoch, &version, &release, &p->arch);
+  /* pkgindex entries extend the pkglist (sssss) tuple */
+  p->gv_is_index_entry =
+    g_variant_is_of_type (p->gv_nevra, (GVariantType*)RPMOSTREE_PKGINDEX_ENTRY_FORMAT);
+  g_variant_get_child (p->gv_nevra, 0, "&s", &p->name);
+  g_variant_get_child (p->gv_nevra, 1, "&s", &epoch);
+  g_variant_get_child (p->gv_nevra, 2, "&s", &version);
+  g_variant_get_child (p->gv_nevra, 3, "&s", &release);
+  g_variant_get_child (p->gv_nevra, 4, "&s", &p->arch);
   /* we follow the libdnf convention here of explicit 0 --> skip over */
   g_assert (epoch);
   if (g_str_equal (epoch, "0"))
@@ -211,6 +221,69 @@ _rpm_ostree_package_new_from_variant (GVariant *gv_nevra)
   return p;
 }
 
+/* Installed size in bytes, or 0 if unknown (i.e. backed by a pkglist from an
+ * older commit). */
+guint64
+_rpm_ostree_package_get_installsize (RpmOstreePackage *p)
+{
+  if (p->hypkg)
+    return dnf_package_get_installsize (p->hypkg);
+  if (!p->gv_is_index_entry)
+    return 0;
+  guint64 v;
+  g_variant_get_child (p->gv_nevra, 5, "t", &v);
+  return v;
+}
+
+/* Build time, or 0 if unknown. */
+guint64
+_rpm_ostree_package_get_buildtime (RpmOstreePackage *p)
+{
+  if (p->hypkg)
+    return dnf_package_get_buildtime (p->hypkg);
+  if (!p->gv_is_index_entry)
+    return 0;
+  guint64 v;
+  g_variant_get_child (p->gv_nevra, 6, "t", &v);
+  return v;
+}
+
+/* Source RPM filename, or %NULL if unknown. */
+const char *
+_rpm_ostree_package_get_sourcerpm (RpmOstreePackage *p)
+{
+  const char *v = NULL;
+  if (p->hypkg)
+    v = dnf_package_get_sourcerpm (p->hypkg);
+  else if (p->gv_is_index_entry)
+    g_variant_get_child (p->gv_nevra, 7, "&s", &v);
+  return (v && *v) ? v : NULL;
+}
+
+/* Header digest in TYPE:HASH form, or %NULL if unknown. */
+const char *
+_rpm_ostree_package_get_digest (RpmOstreePackage *p)
+{
+  if (p->hypkg && !p->digest)
+    {
+      int chksum_type;
+      const unsigned char *chksum_raw = dnf_package_get_hdr_chksum (p->hypkg, &chksum_type);
+      if (chksum_raw)
+        {
+          g_autofree char *chksum = hy_chksum_str (chksum_raw, chksum_type);
+          p->digest = g_strconcat (hy_chksum_name (chksum_type), ":", chksum, NULL);
+        }
+    }
+  else if (p->gv_is_index_entry && !p->digest)
+    {
+      const char *v;
+      g_variant_get_child (p->gv_nevra, 8, "&s", &v);
+      if (*v)
+        p->digest = g_strdup (v);
+    }
+  return p->digest;
+}
+
 static GVariant*
 get_commit_rpmdb_pkglist (GVariant *commit)
 {
@@ -236,8 +309,8 @@ query_all_packages_in_sack (RpmOstreeRefSack *rsack)
   return g_steal_pointer (&result);
 }
 
-/* Opportunistically try to use the new rpmostree.rpmdb.pkglist metadata, otherwise fall
- * back to commit rpmdb if available.
+/* Opportunistically try to use the rpmostree.rpmdb.pkgindex metadata, then the older
+ * rpmostree.rpmdb.pkglist metadata, otherwise fall back to commit rpmdb if available.
  *
  * Let's keep this private for now.
  */
@@ -258,7 +331,13 @@ _rpm_ostree_package_list_for_commit (OstreeRepo   *repo,
   if (!ostree_repo_load_variant (repo, OSTREE_OBJECT_TYPE_COMMIT, checksum, &commit, error))
     return FALSE;
 
-  g_autoptr(GVariant) pkglist_v = get_commit_rpmdb_pkglist (commit);
+  /* both are sorted, and index entries extend the pkglist tuple */
+  g_autoptr(GVariant) pkglist_v = NULL;
+  g_autoptr(GVariant) pkgindex = rpmostree_commit_get_pkgindex (commit);
+  if (pkgindex)
+    pkglist_v = g_variant_get_child_value (pkgindex, 1);
+  else
+    pkglist_v = get_commit_rpmdb_pkglist (commit);
   if (!pkglist_v)
     {
       /* file-based rpmdb fallback; let fail if rpmdb not available */
@@ -20,6 +20,7 @@
 
 #include "config.h"
 #include "rpmostree-bwrap.h"
+#include "rpmostree-sched.h"
 
 #include <err.h>
 #include <stdio.h>
@@ -393,6 +394,8 @@ bwrap_child_setup (gpointer data)
   if (fchdir (bwrap->rootfs_fd) < 0)
     err (1, "fchdir");
 
+  rpmostree_sched_child_setup ();
+
   if (bwrap->child_setup_func)
     bwrap->child_setup_func (bwrap->child_setup_data);
 }
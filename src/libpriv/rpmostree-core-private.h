@@ -23,6 +23,7 @@
 #include "libglnx.h"
 #include "rpmostree-rojig-core.h"
 #include "rpmostree-core.h"
+#include "rpmostree-selabel-cache.h"
 
 struct _RpmOstreeContext {
   GObject parent;
@@ -51,12 +52,19 @@ struct _RpmOstreeContext {
   OstreeRepoDevInoCache *devino_cache;
   gboolean unprivileged;
   OstreeSePolicy *sepolicy;
+  /* Label lookups against @sepolicy, shared by imports, relabeling and commit */
+  RpmOstreeSeLabelCache *selabel_cache;
   char *passwd_dir;
   /* Used in async imports, not owned */
-  GVariant *rojig_xattr_table;
+  GPtrArray *rojig_xattr_table;
   GHashTable *rojig_pkg_to_xattrs;
 
   guint async_index; /* Offset into array if applicable */
+  /* When streaming, the packages that are ready to import; see
+   * rpmostree_context_download_import_rojig() */
+  GPtrArray *async_pkgs_ready;
+  gboolean async_downloading;
+  GMutex *async_dnf_lock; /* Held while the download thread is in libdnf */
   guint n_async_running;
   guint n_async_max;
   gboolean async_running;
@@ -64,11 +72,15 @@ struct _RpmOstreeContext {
   GError *async_error;
   GPtrArray *pkgs; /* All packages */
   GPtrArray *pkgs_to_download;
+  guint64 download_size; /* Total bytes fetched by rpmostree_context_download() */
   GPtrArray *pkgs_to_import;
   guint n_async_pkgs_imported;
   GPtrArray *pkgs_to_relabel;
   guint n_async_pkgs_relabeled;
 
+  GHashTable *pkgcache_index; /* cachebranch --> RpmOstreePkgCacheEntry; see find_pkg_in_ostree() */
+  guint64 pkgcache_index_build_ms;
+
   GHashTable *pkgs_to_remove;  /* pkgname --> gv_nevra */
   GHashTable *pkgs_to_replace; /* new gv_nevra --> old gv_nevra */
 
@@ -81,6 +93,7 @@ struct _RpmOstreeContext {
 
   int tmprootfs_dfd; /* Borrowed */
   GHashTable *rootfs_usrlinks;
+  GHashTable *script_timings; /* pkgname --> guint64* cumulative usec */
   GLnxTmpDir repo_tmpdir; /* Used to assemble+commit if no base rootfs provided */
 };
 
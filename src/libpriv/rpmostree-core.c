@@ -41,6 +41,8 @@
 #include "rpmostree-kernel.h"
 #include "rpmostree-importer.h"
 #include "rpmostree-output.h"
+#include "rpmostree-probes.h"
+#include "rpmostree-sched.h"
 
 #define RPMOSTREE_MESSAGE_COMMIT_STATS SD_ID128_MAKE(e6,37,2e,38,41,21,42,a9,bc,13,b6,32,b3,f8,93,44)
 #define RPMOSTREE_MESSAGE_SELINUX_RELABEL SD_ID128_MAKE(5a,e0,56,34,f2,d7,49,3b,b1,58,79,b7,0c,02,e6,5d)
@@ -342,6 +344,7 @@ rpmostree_context_finalize (GObject *object)
   g_clear_pointer (&rctx->devino_cache, (GDestroyNotify)ostree_repo_devino_cache_unref);
 
   g_clear_object (&rctx->sepolicy);
+  g_clear_pointer (&rctx->selabel_cache, rpmostree_selabel_cache_unref);
 
   g_clear_pointer (&rctx->passwd_dir, g_free);
 
@@ -349,6 +352,7 @@ rpmostree_context_finalize (GObject *object)
   g_clear_pointer (&rctx->pkgs_to_download, g_ptr_array_unref);
   g_clear_pointer (&rctx->pkgs_to_import, g_ptr_array_unref);
   g_clear_pointer (&rctx->pkgs_to_relabel, g_ptr_array_unref);
+  g_clear_pointer (&rctx->pkgcache_index, g_hash_table_unref);
 
   g_clear_pointer (&rctx->pkgs_to_remove, g_hash_table_unref);
   g_clear_pointer (&rctx->pkgs_to_replace, g_hash_table_unref);
@@ -359,6 +363,7 @@ rpmostree_context_finalize (GObject *object)
   (void)glnx_tmpdir_delete (&rctx->repo_tmpdir, NULL, NULL);
 
   g_clear_pointer (&rctx->rootfs_usrlinks, g_hash_table_unref);
+  g_clear_pointer (&rctx->script_timings, g_hash_table_unref);
 
   G_OBJECT_CLASS (rpmostree_context_parent_class)->finalize (object);
 }
@@ -562,6 +567,21 @@ rpmostree_context_set_sepolicy (RpmOstreeContext *self,
                                 OstreeSePolicy   *sepolicy)
 {
   g_set_object (&self->sepolicy, sepolicy);
+  if (!sepolicy)
+    g_clear_pointer (&self->selabel_cache, rpmostree_selabel_cache_unref);
+  else if (!self->selabel_cache || !rpmostree_selabel_cache_matches (self->selabel_cache, sepolicy))
+    {
+      g_clear_pointer (&self->selabel_cache, rpmostree_selabel_cache_unref);
+      self->selabel_cache = rpmostree_selabel_cache_new (sepolicy);
+    }
+}
+
+/* Returns: (transfer none) (nullable): Label lookups against the policy
+ * set via rpmostree_context_set_sepolicy() */
+RpmOstreeSeLabelCache *
+rpmostree_context_get_selabel_cache (RpmOstreeContext *self)
+{
+  return self->selabel_cache;
 }
 
 void
@@ -1298,27 +1318,6 @@ get_pkgcache_repodata_chksum_repr (GVariant    *commit,
   return TRUE;
 }
 
-static gboolean
-commit_has_matching_repodata_chksum_repr (GVariant    *commit,
-                                          const char  *expected,
-                                          gboolean    *out_matches,
-                                          GError     **error)
-{
-  g_autofree char *chksum_repr = NULL;
-  if (!get_pkgcache_repodata_chksum_repr (commit, &chksum_repr, TRUE, error))
-    return FALSE;
-
-  /* never match pkgs unpacked with older versions that didn't embed chksum_repr */
-  if (chksum_repr == NULL)
-    {
-      *out_matches = FALSE;
-      return TRUE;
-    }
-
-  *out_matches = g_str_equal (expected, chksum_repr);
-  return TRUE;
-}
-
 static gboolean
 pkg_is_cached (DnfPackage *pkg)
 {
@@ -1335,6 +1334,127 @@ pkg_is_cached (DnfPackage *pkg)
   return g_file_test (dnf_package_get_filename (pkg), G_FILE_TEST_EXISTS);
 }
 
+/* The bits of a pkgcache commit that find_pkg_in_ostree() needs */
+typedef struct {
+  char *checksum;
+  gboolean loaded;
+  gboolean partial;
+  gboolean nodocs;
+  char *repodata_chksum_repr; /* May be NULL for old imports */
+  char *sepolicy_csum;        /* May be NULL for e.g. local pkgs without policy */
+} RpmOstreePkgCacheEntry;
+
+static void
+pkgcache_entry_free (RpmOstreePkgCacheEntry *entry)
+{
+  g_free (entry->checksum);
+  g_free (entry->repodata_chksum_repr);
+  g_free (entry->sepolicy_csum);
+  g_free (entry);
+}
+
+static gboolean
+pkgcache_entry_load (OstreeRepo             *repo,
+                     const char             *cachebranch,
+                     RpmOstreePkgCacheEntry *entry,
+                     GError                **error)
+{
+  if (entry->loaded)
+    return TRUE;
+
+  const char *errprefix = glnx_strjoina ("Loading pkgcache branch ", cachebranch);
+  GLNX_AUTO_PREFIX_ERROR (errprefix, error);
+
+  g_autoptr(GVariant) commit = NULL;
+  OstreeRepoCommitState commitstate;
+  if (!ostree_repo_load_commit (repo, entry->checksum, &commit, &commitstate, error))
+    return FALSE;
+  g_assert (commit);
+
+  /* If the commit is partial, then we need to redownload. This can happen if e.g. corrupted
+   * commit objects were deleted with `ostree fsck --delete`. */
+  entry->partial = (commitstate & OSTREE_REPO_COMMIT_STATE_PARTIAL) > 0;
+
+  g_autoptr(GVariant) metadata = g_variant_get_child_value (commit, 0);
+  g_autoptr(GVariantDict) metadata_dict = g_variant_dict_new (metadata);
+  if (!g_variant_dict_lookup (metadata_dict, "rpmostree.nodocs", "b", &entry->nodocs))
+    entry->nodocs = FALSE;
+  g_variant_dict_lookup (metadata_dict, "rpmostree.repodata_checksum", "s",
+                         &entry->repodata_chksum_repr);
+  g_variant_dict_lookup (metadata_dict, "rpmostree.sepolicy", "s", &entry->sepolicy_csum);
+
+  entry->loaded = TRUE;
+  return TRUE;
+}
+
+/* Build the in-memory pkgcache index from a single listing of the pkgcache
+ * refs, and load the metadata of the cached commits for @packages up front.
+ * Queries for other packages load lazily. The index is dropped whenever we
+ * write to the pkgcache; see invalidate_pkgcache_index().
+ */
+static gboolean
+ensure_pkgcache_index (RpmOstreeContext *self,
+                       GPtrArray        *packages,
+                       GCancellable     *cancellable,
+                       GError          **error)
+{
+  OstreeRepo *repo = get_pkgcache_repo (self);
+  /* NB: we're not using a pkgcache yet in the compose path */
+  if (repo == NULL || self->pkgcache_index)
+    return TRUE;
+
+  GLNX_AUTO_PREFIX_ERROR ("Building pkgcache index", error);
+  g_auto(RpmOstreePhase) phase = { 0, };
+  rpmostree_output_phase_begin (&phase, "pkgcache-index");
+  const guint64 start_time_ms = g_get_monotonic_time () / 1000;
+
+  g_autoptr(GHashTable) refs = NULL;
+  if (!ostree_repo_list_refs_ext (repo, self->rojig_spec ? "rpmostree/rojig" : "rpmostree/pkg",
+                                  &refs, OSTREE_REPO_LIST_REFS_EXT_NONE, cancellable, error))
+    return FALSE;
+
+  g_autoptr(GHashTable) index =
+    g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                           (GDestroyNotify)pkgcache_entry_free);
+  GLNX_HASH_TABLE_FOREACH_IT (refs, it, char*, ref, char*, checksum)
+    {
+      RpmOstreePkgCacheEntry *entry = g_new0 (RpmOstreePkgCacheEntry, 1);
+      entry->checksum = g_strdup (checksum);
+      g_hash_table_insert (index, g_strdup (ref), entry);
+    }
+
+  guint n_loaded = 0;
+  for (guint i = 0; packages && i < packages->len; i++)
+    {
+      DnfPackage *pkg = packages->pdata[i];
+      g_autofree char *cachebranch = self->rojig_spec ?
+        rpmostree_get_rojig_branch_pkg (pkg) : rpmostree_get_cache_branch_pkg (pkg);
+      RpmOstreePkgCacheEntry *entry = g_hash_table_lookup (index, cachebranch);
+      if (!entry || entry->loaded)
+        continue;
+      if (!pkgcache_entry_load (repo, cachebranch, entry, error))
+        return FALSE;
+      n_loaded++;
+    }
+
+  self->pkgcache_index = g_steal_pointer (&index);
+  self->pkgcache_index_build_ms = g_get_monotonic_time () / 1000 - start_time_ms;
+  sd_journal_send ("MESSAGE=Built pkgcache index in %" G_GUINT64_FORMAT "ms",
+                   self->pkgcache_index_build_ms,
+                   "PKGCACHE_INDEX_BUILD_MS=%" G_GUINT64_FORMAT, self->pkgcache_index_build_ms,
+                   "PKGCACHE_INDEX_N_REFS=%u", g_hash_table_size (self->pkgcache_index),
+                   "PKGCACHE_INDEX_N_LOADED=%u", n_loaded,
+                   NULL);
+  return TRUE;
+}
+
+/* Must be called before writing new pkgcache refs */
+static void
+invalidate_pkgcache_index (RpmOstreeContext *self)
+{
+  g_clear_pointer (&self->pkgcache_index, g_hash_table_unref);
+}
+
 /* Given @pkg, return its state in the pkgcache repo. It could be not present,
  * or present but have been imported with a different SELinux policy version
  * (and hence in need of relabeling).
@@ -1357,34 +1477,21 @@ find_pkg_in_ostree (RpmOstreeContext *self,
   if (repo == NULL)
     return TRUE; /* Note early return */
 
-  g_autofree char *cachebranch = self->rojig_spec ?
-      rpmostree_get_rojig_branch_pkg (pkg) : rpmostree_get_cache_branch_pkg (pkg);
-  g_autofree char *cached_rev = NULL;
-  if (!ostree_repo_resolve_rev (repo, cachebranch, TRUE,
-                                &cached_rev, error))
+  if (!ensure_pkgcache_index (self, NULL, NULL, error))
     return FALSE;
 
-  if (!cached_rev)
+  g_autofree char *cachebranch = self->rojig_spec ?
+      rpmostree_get_rojig_branch_pkg (pkg) : rpmostree_get_cache_branch_pkg (pkg);
+  RpmOstreePkgCacheEntry *entry = g_hash_table_lookup (self->pkgcache_index, cachebranch);
+  if (!entry)
     return TRUE; /* Note early return */
 
-  /* Below here prefix with the branch */
-  const char *errprefix = glnx_strjoina ("Loading pkgcache branch ", cachebranch);
-  GLNX_AUTO_PREFIX_ERROR (errprefix, error);
-
-  g_autoptr(GVariant) commit = NULL;
-  OstreeRepoCommitState commitstate;
-  if (!ostree_repo_load_commit (repo, cached_rev, &commit, &commitstate, error))
+  if (!pkgcache_entry_load (repo, cachebranch, entry, error))
     return FALSE;
-  g_assert (commit);
 
-  /* If the commit is partial, then we need to redownload. This can happen if e.g. corrupted
-   * commit objects were deleted with `ostree fsck --delete`. */
-  if (commitstate & OSTREE_REPO_COMMIT_STATE_PARTIAL)
+  if (entry->partial)
     return TRUE; /* Note early return */
 
-  g_autoptr(GVariant) metadata = g_variant_get_child_value (commit, 0);
-  g_autoptr(GVariantDict) metadata_dict = g_variant_dict_new (metadata);
-
   /* NB: we do an exception for LocalPackages here; we've already checked that
    * its cache is valid and matches what's in the origin. We never want to fetch
    * newer versions of LocalPackages from the repos. But we do want to check
@@ -1398,13 +1505,9 @@ find_pkg_in_ostree (RpmOstreeContext *self,
                                                error))
         return FALSE;
 
-      gboolean same_pkg_chksum = FALSE;
-      if (!commit_has_matching_repodata_chksum_repr (commit,
-                                                     expected_chksum_repr,
-                                                     &same_pkg_chksum, error))
-        return FALSE;
-
-      if (!same_pkg_chksum)
+      /* never match pkgs unpacked with older versions that didn't embed chksum_repr */
+      if (!entry->repodata_chksum_repr ||
+          !g_str_equal (expected_chksum_repr, entry->repodata_chksum_repr))
         return TRUE; /* Note early return */
 
       /* We need to handle things like the nodocs flag changing; in that case we
@@ -1414,14 +1517,10 @@ find_pkg_in_ostree (RpmOstreeContext *self,
       g_variant_dict_lookup (self->spec->dict, "documentation", "b", &global_docs);
       const gboolean global_nodocs = !global_docs;
 
-      gboolean pkgcache_commit_is_nodocs;
-      if (!g_variant_dict_lookup (metadata_dict, "rpmostree.nodocs", "b", &pkgcache_commit_is_nodocs))
-        pkgcache_commit_is_nodocs = FALSE;
-
       /* We treat a mismatch of documentation state as simply not being
        * imported at all.
        */
-      if (global_nodocs != pkgcache_commit_is_nodocs)
+      if (global_nodocs != entry->nodocs)
         return TRUE;
     }
 
@@ -1429,9 +1528,13 @@ find_pkg_in_ostree (RpmOstreeContext *self,
   *out_in_ostree = TRUE;
   if (sepolicy)
     {
-      if (!commit_has_matching_sepolicy (commit, sepolicy,
-                                         out_selinux_match, error))
-        return FALSE;
+      const char *sepolicy_csum_wanted = ostree_sepolicy_get_csum (sepolicy);
+      if (!sepolicy_csum_wanted)
+        return glnx_throw (error, "SELinux enabled, but no policy found");
+      if (!entry->sepolicy_csum)
+        return glnx_throw (error, "Loading pkgcache branch %s: Failed to find metadata key rpmostree.sepolicy",
+                           cachebranch);
+      *out_selinux_match = g_str_equal (entry->sepolicy_csum, sepolicy_csum_wanted);
     }
 
   return TRUE;
@@ -1456,6 +1559,10 @@ sort_packages (RpmOstreeContext *self,
   self->pkgs_to_relabel = g_ptr_array_new_with_free_func ((GDestroyNotify)g_object_unref);
   self->n_async_pkgs_relabeled = 0;
 
+  /* One listing of the pkgcache refs, rather than a lookup per package */
+  if (!ensure_pkgcache_index (self, packages, cancellable, error))
+    return FALSE;
+
   GPtrArray *sources = dnf_context_get_repos (dnfctx);
   for (guint i = 0; i < packages->len; i++)
     {
@@ -1940,6 +2047,9 @@ rpmostree_context_prepare (RpmOstreeContext *self,
 {
   g_assert (!self->empty);
 
+  g_auto(RpmOstreePhase) phase = { 0, };
+  rpmostree_output_phase_begin (&phase, "depsolve");
+
   DnfContext *dnfctx = self->dnfctx;
   g_autofree char **pkgnames = NULL;
   g_autofree char **exclude_packages = NULL;
@@ -2262,6 +2372,29 @@ rpmostree_context_get_packages_to_import (RpmOstreeContext *self)
   return g_ptr_array_ref (self->pkgs_to_import);
 }
 
+/* Returns the number of bytes fetched by rpmostree_context_download() */
+guint64
+rpmostree_context_get_download_size (RpmOstreeContext *self)
+{
+  return self->download_size;
+}
+
+/* Returns: (transfer floating): a{st} of package name to the wall-clock time
+ * in microseconds spent running its scripts during assembly.
+ */
+GVariant *
+rpmostree_context_get_script_timings (RpmOstreeContext *self)
+{
+  g_auto(GVariantBuilder) builder;
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{st}"));
+  if (self->script_timings)
+    {
+      GLNX_HASH_TABLE_FOREACH_KV (self->script_timings, const char*, name, guint64*, usec)
+        g_variant_builder_add (&builder, "{st}", name, *usec);
+    }
+  return g_variant_builder_end (&builder);
+}
+
 /* Note this must be called *before* rpmostree_context_setup(). */
 void
 rpmostree_context_set_vlockmap (RpmOstreeContext *self,
@@ -2420,10 +2553,14 @@ rpmostree_context_download (RpmOstreeContext *self,
         dnf_package_array_get_download_size (self->pkgs_to_download);
       g_autofree char *sizestr = g_format_size (size);
       rpmostree_output_message ("Will download: %u package%s (%s)", n, _NS(n), sizestr);
+      self->download_size = size;
     }
   else
     return TRUE;
 
+  g_auto(RpmOstreePhase) phase = { 0, };
+  rpmostree_output_phase_begin (&phase, "download");
+
   { guint progress_sigid;
     g_autoptr(GHashTable) source_to_packages = gather_source_to_packages (self);
     GLNX_HASH_TABLE_FOREACH_KV (source_to_packages, DnfRepo*, src, GPtrArray*, src_packages)
@@ -2502,7 +2639,9 @@ on_async_import_done (GObject                    *obj,
   self->n_async_pkgs_imported++;
   g_assert_cmpint (self->n_async_running, >, 0);
   self->n_async_running--;
-  rpmostree_output_progress_n_items (self->n_async_pkgs_imported);
+  /* While streaming, the progress bar is the download's until it's done */
+  if (!self->async_downloading)
+    rpmostree_output_progress_n_items (self->n_async_pkgs_imported);
   async_imports_mainctx_iter (self);
 }
 
@@ -2554,6 +2693,8 @@ start_async_import_one_package (RpmOstreeContext *self, DnfPackage *pkg,
       g_assert (!self->sepolicy);
       rpmostree_importer_set_rojig_mode (unpacker, self->rojig_xattr_table, rojig_xattrs);
     }
+  else if (self->selabel_cache)
+    rpmostree_importer_set_selabel_cache (unpacker, self->selabel_cache);
 
   rpmostree_importer_run_async (unpacker, cancellable, on_async_import_done, self);
 
@@ -2569,11 +2710,21 @@ async_imports_mainctx_iter (gpointer user_data)
 {
   RpmOstreeContext *self = user_data;
 
-  while (self->async_index < self->pkgs_to_import->len &&
+  GPtrArray *pkgs = self->async_pkgs_ready ?: self->pkgs_to_import;
+  gboolean have_dnf_lock = FALSE;
+  while (self->async_index < pkgs->len &&
          self->n_async_running < self->n_async_max &&
          self->async_error == NULL)
     {
-      DnfPackage *pkg = self->pkgs_to_import->pdata[self->async_index];
+      /* If the download thread is in libdnf, we'll be called again once it's
+       * done with the current repo; don't block the main loop on it. */
+      if (self->async_dnf_lock && !have_dnf_lock)
+        {
+          if (!g_mutex_trylock (self->async_dnf_lock))
+            break;
+          have_dnf_lock = TRUE;
+        }
+      DnfPackage *pkg = pkgs->pdata[self->async_index];
       if (!start_async_import_one_package (self, pkg, self->async_cancellable, &self->async_error))
         {
           g_cancellable_cancel (self->async_cancellable);
@@ -2582,8 +2733,11 @@ async_imports_mainctx_iter (gpointer user_data)
       self->async_index++;
       self->n_async_running++;
     }
+  if (have_dnf_lock)
+    g_mutex_unlock (self->async_dnf_lock);
 
-  if (self->n_async_running == 0)
+  /* If we're streaming, more packages may still arrive */
+  if (self->n_async_running == 0 && !self->async_downloading)
     {
       self->async_running = FALSE;
       g_main_context_wakeup (g_main_context_get_thread_default ());
@@ -2592,12 +2746,173 @@ async_imports_mainctx_iter (gpointer user_data)
   return FALSE;
 }
 
-gboolean
-rpmostree_context_import_rojig (RpmOstreeContext *self,
-                                GVariant         *rojig_xattr_table,
-                                GHashTable       *rojig_pkg_to_xattrs,
-                                GCancellable     *cancellable,
-                                GError          **error)
+/* Downloads for rpmostree_context_download_import_rojig() are done on a
+ * separate thread, one dnf_repo_download_packages() call per repo so that
+ * librepo keeps all its parallel downloads; each repo's packages are handed
+ * to the importers as soon as they land.  libdnf isn't thread-safe, so the
+ * thread holds @dnf_lock while it's in there, and the main thread doesn't
+ * start imports (which use libdnf) while it's held.  All output is done from
+ * the main thread: each repo gets a progress bar as rpmostree_context_download()
+ * would show, then the import one takes over once all downloads are done.
+ */
+typedef struct {
+  RpmOstreeContext *self;
+  GMainContext *mainctx;
+  GHashTable *source_to_packages;
+  GCancellable *cancellable;
+  GMutex dnf_lock;
+  /* Main thread only */
+  RpmOstreePhase phase;
+  RpmOstreeProgress *progress;
+} StreamingDownload;
+
+typedef enum {
+  STREAMING_DOWNLOAD_REPO_BEGIN,
+  STREAMING_DOWNLOAD_REPO_PROGRESS,
+  STREAMING_DOWNLOAD_REPO_END,
+  STREAMING_DOWNLOAD_DONE,
+} StreamingDownloadEventType;
+
+typedef struct {
+  StreamingDownload *dl;
+  StreamingDownloadEventType type;
+  char *repo_id; /* REPO_BEGIN */
+  guint percentage; /* REPO_PROGRESS */
+  GPtrArray *pkgs; /* REPO_END */
+  GError *error; /* DONE */
+} StreamingDownloadEvent;
+
+static void
+streaming_download_event_free (StreamingDownloadEvent *event)
+{
+  g_free (event->repo_id);
+  g_clear_pointer (&event->pkgs, (GDestroyNotify)g_ptr_array_unref);
+  g_clear_error (&event->error);
+  g_free (event);
+}
+
+/* Runs on the main thread */
+static gboolean
+on_streaming_download_event (gpointer user_data)
+{
+  StreamingDownloadEvent *event = user_data;
+  StreamingDownload *dl = event->dl;
+  RpmOstreeContext *self = dl->self;
+  switch (event->type)
+    {
+    case STREAMING_DOWNLOAD_REPO_BEGIN:
+      rpmostree_output_progress_percent_begin (dl->progress, "Downloading from '%s'",
+                                               event->repo_id);
+      break;
+    case STREAMING_DOWNLOAD_REPO_PROGRESS:
+      rpmostree_output_progress_percent (event->percentage);
+      break;
+    case STREAMING_DOWNLOAD_REPO_END:
+      rpmostree_output_progress_end (dl->progress);
+      for (guint i = 0; i < event->pkgs->len; i++)
+        g_ptr_array_add (self->async_pkgs_ready, event->pkgs->pdata[i]);
+      break;
+    case STREAMING_DOWNLOAD_DONE:
+      rpmostree_output_progress_end (dl->progress);
+      rpmostree_output_phase_end (&dl->phase);
+      self->async_downloading = FALSE;
+      if (event->error && !self->async_error)
+        self->async_error = g_steal_pointer (&event->error);
+      /* Now show how far along the imports are */
+      rpmostree_output_progress_nitems_begin (dl->progress, self->pkgs_to_import->len,
+                                              "Importing packages");
+      rpmostree_output_progress_n_items (self->n_async_pkgs_imported);
+      break;
+    }
+  /* The download thread may have released the libdnf lock */
+  async_imports_mainctx_iter (self);
+  return FALSE;
+}
+
+static void
+streaming_download_post (StreamingDownload         *dl,
+                         StreamingDownloadEventType type,
+                         StreamingDownloadEvent    *event)
+{
+  event->dl = dl;
+  event->type = type;
+  g_main_context_invoke_full (dl->mainctx, G_PRIORITY_DEFAULT, on_streaming_download_event,
+                              event, (GDestroyNotify)streaming_download_event_free);
+}
+
+/* Runs on the download thread */
+static void
+on_streaming_download_percentage (DnfState   *hifstate,
+                                  guint       percentage,
+                                  gpointer    user_data)
+{
+  StreamingDownload *dl = user_data;
+  StreamingDownloadEvent *event = g_new0 (StreamingDownloadEvent, 1);
+  event->percentage = percentage;
+  streaming_download_post (dl, STREAMING_DOWNLOAD_REPO_PROGRESS, event);
+}
+
+static gboolean
+streaming_download_run (StreamingDownload *dl,
+                        GError           **error)
+{
+  GLNX_HASH_TABLE_FOREACH_KV (dl->source_to_packages, DnfRepo*, src, GPtrArray*, src_packages)
+    {
+      /* Stop early if an import failed or we were cancelled */
+      if (g_cancellable_set_error_if_cancelled (dl->cancellable, error))
+        return FALSE;
+
+      glnx_unref_object DnfState *hifstate = dnf_state_new ();
+      dnf_state_set_cancellable (hifstate, dl->cancellable);
+      g_signal_connect (hifstate, "percentage-changed",
+                        G_CALLBACK (on_streaming_download_percentage), dl);
+
+      g_mutex_lock (&dl->dnf_lock);
+      StreamingDownloadEvent *begin = g_new0 (StreamingDownloadEvent, 1);
+      begin->repo_id = g_strdup (dnf_repo_get_id (src));
+      streaming_download_post (dl, STREAMING_DOWNLOAD_REPO_BEGIN, begin);
+      g_autofree char *target_dir = g_build_filename (dnf_repo_get_location (src), "/packages/", NULL);
+      gboolean downloaded =
+        glnx_shutil_mkdir_p_at (AT_FDCWD, target_dir, 0755, dl->cancellable, error) &&
+        dnf_repo_download_packages (src, src_packages, target_dir, hifstate, error);
+      g_mutex_unlock (&dl->dnf_lock);
+      if (!downloaded)
+        return FALSE;
+
+      StreamingDownloadEvent *end = g_new0 (StreamingDownloadEvent, 1);
+      end->pkgs = g_ptr_array_ref (src_packages);
+      streaming_download_post (dl, STREAMING_DOWNLOAD_REPO_END, end);
+    }
+  return TRUE;
+}
+
+static gpointer
+streaming_download_thread (gpointer data)
+{
+  StreamingDownload *dl = data;
+  rpmostree_sched_thread_enter ();
+  StreamingDownloadEvent *done = g_new0 (StreamingDownloadEvent, 1);
+  (void) streaming_download_run (dl, &done->error);
+  /* And tell the main thread we're done */
+  streaming_download_post (dl, STREAMING_DOWNLOAD_DONE, done);
+  rpmostree_sched_thread_leave ();
+  return NULL;
+}
+
+static void
+on_caller_cancelled (GCancellable *cancellable,
+                     gpointer      user_data)
+{
+  g_cancellable_cancel (user_data);
+}
+
+static gboolean
+import_packages (RpmOstreeContext *self,
+                 GPtrArray        *rojig_xattr_table,
+                 GHashTable       *rojig_pkg_to_xattrs,
+                 gboolean          stream_downloads,
+                 GCancellable     *cancellable,
+                 GError          **error)
 {
   DnfContext *dnfctx = self->dnfctx;
   const int n = self->pkgs_to_import->len;
@@ -2610,6 +2925,10 @@ rpmostree_context_import_rojig (RpmOstreeContext *self,
   if (!dnf_transaction_import_keys (dnf_context_get_transaction (dnfctx), error))
     return FALSE;
 
+  g_auto(RpmOstreePhase) phase = { 0, };
+  rpmostree_output_phase_begin (&phase, "import");
+
+  invalidate_pkgcache_index (self);
   g_auto(RpmOstreeRepoAutoTransaction) txn = { 0, };
   /* Note use of commit-on-failure */
   if (!rpmostree_repo_auto_transaction_start (&txn, repo, TRUE, cancellable, error))
@@ -2620,15 +2939,59 @@ rpmostree_context_import_rojig (RpmOstreeContext *self,
   self->async_running = TRUE;
   self->async_index = 0;
   self->n_async_running = 0;
-  /* We're CPU bound, so just use processors */
-  self->n_async_max = g_get_num_processors ();
+  /* We're CPU bound, so just use processors; unless we're in the background */
+  self->n_async_max = rpmostree_sched_get_max_workers (g_get_num_processors ());
   self->async_cancellable = cancellable;
 
   g_auto(RpmOstreeProgress) progress = { 0, };
-  rpmostree_output_progress_nitems_begin (&progress, self->pkgs_to_import->len, "Importing packages");
+  if (!stream_downloads)
+    rpmostree_output_progress_nitems_begin (&progress, self->pkgs_to_import->len,
+                                            "Importing packages");
 
-  /* Process imports */
   GMainContext *mainctx = g_main_context_get_thread_default ();
+
+  /* If streaming, start with the packages that don't need downloading (e.g.
+   * local RPMs) and let the download thread feed us the rest.  Both sides use
+   * our own cancellable, chained to the caller's, so that a failed import
+   * also stops the download.
+   */
+  g_autoptr(GPtrArray) pkgs_ready = NULL;
+  g_autoptr(GCancellable) stream_cancellable = NULL;
+  gulong cancelled_id = 0;
+  StreamingDownload dl = { 0, };
+  GThread *download_thread = NULL;
+  if (stream_downloads)
+    {
+      g_autoptr(GHashTable) to_download = g_hash_table_new (NULL, NULL);
+      for (guint i = 0; i < self->pkgs_to_download->len; i++)
+        g_hash_table_add (to_download, self->pkgs_to_download->pdata[i]);
+      pkgs_ready = g_ptr_array_new ();
+      for (guint i = 0; i < self->pkgs_to_import->len; i++)
+        {
+          DnfPackage *pkg = self->pkgs_to_import->pdata[i];
+          if (!g_hash_table_contains (to_download, pkg))
+            g_ptr_array_add (pkgs_ready, pkg);
+        }
+      self->async_pkgs_ready = pkgs_ready;
+
+      stream_cancellable = g_cancellable_new ();
+      if (cancellable)
+        cancelled_id = g_cancellable_connect (cancellable, G_CALLBACK (on_caller_cancelled),
+                                              stream_cancellable, NULL);
+      self->async_cancellable = stream_cancellable;
+      dl.self = self;
+      dl.mainctx = mainctx;
+      dl.source_to_packages = gather_source_to_packages (self);
+      dl.cancellable = stream_cancellable;
+      dl.progress = &progress;
+      g_mutex_init (&dl.dnf_lock);
+      self->async_dnf_lock = &dl.dnf_lock;
+      self->async_downloading = TRUE;
+      rpmostree_output_phase_begin (&dl.phase, "download");
+      download_thread = g_thread_new ("rpmostree-download", streaming_download_thread, &dl);
+    }
+
+  /* Process imports */
   { g_autoptr(GSource) src = g_timeout_source_new (0);
     g_source_set_priority (src, G_PRIORITY_HIGH);
     g_source_set_callback (src, async_imports_mainctx_iter, self, NULL);
@@ -2637,7 +3000,24 @@ rpmostree_context_import_rojig (RpmOstreeContext *self,
 
   self->async_error = NULL;
   while (self->async_running)
-    g_main_context_iteration (mainctx, TRUE);
+    {
+      /* Stop downloading if something failed */
+      if (stream_cancellable && self->async_error)
+        g_cancellable_cancel (stream_cancellable);
+      g_main_context_iteration (mainctx, TRUE);
+    }
+  if (download_thread)
+    {
+      /* We only stop once it's posted that it's done */
+      g_thread_join (download_thread);
+      g_cancellable_disconnect (cancellable, cancelled_id);
+      g_hash_table_unref (dl.source_to_packages);
+      g_mutex_clear (&dl.dnf_lock);
+      rpmostree_output_phase_end (&dl.phase);
+      self->async_dnf_lock = NULL;
+      self->async_pkgs_ready = NULL;
+      self->async_cancellable = NULL;
+    }
   if (self->async_error)
     {
       g_propagate_error (error, g_steal_pointer (&self->async_error));
@@ -2645,6 +3025,8 @@ rpmostree_context_import_rojig (RpmOstreeContext *self,
     }
 
   rpmostree_output_progress_end (&progress);
+  if (self->selabel_cache)
+    rpmostree_selabel_cache_report (self->selabel_cache);
 
   if (!ostree_repo_commit_transaction (repo, NULL, cancellable, error))
     return FALSE;
@@ -2658,6 +3040,45 @@ rpmostree_context_import_rojig (RpmOstreeContext *self,
   return TRUE;
 }
 
+gboolean
+rpmostree_context_import_rojig (RpmOstreeContext *self,
+                                GPtrArray        *rojig_xattr_table,
+                                GHashTable       *rojig_pkg_to_xattrs,
+                                GCancellable     *cancellable,
+                                GError          **error)
+{
+  return import_packages (self, rojig_xattr_table, rojig_pkg_to_xattrs, FALSE,
+                          cancellable, error);
+}
+
+/* Like rpmostree_context_download() followed by
+ * rpmostree_context_import_rojig(), but imports each repo's packages as soon
+ * as they land rather than waiting for all of them.
+ */
+gboolean
+rpmostree_context_download_import_rojig (RpmOstreeContext *self,
+                                         GPtrArray        *rojig_xattr_table,
+                                         GHashTable       *rojig_pkg_to_xattrs,
+                                         GCancellable     *cancellable,
+                                         GError          **error)
+{
+  const guint n = self->pkgs_to_download->len;
+  if (n == 0 || self->pkgs_to_import->len == 0)
+    {
+      if (!rpmostree_context_download (self, cancellable, error))
+        return FALSE;
+      return rpmostree_context_import_rojig (self, rojig_xattr_table, rojig_pkg_to_xattrs,
+                                             cancellable, error);
+    }
+
+  self->download_size = dnf_package_array_get_download_size (self->pkgs_to_download);
+  g_autofree char *sizestr = g_format_size (self->download_size);
+  rpmostree_output_message ("Will download: %u package%s (%s)", n, _NS(n), sizestr);
+
+  return import_packages (self, rojig_xattr_table, rojig_pkg_to_xattrs, TRUE,
+                          cancellable, error);
+}
+
 gboolean
 rpmostree_context_import (RpmOstreeContext *self,
                           GCancellable     *cancellable,
@@ -2939,11 +3360,14 @@ checkout_package_into_root (RpmOstreeContext *self,
         }
     }
 
+  RPMOSTREE_PROBE1 (checkout__start, dnf_package_get_nevra (pkg));
   if (!checkout_package (pkgcache_repo, dfd, path,
                          devino_cache, pkg_commit, files_skip, ovwmode,
                          !self->enable_rofiles,
                          cancellable, error))
     return glnx_prefix_error (error, "Checkout %s", dnf_package_get_nevra (pkg));
+  RPMOSTREE_PROBE2 (checkout__done, dnf_package_get_nevra (pkg),
+                    dnf_package_get_installsize (pkg));
 
   return TRUE;
 }
@@ -3151,6 +3575,36 @@ break_hardlinks_at (int             dfd,
   return TRUE;
 }
 
+/* Used as an xattr callback when committing a checked out tree with a label
+ * cache; like what libostree does with a policy set on the modifier, we
+ * take the xattrs from disk and replace the label.
+ */
+typedef struct {
+  RpmOstreeSeLabelCache *cache;
+  int dfd;
+  const char *prefix;
+  GError *error;
+} CachedLabelData;
+
+static GVariant *
+cached_label_xattr_cb (OstreeRepo  *repo,
+                       const char  *path,
+                       GFileInfo   *file_info,
+                       gpointer     user_data)
+{
+  CachedLabelData *data = user_data;
+  if (data->error)
+    return NULL;
+
+  g_autofree char *relpath = g_strconcat (data->prefix, path, NULL);
+  g_autoptr(GVariant) xattrs = NULL;
+  if (!glnx_dfd_name_get_all_xattrs (data->dfd, relpath, &xattrs, NULL, &data->error))
+    return NULL;
+  const guint32 mode = g_file_info_get_attribute_uint32 (file_info, "unix::mode");
+  return rpmostree_selabel_cache_label_xattrs (data->cache, path, mode, xattrs,
+                                               FALSE, &data->error);
+}
+
 typedef struct {
   int tmpdir_dfd;
   const char *name;
@@ -3175,6 +3629,7 @@ relabel_in_thread_impl (RpmOstreeContext *self,
   const char *errmsg = glnx_strjoina ("Relabeling ", nevra);
   GLNX_AUTO_PREFIX_ERROR (errmsg, error);
   const char *pkg_dirname = nevra;
+  RPMOSTREE_PROBE1 (relabel__start, nevra);
 
   OstreeRepo *repo = get_pkgcache_repo (self);
   g_autofree char *cachebranch = rpmostree_get_cache_branch_for_n_evr_a (name, evr, arch);
@@ -3202,12 +3657,22 @@ relabel_in_thread_impl (RpmOstreeContext *self,
     ostree_repo_commit_modifier_new (OSTREE_REPO_COMMIT_MODIFIER_FLAGS_CONSUME,
                                        NULL, NULL, NULL);
   ostree_repo_commit_modifier_set_devino_cache (modifier, cache);
-  ostree_repo_commit_modifier_set_sepolicy (modifier, self->sepolicy);
+  CachedLabelData label_data = { self->selabel_cache, tmpdir_dfd, pkg_dirname, NULL };
+  if (self->selabel_cache)
+    ostree_repo_commit_modifier_set_xattr_callback (modifier, cached_label_xattr_cb,
+                                                    NULL, &label_data);
+  else
+    ostree_repo_commit_modifier_set_sepolicy (modifier, self->sepolicy);
 
   g_autoptr(OstreeMutableTree) mtree = ostree_mutable_tree_new ();
   if (!ostree_repo_write_dfd_to_mtree (repo, tmpdir_dfd, pkg_dirname, mtree,
                                        modifier, cancellable, error))
     return glnx_prefix_error (error, "Writing dfd");
+  if (label_data.error)
+    {
+      g_propagate_error (error, label_data.error);
+      return FALSE;
+    }
 
   g_autoptr(GFile) root = NULL;
   if (!ostree_repo_write_mtree (repo, mtree, &root, cancellable, error))
@@ -3246,6 +3711,7 @@ relabel_in_thread_impl (RpmOstreeContext *self,
 
   /* Return whether or not we actually changed content */
   *out_changed = !g_str_equal (orig_content_checksum, new_content_checksum);
+  RPMOSTREE_PROBE2 (relabel__done, nevra, *out_changed);
 
   return TRUE;
 }
@@ -3261,12 +3727,14 @@ relabel_in_thread (GTask            *task,
   RelabelTaskData *tdata = task_data;
 
   gboolean changed = FALSE;
+  rpmostree_sched_thread_enter ();
   if (!relabel_in_thread_impl (self, tdata->name, tdata->evr, tdata->arch,
                                tdata->tmpdir_dfd, &changed,
                                cancellable, &local_error))
     g_task_return_error (task, g_steal_pointer (&local_error));
   else
     g_task_return_int (task, changed ? 1 : 0);
+  rpmostree_sched_thread_leave ();
 }
 
 static void
@@ -3349,7 +3817,11 @@ relabel_if_necessary (RpmOstreeContext *self,
 
   g_return_val_if_fail (ostreerepo != NULL, FALSE);
 
+  g_auto(RpmOstreePhase) phase = { 0, };
+  rpmostree_output_phase_begin (&phase, "relabel");
+
   /* Prep a txn and tmpdir for all of the relabels */
+  invalidate_pkgcache_index (self);
   g_auto(RpmOstreeRepoAutoTransaction) txn = { 0, };
   if (!rpmostree_repo_auto_transaction_start (&txn, ostreerepo, FALSE, cancellable, error))
     return FALSE;
@@ -3385,6 +3857,8 @@ relabel_if_necessary (RpmOstreeContext *self,
     }
 
   rpmostree_output_progress_end (&progress);
+  if (self->selabel_cache)
+    rpmostree_selabel_cache_report (self->selabel_cache);
 
   /* Commit */
   if (!ostree_repo_commit_transaction (ostreerepo, NULL, cancellable, error))
@@ -3415,6 +3889,9 @@ rpmostree_context_force_relabel (RpmOstreeContext *self,
                                                          DNF_PACKAGE_INFO_UPDATE,
                                                          DNF_PACKAGE_INFO_DOWNGRADE, -1);
 
+  if (!ensure_pkgcache_index (self, packages, cancellable, error))
+    return FALSE;
+
   for (guint i = 0; i < packages->len; i++)
     {
       DnfPackage *pkg = packages->pdata[i];
@@ -3550,6 +4027,7 @@ static gboolean
 run_script_sync (RpmOstreeContext *self,
                  int rootfs_dfd,
                  GLnxTmpDir *var_lib_rpm_statedir,
+                 const char *selinux_policy_cachedir,
                  DnfPackage *pkg,
                  RpmOstreeScriptKind kind,
                  guint        *out_n_run,
@@ -3562,10 +4040,28 @@ run_script_sync (RpmOstreeContext *self,
   if (!get_package_metainfo (self, path, &hdr, NULL, error))
     return FALSE;
 
+  const guint n_run_before = *out_n_run;
+  const guint64 start_time = g_get_monotonic_time ();
   if (!rpmostree_script_run_sync (pkg, hdr, kind, rootfs_dfd, var_lib_rpm_statedir,
-                                  self->enable_rofiles, out_n_run, cancellable, error))
+                                  selinux_policy_cachedir, self->enable_rofiles,
+                                  out_n_run, cancellable, error))
     return FALSE;
 
+  /* Only account packages which actually had a script of this kind */
+  if (*out_n_run > n_run_before)
+    {
+      if (!self->script_timings)
+        self->script_timings = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+      const char *name = dnf_package_get_name (pkg);
+      guint64 *usec = g_hash_table_lookup (self->script_timings, name);
+      if (!usec)
+        {
+          usec = g_new0 (guint64, 1);
+          g_hash_table_insert (self->script_timings, g_strdup (name), usec);
+        }
+      *usec += g_get_monotonic_time () - start_time;
+    }
+
   return TRUE;
 }
 
@@ -4011,11 +4507,152 @@ process_ostree_layers (RpmOstreeContext *self,
   return TRUE;
 }
 
+/* Policy stores built by `semodule` in scripts, kept in the pkgcache repo;
+ * see semodule-wrapper.sh. */
+#define RPMOSTREE_SELINUX_POLICY_CACHE_DIR "extensions/rpmostree/selinux-policy-cache"
+
+typedef struct {
+  gboolean initialized;
+  int dfd;
+  char *path; /* Absolute, for bind mounting into scripts */
+} SelinuxPolicyCache;
+
+static void
+selinux_policy_cache_clear (SelinuxPolicyCache *cache)
+{
+  if (!cache->initialized)
+    return;
+  glnx_close_fd (&cache->dfd);
+  g_clear_pointer (&cache->path, g_free);
+  cache->initialized = FALSE;
+}
+G_DEFINE_AUTO_CLEANUP_CLEAR_FUNC (SelinuxPolicyCache, selinux_policy_cache_clear)
+
+/* Like the systemctl wrapper, but for memoizing policy builds; does nothing
+ * if the rootfs has no semodule. */
+static gboolean
+selinux_policy_cache_begin (RpmOstreeContext   *self,
+                            int                 rootfs_dfd,
+                            SelinuxPolicyCache *cache,
+                            GCancellable       *cancellable,
+                            GError            **error)
+{
+  if (renameat (rootfs_dfd, "usr/sbin/semodule",
+                rootfs_dfd, "usr/sbin/semodule.rpmostreesave") < 0)
+    {
+      if (errno == ENOENT)
+        return TRUE;
+      return glnx_throw_errno_prefix (error, "rename(usr/sbin/semodule)");
+    }
+  cache->initialized = TRUE;
+  cache->dfd = -1;
+
+  g_autoptr(GBytes) semodule_wrapper = g_resources_lookup_data ("/rpmostree/semodule-wrapper.sh",
+                                                                G_RESOURCE_LOOKUP_FLAGS_NONE,
+                                                                error);
+  if (!semodule_wrapper)
+    return FALSE;
+  size_t len;
+  const guint8* buf = g_bytes_get_data (semodule_wrapper, &len);
+  if (!glnx_file_replace_contents_with_perms_at (rootfs_dfd, "usr/sbin/semodule",
+                                                 buf, len, 0755, (uid_t) -1, (gid_t) -1,
+                                                 GLNX_FILE_REPLACE_NODATASYNC,
+                                                 cancellable, error))
+    return FALSE;
+
+  OstreeRepo *repo = get_pkgcache_repo (self);
+  const int repo_dfd = ostree_repo_get_dfd (repo);
+  if (!glnx_shutil_mkdir_p_at (repo_dfd, RPMOSTREE_SELINUX_POLICY_CACHE_DIR, 0700,
+                               cancellable, error))
+    return FALSE;
+  if (!glnx_opendirat (repo_dfd, RPMOSTREE_SELINUX_POLICY_CACHE_DIR, TRUE, &cache->dfd, error))
+    return FALSE;
+  /* Start a fresh log of the entries used */
+  if (!glnx_shutil_rm_rf_at (cache->dfd, "log", cancellable, error))
+    return FALSE;
+  /* The repo may have been opened by fd, in which case its path is under
+   * /proc/self/fd, which doesn't work for scripts; the fd is O_CLOEXEC.  So
+   * resolve the directory to its real path. */
+  g_autofree char *fdpath = g_strdup_printf ("/proc/self/fd/%d", cache->dfd);
+  cache->path = glnx_readlinkat_malloc (AT_FDCWD, fdpath, cancellable, error);
+  if (!cache->path)
+    return glnx_prefix_error (error, "Resolving %s", RPMOSTREE_SELINUX_POLICY_CACHE_DIR);
+  return TRUE;
+}
+
+/* Put back the real semodule, and prune the cache down to the entries used
+ * by this run's scripts.
+ */
+static gboolean
+selinux_policy_cache_end (int                 rootfs_dfd,
+                          SelinuxPolicyCache *cache,
+                          GCancellable       *cancellable,
+                          GError            **error)
+{
+  if (!cache->initialized)
+    return TRUE;
+
+  if (!glnx_renameat (rootfs_dfd, "usr/sbin/semodule.rpmostreesave",
+                      rootfs_dfd, "usr/sbin/semodule", error))
+    return FALSE;
+
+  g_autoptr(GHashTable) used = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  guint n_hits = 0;
+  guint n_builds = 0;
+  if (!glnx_fstatat_allow_noent (cache->dfd, "log", NULL, 0, error))
+    return FALSE;
+  if (errno == 0)
+    {
+      g_autofree char *contents = glnx_file_get_contents_utf8_at (cache->dfd, "log", NULL,
+                                                                  cancellable, error);
+      if (!contents)
+        return FALSE;
+      g_auto(GStrv) lines = g_strsplit (contents, "\n", -1);
+      for (char **it = lines; it && *it; it++)
+        {
+          const char *line = *it;
+          if (g_str_has_prefix (line, "hit "))
+            {
+              n_hits++;
+              g_hash_table_add (used, g_strdup (line + strlen ("hit ")));
+            }
+          else if (g_str_has_prefix (line, "build "))
+            {
+              n_builds++;
+              g_hash_table_add (used, g_strdup (line + strlen ("build ")));
+            }
+        }
+    }
+
+  g_auto(GLnxDirFdIterator) dfd_iter = { 0, };
+  if (!glnx_dirfd_iterator_init_at (cache->dfd, ".", FALSE, &dfd_iter, error))
+    return FALSE;
+  while (TRUE)
+    {
+      struct dirent *dent = NULL;
+      if (!glnx_dirfd_iterator_next_dent (&dfd_iter, &dent, cancellable, error))
+        return FALSE;
+      if (dent == NULL)
+        break;
+      if (g_hash_table_contains (used, dent->d_name))
+        continue;
+      if (!glnx_shutil_rm_rf_at (dfd_iter.fd, dent->d_name, cancellable, error))
+        return FALSE;
+    }
+
+  rpmostree_output_counter ("selinux-policy-cache-hits", n_hits);
+  rpmostree_output_counter ("selinux-policy-builds", n_builds);
+  return TRUE;
+}
+
 gboolean
 rpmostree_context_assemble (RpmOstreeContext      *self,
                             GCancellable          *cancellable,
                             GError               **error)
 {
+  g_auto(RpmOstreePhase) phase = { 0, };
+  rpmostree_output_phase_begin (&phase, "assemble");
+
   /* Synthesize a tmpdir if we weren't provided a base */
   if (self->tmprootfs_dfd == -1)
     {
@@ -4155,7 +4792,9 @@ rpmostree_context_assemble (RpmOstreeContext      *self,
   guint n_rpmts_done = 0;
 
   g_auto(RpmOstreeProgress) checkout_progress = { 0, };
+  g_auto(RpmOstreePhase) checkout_phase = { 0, };
   rpmostree_output_progress_nitems_begin (&checkout_progress, n_rpmts_elements, "%s", progress_msg);
+  rpmostree_output_phase_begin (&checkout_phase, "checkout");
 
   /* Okay so what's going on in Fedora with incestuous relationship
    * between the `filesystem`, `setup`, `libgcc` RPMs is actively
@@ -4255,6 +4894,7 @@ rpmostree_context_assemble (RpmOstreeContext      *self,
     }
 
   rpmostree_output_progress_end (&checkout_progress);
+  rpmostree_output_phase_end (&checkout_phase);
 
   /* Some packages expect to be able to make temporary files here
    * for obvious reasons, but we otherwise make `/var` read-only.
@@ -4333,6 +4973,12 @@ rpmostree_context_assemble (RpmOstreeContext      *self,
       if (!rpmostree_rootfs_fixup_selinux_store_root (tmprootfs_dfd, cancellable, error))
         return FALSE;
 
+      /* And avoid rebuilding the policy each time for layered policy modules */
+      g_auto(SelinuxPolicyCache) selinux_policy_cache = { 0, };
+      if (!selinux_policy_cache_begin (self, tmprootfs_dfd, &selinux_policy_cache,
+                                       cancellable, error))
+        return FALSE;
+
       g_auto(GLnxTmpDir) var_lib_rpm_statedir = { 0, };
       if (!glnx_mkdtempat (AT_FDCWD, "/tmp/rpmostree-state.XXXXXX", 0700,
                            &var_lib_rpm_statedir, error))
@@ -4364,7 +5010,9 @@ rpmostree_context_assemble (RpmOstreeContext      *self,
        * before applying the overrides, rather than after each %pre.
        */
       { g_auto(RpmOstreeProgress) task = { 0, };
+        g_auto(RpmOstreePhase) scripts_phase = { 0, };
         rpmostree_output_task_begin (&task, "Running pre scripts");
+        rpmostree_output_phase_begin (&scripts_phase, "scripts");
         guint n_pre_scripts_run = 0;
         for (guint i = 0; i < n_rpmts_elements; i++)
           {
@@ -4377,6 +5025,7 @@ rpmostree_context_assemble (RpmOstreeContext      *self,
 
             rpmostree_output_set_sub_message (dnf_package_get_name (pkg));
             if (!run_script_sync (self, tmprootfs_dfd, &var_lib_rpm_statedir,
+                                  selinux_policy_cache.path,
                                   pkg, RPMOSTREE_SCRIPT_PREIN,
                                   &n_pre_scripts_run, cancellable, error))
               return FALSE;
@@ -4425,7 +5074,9 @@ rpmostree_context_assemble (RpmOstreeContext      *self,
 
       {
       g_auto(RpmOstreeProgress) task = { 0, };
+      g_auto(RpmOstreePhase) scripts_phase = { 0, };
       rpmostree_output_task_begin (&task, "Running post scripts");
+      rpmostree_output_phase_begin (&scripts_phase, "scripts");
       guint n_post_scripts_run = 0;
 
       /* %post */
@@ -4445,6 +5096,7 @@ rpmostree_context_assemble (RpmOstreeContext      *self,
                                       dnf_package_get_name (pkg));
 
           if (!run_script_sync (self, tmprootfs_dfd, &var_lib_rpm_statedir,
+                                selinux_policy_cache.path,
                                 pkg, RPMOSTREE_SCRIPT_POSTIN,
                                 &n_post_scripts_run, cancellable, error))
             return FALSE;
@@ -4457,7 +5109,9 @@ rpmostree_context_assemble (RpmOstreeContext      *self,
 
       {
       g_auto(RpmOstreeProgress) task = { 0, };
+      g_auto(RpmOstreePhase) scripts_phase = { 0, };
       rpmostree_output_task_begin (&task, "Running posttrans scripts");
+      rpmostree_output_phase_begin (&scripts_phase, "scripts");
       guint n_posttrans_scripts_run = 0;
 
       /* %posttrans */
@@ -4472,6 +5126,7 @@ rpmostree_context_assemble (RpmOstreeContext      *self,
 
           rpmostree_output_set_sub_message (dnf_package_get_name (pkg));
           if (!run_script_sync (self, tmprootfs_dfd, &var_lib_rpm_statedir,
+                                selinux_policy_cache.path,
                                 pkg, RPMOSTREE_SCRIPT_POSTTRANS,
                                 &n_posttrans_scripts_run, cancellable, error))
             return FALSE;
@@ -4500,6 +5155,10 @@ rpmostree_context_assemble (RpmOstreeContext      *self,
             return FALSE;
         }
 
+      if (!selinux_policy_cache_end (tmprootfs_dfd, &selinux_policy_cache,
+                                     cancellable, error))
+        return FALSE;
+
       if (have_passwd)
         {
           if (!rpmostree_passwd_complete_rpm_layering (tmprootfs_dfd, error))
@@ -4531,7 +5190,9 @@ rpmostree_context_assemble (RpmOstreeContext      *self,
   g_clear_pointer (&ordering_ts, rpmtsFree);
 
   g_auto(RpmOstreeProgress) task = { 0, };
+  g_auto(RpmOstreePhase) rpmdb_phase = { 0, };
   rpmostree_output_task_begin (&task, "Writing rpmdb");
+  rpmostree_output_phase_begin (&rpmdb_phase, "rpmdb");
 
   if (!glnx_shutil_mkdir_p_at (tmprootfs_dfd, RPMOSTREE_RPMDB_LOCATION, 0755, cancellable, error))
     return FALSE;
@@ -4648,7 +5309,9 @@ rpmostree_context_commit (RpmOstreeContext      *self,
   g_autofree char *ret_commit_checksum = NULL;
 
   g_auto(RpmOstreeProgress) task = { 0, };
+  g_auto(RpmOstreePhase) phase = { 0, };
   rpmostree_output_task_begin (&task, "Writing OSTree commit");
+  rpmostree_output_phase_begin (&phase, "commit");
 
   g_auto(RpmOstreeRepoAutoTransaction) txn = { 0, };
   if (!rpmostree_repo_auto_transaction_start (&txn, self->ostreerepo, FALSE, cancellable, error))
@@ -4721,10 +5384,12 @@ rpmostree_context_commit (RpmOstreeContext      *self,
 
         /* this is used by the db commands, and auto updates to diff against the base */
         g_autoptr(GVariant) rpmdb = NULL;
+        g_autoptr(GVariant) rpmdb_index = NULL;
         if (!rpmostree_create_rpmdb_pkglist_variant (self->tmprootfs_dfd, ".", &rpmdb,
-                                                     cancellable, error))
+                                                     &rpmdb_index, cancellable, error))
           return FALSE;
         g_variant_builder_add (&metadata_builder, "{sv}", "rpmostree.rpmdb.pkglist", rpmdb);
+        g_variant_builder_add (&metadata_builder, "{sv}", "rpmostree.rpmdb.pkgindex", rpmdb_index);
 
         /* be nice to our future selves */
         g_variant_builder_add (&metadata_builder, "{sv}",
@@ -4783,7 +5448,18 @@ rpmostree_context_commit (RpmOstreeContext      *self,
       }
 
     commit_modifier = ostree_repo_commit_modifier_new (modflags, NULL, NULL, NULL);
-    if (final_sepolicy)
+    /* Files we didn't import ourselves (e.g. written by scripts) need
+     * labeling; if the policy didn't change, most of those lookups were
+     * already done by imports and relabeling. */
+    CachedLabelData label_data = { NULL, self->tmprootfs_dfd, ".", NULL };
+    if (final_sepolicy && ostree_sepolicy_get_name (final_sepolicy) != NULL &&
+        self->selabel_cache && rpmostree_selabel_cache_matches (self->selabel_cache, final_sepolicy))
+      {
+        label_data.cache = self->selabel_cache;
+        ostree_repo_commit_modifier_set_xattr_callback (commit_modifier, cached_label_xattr_cb,
+                                                        NULL, &label_data);
+      }
+    else if (final_sepolicy)
       ostree_repo_commit_modifier_set_sepolicy (commit_modifier, final_sepolicy);
 
     if (self->devino_cache)
@@ -4796,6 +5472,13 @@ rpmostree_context_commit (RpmOstreeContext      *self,
                                          mtree, commit_modifier,
                                          cancellable, error))
       return FALSE;
+    if (label_data.error)
+      {
+        g_propagate_error (error, label_data.error);
+        return FALSE;
+      }
+    if (label_data.cache)
+      rpmostree_selabel_cache_report (label_data.cache);
 
     if (!ostree_repo_write_mtree (self->ostreerepo, mtree, &root, cancellable, error))
       return FALSE;
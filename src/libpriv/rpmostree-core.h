@@ -26,6 +26,7 @@
 
 #include "rpmostree-rust.h"
 #include "libglnx.h"
+#include "rpmostree-selabel-cache.h"
 
 #define RPMOSTREE_CORE_CACHEDIR "/var/cache/rpm-ostree/"
 #define RPMOSTREE_DIR_CACHE_REPOMD "repomd"
@@ -130,6 +131,7 @@ void rpmostree_context_set_devino_cache (RpmOstreeContext *self,
 void rpmostree_context_disable_rofiles (RpmOstreeContext *self);
 void rpmostree_context_set_sepolicy (RpmOstreeContext *self,
                                      OstreeSePolicy   *sepolicy);
+RpmOstreeSeLabelCache *rpmostree_context_get_selabel_cache (RpmOstreeContext *self);
 
 gboolean rpmostree_dnf_add_checksum_goal (GChecksum  *checksum,
                                           HyGoal      goal,
@@ -172,6 +174,8 @@ gboolean rpmostree_context_set_packages (RpmOstreeContext *self,
                                          GError          **error);
 
 GPtrArray *rpmostree_context_get_packages_to_import (RpmOstreeContext *self);
+guint64 rpmostree_context_get_download_size (RpmOstreeContext *self);
+GVariant *rpmostree_context_get_script_timings (RpmOstreeContext *self);
 
 void
 rpmostree_context_set_vlockmap (RpmOstreeContext *self,
@@ -202,11 +206,17 @@ gboolean rpmostree_context_import (RpmOstreeContext *self,
                                    GError          **error);
 
 gboolean rpmostree_context_import_rojig (RpmOstreeContext *self,
-                                         GVariant         *xattr_table,
+                                         GPtrArray        *xattr_table,
                                          GHashTable       *pkg_to_xattrs,
                                          GCancellable     *cancellable,
                                          GError          **error);
 
+gboolean rpmostree_context_download_import_rojig (RpmOstreeContext *self,
+                                                  GPtrArray        *xattr_table,
+                                                  GHashTable       *pkg_to_xattrs,
+                                                  GCancellable     *cancellable,
+                                                  GError          **error);
+
 gboolean rpmostree_context_force_relabel (RpmOstreeContext *self,
                                           GCancellable     *cancellable,
                                           GError          **error);
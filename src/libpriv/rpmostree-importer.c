@@ -37,7 +37,10 @@
 #include "rpmostree-core.h"
 #include "rpmostree-rojig-assembler.h"
 #include "rpmostree-rpm-util.h"
+#include "rpmostree-probes.h"
 #include "rpmostree-util.h"
+#include "rpmostree-pathrules.h"
+#include "rpmostree-sched.h"
 #include <rpm/rpmlib.h>
 #include <rpm/rpmlog.h>
 #include <rpm/rpmfi.h>
@@ -56,6 +59,7 @@ struct RpmOstreeImporter
   GObject parent_instance;
   OstreeRepo *repo;
   OstreeSePolicy *sepolicy;
+  RpmOstreeSeLabelCache *selabel_cache;
   struct archive *archive;
   int fd;
   Header hdr;
@@ -76,7 +80,7 @@ struct RpmOstreeImporter
 
   gboolean rojig_mode;
   char *rojig_cacheid;
-  GVariant *rojig_xattr_table;
+  GPtrArray *rojig_xattr_table;
   GVariant *rojig_xattrs;
   GVariant *rojig_next_xattrs; /* passed from filter to xattr cb */
 };
@@ -98,6 +102,7 @@ rpmostree_importer_finalize (GObject *object)
   g_free (self->ostree_branch);
   g_clear_object (&self->repo);
   g_clear_object (&self->sepolicy);
+  g_clear_pointer (&self->selabel_cache, rpmostree_selabel_cache_unref);
 
   g_clear_pointer (&self->rpmfi_overrides, (GDestroyNotify)g_hash_table_unref);
   g_clear_pointer (&self->doc_files, (GDestroyNotify)g_hash_table_unref);
@@ -106,7 +111,7 @@ rpmostree_importer_finalize (GObject *object)
   g_free (self->hdr_sha256);
 
   g_free (self->rojig_cacheid);
-  g_clear_pointer (&self->rojig_xattr_table, (GDestroyNotify)g_variant_unref);
+  g_clear_pointer (&self->rojig_xattr_table, (GDestroyNotify)g_ptr_array_unref);
   g_clear_pointer (&self->rojig_xattrs, (GDestroyNotify)g_variant_unref);
   g_clear_pointer (&self->rojig_next_xattrs, (GDestroyNotify)g_variant_unref);
 
@@ -297,16 +302,28 @@ rpmostree_importer_new_take_fd (int                     *fd,
 
 void
 rpmostree_importer_set_rojig_mode (RpmOstreeImporter                    *self,
-                                   GVariant *xattr_table,
+                                   GPtrArray *xattr_table,
                                    GVariant *xattrs)
 {
   self->rojig_mode = TRUE;
-  self->rojig_xattr_table = g_variant_ref (xattr_table);
+  self->rojig_xattr_table = g_ptr_array_ref (xattr_table);
   g_variant_get (xattrs, "(s@a(su))",
                  &self->rojig_cacheid,
                  &self->rojig_xattrs);
 }
 
+/* Serve SELinux label lookups from @cache, which must be for the same policy
+ * the importer was created with. */
+void
+rpmostree_importer_set_selabel_cache (RpmOstreeImporter     *self,
+                                      RpmOstreeSeLabelCache *cache)
+{
+  g_assert (self->sepolicy);
+  g_assert (rpmostree_selabel_cache_matches (cache, self->sepolicy));
+  g_clear_pointer (&self->selabel_cache, rpmostree_selabel_cache_unref);
+  self->selabel_cache = rpmostree_selabel_cache_ref (cache);
+}
+
 static void
 get_rpmfi_override (RpmOstreeImporter *self,
                     const char        *path,
@@ -536,26 +553,13 @@ ensure_directories_user_writable (GFileInfo *file_info)
     }
 }
 
-static gboolean
-path_for_tmpfiles_should_be_ignored (const char *path)
-{
-  /* HACK: Avoid generating tmpfiles.d entries for the `rpm` package's
-   * /var/lib/rpm entries in --unified-core composes.  A much more
-   * rigorous approach here would be to maintain our built-in tmpfiles.d
-   * entries as a struct and ensure we're not writing any overrides for
-   * those here.
-   */
-  return g_str_has_prefix (path, "/var/lib/rpm");
-}
-
 /* systemd-tmpfiles complains loudly about writing to /var/run; ideally,
  * all of the packages get fixed for this but...eh.
  */
 static void
-append_translated_tmpfiles_path (GString *buf, const char *path)
+append_translated_tmpfiles_path (GString *buf, const char *path, guint32 path_flags)
 {
-  static const char varrun[] = "/var/run/";
-  if (g_str_has_prefix (path, varrun))
+  if (path_flags & RPMOSTREE_PATH_FLAG_VAR_RUN)
     path += strlen ("/var");
   /* Handle file paths with spaces and other chars https://github.com/coreos/rpm-ostree/issues/2029 */
   g_autofree char *quoted = rpmostree_maybe_shell_quote (path);
@@ -565,13 +569,11 @@ append_translated_tmpfiles_path (GString *buf, const char *path)
 static void
 append_tmpfiles_d (RpmOstreeImporter *self,
                    const char *path,
+                   guint32 path_flags,
                    GFileInfo *finfo,
                    const char *user,
                    const char *group)
 {
-  if (path_for_tmpfiles_should_be_ignored (path))
-    return;
-
   GString *tmpfiles_d = self->tmpfiles_d;
   const guint32 mode = g_file_info_get_attribute_uint32 (finfo, "unix::mode");
   char filetype_c;
@@ -590,7 +592,7 @@ append_tmpfiles_d (RpmOstreeImporter *self,
 
   g_string_append_c (tmpfiles_d, filetype_c);
   g_string_append_c (tmpfiles_d, ' ');
-  append_translated_tmpfiles_path (tmpfiles_d, path);
+  append_translated_tmpfiles_path (tmpfiles_d, path, path_flags);
 
   switch (g_file_info_get_file_type (finfo))
     {
@@ -619,11 +621,10 @@ append_tmpfiles_d (RpmOstreeImporter *self,
  * https://github.com/projectatomic/rpm-ostree/issues/233
  */
 static gboolean
-path_is_ostree_compliant (const char *path)
+path_is_ostree_compliant (guint32 path_flags)
 {
-  g_assert (*path == '/');
-  path++;
-  return (*path == '\0' || rpmostree_relative_path_is_ostree_compliant (path));
+  return (path_flags & (RPMOSTREE_PATH_FLAG_OSTREE_COMPLIANT | RPMOSTREE_PATH_FLAG_USR_LOCAL)) ==
+    RPMOSTREE_PATH_FLAG_OSTREE_COMPLIANT;
 }
 
 static OstreeRepoCommitFilterResult
@@ -674,9 +675,11 @@ compose_filter_cb (OstreeRepo         *repo,
         }
     }
 
+  const guint32 path_flags =
+    rpmostree_path_rules_match (rpmostree_path_rules_get_default (), path);
+
   /* Special case exemptions */
-  if (g_str_has_prefix (path, "/usr/etc/selinux") &&
-      g_str_has_suffix (path, ".LOCK"))
+  if (path_flags & RPMOSTREE_PATH_FLAG_SELINUX_LOCK)
     {
       /* These empty lock files cause problems;
        * https://github.com/projectatomic/rpm-ostree/pull/1002
@@ -684,8 +687,7 @@ compose_filter_cb (OstreeRepo         *repo,
       return OSTREE_REPO_COMMIT_FILTER_SKIP;
     }
   /* convert /run and /var entries to tmpfiles.d */
-  else if (g_str_has_prefix (path, "/run/") ||
-           g_str_has_prefix (path, "/var/"))
+  else if (path_flags & RPMOSTREE_PATH_FLAG_TMPFILES)
     {
       /* HACK: Avoid generating tmpfiles.d entries for the `rpm` package's
        * /var/lib/rpm entries in --unified-core composes.  A much more
@@ -693,9 +695,9 @@ compose_filter_cb (OstreeRepo         *repo,
        * entries as a struct and ensure we're not writing any overrides for
        * those here.
        */
-      if (!g_str_has_prefix (path, "/var/lib/rpm"))
+      if (!(path_flags & RPMOSTREE_PATH_FLAG_VAR_LIB_RPM))
         {
-          append_tmpfiles_d (self, path, file_info,
+          append_tmpfiles_d (self, path, path_flags, file_info,
                              user ?: "root", group ?: "root");
         }
       return OSTREE_REPO_COMMIT_FILTER_SKIP;
@@ -705,9 +707,8 @@ compose_filter_cb (OstreeRepo         *repo,
       /* And ensure the RPM installs into supported paths.
        * Note that we rewrite opt in handle_translate_pathname, but
        * this gets called with the old path, so handle it here too. */
-      if (!(path_is_ostree_compliant (path) ||
-            g_str_equal (path, "opt") ||
-            g_str_has_prefix (path, "opt/")))
+      if (!(path_is_ostree_compliant (path_flags) ||
+            path_flags & RPMOSTREE_PATH_FLAG_OPT))
         {
           if ((self->flags & RPMOSTREE_IMPORTER_FLAGS_SKIP_EXTRANEOUS) == 0)
             g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
@@ -751,7 +752,8 @@ unprivileged_filter_cb (OstreeRepo         *repo,
   /* HACK: Also special-case rpm's `/var/lib/rpm` here like in the privileged flow;
    * otherwise libsolv can get confused (see
    * https://github.com/projectatomic/rpm-ostree/pull/290) */
-  if (g_str_has_prefix (path, "/var/lib/rpm"))
+  if (rpmostree_path_rules_match (rpmostree_path_rules_get_default (), path) &
+      RPMOSTREE_PATH_FLAG_VAR_LIB_RPM)
     return OSTREE_REPO_COMMIT_FILTER_SKIP;
 
   return OSTREE_REPO_COMMIT_FILTER_ALLOW;
@@ -807,15 +809,22 @@ xattr_cb (OstreeRepo  *repo,
           GFileInfo   *file_info,
           gpointer     user_data)
 {
-  RpmOstreeImporter *self = user_data;
+  RpmOstreeImporter *self = ((cb_data*)user_data)->self;
+  GError **error = ((cb_data*)user_data)->error;
   const char *fcaps = NULL;
 
   get_rpmfi_override (self, path, NULL, NULL, &fcaps);
 
+  g_autoptr(GVariant) xattrs = NULL;
   if (fcaps != NULL && fcaps[0] != '\0')
-    return rpmostree_fcap_to_xattr_variant (fcaps);
-
-  return NULL;
+    xattrs = rpmostree_fcap_to_xattr_variant (fcaps);
+
+  /* With a label cache, we do the labeling rather than libostree */
+  if (!self->selabel_cache || (error && *error != NULL))
+    return g_steal_pointer (&xattrs);
+  const guint32 mode = g_file_info_get_attribute_uint32 (file_info, "unix::mode");
+  return rpmostree_selabel_cache_label_xattrs (self->selabel_cache, path, mode, xattrs,
+                                               TRUE, error);
 }
 
 static char *
@@ -840,11 +849,12 @@ handle_translate_pathname (OstreeRepo   *repo,
 {
   RpmOstreeImporter *self = user_data;
 
-  if (g_str_has_prefix (path, "opt/"))
+  char *translated = rpmostree_translate_path_for_ostree (path);
+  if (translated && g_str_has_prefix (translated, "usr/lib/opt/"))
     g_hash_table_add (self->opt_files,
                       get_first_path_element (path + strlen("opt/")));
 
-  return rpmostree_translate_path_for_ostree (path);
+  return translated;
 }
 
 static gboolean
@@ -885,8 +895,9 @@ import_rpm_to_repo (RpmOstreeImporter *self,
     }
   else
     {
-      ostree_repo_commit_modifier_set_xattr_callback (modifier, xattr_cb, NULL, self);
-      ostree_repo_commit_modifier_set_sepolicy (modifier, self->sepolicy);
+      ostree_repo_commit_modifier_set_xattr_callback (modifier, xattr_cb, NULL, &fdata);
+      if (!self->selabel_cache)
+        ostree_repo_commit_modifier_set_sepolicy (modifier, self->sepolicy);
     }
 
   OstreeRepoImportArchiveOptions opts = { 0 };
@@ -919,27 +930,24 @@ import_rpm_to_repo (RpmOstreeImporter *self,
                               opt_quoted ?: opt, filename);
     }
 
-  /* Handle any data we've accumulated data to write to tmpfiles.d.
-   * I originally tried to do this entirely in memory but things
-   * like selinux labeling only happen as callbacks out of using
-   * the input dfd/archive paths...so let's just use a tempdir. (:sadface:)
+  /* Handle any data we've accumulated data to write to tmpfiles.d; this is
+   * written straight into the mtree, applying the same filter, xattrs and
+   * labeling as the modifier would.
    */
-  g_auto(GLnxTmpDir) tmpdir = { 0, };
   if (self->tmpfiles_d->len > 0)
     {
       g_autofree char *pkgname = headerGetAsString (self->hdr, RPMTAG_NAME);
-
-      if (!glnx_mkdtemp ("rpm-ostree-import.XXXXXX", 0700, &tmpdir, error))
-        return FALSE;
-      if (!glnx_shutil_mkdir_p_at (tmpdir.fd, "usr/lib/tmpfiles.d", 0755, cancellable,  error))
-        return FALSE;
-      if (!glnx_file_replace_contents_at (tmpdir.fd, glnx_strjoina ("usr/lib/tmpfiles.d/", "pkg-", pkgname, ".conf"),
-                                          (guint8*)self->tmpfiles_d->str, self->tmpfiles_d->len, GLNX_FILE_REPLACE_NODATASYNC,
-                                          cancellable, error))
-        return FALSE;
-
-      if (!ostree_repo_write_dfd_to_mtree (repo, tmpdir.fd, ".", mtree, modifier,
-                                           cancellable, error))
+      g_autofree char *path = g_strconcat ("usr/lib/tmpfiles.d/pkg-", pkgname, ".conf", NULL);
+      g_autoptr(GBytes) content = g_bytes_new (self->tmpfiles_d->str, self->tmpfiles_d->len);
+      RpmOstreeMtreeWriteOptions write_opts = { 0, };
+      write_opts.filter = filter;
+      write_opts.filter_data = &fdata;
+      write_opts.xattr_callback = self->rojig_mode ? rojig_xattr_cb : xattr_cb;
+      write_opts.xattr_data = self->rojig_mode ? (gpointer)self : (gpointer)&fdata;
+      write_opts.sepolicy = (self->rojig_mode || self->selabel_cache) ? NULL : self->sepolicy;
+
+      if (!rpmostree_mtree_write_file (repo, mtree, path, 0644, content, &write_opts,
+                                       cancellable, error))
         return glnx_prefix_error (error, "Writing tmpfiles mtree");
 
       /* check if any of the cbs set an error */
@@ -982,6 +990,9 @@ rpmostree_importer_run (RpmOstreeImporter *self,
   if (g_cancellable_set_error_if_cancelled (cancellable, error))
     return FALSE;
 
+  g_autofree char *nevra = rpmostree_importer_get_nevra (self);
+  RPMOSTREE_PROBE1 (import__start, nevra);
+
   g_autofree char *csum = NULL;
   if (!import_rpm_to_repo (self, &csum, cancellable, error))
     {
@@ -989,6 +1000,10 @@ rpmostree_importer_run (RpmOstreeImporter *self,
       return glnx_prefix_error (error, "Importing package '%s'", name);
     }
 
+  RPMOSTREE_PROBE4 (import__done, nevra, archive_filter_bytes (self->archive, -1),
+                    self->fi ? rpmfiFC (self->fi) : 0,
+                    headerGetNumber (self->hdr, RPMTAG_LONGSIZE));
+
   const char *branch = rpmostree_importer_get_ostree_branch (self);
   ostree_repo_transaction_set_ref (self->repo, NULL, branch, csum);
 
@@ -1007,10 +1022,12 @@ import_in_thread (GTask            *task,
   RpmOstreeImporter *self = source;
   g_autofree char *rev = NULL;
 
+  rpmostree_sched_thread_enter ();
   if (!rpmostree_importer_run (self, &rev, cancellable, &local_error))
     g_task_return_error (task, local_error);
   else
     g_task_return_pointer (task, g_steal_pointer (&rev), g_free);
+  rpmostree_sched_thread_leave ();
 }
 
 void
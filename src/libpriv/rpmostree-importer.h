@@ -26,6 +26,8 @@
 #include <rpm/rpmlib.h>
 #include <libdnf/libdnf.h>
 
+#include "rpmostree-selabel-cache.h"
+
 typedef struct RpmOstreeImporter RpmOstreeImporter;
 
 #define RPMOSTREE_TYPE_IMPORTER         (rpmostree_importer_get_type ())
@@ -55,9 +57,12 @@ rpmostree_importer_new_take_fd (int                     *fd,
                                 GError                 **error);
 
 void rpmostree_importer_set_rojig_mode (RpmOstreeImporter *self,
-                                        GVariant *xattr_table,
+                                        GPtrArray *xattr_table,
                                         GVariant *xattrs);
 
+void rpmostree_importer_set_selabel_cache (RpmOstreeImporter     *self,
+                                           RpmOstreeSeLabelCache *cache);
+
 gboolean
 rpmostree_importer_read_metainfo (int fd,
                                   Header *out_header,
@@ -68,6 +68,11 @@ rpmostree_output_default_handler (RpmOstreeOutputType type,
       ror_progress_end (end->msg);
       break;
     }
+  case RPMOSTREE_OUTPUT_PHASE_BEGIN:
+  case RPMOSTREE_OUTPUT_PHASE_END:
+  case RPMOSTREE_OUTPUT_COUNTER:
+    /* Only consumed by the daemon */
+    break;
   }
 }
 
@@ -163,3 +168,31 @@ rpmostree_output_progress_n_items (guint current)
   RpmOstreeOutputProgressUpdate progress = { current };
   active_cb (RPMOSTREE_OUTPUT_PROGRESS_UPDATE, &progress, active_cb_opaque);
 }
+
+void
+rpmostree_output_phase_begin (RpmOstreePhase *phasep, const char *name)
+{
+  g_assert (phasep && !phasep->initialized);
+  phasep->initialized = TRUE;
+  phasep->name = name;
+  RpmOstreeOutputPhase phase = { name };
+  active_cb (RPMOSTREE_OUTPUT_PHASE_BEGIN, &phase, active_cb_opaque);
+}
+
+void
+rpmostree_output_phase_end (RpmOstreePhase *phasep)
+{
+  g_assert (phasep);
+  if (!phasep->initialized)
+    return;
+  phasep->initialized = false;
+  RpmOstreeOutputPhase phase = { phasep->name };
+  active_cb (RPMOSTREE_OUTPUT_PHASE_END, &phase, active_cb_opaque);
+}
+
+void
+rpmostree_output_counter (const char *name, guint64 value)
+{
+  RpmOstreeOutputCounter counter = { name, value };
+  active_cb (RPMOSTREE_OUTPUT_COUNTER, &counter, active_cb_opaque);
+}
@@ -26,6 +26,9 @@ typedef enum {
   RPMOSTREE_OUTPUT_PROGRESS_UPDATE,
   RPMOSTREE_OUTPUT_PROGRESS_SUB_MESSAGE,
   RPMOSTREE_OUTPUT_PROGRESS_END,
+  RPMOSTREE_OUTPUT_PHASE_BEGIN,
+  RPMOSTREE_OUTPUT_PHASE_END,
+  RPMOSTREE_OUTPUT_COUNTER,
 } RpmOstreeOutputType;
 
 typedef enum {
@@ -68,6 +71,24 @@ static inline void rpmostree_output_progress_end (RpmOstreeProgress *task)
 }
 G_DEFINE_AUTO_CLEANUP_CLEAR_FUNC (RpmOstreeProgress, rpmostree_output_progress_end)
 
+/* Phases are machine-readable markers around the expensive parts of an
+ * operation (e.g. "import", "scripts", "commit"); they're not displayed, but
+ * the daemon uses them to account time and resource usage per transaction.
+ * Phases may nest, and the same phase may be entered more than once.
+ */
+typedef struct {
+  bool initialized;
+  const char *name;
+} RpmOstreePhase;
+void rpmostree_output_phase_begin (RpmOstreePhase *phase, const char *name);
+void rpmostree_output_phase_end (RpmOstreePhase *phase);
+G_DEFINE_AUTO_CLEANUP_CLEAR_FUNC (RpmOstreePhase, rpmostree_output_phase_end)
+
+/* Like phases, counters aren't displayed; @value is added to the named
+ * counter in the operation's statistics.
+ */
+void rpmostree_output_counter (const char *name, guint64 value);
+
 /* For implementers of the output backend. If percent is TRUE, then n is
  * ignored. If n is zero, then it is taken to be an indefinite task.  Otherwise,
  * n is used for n_items.
@@ -91,3 +112,13 @@ typedef struct {
   const char *msg;
 } RpmOstreeOutputProgressEnd;
 
+/* Begin or end a phase; name is a static string */
+typedef struct {
+  const char *name;
+} RpmOstreeOutputPhase;
+
+/* Add to a counter; name is a static string */
+typedef struct {
+  const char *name;
+  guint64 value;
+} RpmOstreeOutputCounter;
@@ -34,101 +34,259 @@
 #include "rpmostree-json-parsing.h"
 #include "rpmostree-passwd-util.h"
 #include "rpmostree-rust.h"
+#include "rpmostree-sched.h"
 
 #include "libglnx.h"
 
-/* Recursively search a directory for a subpath
- * owned by a uid/gid.
+/* An index from uid and gid to the first path found owned by it, built
+ * with a single walk of the rootfs; the walk of each toplevel directory is
+ * done in parallel.  This lets us check any number of removed users and
+ * groups without rescanning.
  */
-static gboolean
-dir_contains_uid_or_gid (int            rootfs_fd,
-                         const char    *path,
-                         guint32        id,
-                         gboolean       is_uid,
-                         gboolean      *out_found_match,
-                         GCancellable  *cancellable,
-                         GError       **error)
-{
-  gboolean found_match = FALSE;
+struct RpmOstreeOwnerIndex {
+  GHashTable *uid_to_path; /* Map<uid_t, char *path> */
+  GHashTable *gid_to_path; /* Map<gid_t, char *path> */
+};
 
-  g_auto(GLnxDirFdIterator) dfd_iter = { 0, };
-  if (!glnx_dirfd_iterator_init_at (rootfs_fd, path, FALSE, &dfd_iter, error))
-    return FALSE;
+static RpmOstreeOwnerIndex *
+owner_index_new_empty (void)
+{
+  RpmOstreeOwnerIndex *idx = g_new0 (RpmOstreeOwnerIndex, 1);
+  idx->uid_to_path = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+  idx->gid_to_path = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+  return idx;
+}
 
-  /* Examine the owner of the directory */
-  struct stat stbuf;
-  if (!glnx_fstat (dfd_iter.fd, &stbuf, error))
-    return FALSE;
+void
+rpmostree_owner_index_free (RpmOstreeOwnerIndex *idx)
+{
+  g_hash_table_unref (idx->uid_to_path);
+  g_hash_table_unref (idx->gid_to_path);
+  g_free (idx);
+}
 
-  if (is_uid)
-    found_match = (id == stbuf.st_uid);
-  else
-    found_match = (id == stbuf.st_gid);
+/* Record @path as owned by the uid/gid in @stbuf, unless we already have an
+ * earlier owner. */
+static void
+owner_index_add (RpmOstreeOwnerIndex *idx,
+                 const struct stat   *stbuf,
+                 const char          *path)
+{
+  if (!g_hash_table_contains (idx->uid_to_path, GUINT_TO_POINTER (stbuf->st_uid)))
+    g_hash_table_insert (idx->uid_to_path, GUINT_TO_POINTER (stbuf->st_uid), g_strdup (path));
+  if (!g_hash_table_contains (idx->gid_to_path, GUINT_TO_POINTER (stbuf->st_gid)))
+    g_hash_table_insert (idx->gid_to_path, GUINT_TO_POINTER (stbuf->st_gid), g_strdup (path));
+}
 
-  /* Early return if we found a match */
-  if (found_match)
+/* Fold @other into @idx; entries already in @idx win */
+static void
+owner_index_merge (RpmOstreeOwnerIndex *idx,
+                   RpmOstreeOwnerIndex *other)
+{
+  GHashTable *tables[][2] = { { idx->uid_to_path, other->uid_to_path },
+                              { idx->gid_to_path, other->gid_to_path } };
+  for (guint i = 0; i < G_N_ELEMENTS (tables); i++)
     {
-      *out_found_match = TRUE;
-      return TRUE;
+      GLNX_HASH_TABLE_FOREACH_IT (tables[i][1], it, gpointer, id, char *, path)
+        {
+          if (g_hash_table_contains (tables[i][0], id))
+            continue;
+          g_hash_table_insert (tables[i][0], id, path);
+          g_hash_table_iter_steal (&it);
+        }
     }
+}
+
+typedef struct {
+  int rootfs_fd;
+  char *name;
+  RpmOstreeOwnerIndex *idx;
+  GError *error;
+  GCancellable *cancellable;
+  gint *failed; /* Shared by all scans; set once one of them fails */
+} OwnerIndexScan;
 
-  /* Loop over the directory contents */
+/* Add the contents of the directory @dfd (at @path) to @scan's index */
+static gboolean
+owner_index_scan_dir (OwnerIndexScan *scan,
+                      int             dfd,
+                      GString        *path,
+                      GError        **error)
+{
+  g_auto(GLnxDirFdIterator) dfd_iter = { 0, };
+  if (!glnx_dirfd_iterator_init_at (dfd, ".", FALSE, &dfd_iter, error))
+    return FALSE;
+
+  const gsize path_len = path->len;
   while (TRUE)
     {
+      if (g_cancellable_set_error_if_cancelled (scan->cancellable, error))
+        return FALSE;
+      /* No point in going on, the index won't be used */
+      if (g_atomic_int_get (scan->failed))
+        return TRUE;
+
       struct dirent *dent = NULL;
-      if (!glnx_dirfd_iterator_next_dent_ensure_dtype (&dfd_iter, &dent, cancellable, error))
+      if (!glnx_dirfd_iterator_next_dent_ensure_dtype (&dfd_iter, &dent, scan->cancellable, error))
         return FALSE;
       if (dent == NULL)
         break;
 
+      struct stat stbuf;
+      if (!glnx_fstatat (dfd_iter.fd, dent->d_name, &stbuf, AT_SYMLINK_NOFOLLOW, error))
+        return FALSE;
+      g_string_append_c (path, '/');
+      g_string_append (path, dent->d_name);
+      owner_index_add (scan->idx, &stbuf, path->str);
+
       if (dent->d_type == DT_DIR)
         {
-          if (!dir_contains_uid_or_gid (dfd_iter.fd, dent->d_name,
-                                        id, is_uid, out_found_match,
-                                        cancellable, error))
+          glnx_autofd int subdfd = -1;
+          if (!glnx_opendirat (dfd_iter.fd, dent->d_name, FALSE, &subdfd, error))
             return FALSE;
-        }
-      else
-        {
-          if (!glnx_fstatat (dfd_iter.fd, dent->d_name, &stbuf, AT_SYMLINK_NOFOLLOW, error))
+          if (!owner_index_scan_dir (scan, subdfd, path, error))
             return FALSE;
-
-          if (is_uid)
-            found_match = (id == stbuf.st_uid);
-          else
-            found_match = (id == stbuf.st_gid);
         }
+      g_string_truncate (path, path_len);
+    }
+
+  return TRUE;
+}
+
+static void
+owner_index_scan_worker (gpointer data,
+                         gpointer user_data)
+{
+  OwnerIndexScan *scan = data;
+  rpmostree_sched_thread_enter ();
+  scan->idx = owner_index_new_empty ();
+  glnx_autofd int dfd = -1;
+  g_autoptr(GString) path = g_string_new ("/");
+  g_string_append (path, scan->name);
+  if (!glnx_opendirat (scan->rootfs_fd, scan->name, FALSE, &dfd, &scan->error) ||
+      !owner_index_scan_dir (scan, dfd, path, &scan->error))
+    g_atomic_int_set (scan->failed, TRUE);
+  rpmostree_sched_thread_leave ();
+}
+
+static int
+cmp_owner_index_scans (gconstpointer a,
+                       gconstpointer b)
+{
+  const OwnerIndexScan *scan_a = *((OwnerIndexScan**)a);
+  const OwnerIndexScan *scan_b = *((OwnerIndexScan**)b);
+  return strcmp (scan_a->name, scan_b->name);
+}
+
+static void
+owner_index_scan_free (OwnerIndexScan *scan)
+{
+  g_free (scan->name);
+  g_clear_pointer (&scan->idx, rpmostree_owner_index_free);
+  g_clear_error (&scan->error);
+  g_free (scan);
+}
+
+RpmOstreeOwnerIndex *
+rpmostree_owner_index_new (int            rootfs_fd,
+                           GCancellable  *cancellable,
+                           GError       **error)
+{
+  g_autoptr(RpmOstreeOwnerIndex) idx = owner_index_new_empty ();
 
-      if (found_match)
+  struct stat stbuf;
+  if (!glnx_fstat (rootfs_fd, &stbuf, error))
+    return NULL;
+  owner_index_add (idx, &stbuf, "/");
+
+  /* Toplevel entries are handled here, and each toplevel directory is
+   * scanned by a worker. */
+  g_autoptr(GPtrArray) scans = g_ptr_array_new_with_free_func ((GDestroyNotify)owner_index_scan_free);
+  gint failed = FALSE;
+  g_auto(GLnxDirFdIterator) dfd_iter = { 0, };
+  if (!glnx_dirfd_iterator_init_at (rootfs_fd, ".", FALSE, &dfd_iter, error))
+    return NULL;
+  while (TRUE)
+    {
+      struct dirent *dent = NULL;
+      if (!glnx_dirfd_iterator_next_dent_ensure_dtype (&dfd_iter, &dent, cancellable, error))
+        return NULL;
+      if (dent == NULL)
         break;
+
+      if (!glnx_fstatat (dfd_iter.fd, dent->d_name, &stbuf, AT_SYMLINK_NOFOLLOW, error))
+        return NULL;
+      g_autofree char *path = g_strconcat ("/", dent->d_name, NULL);
+      owner_index_add (idx, &stbuf, path);
+
+      if (dent->d_type == DT_DIR)
+        {
+          OwnerIndexScan *scan = g_new0 (OwnerIndexScan, 1);
+          scan->rootfs_fd = dfd_iter.fd;
+          scan->name = g_strdup (dent->d_name);
+          scan->cancellable = cancellable;
+          scan->failed = &failed;
+          g_ptr_array_add (scans, scan);
+        }
     }
+  /* Sort so the merged result doesn't depend on readdir() order */
+  g_ptr_array_sort (scans, cmp_owner_index_scans);
 
-  *out_found_match = found_match;
-  return TRUE;
+  if (scans->len > 0)
+    {
+      const guint n_workers = MIN (scans->len, rpmostree_sched_get_max_workers (g_get_num_processors ()));
+      GThreadPool *pool = g_thread_pool_new (owner_index_scan_worker, NULL, n_workers, FALSE, error);
+      if (!pool)
+        return NULL;
+      gboolean pushed = TRUE;
+      for (guint i = 0; i < scans->len && pushed; i++)
+        pushed = g_thread_pool_push (pool, scans->pdata[i], error);
+      /* Either way, wait for the scans that were queued */
+      g_thread_pool_free (pool, FALSE, TRUE);
+      if (!pushed)
+        return NULL;
+    }
+
+  for (guint i = 0; i < scans->len; i++)
+    {
+      OwnerIndexScan *scan = scans->pdata[i];
+      if (scan->error)
+        {
+          g_propagate_error (error, g_steal_pointer (&scan->error));
+          return NULL;
+        }
+      owner_index_merge (idx, scan->idx);
+    }
+
+  return g_steal_pointer (&idx);
 }
 
-static gboolean
-dir_contains_uid (int              rootfs_fd,
-                  uid_t            uid,
-                  gboolean        *out_found_match,
-                  GCancellable    *cancellable,
-                  GError         **error)
+/* Returns: (transfer none) (nullable): The first path found owned by @uid */
+const char *
+rpmostree_owner_index_lookup_uid (RpmOstreeOwnerIndex *idx,
+                                  uid_t                uid)
 {
-  *out_found_match = FALSE;
-  return dir_contains_uid_or_gid (rootfs_fd, ".", uid, TRUE,
-                                  out_found_match, cancellable, error);
+  return g_hash_table_lookup (idx->uid_to_path, GUINT_TO_POINTER (uid));
 }
 
-static gboolean
-dir_contains_gid (int              rootfs_fd,
-                  gid_t            gid,
-                  gboolean        *out_found_match,
-                  GCancellable    *cancellable,
-                  GError         **error)
+/* Returns: (transfer none) (nullable): The first path found owned by @gid */
+const char *
+rpmostree_owner_index_lookup_gid (RpmOstreeOwnerIndex *idx,
+                                  gid_t                gid)
 {
-  *out_found_match = FALSE;
-  return dir_contains_uid_or_gid (rootfs_fd, ".", gid, FALSE,
-                                  out_found_match, cancellable, error);
+  return g_hash_table_lookup (idx->gid_to_path, GUINT_TO_POINTER (gid));
+}
+
+/* Build the index on first use */
+static RpmOstreeOwnerIndex *
+ensure_owner_index (RpmOstreeOwnerIndex **owner_index,
+                    int                   rootfs_fd,
+                    GCancellable         *cancellable,
+                    GError              **error)
+{
+  if (!*owner_index)
+    *owner_index = rpmostree_owner_index_new (rootfs_fd, cancellable, error);
+  return *owner_index;
 }
 
 static void
@@ -360,6 +518,7 @@ rpmostree_check_passwd_groups (gboolean         passwd,
                                RORTreefile     *treefile_rs,
                                JsonObject      *treedata,
                                const char      *previous_commit,
+                               RpmOstreeOwnerIndex **owner_index,
                                GCancellable    *cancellable,
                                GError         **error)
 {
@@ -560,8 +719,6 @@ rpmostree_check_passwd_groups (gboolean         passwd,
         }
       else if (cmp < 0) /* Missing value from new passwd */
         {
-          gboolean found_matching_uid;
-
           if (ignore_all_removed ||
               rpmostree_str_ptrarray_contains (ignore_removed_ents, odata->name))
             {
@@ -570,12 +727,15 @@ rpmostree_check_passwd_groups (gboolean         passwd,
             }
           else
             {
-              if (!dir_contains_uid (rootfs_fd, odata->uid, &found_matching_uid,
-                                     cancellable, error))
+              RpmOstreeOwnerIndex *idx = ensure_owner_index (owner_index, rootfs_fd,
+                                                             cancellable, error);
+              if (!idx)
                 return FALSE;
 
-              if (found_matching_uid)
-                return glnx_throw (error, "User missing from new passwd file: %s", odata->name);
+              const char *owned_path = rpmostree_owner_index_lookup_uid (idx, odata->uid);
+              if (owned_path)
+                return glnx_throw (error, "User missing from new passwd file: %s (owns %s)",
+                                   odata->name, owned_path);
               else
                 g_print ("User removed from new passwd file: %s\n",
                          odata->name);
@@ -618,14 +778,15 @@ rpmostree_check_passwd_groups (gboolean         passwd,
             }
           else
             {
-              gboolean found_gid;
-
-              if (!dir_contains_gid (rootfs_fd, odata->gid, &found_gid,
-                                     cancellable, error))
+              RpmOstreeOwnerIndex *idx = ensure_owner_index (owner_index, rootfs_fd,
+                                                             cancellable, error);
+              if (!idx)
                 return FALSE;
 
-              if (found_gid)
-                return glnx_throw (error, "Group missing from new group file: %s", odata->name);
+              const char *owned_path = rpmostree_owner_index_lookup_gid (idx, odata->gid);
+              if (owned_path)
+                return glnx_throw (error, "Group missing from new group file: %s (owns %s)",
+                                   odata->name, owned_path);
               else
                 g_print ("Group removed from new passwd file: %s\n",
                          odata->name);
@@ -687,11 +848,12 @@ rpmostree_check_passwd (OstreeRepo      *repo,
                         RORTreefile     *treefile_rs,
                         JsonObject      *treedata,
                         const char      *previous_commit,
+                        RpmOstreeOwnerIndex **owner_index,
                         GCancellable    *cancellable,
                         GError         **error)
 {
   return rpmostree_check_passwd_groups (TRUE, repo, rootfs_fd, treefile_rs,
-                                        treedata, previous_commit,
+                                        treedata, previous_commit, owner_index,
                                         cancellable, error);
 }
 
@@ -704,11 +866,12 @@ rpmostree_check_groups (OstreeRepo      *repo,
                         RORTreefile     *treefile_rs,
                         JsonObject      *treedata,
                         const char      *previous_commit,
+                        RpmOstreeOwnerIndex **owner_index,
                         GCancellable    *cancellable,
                         GError         **error)
 {
   return rpmostree_check_passwd_groups (FALSE, repo, rootfs_fd, treefile_rs,
-                                        treedata, previous_commit,
+                                        treedata, previous_commit, owner_index,
                                         cancellable, error);
 }
 
@@ -27,12 +27,30 @@
 
 #include "rpmostree-rust.h"
 
+typedef struct RpmOstreeOwnerIndex RpmOstreeOwnerIndex;
+
+RpmOstreeOwnerIndex *
+rpmostree_owner_index_new (int            rootfs_fd,
+                           GCancellable  *cancellable,
+                           GError       **error);
+void rpmostree_owner_index_free (RpmOstreeOwnerIndex *idx);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(RpmOstreeOwnerIndex, rpmostree_owner_index_free)
+
+const char *rpmostree_owner_index_lookup_uid (RpmOstreeOwnerIndex *idx,
+                                              uid_t                uid);
+const char *rpmostree_owner_index_lookup_gid (RpmOstreeOwnerIndex *idx,
+                                              gid_t                gid);
+
+/* @owner_index is built on demand if a removed user or group needs checking,
+ * and can be shared between the two calls.
+ */
 gboolean
 rpmostree_check_passwd (OstreeRepo      *repo,
                         int              rootfs_dfd,
                         RORTreefile     *treefile_rs,
                         JsonObject      *treedata,
                         const char      *previous_commit,
+                        RpmOstreeOwnerIndex **owner_index,
                         GCancellable    *cancellable,
                         GError         **error);
 
@@ -42,6 +60,7 @@ rpmostree_check_groups (OstreeRepo      *repo,
                         RORTreefile     *treefile_rs,
                         JsonObject      *treedata,
                         const char      *previous_commit,
+                        RpmOstreeOwnerIndex **owner_index,
                         GCancellable    *cancellable,
                         GError         **error);
 
@@ -0,0 +1,296 @@
+/*
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "rpmostree-pathrules.h"
+#include "rpmostree-core.h"
+#include "rpmostree-util.h"
+
+typedef struct {
+  GRegex *regex;
+  guint32 flags;
+} PathRuleRegex;
+
+typedef struct PathRuleNode PathRuleNode;
+struct PathRuleNode {
+  char c;
+  guint32 prefix_flags;
+  guint32 dir_flags;
+  guint32 exact_flags;
+  GPtrArray *regexes; /* PathRuleRegex* */
+  PathRuleNode *children;
+  PathRuleNode *next;
+};
+
+struct RpmOstreePathRules {
+  gint refcount;
+  PathRuleNode root;
+};
+
+static void
+path_rule_regex_free (PathRuleRegex *r)
+{
+  g_regex_unref (r->regex);
+  g_free (r);
+}
+
+static void
+path_rule_node_clear (PathRuleNode *node)
+{
+  PathRuleNode *child = node->children;
+  while (child)
+    {
+      PathRuleNode *next = child->next;
+      path_rule_node_clear (child);
+      g_free (child);
+      child = next;
+    }
+  g_clear_pointer (&node->regexes, g_ptr_array_unref);
+}
+
+RpmOstreePathRules *
+rpmostree_path_rules_new (void)
+{
+  RpmOstreePathRules *rules = g_new0 (RpmOstreePathRules, 1);
+  rules->refcount = 1;
+  return rules;
+}
+
+RpmOstreePathRules *
+rpmostree_path_rules_ref (RpmOstreePathRules *rules)
+{
+  g_atomic_int_inc (&rules->refcount);
+  return rules;
+}
+
+void
+rpmostree_path_rules_unref (RpmOstreePathRules *rules)
+{
+  if (!g_atomic_int_dec_and_test (&rules->refcount))
+    return;
+  path_rule_node_clear (&rules->root);
+  g_free (rules);
+}
+
+static PathRuleNode *
+path_rule_node_child (const PathRuleNode *node,
+                      char                c)
+{
+  for (PathRuleNode *child = node->children; child; child = child->next)
+    {
+      if (child->c == c)
+        return child;
+    }
+  return NULL;
+}
+
+static PathRuleNode *
+path_rules_ensure_node (RpmOstreePathRules *rules,
+                        const char         *path)
+{
+  PathRuleNode *node = &rules->root;
+  for (const char *p = path; *p; p++)
+    {
+      PathRuleNode *child = path_rule_node_child (node, *p);
+      if (!child)
+        {
+          child = g_new0 (PathRuleNode, 1);
+          child->c = *p;
+          child->next = node->children;
+          node->children = child;
+        }
+      node = child;
+    }
+  return node;
+}
+
+void
+rpmostree_path_rules_add (RpmOstreePathRules *rules,
+                          RpmOstreePathMatch  match,
+                          const char         *path,
+                          guint32             flags)
+{
+  PathRuleNode *node = path_rules_ensure_node (rules, path);
+  switch (match)
+    {
+    case RPMOSTREE_PATH_MATCH_PREFIX:
+      node->prefix_flags |= flags;
+      break;
+    case RPMOSTREE_PATH_MATCH_DIR:
+      node->dir_flags |= flags;
+      break;
+    case RPMOSTREE_PATH_MATCH_EXACT:
+      node->exact_flags |= flags;
+      break;
+    }
+}
+
+/* Add a rule matching paths which start with @prefix (if any) and match
+ * @pattern.  The regex is run against the whole path, but only for paths
+ * that reached its prefix in the trie.
+ */
+gboolean
+rpmostree_path_rules_add_regex (RpmOstreePathRules *rules,
+                                const char         *prefix,
+                                const char         *pattern,
+                                guint32             flags,
+                                GError            **error)
+{
+  g_autoptr(GRegex) regex = g_regex_new (pattern, G_REGEX_JAVASCRIPT_COMPAT | G_REGEX_OPTIMIZE,
+                                         0, error);
+  if (!regex)
+    return FALSE;
+
+  PathRuleNode *node = path_rules_ensure_node (rules, prefix ?: "");
+  if (!node->regexes)
+    node->regexes = g_ptr_array_new_with_free_func ((GDestroyNotify)path_rule_regex_free);
+  PathRuleRegex *r = g_new0 (PathRuleRegex, 1);
+  r->regex = g_steal_pointer (&regex);
+  r->flags = flags;
+  g_ptr_array_add (node->regexes, r);
+  return TRUE;
+}
+
+static guint32
+path_rule_node_regex_flags (const PathRuleNode *node,
+                            const char         *path,
+                            guint32             flags)
+{
+  if (!node->regexes)
+    return flags;
+  for (guint i = 0; i < node->regexes->len; i++)
+    {
+      PathRuleRegex *r = node->regexes->pdata[i];
+      /* Skip the regex if it can't tell us anything new */
+      if ((flags & r->flags) == r->flags)
+        continue;
+      if (g_regex_match (r->regex, path, 0, NULL))
+        flags |= r->flags;
+    }
+  return flags;
+}
+
+static guint32
+path_rule_node_flags (const PathRuleNode *node,
+                      const char         *path,
+                      const char         *rest,
+                      guint32             flags)
+{
+  flags |= node->prefix_flags;
+  if (*rest == '\0')
+    flags |= node->dir_flags | node->exact_flags;
+  else if (*rest == '/')
+    flags |= node->dir_flags;
+  return path_rule_node_regex_flags (node, path, flags);
+}
+
+static guint32
+path_rules_match_from (const PathRuleNode *node,
+                       const char         *path,
+                       const char         *rest,
+                       guint32             flags)
+{
+  while (node)
+    {
+      flags = path_rule_node_flags (node, path, rest, flags);
+      if (*rest == '\0')
+        break;
+      node = path_rule_node_child (node, *rest);
+      rest++;
+    }
+  return flags;
+}
+
+/* Returns: The union of the flags of all rules matching @path */
+guint32
+rpmostree_path_rules_match (RpmOstreePathRules *rules,
+                            const char         *path)
+{
+  return path_rules_match_from (&rules->root, path, path, 0);
+}
+
+/* Like rpmostree_path_rules_match(), but for a path relative to /; that is
+ * "usr/bin" matches the same literal rules as "/usr/bin".  Regexes see
+ * @relpath as is.
+ */
+guint32
+rpmostree_path_rules_match_relative (RpmOstreePathRules *rules,
+                                     const char         *relpath)
+{
+  g_assert (*relpath != '/');
+  /* Regexes without a prefix still apply */
+  guint32 flags = path_rule_node_regex_flags (&rules->root, relpath, 0);
+  return path_rules_match_from (path_rule_node_child (&rules->root, '/'),
+                                relpath, relpath, flags);
+}
+
+/* The rules for where content may live in an ostree-based system, and
+ * how it's translated on import.
+ */
+static RpmOstreePathRules *
+path_rules_new_default (void)
+{
+  RpmOstreePathRules *rules = rpmostree_path_rules_new ();
+
+  rpmostree_path_rules_add (rules, RPMOSTREE_PATH_MATCH_EXACT, "/", RPMOSTREE_PATH_FLAG_OSTREE_COMPLIANT);
+  static const char *compliant_dirs[] = { "/usr", "/bin", "/sbin", "/lib", "/lib64" };
+  for (guint i = 0; i < G_N_ELEMENTS (compliant_dirs); i++)
+    rpmostree_path_rules_add (rules, RPMOSTREE_PATH_MATCH_DIR, compliant_dirs[i],
+                              RPMOSTREE_PATH_FLAG_OSTREE_COMPLIANT);
+  rpmostree_path_rules_add (rules, RPMOSTREE_PATH_MATCH_PREFIX, "/usr/local/", RPMOSTREE_PATH_FLAG_USR_LOCAL);
+  rpmostree_path_rules_add (rules, RPMOSTREE_PATH_MATCH_PREFIX, "/opt/", RPMOSTREE_PATH_FLAG_OPT);
+  rpmostree_path_rules_add (rules, RPMOSTREE_PATH_MATCH_PREFIX, "/run/", RPMOSTREE_PATH_FLAG_TMPFILES);
+  rpmostree_path_rules_add (rules, RPMOSTREE_PATH_MATCH_PREFIX, "/var/", RPMOSTREE_PATH_FLAG_TMPFILES);
+  rpmostree_path_rules_add (rules, RPMOSTREE_PATH_MATCH_PREFIX, "/var/lib/rpm", RPMOSTREE_PATH_FLAG_VAR_LIB_RPM);
+  rpmostree_path_rules_add (rules, RPMOSTREE_PATH_MATCH_PREFIX, "/var/run/", RPMOSTREE_PATH_FLAG_VAR_RUN);
+  rpmostree_path_rules_add (rules, RPMOSTREE_PATH_MATCH_PREFIX, "/etc/", RPMOSTREE_PATH_FLAG_ETC);
+  rpmostree_path_rules_add (rules, RPMOSTREE_PATH_MATCH_PREFIX, "/boot/", RPMOSTREE_PATH_FLAG_BOOT);
+  rpmostree_path_rules_add (rules, RPMOSTREE_PATH_MATCH_PREFIX, "/usr/lib/ostree-boot/", RPMOSTREE_PATH_FLAG_OSTREE_BOOT);
+  rpmostree_path_rules_add (rules, RPMOSTREE_PATH_MATCH_PREFIX, "/" VAR_SELINUX_TARGETED_PATH, RPMOSTREE_PATH_FLAG_VAR_SELINUX);
+  rpmostree_path_rules_add (rules, RPMOSTREE_PATH_MATCH_PREFIX, "/usr/etc/", RPMOSTREE_PATH_FLAG_USR_ETC);
+  rpmostree_path_rules_add (rules, RPMOSTREE_PATH_MATCH_PREFIX, "/usr/", RPMOSTREE_PATH_FLAG_USR);
+  rpmostree_path_rules_add (rules, RPMOSTREE_PATH_MATCH_PREFIX, "/" RPMOSTREE_RPMDB_LOCATION "/", RPMOSTREE_PATH_FLAG_RPMDB);
+  rpmostree_path_rules_add (rules, RPMOSTREE_PATH_MATCH_PREFIX, "/usr/lib/tmpfiles.d", RPMOSTREE_PATH_FLAG_TMPFILES_D);
+  rpmostree_path_rules_add (rules, RPMOSTREE_PATH_MATCH_EXACT, "/proc", RPMOSTREE_PATH_FLAG_PROC);
+  /* These empty lock files cause problems;
+   * https://github.com/projectatomic/rpm-ostree/pull/1002
+   */
+  g_autoptr(GError) local_error = NULL;
+  if (!rpmostree_path_rules_add_regex (rules, "/usr/etc/selinux", "\\.LOCK$",
+                                       RPMOSTREE_PATH_FLAG_SELINUX_LOCK, &local_error))
+    g_error ("%s", local_error->message);
+
+  return rules;
+}
+
+/* Returns: (transfer none): The built-in rules; see RpmOstreePathFlags */
+RpmOstreePathRules *
+rpmostree_path_rules_get_default (void)
+{
+  static gsize initialized;
+  static RpmOstreePathRules *rules;
+  if (g_once_init_enter (&initialized))
+    {
+      rules = path_rules_new_default ();
+      g_once_init_leave (&initialized, 1);
+    }
+  return rules;
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* A compiled set of path classification rules.  Literal rules are stored
+ * in a prefix trie, and regexes hang off the trie node for their (optional)
+ * literal prefix, so classifying a path is a single walk over it which
+ * returns the union of the flags of all matching rules.  Rules are added up
+ * front; after that a ruleset is immutable and may be shared between
+ * threads.
+ */
+typedef struct RpmOstreePathRules RpmOstreePathRules;
+
+typedef enum {
+  RPMOSTREE_PATH_MATCH_PREFIX, /* Any path starting with the string */
+  RPMOSTREE_PATH_MATCH_DIR,    /* The path itself, or anything below it */
+  RPMOSTREE_PATH_MATCH_EXACT,  /* Only the path itself */
+} RpmOstreePathMatch;
+
+RpmOstreePathRules *rpmostree_path_rules_new (void);
+RpmOstreePathRules *rpmostree_path_rules_ref (RpmOstreePathRules *rules);
+void rpmostree_path_rules_unref (RpmOstreePathRules *rules);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(RpmOstreePathRules, rpmostree_path_rules_unref)
+
+void rpmostree_path_rules_add (RpmOstreePathRules *rules,
+                               RpmOstreePathMatch  match,
+                               const char         *path,
+                               guint32             flags);
+
+gboolean rpmostree_path_rules_add_regex (RpmOstreePathRules *rules,
+                                         const char         *prefix,
+                                         const char         *pattern,
+                                         guint32             flags,
+                                         GError            **error);
+
+guint32 rpmostree_path_rules_match (RpmOstreePathRules *rules,
+                                    const char         *path);
+guint32 rpmostree_path_rules_match_relative (RpmOstreePathRules *rules,
+                                             const char         *relpath);
+
+/* Flags for the built-in rules, returned by rpmostree_path_rules_get_default() */
+typedef enum {
+  RPMOSTREE_PATH_FLAG_OSTREE_COMPLIANT = (1 << 0),  /* /, and the /usr, /bin, /sbin, /lib, /lib64 trees */
+  RPMOSTREE_PATH_FLAG_USR_LOCAL        = (1 << 1),  /* Below /usr/local/; not compliant */
+  RPMOSTREE_PATH_FLAG_OPT              = (1 << 2),  /* Below /opt/; translated to /usr/lib/opt */
+  RPMOSTREE_PATH_FLAG_TMPFILES         = (1 << 3),  /* Below /run/ or /var/; converted to tmpfiles.d */
+  RPMOSTREE_PATH_FLAG_VAR_LIB_RPM      = (1 << 4),  /* Starts with /var/lib/rpm */
+  RPMOSTREE_PATH_FLAG_VAR_RUN          = (1 << 5),  /* Below /var/run/ */
+  RPMOSTREE_PATH_FLAG_SELINUX_LOCK     = (1 << 6),  /* A .LOCK file in /usr/etc/selinux */
+  RPMOSTREE_PATH_FLAG_ETC              = (1 << 7),  /* Below /etc/ */
+  RPMOSTREE_PATH_FLAG_BOOT             = (1 << 8),  /* Below /boot/ */
+  RPMOSTREE_PATH_FLAG_VAR_SELINUX      = (1 << 9),  /* Below /var/lib/selinux/targeted/ */
+  RPMOSTREE_PATH_FLAG_USR_ETC          = (1 << 10), /* Below /usr/etc/ */
+  RPMOSTREE_PATH_FLAG_USR              = (1 << 11), /* Below /usr/ */
+  RPMOSTREE_PATH_FLAG_RPMDB            = (1 << 12), /* Below the rpmdb location in /usr */
+  RPMOSTREE_PATH_FLAG_TMPFILES_D       = (1 << 13), /* Starts with /usr/lib/tmpfiles.d */
+  RPMOSTREE_PATH_FLAG_PROC             = (1 << 14), /* Exactly /proc */
+  RPMOSTREE_PATH_FLAG_OSTREE_BOOT      = (1 << 15), /* Below /usr/lib/ostree-boot/ */
+} RpmOstreePathFlags;
+
+RpmOstreePathRules *rpmostree_path_rules_get_default (void);
+
+G_END_DECLS
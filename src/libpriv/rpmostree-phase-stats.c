@@ -0,0 +1,323 @@
+/*
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config.h"
+
+#include <sys/resource.h>
+#include <libglnx.h>
+
+#include "rpmostree-phase-stats.h"
+#include "rpmostree-probes.h"
+
+/* A point-in-time sample of our resource usage. We use RUSAGE_SELF rather
+ * than RUSAGE_THREAD since e.g. libostree does its checkout and commit writes
+ * from worker threads; callers are expected to run one operation at a time.
+ */
+typedef struct {
+  gint64 monotonic_usec;
+  struct rusage self;
+  struct rusage children;
+} UsageSample;
+
+typedef struct {
+  char *name;
+  guint depth; /* Phases may be re-entered while active; only the outermost counts */
+  UsageSample start;
+  RpmOstreeUsage usage;
+} Phase;
+
+struct RpmOstreePhaseStats {
+  GMutex lock;
+  UsageSample start;
+  RpmOstreeUsage total;
+  gboolean finished;
+  GPtrArray *phases; /* Phase, in order of first entry */
+  GHashTable *counters; /* Map<char *name, guint64 *value> */
+};
+
+static void
+phase_free (Phase *phase)
+{
+  g_free (phase->name);
+  g_free (phase);
+}
+
+static void
+usage_sample (UsageSample *sample)
+{
+  sample->monotonic_usec = g_get_monotonic_time ();
+  (void) getrusage (RUSAGE_SELF, &sample->self);
+  (void) getrusage (RUSAGE_CHILDREN, &sample->children);
+}
+
+static guint64
+timeval_to_usec (const struct timeval *tv)
+{
+  return ((guint64)tv->tv_sec) * G_USEC_PER_SEC + tv->tv_usec;
+}
+
+/* Add the usage since @start to @usage */
+static void
+usage_accumulate (RpmOstreeUsage    *usage,
+                  const UsageSample *start)
+{
+  UsageSample end;
+  usage_sample (&end);
+
+#define DELTA(field) ((end.self.field - start->self.field) + \
+                      (end.children.field - start->children.field))
+#define DELTA_TV(field) ((timeval_to_usec (&end.self.field) - timeval_to_usec (&start->self.field)) + \
+                         (timeval_to_usec (&end.children.field) - timeval_to_usec (&start->children.field)))
+  usage->elapsed_usec += end.monotonic_usec - start->monotonic_usec;
+  usage->utime_usec += DELTA_TV (ru_utime);
+  usage->stime_usec += DELTA_TV (ru_stime);
+  usage->inblock += DELTA (ru_inblock);
+  usage->oublock += DELTA (ru_oublock);
+#undef DELTA_TV
+#undef DELTA
+  usage->maxrss_kb = MAX (usage->maxrss_kb, MAX (end.self.ru_maxrss, end.children.ru_maxrss));
+  usage->count++;
+}
+
+RpmOstreePhaseStats *
+rpmostree_phase_stats_new (void)
+{
+  RpmOstreePhaseStats *stats = g_new0 (RpmOstreePhaseStats, 1);
+  g_mutex_init (&stats->lock);
+  stats->phases = g_ptr_array_new_with_free_func ((GDestroyNotify)phase_free);
+  stats->counters = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  usage_sample (&stats->start);
+  return stats;
+}
+
+void
+rpmostree_phase_stats_free (RpmOstreePhaseStats *stats)
+{
+  g_ptr_array_unref (stats->phases);
+  g_hash_table_unref (stats->counters);
+  g_mutex_clear (&stats->lock);
+  g_free (stats);
+}
+
+static Phase *
+lookup_phase (RpmOstreePhaseStats *stats,
+              const char          *name)
+{
+  for (guint i = 0; i < stats->phases->len; i++)
+    {
+      Phase *phase = stats->phases->pdata[i];
+      if (g_str_equal (phase->name, name))
+        return phase;
+    }
+  return NULL;
+}
+
+void
+rpmostree_phase_stats_begin (RpmOstreePhaseStats *stats,
+                             const char          *name)
+{
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&stats->lock);
+
+  Phase *phase = lookup_phase (stats, name);
+  if (!phase)
+    {
+      phase = g_new0 (Phase, 1);
+      phase->name = g_strdup (name);
+      g_ptr_array_add (stats->phases, phase);
+    }
+  if (phase->depth++ == 0)
+    {
+      usage_sample (&phase->start);
+      RPMOSTREE_PROBE1 (phase__begin, phase->name);
+    }
+}
+
+void
+rpmostree_phase_stats_end (RpmOstreePhaseStats *stats,
+                           const char          *name)
+{
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&stats->lock);
+
+  Phase *phase = lookup_phase (stats, name);
+  g_return_if_fail (phase != NULL && phase->depth > 0);
+  if (--phase->depth == 0)
+    {
+      usage_accumulate (&phase->usage, &phase->start);
+      RPMOSTREE_PROBE2 (phase__end, phase->name,
+                        g_get_monotonic_time () - phase->start.monotonic_usec);
+    }
+}
+
+void
+rpmostree_phase_stats_add_counter (RpmOstreePhaseStats *stats,
+                                   const char          *name,
+                                   guint64              value)
+{
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&stats->lock);
+  guint64 *counter = g_hash_table_lookup (stats->counters, name);
+  if (!counter)
+    {
+      counter = g_new0 (guint64, 1);
+      g_hash_table_insert (stats->counters, g_strdup (name), counter);
+    }
+  *counter += value;
+}
+
+guint64
+rpmostree_phase_stats_get_counter (RpmOstreePhaseStats *stats,
+                                   const char          *name)
+{
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&stats->lock);
+  guint64 *counter = g_hash_table_lookup (stats->counters, name);
+  return counter ? *counter : 0;
+}
+
+/* Stop accounting; phases left open (e.g. on error) are accounted up to now. */
+void
+rpmostree_phase_stats_finish (RpmOstreePhaseStats *stats)
+{
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&stats->lock);
+
+  if (stats->finished)
+    return;
+  stats->finished = TRUE;
+
+  for (guint i = 0; i < stats->phases->len; i++)
+    {
+      Phase *phase = stats->phases->pdata[i];
+      if (phase->depth > 0)
+        {
+          phase->depth = 0;
+          usage_accumulate (&phase->usage, &phase->start);
+        }
+    }
+  usage_accumulate (&stats->total, &stats->start);
+}
+
+void
+rpmostree_phase_stats_get_total (RpmOstreePhaseStats *stats,
+                                 RpmOstreeUsage      *out_usage)
+{
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&stats->lock);
+  g_return_if_fail (stats->finished);
+  *out_usage = stats->total;
+}
+
+gboolean
+rpmostree_phase_stats_lookup (RpmOstreePhaseStats *stats,
+                              const char          *name,
+                              RpmOstreeUsage      *out_usage)
+{
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&stats->lock);
+  Phase *phase = lookup_phase (stats, name);
+  if (!phase)
+    return FALSE;
+  *out_usage = phase->usage;
+  return TRUE;
+}
+
+void
+rpmostree_usage_to_vardict (const RpmOstreeUsage *usage,
+                            GVariantDict         *dict)
+{
+  g_variant_dict_insert (dict, "elapsed-ms", "t", usage->elapsed_usec / 1000);
+  g_variant_dict_insert (dict, "utime-ms", "t", usage->utime_usec / 1000);
+  g_variant_dict_insert (dict, "stime-ms", "t", usage->stime_usec / 1000);
+  g_variant_dict_insert (dict, "inblock", "t", usage->inblock);
+  g_variant_dict_insert (dict, "oublock", "t", usage->oublock);
+  g_variant_dict_insert (dict, "maxrss-kb", "t", usage->maxrss_kb);
+  g_variant_dict_insert (dict, "count", "u", usage->count);
+}
+
+/* Returns a floating a{sv} with the total usage, plus a "phases" aa{sv} with
+ * the usage of each phase and its "name", and the "counters" as an a{st}. */
+GVariant *
+rpmostree_phase_stats_to_variant (RpmOstreePhaseStats *stats)
+{
+  rpmostree_phase_stats_finish (stats);
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&stats->lock);
+
+  g_autoptr(GVariantDict) dict = g_variant_dict_new (NULL);
+  rpmostree_usage_to_vardict (&stats->total, dict);
+
+  g_auto(GVariantBuilder) phases;
+  g_variant_builder_init (&phases, G_VARIANT_TYPE ("aa{sv}"));
+  for (guint i = 0; i < stats->phases->len; i++)
+    {
+      Phase *phase = stats->phases->pdata[i];
+      g_autoptr(GVariantDict) phase_dict = g_variant_dict_new (NULL);
+      g_variant_dict_insert (phase_dict, "name", "s", phase->name);
+      rpmostree_usage_to_vardict (&phase->usage, phase_dict);
+      g_variant_builder_add_value (&phases, g_variant_dict_end (phase_dict));
+    }
+  g_variant_dict_insert_value (dict, "phases", g_variant_builder_end (&phases));
+
+  g_auto(GVariantBuilder) counters;
+  g_variant_builder_init (&counters, G_VARIANT_TYPE ("a{st}"));
+  GLNX_HASH_TABLE_FOREACH_KV (stats->counters, const char*, name, guint64*, value)
+    g_variant_builder_add (&counters, "{st}", name, *value);
+  g_variant_dict_insert_value (dict, "counters", g_variant_builder_end (&counters));
+
+  return g_variant_dict_end (dict);
+}
+
+/* Returns e.g. "download=1200 import=340", in milliseconds */
+char *
+rpmostree_phase_stats_to_summary (RpmOstreePhaseStats *stats)
+{
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&stats->lock);
+  GString *buf = g_string_new ("");
+  for (guint i = 0; i < stats->phases->len; i++)
+    {
+      Phase *phase = stats->phases->pdata[i];
+      if (buf->len > 0)
+        g_string_append_c (buf, ' ');
+      g_string_append_printf (buf, "%s=%" G_GUINT64_FORMAT, phase->name,
+                              phase->usage.elapsed_usec / 1000);
+    }
+  return g_string_free (buf, FALSE);
+}
+
+/* An output callback for use with rpmostree_output_set_callback() which
+ * accounts phases and counters into @opaque, a #RpmOstreePhaseStats, and
+ * forwards everything else to the default handler. */
+void
+rpmostree_phase_stats_output_cb (RpmOstreeOutputType type,
+                                 void               *data,
+                                 void               *opaque)
+{
+  RpmOstreePhaseStats *stats = opaque;
+  switch (type)
+    {
+    case RPMOSTREE_OUTPUT_PHASE_BEGIN:
+      rpmostree_phase_stats_begin (stats, ((RpmOstreeOutputPhase*)data)->name);
+      break;
+    case RPMOSTREE_OUTPUT_PHASE_END:
+      rpmostree_phase_stats_end (stats, ((RpmOstreeOutputPhase*)data)->name);
+      break;
+    case RPMOSTREE_OUTPUT_COUNTER:
+      {
+        RpmOstreeOutputCounter *counter = data;
+        rpmostree_phase_stats_add_counter (stats, counter->name, counter->value);
+      }
+      break;
+    default:
+      rpmostree_output_default_handler (type, data, NULL);
+      break;
+    }
+}
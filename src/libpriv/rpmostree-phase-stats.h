@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+#include "rpmostree-output.h"
+
+G_BEGIN_DECLS
+
+/* Wall clock time and resource usage, accumulated over one or more intervals.
+ * CPU and IO include reaped child processes (scripts, dracut); since getrusage()
+ * only offers a high-water mark, maxrss_kb is the peak as of the end of the
+ * last interval.
+ */
+typedef struct {
+  guint64 elapsed_usec;
+  guint64 utime_usec;
+  guint64 stime_usec;
+  guint64 inblock;
+  guint64 oublock;
+  guint64 maxrss_kb;
+  guint count;
+} RpmOstreeUsage;
+
+/* Accounts usage for a whole operation (from _new() to _finish()) and for each
+ * of the phases marked with rpmostree_output_phase_begin(), along with any
+ * counters from rpmostree_output_counter(). This is thread-safe.
+ */
+typedef struct RpmOstreePhaseStats RpmOstreePhaseStats;
+
+RpmOstreePhaseStats *rpmostree_phase_stats_new (void);
+void rpmostree_phase_stats_free (RpmOstreePhaseStats *stats);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (RpmOstreePhaseStats, rpmostree_phase_stats_free)
+
+void rpmostree_phase_stats_begin (RpmOstreePhaseStats *stats,
+                                  const char          *name);
+void rpmostree_phase_stats_end (RpmOstreePhaseStats *stats,
+                                const char          *name);
+
+void rpmostree_phase_stats_add_counter (RpmOstreePhaseStats *stats,
+                                        const char          *name,
+                                        guint64              value);
+guint64 rpmostree_phase_stats_get_counter (RpmOstreePhaseStats *stats,
+                                           const char          *name);
+
+void rpmostree_phase_stats_finish (RpmOstreePhaseStats *stats);
+
+void rpmostree_phase_stats_get_total (RpmOstreePhaseStats *stats,
+                                      RpmOstreeUsage      *out_usage);
+gboolean rpmostree_phase_stats_lookup (RpmOstreePhaseStats *stats,
+                                       const char          *name,
+                                       RpmOstreeUsage      *out_usage);
+
+void rpmostree_usage_to_vardict (const RpmOstreeUsage *usage,
+                                 GVariantDict         *dict);
+
+GVariant *rpmostree_phase_stats_to_variant (RpmOstreePhaseStats *stats);
+char *rpmostree_phase_stats_to_summary (RpmOstreePhaseStats *stats);
+
+void rpmostree_phase_stats_output_cb (RpmOstreeOutputType type,
+                                      void               *data,
+                                      void               *opaque);
+
+G_END_DECLS
@@ -42,11 +42,13 @@
 #include "rpmostree-kernel.h"
 #include "rpmostree-bwrap.h"
 #include "rpmostree-output.h"
+#include "rpmostree-probes.h"
 #include "rpmostree-passwd-util.h"
 #include "rpmostree-rpm-util.h"
 #include "rpmostree-core.h"
 #include "rpmostree-json-parsing.h"
 #include "rpmostree-util.h"
+#include "rpmostree-pathrules.h"
 #include "rpmostree-rust.h"
 
 typedef enum {
@@ -477,8 +479,12 @@ process_kernel_and_initramfs (int            rootfs_dfd,
   return TRUE;
 }
 
+/* Append tmpfiles.d entries for the contents of @dfd (which is at @prefix)
+ * to @tmpfiles_d, deleting them as we go.  Subdirectories are opened
+ * relative to their parent, and the output is accumulated in memory.
+ */
 static gboolean
-convert_var_to_tmpfiles_d_recurse (GOutputStream *tmpfiles_out,
+convert_var_to_tmpfiles_d_recurse (GString       *tmpfiles_d,
                                    int            dfd,
                                    RpmOstreePasswdDB *pwdb,
                                    GString       *prefix,
@@ -486,9 +492,8 @@ convert_var_to_tmpfiles_d_recurse (GOutputStream *tmpfiles_out,
                                    GError       **error)
 {
   g_auto(GLnxDirFdIterator) dfd_iter = { 0, };
-  gsize bytes_written;
 
-  if (!glnx_dirfd_iterator_init_at (dfd, prefix->str + 1, TRUE, &dfd_iter, error))
+  if (!glnx_dirfd_iterator_init_take_fd (&dfd, &dfd_iter, error))
     return FALSE;
 
   while (TRUE)
@@ -549,13 +554,17 @@ convert_var_to_tmpfiles_d_recurse (GOutputStream *tmpfiles_out,
 
           if (filetype_c == 'd')
             {
+              glnx_autofd int subdfd = -1;
+              if (!glnx_opendirat (dfd_iter.fd, dent->d_name, FALSE, &subdfd, error))
+                return FALSE;
+
               /* Push prefix */
               gsize prev_len = prefix->len;
               g_string_append_c (prefix, '/');
               g_string_append (prefix, dent->d_name);
 
-              if (!convert_var_to_tmpfiles_d_recurse (tmpfiles_out, dfd, pwdb, prefix,
-                                                      cancellable, error))
+              if (!convert_var_to_tmpfiles_d_recurse (tmpfiles_d, glnx_steal_fd (&subdfd),
+                                                      pwdb, prefix, cancellable, error))
                 return FALSE;
 
               /* Pop prefix */
@@ -576,12 +585,9 @@ convert_var_to_tmpfiles_d_recurse (GOutputStream *tmpfiles_out,
                           dent->d_type == DT_DIR ? AT_REMOVEDIR : 0, error))
         return FALSE;
 
+      /* Note a directory is emitted after its contents */
       g_string_append_c (tmpfiles_d_buf, '\n');
-
-      if (!g_output_stream_write_all (tmpfiles_out, tmpfiles_d_buf->str,
-                                      tmpfiles_d_buf->len, &bytes_written,
-                                      cancellable, error))
-        return FALSE;
+      g_string_append_len (tmpfiles_d, tmpfiles_d_buf->str, tmpfiles_d_buf->len);
     }
 
   return TRUE;
@@ -637,20 +643,18 @@ convert_var_to_tmpfiles_d (int            rootfs_dfd,
   /* Convert /var wholesale to tmpfiles.d. Note that with unified core, this
    * code should no longer be necessary as we convert packages on import.
    */
-  g_auto(GLnxTmpfile) tmpf = { 0, };
-  if (!glnx_open_tmpfile_linkable_at (rootfs_dfd, "usr/lib/tmpfiles.d", O_WRONLY | O_CLOEXEC,
-                                      &tmpf, error))
-    return FALSE;
-  g_autoptr(GOutputStream) tmpfiles_out = g_unix_output_stream_new (tmpf.fd, FALSE);
-  if (!tmpfiles_out)
-    return FALSE;
-
+  g_autoptr(GString) tmpfiles_d = g_string_new ("");
   g_autoptr(GString) prefix = g_string_new ("/var");
-  if (!convert_var_to_tmpfiles_d_recurse (tmpfiles_out, rootfs_dfd, pwdb, prefix, cancellable, error))
+  if (!convert_var_to_tmpfiles_d_recurse (tmpfiles_d, glnx_steal_fd (&var_dfd), pwdb, prefix,
+                                          cancellable, error))
     return FALSE;
 
-  if (!g_output_stream_close (tmpfiles_out, cancellable, error))
+  g_auto(GLnxTmpfile) tmpf = { 0, };
+  if (!glnx_open_tmpfile_linkable_at (rootfs_dfd, "usr/lib/tmpfiles.d", O_WRONLY | O_CLOEXEC,
+                                      &tmpf, error))
     return FALSE;
+  if (glnx_loop_write (tmpf.fd, tmpfiles_d->str, tmpfiles_d->len) < 0)
+    return glnx_throw_errno_prefix (error, "write");
 
   /* Make it world-readable, no reason why not to
    * https://bugzilla.redhat.com/show_bug.cgi?id=1631794
@@ -1108,32 +1112,32 @@ handle_remove_files_from_package (int               rootfs_fd,
   if (npackages == 0)
     return glnx_throw (error, "Unable to find package '%s' specified in remove-from-packages", pkgname);
 
+  /* Compile the patterns once, and check each file against all of them */
+  g_autoptr(RpmOstreePathRules) rules = rpmostree_path_rules_new ();
+  for (guint i = 1; i < len; i++)
+    {
+      const char *remove_regex_pattern = json_array_get_string_element (removespec, i);
+      if (!rpmostree_path_rules_add_regex (rules, NULL, remove_regex_pattern, 1, error))
+        return FALSE;
+    }
+
   for (guint j = 0; j < npackages; j++)
     {
       DnfPackage *pkg = pkglist->pdata[j];
       g_auto(GStrv) pkg_files = dnf_package_get_files (pkg);
 
-      for (guint i = 1; i < len; i++)
+      for (char **strviter = pkg_files; strviter && strviter[0]; strviter++)
         {
-          const char *remove_regex_pattern = json_array_get_string_element (removespec, i);
+          const char *file = *strviter;
 
-          GRegex *regex = g_regex_new (remove_regex_pattern, G_REGEX_JAVASCRIPT_COMPAT, 0, error);
-          if (!regex)
-            return FALSE;
-
-          for (char **strviter = pkg_files; strviter && strviter[0]; strviter++)
+          if (rpmostree_path_rules_match (rules, file))
             {
-              const char *file = *strviter;
-
-              if (g_regex_match (regex, file, 0, NULL))
-                {
-                  if (file[0] == '/')
-                    file++;
+              if (file[0] == '/')
+                file++;
 
-                  g_print ("Deleting: %s\n", file);
-                  if (!glnx_shutil_rm_rf_at (rootfs_fd, file, cancellable, error))
-                    return FALSE;
-                }
+              g_print ("Deleting: %s\n", file);
+              if (!glnx_shutil_rm_rf_at (rootfs_fd, file, cancellable, error))
+                return FALSE;
             }
         }
     }
@@ -1888,13 +1892,19 @@ struct CommitThreadData {
   int rootfs_fd;
   OstreeMutableTree *mtree;
   OstreeSePolicy *sepolicy;
+  /* If set, we label from this rather than libostree from @sepolicy */
+  RpmOstreeSeLabelCache *selabel_cache;
   OstreeRepoCommitModifier *commit_modifier;
   gboolean success;
   GCancellable *cancellable;
   GError **error;
+  /* The first error from filter_xattrs_cb(), which can't throw; we cancel
+   * @cancellable to stop the commit */
+  GError *xattrs_error;
 };
 
-/* Filters out all xattrs that aren't accepted. */
+/* Filters out all xattrs that aren't accepted, and labels if we have a
+ * label cache. */
 static GVariant *
 filter_xattrs_cb (OstreeRepo     *repo,
                   const char     *relpath,
@@ -1951,14 +1961,36 @@ filter_xattrs_cb (OstreeRepo     *repo,
         }
     }
 
+  if (tdata->selabel_cache)
+    {
+      /* Like ERROR_ON_UNLABELED */
+      const char *label = NULL;
+      g_autofree char *abspath = g_strconcat ("/", relpath, NULL);
+      const guint32 mode = g_file_info_get_attribute_uint32 (file_info, "unix::mode");
+      if (!rpmostree_selabel_cache_lookup (tdata->selabel_cache, abspath, mode, &label, error))
+        goto out;
+      if (!label)
+        {
+          glnx_throw (error, "Failed to look up SELinux label");
+          goto out;
+        }
+      g_variant_builder_add (&builder, "(@ay@ay)",
+                             g_variant_new_bytestring ("security.selinux"),
+                             g_variant_new_bytestring (label));
+    }
+
  out:
   if (local_error)
     {
-      g_variant_builder_clear (&builder);
-      /* Unfortunately we have no way to throw from this callback */
-      g_printerr ("Failed to read xattrs of '%s': %s\n",
-                  relpath, local_error->message);
-      exit (1);
+      /* We have no way to throw from this callback, so stash the error and
+       * stop the commit; this is only ever called from the commit thread */
+      if (!tdata->xattrs_error)
+        {
+          g_prefix_error (&local_error, "Failed to read xattrs of '%s': ", relpath);
+          tdata->xattrs_error = g_steal_pointer (&local_error);
+        }
+      g_clear_error (&local_error);
+      g_cancellable_cancel (tdata->cancellable);
     }
   return g_variant_ref_sink (g_variant_builder_end (&builder));
 }
@@ -2004,6 +2036,13 @@ count_filesizes (int dfd,
   return TRUE;
 }
 
+static void
+on_commit_cancelled (GCancellable *cancellable,
+                     gpointer      user_data)
+{
+  g_cancellable_cancel (user_data);
+}
+
 static gpointer
 write_dfd_thread (gpointer datap)
 {
@@ -2030,6 +2069,7 @@ on_progress_timeout (gpointer datap)
 
   /* clamp to 100 if it somehow goes over (XXX: bad counting?) */
   rpmostree_output_progress_percent (MIN(percent, 100));
+  RPMOSTREE_PROBE2 (compose__commit__progress, data->n_processed, data->n_bytes);
 
   return TRUE;
 }
@@ -2046,6 +2086,7 @@ rpmostree_compose_commit (int            rootfs_fd,
                           const char    *gpg_keyid,
                           gboolean       enable_selinux,
                           OstreeRepoDevInoCache *devino_cache,
+                          RpmOstreeSeLabelCache *selabel_cache,
                           char         **out_new_revision,
                           GCancellable  *cancellable,
                           GError       **error)
@@ -2076,17 +2117,30 @@ rpmostree_compose_commit (int            rootfs_fd,
                                                   filter_xattrs_cb, NULL,
                                                   &tdata);
 
+  /* Most of the tree was already labeled when importing, so reuse those
+   * lookups if the policy is the same. */
   if (sepolicy && ostree_sepolicy_get_name (sepolicy) != NULL)
-    ostree_repo_commit_modifier_set_sepolicy (commit_modifier, sepolicy);
+    {
+      if (selabel_cache && rpmostree_selabel_cache_matches (selabel_cache, sepolicy))
+        tdata.selabel_cache = selabel_cache;
+      else
+        ostree_repo_commit_modifier_set_sepolicy (commit_modifier, sepolicy);
+    }
   else if (enable_selinux)
     return glnx_throw (error, "SELinux enabled, but no policy found");
 
   if (devino_cache)
     ostree_repo_commit_modifier_set_devino_cache (commit_modifier, devino_cache);
 
+  g_auto(RpmOstreePhase) phase = { 0, };
+  rpmostree_output_phase_begin (&phase, "commit");
+
   off_t n_bytes = 0;
-  if (!count_filesizes (rootfs_fd, ".", &n_bytes, cancellable, error))
-    return FALSE;
+  { g_auto(RpmOstreePhase) count_phase = { 0, };
+    rpmostree_output_phase_begin (&count_phase, "count-filesizes");
+    if (!count_filesizes (rootfs_fd, ".", &n_bytes, cancellable, error))
+      return FALSE;
+  }
 
   tdata.n_bytes = n_bytes;
   tdata.repo = repo;
@@ -2095,7 +2149,15 @@ rpmostree_compose_commit (int            rootfs_fd,
   tdata.sepolicy = sepolicy;
   tdata.commit_modifier = commit_modifier;
   tdata.error = error;
-
+  /* Our own, so that filter_xattrs_cb() can stop the commit */
+  g_autoptr(GCancellable) commit_cancellable = g_cancellable_new ();
+  tdata.cancellable = commit_cancellable;
+  gulong cancelled_id = 0;
+  if (cancellable)
+    cancelled_id = g_cancellable_connect (cancellable, G_CALLBACK (on_commit_cancelled),
+                                          commit_cancellable, NULL);
+
+  RPMOSTREE_PROBE1 (compose__commit__start, n_bytes);
   {
     g_autoptr(GThread) commit_thread = g_thread_new ("commit", write_dfd_thread, &tdata);
 
@@ -2114,9 +2176,19 @@ rpmostree_compose_commit (int            rootfs_fd,
 
     rpmostree_output_progress_percent (100);
   }
+  g_cancellable_disconnect (cancellable, cancelled_id);
 
+  if (tdata.xattrs_error)
+    {
+      /* Rather than the cancellation it caused */
+      g_clear_error (error);
+      g_propagate_error (error, g_steal_pointer (&tdata.xattrs_error));
+      return glnx_prefix_error (error, "While writing rootfs to mtree");
+    }
   if (!tdata.success)
     return glnx_prefix_error (error, "While writing rootfs to mtree");
+  if (tdata.selabel_cache)
+    rpmostree_selabel_cache_report (tdata.selabel_cache);
 
   g_autoptr(GFile) root_tree = NULL;
   if (!ostree_repo_write_mtree (repo, mtree, &root_tree, cancellable, error))
@@ -2135,6 +2207,8 @@ rpmostree_compose_commit (int            rootfs_fd,
         return glnx_prefix_error (error, "While signing commit");
     }
 
+  RPMOSTREE_PROBE2 (compose__commit__done, new_revision, n_bytes);
+
   if (out_new_revision)
     *out_new_revision = g_steal_pointer (&new_revision);
 
@@ -23,6 +23,7 @@
 #include <ostree.h>
 #include "rpmostree-json-parsing.h"
 #include "rpmostree-rust.h"
+#include "rpmostree-selabel-cache.h"
 
 /* "public" for unit tests */
 char *
@@ -100,6 +101,7 @@ rpmostree_compose_commit (int            rootfs_dfd,
                           const char    *gpg_keyid,
                           gboolean       enable_selinux,
                           OstreeRepoDevInoCache *devino_cache,
+                          RpmOstreeSeLabelCache *selabel_cache,
                           char         **out_new_revision,
                           GCancellable  *cancellable,
                           GError       **error);
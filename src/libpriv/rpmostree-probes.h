@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+/* Static (USDT) tracepoints, under the "rpmostree" provider. When built with
+ * <sys/sdt.h> (systemtap-sdt-devel), each probe compiles down to a single nop
+ * plus an ELF note, so they can be left in production builds and attached to
+ * on demand, e.g.:
+ *
+ *   bpftrace -e 'usdt:/usr/bin/rpm-ostree:rpmostree:import__done { printf("%s %d\n", str(arg0), arg1); }'
+ *
+ * Arguments should be values already at hand; avoid doing work solely for a
+ * probe in inner loops.
+ * Strings are passed as `const char *`. Current probes:
+ *
+ *   import__start (nevra)
+ *   import__done (nevra, archive bytes read, n files, installed size)
+ *   checkout__start (nevra)
+ *   checkout__done (nevra, installed size)
+ *   script__start (pkg name, script description)
+ *   script__done (pkg name, script description, script length, elapsed usec)
+ *   relabel__start (nevra)
+ *   relabel__done (nevra, changed)
+ *   compose__commit__start (total bytes)
+ *   compose__commit__progress (bytes processed, total bytes)
+ *   compose__commit__done (revision, total bytes)
+ *   txn__start (method, object path)
+ *   phase__begin (phase)
+ *   phase__end (phase, elapsed usec)
+ *   txn__done (method, success, elapsed usec)
+ */
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define RPMOSTREE_PROBE(name) DTRACE_PROBE (rpmostree, name)
+#define RPMOSTREE_PROBE1(name, a) DTRACE_PROBE1 (rpmostree, name, a)
+#define RPMOSTREE_PROBE2(name, a, b) DTRACE_PROBE2 (rpmostree, name, a, b)
+#define RPMOSTREE_PROBE3(name, a, b, c) DTRACE_PROBE3 (rpmostree, name, a, b, c)
+#define RPMOSTREE_PROBE4(name, a, b, c, d) DTRACE_PROBE4 (rpmostree, name, a, b, c, d)
+#else
+/* Reference (but never evaluate) the arguments to avoid unused warnings */
+#define RPMOSTREE_PROBE(name) do {} while (0)
+#define RPMOSTREE_PROBE1(name, a) do { if (0) { (void) (a); } } while (0)
+#define RPMOSTREE_PROBE2(name, a, b) do { if (0) { (void) (a); (void) (b); } } while (0)
+#define RPMOSTREE_PROBE3(name, a, b, c) do { if (0) { (void) (a); (void) (b); (void) (c); } } while (0)
+#define RPMOSTREE_PROBE4(name, a, b, c, d) do { if (0) { (void) (a); (void) (b); (void) (c); (void) (d); } } while (0)
+#endif
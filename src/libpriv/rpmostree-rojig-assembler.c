@@ -22,12 +22,11 @@
 
 #include "config.h"
 
-#include <gio/gunixinputstream.h>
-#include "rpmostree-libarchive-input-stream.h"
 #include "rpmostree-unpacker-core.h"
 #include "rpmostree-rojig-assembler.h"
 #include "rpmostree-core.h"
 #include "rpmostree-rpm-util.h"
+#include "rpmostree-sched.h"
 #include <rpm/rpmlib.h>
 #include <rpm/rpmlog.h>
 #include <rpm/rpmfi.h>
@@ -66,6 +65,7 @@ struct RpmOstreeRojigAssembler
   GVariant *meta;
   char *checksum;
   GVariant *xattrs_table;
+  GPtrArray *xattrs_dict; /* Direct-indexed view of xattrs_table */
   struct archive *archive;
   struct archive_entry *next_entry;
   int fd;
@@ -84,6 +84,7 @@ rpmostree_rojig_assembler_finalize (GObject *object)
   g_free (self->checksum);
   g_clear_object (&self->pkg);
   g_clear_pointer (&self->xattrs_table, (GDestroyNotify)g_variant_unref);
+  g_clear_pointer (&self->xattrs_dict, (GDestroyNotify)g_ptr_array_unref);
   glnx_close_fd (&self->fd);
 
   G_OBJECT_CLASS (rpmostree_rojig_assembler_parent_class)->finalize (object);
@@ -318,9 +319,260 @@ rpmostree_rojig_assembler_read_meta (RpmOstreeRojigAssembler    *self,
   return TRUE;
 }
 
+/* Objects are checksummed and written by a pool of workers while the calling
+ * thread keeps decompressing the archive; this bounds how much data can be
+ * queued between the two.
+ */
+#define ROJIG_WRITE_MAX_QUEUED_BYTES (64 * 1024 * 1024)
+/* Payloads larger than this are staged in a tmpfile rather than in memory */
+#define ROJIG_PAYLOAD_MAX_INMEM (1024 * 1024)
+
+typedef enum {
+  ROJIG_WRITE_METADATA,
+  ROJIG_WRITE_CONTENT,   /* A complete content object stream */
+  ROJIG_WRITE_RAW_FILE,  /* Regular file data, plus metadata */
+} RojigWriteKind;
+
+typedef struct {
+  RojigWriteKind kind;
+  OstreeObjectType objtype;
+  char *checksum;
+  GVariant *metadata;
+  /* Shared by all members of a content-identical set */
+  GBytes *payload;
+  guint32 uid;
+  guint32 gid;
+  guint32 mode;
+  GVariant *xattrs;
+  gsize size;
+} RojigWriteJob;
+
+static void
+rojig_write_job_free (RojigWriteJob *job)
+{
+  g_free (job->checksum);
+  g_clear_pointer (&job->metadata, (GDestroyNotify)g_variant_unref);
+  g_clear_pointer (&job->payload, g_bytes_unref);
+  g_clear_pointer (&job->xattrs, (GDestroyNotify)g_variant_unref);
+  g_free (job);
+}
+
+typedef struct {
+  OstreeRepo *repo;
+  GCancellable *cancellable;
+  GThreadPool *pool;
+  GMutex lock;
+  GCond cond;
+  gsize queued_bytes;
+  GError *error; /* First error from a worker */
+} RojigWriter;
+
+static gboolean
+rojig_write_job_run (RojigWriteJob *job,
+                     OstreeRepo    *repo,
+                     GCancellable  *cancellable,
+                     GError       **error)
+{
+  g_autofree guint8 *csum = NULL;
+  switch (job->kind)
+    {
+    case ROJIG_WRITE_METADATA:
+      return ostree_repo_write_metadata (repo, job->objtype, job->checksum, job->metadata,
+                                         &csum, cancellable, error);
+    case ROJIG_WRITE_CONTENT:
+      {
+        g_autoptr(GInputStream) istream = g_memory_input_stream_new_from_bytes (job->payload);
+        return ostree_repo_write_content (repo, job->checksum, istream,
+                                          g_bytes_get_size (job->payload),
+                                          &csum, cancellable, error);
+      }
+    case ROJIG_WRITE_RAW_FILE:
+      {
+        /* See if we already have this object */
+        gboolean has_object;
+        if (!ostree_repo_has_object (repo, OSTREE_OBJECT_TYPE_FILE, job->checksum,
+                                     &has_object, cancellable, error))
+          return FALSE;
+        if (has_object)
+          return TRUE;
+
+        g_autoptr(GInputStream) istream = g_memory_input_stream_new_from_bytes (job->payload);
+        /* Like _ostree_stbuf_to_gfileinfo() - TODO make that public with a
+         * better content writing API.
+         */
+        g_autoptr(GFileInfo) finfo = g_file_info_new ();
+        g_file_info_set_attribute_uint32 (finfo, "standard::type", G_FILE_TYPE_REGULAR);
+        g_file_info_set_attribute_boolean (finfo, "standard::is-symlink", FALSE);
+        g_file_info_set_attribute_uint32 (finfo, "unix::uid", job->uid);
+        g_file_info_set_attribute_uint32 (finfo, "unix::gid", job->gid);
+        g_file_info_set_attribute_uint32 (finfo, "unix::mode", job->mode);
+        g_file_info_set_attribute_uint64 (finfo, "standard::size", g_bytes_get_size (job->payload));
+
+        g_autoptr(GInputStream) objstream = NULL;
+        guint64 objlen;
+        if (!ostree_raw_file_to_content_stream (istream, finfo, job->xattrs, &objstream,
+                                                &objlen, cancellable, error))
+          return FALSE;
+        return ostree_repo_write_content (repo, job->checksum, objstream, objlen, &csum,
+                                          cancellable, error);
+      }
+    }
+  g_assert_not_reached ();
+}
+
+static void
+rojig_writer_worker (gpointer data,
+                     gpointer user_data)
+{
+  RojigWriteJob *job = data;
+  RojigWriter *writer = user_data;
+
+  rpmostree_sched_thread_enter ();
+
+  /* Once something failed, just drain the queue */
+  g_mutex_lock (&writer->lock);
+  const gboolean failed = writer->error != NULL;
+  g_mutex_unlock (&writer->lock);
+
+  g_autoptr(GError) local_error = NULL;
+  if (!failed)
+    (void) rojig_write_job_run (job, writer->repo, writer->cancellable, &local_error);
+
+  g_mutex_lock (&writer->lock);
+  if (local_error && !writer->error)
+    writer->error = g_steal_pointer (&local_error);
+  writer->queued_bytes -= job->size;
+  g_cond_broadcast (&writer->cond);
+  g_mutex_unlock (&writer->lock);
+
+  rojig_write_job_free (job);
+  rpmostree_sched_thread_leave ();
+}
+
+static gboolean
+rojig_writer_init (RojigWriter  *writer,
+                   OstreeRepo   *repo,
+                   GCancellable *cancellable,
+                   GError      **error)
+{
+  writer->repo = repo;
+  writer->cancellable = cancellable;
+  g_mutex_init (&writer->lock);
+  g_cond_init (&writer->cond);
+  const guint n_workers = rpmostree_sched_get_max_workers (g_get_num_processors ());
+  writer->pool = g_thread_pool_new (rojig_writer_worker, writer, n_workers, FALSE, error);
+  return writer->pool != NULL;
+}
+
+/* Queue @job (taking ownership), waiting for space if needed */
+static gboolean
+rojig_writer_push (RojigWriter   *writer,
+                   RojigWriteJob *job,
+                   GError       **error)
+{
+  g_mutex_lock (&writer->lock);
+  while (!writer->error && writer->queued_bytes > 0 &&
+         writer->queued_bytes + job->size > ROJIG_WRITE_MAX_QUEUED_BYTES)
+    g_cond_wait (&writer->cond, &writer->lock);
+  if (writer->error)
+    {
+      g_propagate_error (error, g_error_copy (writer->error));
+      g_mutex_unlock (&writer->lock);
+      rojig_write_job_free (job);
+      return FALSE;
+    }
+  writer->queued_bytes += job->size;
+  g_mutex_unlock (&writer->lock);
+
+  return g_thread_pool_push (writer->pool, job, error);
+}
+
+/* Wait for all queued writes */
+static gboolean
+rojig_writer_finish (RojigWriter *writer,
+                     GError     **error)
+{
+  g_thread_pool_free (g_steal_pointer (&writer->pool), FALSE, TRUE);
+  if (writer->error)
+    {
+      g_propagate_error (error, g_steal_pointer (&writer->error));
+      return FALSE;
+    }
+  return TRUE;
+}
+
+static void
+rojig_writer_clear (RojigWriter *writer)
+{
+  if (writer->pool)
+    g_thread_pool_free (g_steal_pointer (&writer->pool), FALSE, TRUE);
+  g_clear_error (&writer->error);
+  g_mutex_clear (&writer->lock);
+  g_cond_clear (&writer->cond);
+}
+G_DEFINE_AUTO_CLEANUP_CLEAR_FUNC(RojigWriter, rojig_writer_clear)
+
+/* Read the data for @entry so it can be handed off to a worker; in memory
+ * if small, otherwise via a mapped tmpfile.
+ */
+static GBytes *
+rojig_read_payload (struct archive       *a,
+                    struct archive_entry *entry,
+                    GError              **error)
+{
+  const struct stat *stbuf = archive_entry_stat (entry);
+  g_assert_cmpint (stbuf->st_size, >=, 0);
+  const size_t total = stbuf->st_size;
+
+  if (total <= ROJIG_PAYLOAD_MAX_INMEM)
+    {
+      g_autofree guint8 *buf = g_malloc (total);
+      size_t bytes_read = 0;
+      while (bytes_read < total)
+        {
+          ssize_t r = archive_read_data (a, buf + bytes_read, total - bytes_read);
+          if (r < 0)
+            return throw_libarchive_error (error, a), NULL;
+          if (r == 0)
+            break;
+          bytes_read += r;
+        }
+      g_assert_cmpint (bytes_read, ==, total);
+      return g_bytes_new_take (g_steal_pointer (&buf), total);
+    }
+
+  /* One can't reliably seek with libarchive; only some formats support it,
+   * and cpio isn't one of them.  So copy out the data.
+   */
+  g_auto(GLnxTmpfile) tmpf = { 0, };
+  if (!glnx_open_anonymous_tmpfile (O_RDWR | O_CLOEXEC, &tmpf, error))
+    return NULL;
+
+  const size_t bufsize = 128*1024;
+  g_autofree guint8* buf = g_malloc (bufsize);
+  size_t bytes_read = 0;
+  while (bytes_read < total)
+    {
+      ssize_t r = archive_read_data (a, buf, MIN (bufsize, total - bytes_read));
+      if (r < 0)
+        return throw_libarchive_error (error, a), NULL;
+      if (r == 0)
+        break;
+      if (glnx_loop_write (tmpf.fd, buf, r) < 0)
+        return glnx_null_throw_errno_prefix (error, "write");
+      bytes_read += r;
+    }
+  g_assert_cmpint (bytes_read, ==, total);
+
+  g_autoptr(GMappedFile) mfile = g_mapped_file_new_from_fd (tmpf.fd, FALSE, error);
+  if (!mfile)
+    return NULL;
+  return g_mapped_file_get_bytes (mfile);
+}
+
 static gboolean
 process_contentident (RpmOstreeRojigAssembler    *self,
-                      OstreeRepo        *repo,
+                      RojigWriter       *writer,
                       struct archive_entry *entry,
                       const char        *meta_pathname,
                       GCancellable      *cancellable,
@@ -341,7 +593,8 @@ process_contentident (RpmOstreeRojigAssembler    *self,
   g_autoptr(GVariant) meta = rojig_read_variant (RPMOSTREE_ROJIG_NEW_CONTENTIDENT_VARIANT_FORMAT,
                                                  self->archive, entry,
                                                  cancellable, error);
-
+  if (!meta)
+    return FALSE;
 
   /* Read the content */
   // FIXME match contentident_id
@@ -355,82 +608,49 @@ process_contentident (RpmOstreeRojigAssembler    *self,
   if (!g_str_has_suffix (content_pathname, "/05content"))
     return glnx_throw (error, "Malformed contentident: %s", content_pathname);
 
-  const struct stat *stbuf = archive_entry_stat (entry);
-
-  /* Copy the data to a temporary file; a better optimization would be to write
-   * the data to the first object, then clone it, but that requires some
-   * more libostree API.  As far as I can see, one can't reliably seek with
-   * libarchive; only some formats support it, and cpio isn't one of them.
+  /* A better optimization would be to write the data to the first object,
+   * then clone it, but that requires some more libostree API.  For now,
+   * each object shares the payload and is written by a worker.
    */
-  g_auto(GLnxTmpfile) tmpf = { 0, };
-  if (!glnx_open_anonymous_tmpfile (O_RDWR | O_CLOEXEC, &tmpf, error))
+  g_autoptr(GBytes) payload = rojig_read_payload (self->archive, entry, error);
+  if (!payload)
     return FALSE;
 
-  const size_t total = stbuf->st_size;
-  const size_t bufsize = MIN (128*1024, total);
-  g_autofree guint8* buf = g_malloc (bufsize);
-  size_t bytes_read = 0;
-  while (bytes_read < total)
-    {
-      ssize_t r = archive_read_data (self->archive, buf, MIN (bufsize, total - bytes_read));
-      if (r < 0)
-        return throw_libarchive_error (error, self->archive);
-      if (r == 0)
-        break;
-      if (glnx_loop_write (tmpf.fd, buf, r) < 0)
-        return glnx_throw_errno_prefix (error, "write");
-      bytes_read += r;
-    }
-  g_assert_cmpint (bytes_read, ==, total);
-  g_clear_pointer (&buf, g_free);
-
   const guint n = g_variant_n_children (meta);
   for (guint i = 0; i < n; i++)
     {
-      const char *checksum;
-      guint32 uid,gid,mode;
-      g_autoptr(GVariant) xattrs = NULL;
-      g_variant_get_child (meta, i, "(&suuu@a(ayay))", &checksum, &uid, &gid, &mode, &xattrs);
-      /* See if we already have this object */
-      gboolean has_object;
-      if (!ostree_repo_has_object (repo, OSTREE_OBJECT_TYPE_FILE, checksum,
-                                   &has_object, cancellable, error))
-        return FALSE;
-      if (has_object)
-        continue;
-      uid = GUINT32_FROM_BE (uid);
-      gid = GUINT32_FROM_BE (gid);
-      mode = GUINT32_FROM_BE (mode);
-
-      if (lseek (tmpf.fd, 0, SEEK_SET) < 0)
-        return glnx_throw_errno_prefix (error, "lseek");
-      g_autoptr(GInputStream) istream = g_unix_input_stream_new (tmpf.fd, FALSE);
-      /* Like _ostree_stbuf_to_gfileinfo() - TODO make that public with a
-       * better content writing API.
-       */
-      g_autoptr(GFileInfo) finfo = g_file_info_new ();
-      g_file_info_set_attribute_uint32 (finfo, "standard::type", G_FILE_TYPE_REGULAR);
-      g_file_info_set_attribute_boolean (finfo, "standard::is-symlink", FALSE);
-      g_file_info_set_attribute_uint32 (finfo, "unix::uid", uid);
-      g_file_info_set_attribute_uint32 (finfo, "unix::gid", gid);
-      g_file_info_set_attribute_uint32 (finfo, "unix::mode", mode);
-      g_file_info_set_attribute_uint64 (finfo, "standard::size", total);
-
-      g_autoptr(GInputStream) objstream = NULL;
-      guint64 objlen;
-      if (!ostree_raw_file_to_content_stream (istream, finfo, xattrs, &objstream,
-                                              &objlen, cancellable, error))
-        return FALSE;
-
-      g_autofree guchar *csum = NULL;
-      if (!ostree_repo_write_content (repo, checksum, objstream, objlen, &csum,
-                                      cancellable, error))
+      RojigWriteJob *job = g_new0 (RojigWriteJob, 1);
+      job->kind = ROJIG_WRITE_RAW_FILE;
+      g_variant_get_child (meta, i, "(suuu@a(ayay))", &job->checksum,
+                           &job->uid, &job->gid, &job->mode, &job->xattrs);
+      job->uid = GUINT32_FROM_BE (job->uid);
+      job->gid = GUINT32_FROM_BE (job->gid);
+      job->mode = GUINT32_FROM_BE (job->mode);
+      job->payload = g_bytes_ref (payload);
+      job->size = g_bytes_get_size (payload);
+      if (!rojig_writer_push (writer, job, error))
         return FALSE;
     }
 
   return TRUE;
 }
 
+static gboolean
+queue_write_metadata (RojigWriter      *writer,
+                      OstreeObjectType  objtype,
+                      char             *checksum,
+                      GVariant         *metadata,
+                      GError          **error)
+{
+  RojigWriteJob *job = g_new0 (RojigWriteJob, 1);
+  job->kind = ROJIG_WRITE_METADATA;
+  job->objtype = objtype;
+  job->checksum = checksum;
+  job->metadata = metadata;
+  job->size = g_variant_get_size (metadata);
+  return rojig_writer_push (writer, job, error);
+}
+
 static gboolean
 state_transition (RpmOstreeRojigAssembler    *self,
                   const char        *pathname,
@@ -453,6 +673,11 @@ rpmostree_rojig_assembler_write_new_objects (RpmOstreeRojigAssembler    *self,
   GLNX_AUTO_PREFIX_ERROR ("Writing new objects", error);
   g_assert_cmpint (self->state, ==, STATE_DIRMETA);
 
+  /* We only decompress and parse here; the writes go to workers */
+  g_auto(RojigWriter) writer = { 0, };
+  if (!rojig_writer_init (&writer, repo, cancellable, error))
+    return FALSE;
+
   /* TODO sort objects in order for importing, verify we're not
    * importing an unknown object.
    */
@@ -479,9 +704,11 @@ rpmostree_rojig_assembler_write_new_objects (RpmOstreeRojigAssembler    *self,
           g_autoptr(GVariant) dirmeta = rojig_read_variant (OSTREE_DIRMETA_GVARIANT_FORMAT,
                                                             self->archive, entry,
                                                             cancellable, error);
-          g_autofree guint8*csum = NULL;
-          if (!ostree_repo_write_metadata (repo, OSTREE_OBJECT_TYPE_DIR_META,
-                                           checksum, dirmeta, &csum, cancellable, error))
+          if (!dirmeta)
+            return FALSE;
+          if (!queue_write_metadata (&writer, OSTREE_OBJECT_TYPE_DIR_META,
+                                     g_steal_pointer (&checksum), g_steal_pointer (&dirmeta),
+                                     error))
             return FALSE;
         }
       else if (g_str_has_prefix (pathname, RPMOSTREE_ROJIG_DIRTREE_DIR "/"))
@@ -495,16 +722,18 @@ rpmostree_rojig_assembler_write_new_objects (RpmOstreeRojigAssembler    *self,
           g_autoptr(GVariant) dirtree = rojig_read_variant (OSTREE_TREE_GVARIANT_FORMAT,
                                                             self->archive, entry,
                                                             cancellable, error);
-          g_autofree guint8*csum = NULL;
-          if (!ostree_repo_write_metadata (repo, OSTREE_OBJECT_TYPE_DIR_TREE,
-                                           checksum, dirtree, &csum, cancellable, error))
+          if (!dirtree)
+            return FALSE;
+          if (!queue_write_metadata (&writer, OSTREE_OBJECT_TYPE_DIR_TREE,
+                                     g_steal_pointer (&checksum), g_steal_pointer (&dirtree),
+                                     error))
             return FALSE;
         }
       else if (g_str_has_prefix (pathname, RPMOSTREE_ROJIG_NEW_CONTENTIDENT_DIR "/"))
         {
           if (!state_transition (self, pathname, STATE_NEW_CONTENTIDENT, error))
             return FALSE;
-          if (!process_contentident (self, repo, entry, pathname, cancellable, error))
+          if (!process_contentident (self, &writer, entry, pathname, cancellable, error))
             return FALSE;
         }
       else if (g_str_has_prefix (pathname, RPMOSTREE_ROJIG_NEW_DIR "/"))
@@ -516,13 +745,17 @@ rpmostree_rojig_assembler_write_new_objects (RpmOstreeRojigAssembler    *self,
           if (!checksum)
             return FALSE;
 
-          const struct stat *stbuf = archive_entry_stat (entry);
-          g_assert_cmpint (stbuf->st_size, >=, 0);
-
-          g_autoptr(GInputStream) archive_stream = _rpm_ostree_libarchive_input_stream_new (self->archive);
-          g_autofree guint8*csum = NULL;
-          if (!ostree_repo_write_content (repo, checksum, archive_stream,
-                                          stbuf->st_size, &csum, cancellable, error))
+          RojigWriteJob *job = g_new0 (RojigWriteJob, 1);
+          job->kind = ROJIG_WRITE_CONTENT;
+          job->checksum = g_steal_pointer (&checksum);
+          job->payload = rojig_read_payload (self->archive, entry, error);
+          if (!job->payload)
+            {
+              rojig_write_job_free (job);
+              return FALSE;
+            }
+          job->size = g_bytes_get_size (job->payload);
+          if (!rojig_writer_push (&writer, job, error))
             return FALSE;
         }
       else if (g_str_has_prefix (pathname, RPMOSTREE_ROJIG_XATTRS_DIR "/"))
@@ -534,14 +767,25 @@ rpmostree_rojig_assembler_write_new_objects (RpmOstreeRojigAssembler    *self,
         return glnx_throw (error, "Unexpected entry: %s", pathname);
     }
 
-  return TRUE;
+  return rojig_writer_finish (&writer, error);
 }
 
-GVariant *
+/* Returns the xattr table as an array of a(ayay), indexed by the ids in the
+ * per-package maps.  This is split out once so that lookups for each file
+ * just take a ref, rather than allocating a child variant.
+ */
+GPtrArray *
 rpmostree_rojig_assembler_get_xattr_table (RpmOstreeRojigAssembler    *self)
 {
   g_assert (self->xattrs_table);
-  return g_variant_ref (self->xattrs_table);
+  if (!self->xattrs_dict)
+    {
+      const guint n = g_variant_n_children (self->xattrs_table);
+      self->xattrs_dict = g_ptr_array_new_full (n, (GDestroyNotify)g_variant_unref);
+      for (guint i = 0; i < n; i++)
+        g_ptr_array_add (self->xattrs_dict, g_variant_get_child_value (self->xattrs_table, i));
+    }
+  return g_ptr_array_ref (self->xattrs_dict);
 }
 
 /* Loop over each package, returning its xattr set (as indexes into the xattr table) */
@@ -601,7 +845,7 @@ rpmostree_rojig_assembler_next_xattrs (RpmOstreeRojigAssembler    *self,
 
 /* Client side lookup for xattrs */
 gboolean
-rpmostree_rojig_assembler_xattr_lookup (GVariant *xattr_table,
+rpmostree_rojig_assembler_xattr_lookup (GPtrArray *xattr_table,
                                         const char *path,
                                         GVariant *xattrs,
                                         GVariant **out_xattrs,
@@ -623,8 +867,8 @@ rpmostree_rojig_assembler_xattr_lookup (GVariant *xattr_table,
     }
   guint xattr_idx;
   g_variant_get_child (xattrs, pos, "(&su)", NULL, &xattr_idx);
-  if (xattr_idx >= g_variant_n_children (xattr_table))
+  if (xattr_idx >= xattr_table->len)
     return glnx_throw (error, "Out of range rojig xattr index %u for path '%s'", xattr_idx, path);
-  *out_xattrs = g_variant_get_child_value (xattr_table, xattr_idx);
+  *out_xattrs = g_variant_ref (xattr_table->pdata[xattr_idx]);
   return TRUE;
 }
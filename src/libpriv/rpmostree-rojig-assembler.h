@@ -53,7 +53,7 @@ rpmostree_rojig_assembler_write_new_objects (RpmOstreeRojigAssembler    *rojig,
                                              GError           **error);
 
 
-GVariant * rpmostree_rojig_assembler_get_xattr_table (RpmOstreeRojigAssembler *self);
+GPtrArray * rpmostree_rojig_assembler_get_xattr_table (RpmOstreeRojigAssembler *self);
 
 gboolean
 rpmostree_rojig_assembler_next_xattrs (RpmOstreeRojigAssembler    *self,
@@ -62,7 +62,7 @@ rpmostree_rojig_assembler_next_xattrs (RpmOstreeRojigAssembler    *self,
                                        GError           **error);
 
 gboolean
-rpmostree_rojig_assembler_xattr_lookup (GVariant *xattr_table,
+rpmostree_rojig_assembler_xattr_lookup (GPtrArray *xattr_table,
                                         const char *path,
                                         GVariant *xattrs,
                                         GVariant **out_xattrs,
@@ -29,6 +29,7 @@
 #include "rpmostree-rojig-build.h"
 #include "rpmostree-core.h"
 #include "rpmostree-rpm-util.h"
+#include "rpmostree-sched.h"
 #include <rpm/rpmlib.h>
 #include <rpm/rpmlog.h>
 #include <rpm/rpmfi.h>
@@ -95,9 +96,84 @@ add_objid (GHashTable *object_to_objid, const char *checksum, const char *objid)
   g_hash_table_add (objids, g_strdup (objid));
 }
 
+/* Run @func for each index in [0, @n) on a pool of worker threads.  If any
+ * invocation fails, the error for the lowest index is returned, so that the
+ * result doesn't depend on scheduling.
+ */
+typedef gboolean (*ParallelForFunc) (gpointer      user_data,
+                                     guint         i,
+                                     GCancellable *cancellable,
+                                     GError      **error);
+
+typedef struct {
+  ParallelForFunc func;
+  gpointer user_data;
+  GCancellable *cancellable;
+  GError **errors;
+  volatile gint failed;
+} ParallelFor;
+
+static void
+parallel_for_worker (gpointer data,
+                     gpointer user_data)
+{
+  ParallelFor *pfor = user_data;
+  const guint i = GPOINTER_TO_UINT (data) - 1;
+  if (g_atomic_int_get (&pfor->failed))
+    return;
+  rpmostree_sched_thread_enter ();
+  if (!pfor->func (pfor->user_data, i, pfor->cancellable, &pfor->errors[i]))
+    g_atomic_int_set (&pfor->failed, 1);
+  rpmostree_sched_thread_leave ();
+}
+
+static gboolean
+parallel_for (guint           n,
+              ParallelForFunc func,
+              gpointer        user_data,
+              GCancellable   *cancellable,
+              GError        **error)
+{
+  if (n == 0)
+    return TRUE;
+  g_autofree GError **errors = g_new0 (GError*, n);
+  ParallelFor pfor = { func, user_data, cancellable, errors, 0 };
+  const guint n_workers = MIN (n, rpmostree_sched_get_max_workers (g_get_num_processors ()));
+  GThreadPool *pool = g_thread_pool_new (parallel_for_worker, &pfor, n_workers, FALSE, error);
+  if (!pool)
+    return FALSE;
+  for (guint i = 0; i < n; i++)
+    {
+      if (!g_thread_pool_push (pool, GUINT_TO_POINTER (i + 1), error))
+        {
+          g_atomic_int_set (&pfor.failed, 1);
+          break;
+        }
+    }
+  g_thread_pool_free (pool, FALSE, TRUE);
+
+  gboolean ret = !(error && *error);
+  for (guint i = 0; i < n; i++)
+    {
+      if (!errors[i])
+        continue;
+      if (ret)
+        {
+          g_propagate_error (error, g_steal_pointer (&errors[i]));
+          ret = FALSE;
+        }
+      else
+        g_clear_error (&errors[i]);
+    }
+  return ret;
+}
+
 /* One the main tricky things we need to handle when building the objidmap is
  * that we want to compress the xattr map some by using basenames if possible.
  * Otherwise we use the full path.
+ *
+ * This is built for each package in parallel, then merged into the global
+ * state in package order by merge_objid_map_for_package().
  */
 typedef struct {
   DnfPackage *package;
@@ -105,6 +181,13 @@ typedef struct {
   GHashTable *seen_objid_to_path; /* Map<char *objid, char *path> */
   GHashTable *seen_path_to_object; /* Map<char *path, char *checksum> */
   char *tmpfiles_d_path; /* Path to tmpfiles.d, which we skip */
+  /* Maps a content object checksum to a set of "objid", which is either
+   * a basename (if unique) or a full path.
+   */
+  GHashTable *object_to_objid; /* Map<char *checksum, Set<char *objid>> */
+  GHashTable *object_to_size; /* Map<char *checksum, guint32 objsize> */
+  guint n_nonunique_objid_basenames;
+  guint n_objid_basenames;
 } PkgBuildObjidMap;
 
 static void
@@ -114,91 +197,123 @@ pkg_build_objidmap_free (PkgBuildObjidMap *map)
   g_clear_pointer (&map->seen_objid_to_path, (GDestroyNotify)g_hash_table_unref);
   g_clear_pointer (&map->seen_path_to_object, (GDestroyNotify)g_hash_table_unref);
   g_free (map->tmpfiles_d_path);
+  /* Borrows keys from object_to_objid */
+  g_clear_pointer (&map->object_to_size, (GDestroyNotify)g_hash_table_unref);
+  g_clear_pointer (&map->object_to_objid, (GDestroyNotify)g_hash_table_unref);
   g_free (map);
 }
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(PkgBuildObjidMap, pkg_build_objidmap_free)
 
-/* Recursively walk @dir, building a map of object to Set<objid> */
-static gboolean
-build_objid_map_for_tree (RpmOstreeCommit2RojigContext *self,
-                          PkgBuildObjidMap             *build,
-                          GHashTable                   *object_to_objid,
-                          GFile                        *dir,
-                          GCancellable                 *cancellable,
-                          GError                      **error)
+static void
+add_objid_for_path (PkgBuildObjidMap *build,
+                    const char       *checksum,
+                    const char       *path,
+                    const char       *bn)
 {
-  g_autoptr(GFileEnumerator) direnum =
-    g_file_enumerate_children (dir, "standard::name,standard::type",
-                               G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
-                               cancellable, error);
-  if (!direnum)
-    return FALSE;
-  while (TRUE)
+  GHashTable *object_to_objid = build->object_to_objid;
+  const gboolean is_known_nonunique = g_hash_table_contains (build->seen_nonunique_objid, bn);
+  if (is_known_nonunique)
     {
-      GFileInfo *info = NULL;
-      GFile *child = NULL;
-      if (!g_file_enumerator_iterate (direnum, &info, &child, cancellable, error))
-        return FALSE;
-      if (!info)
-        break;
-      OstreeRepoFile *repof = (OstreeRepoFile*)child;
-      if (!ostree_repo_file_ensure_resolved (repof, NULL))
-        g_assert_not_reached ();
-      GFileType ftype = g_file_info_get_file_type (info);
-
-      /* Handle directories */
-      if (ftype == G_FILE_TYPE_DIRECTORY)
+      add_objid (object_to_objid, checksum, path);
+      build->n_nonunique_objid_basenames++;
+    }
+  else
+    {
+      const char *existing_path = g_hash_table_lookup (build->seen_objid_to_path, bn);
+      if (!existing_path)
         {
-          if (!build_objid_map_for_tree (self, build, object_to_objid, child,
-                                         cancellable, error))
-            return FALSE;
-          continue; /* On to the next */
+          g_hash_table_insert (build->seen_objid_to_path, g_strdup (bn), g_strdup (path));
+          g_hash_table_insert (build->seen_path_to_object, g_strdup (path), g_strdup (checksum));
+          add_objid (object_to_objid, checksum, bn);
+        }
+      else
+        {
+          const char *previous_obj = g_hash_table_lookup (build->seen_path_to_object, existing_path);
+          g_assert (previous_obj);
+          /* Replace the previous basename with a full path */
+          add_objid (object_to_objid, previous_obj, existing_path);
+          /* And remove these two hashes which are only needed for transitioning */
+          g_hash_table_remove (build->seen_path_to_object, existing_path);
+          g_hash_table_remove (build->seen_objid_to_path, bn);
+          /* Add to our nonunique set */
+          g_hash_table_add (build->seen_nonunique_objid, g_strdup (bn));
+          /* And finally our conflicting entry with a full path */
+          add_objid (object_to_objid, checksum, path);
+          build->n_nonunique_objid_basenames++;
         }
+    }
+  build->n_objid_basenames++;
+}
 
-      g_autofree char *path = g_file_get_path (child);
+/* Recursively walk the dirtree @contents_csum, building a map of object to
+ * Set<objid>.  We work directly on the dirtree variants rather than going
+ * through OstreeRepoFile; names are borrowed from the variant data, and
+ * @path is a single buffer we append to and truncate as we go.  Like
+ * enumerating an OstreeRepoFile, files are visited before subdirectories.
+ */
+static gboolean
+build_objid_map_for_tree (PkgBuildObjidMap *build,
+                          OstreeRepo       *repo,
+                          const char       *contents_csum,
+                          GString          *path,
+                          GCancellable     *cancellable,
+                          GError          **error)
+{
+  if (g_cancellable_set_error_if_cancelled (cancellable, error))
+    return FALSE;
+
+  g_autoptr(GVariant) dirtree = NULL;
+  if (!ostree_repo_load_variant (repo, OSTREE_OBJECT_TYPE_DIR_TREE, contents_csum,
+                                 &dirtree, error))
+    return FALSE;
+  const gsize path_len = path->len;
 
+  g_autoptr(GVariant) files = g_variant_get_child_value (dirtree, 0);
+  const guint n_files = g_variant_n_children (files);
+  for (guint i = 0; i < n_files; i++)
+    {
+      const char *name;
+      g_autoptr(GVariant) csum_v = NULL;
+      g_variant_get_child (files, i, "(&s@ay)", &name, &csum_v);
+      const guchar *csum = ostree_checksum_bytes_peek_validate (csum_v, error);
+      if (!csum)
+        return FALSE;
+
+      g_string_append_c (path, '/');
+      g_string_append (path, name);
       /* Handling SELinux labeling for the tmpfiles.d would get very tricky.
        * Currently the rojig unpack path is intentionally "dumb" - we won't
        * synthesize the tmpfiles.d like we do for layering. So punt these into
        * the new object set.
        */
-      if (g_str_equal (path, build->tmpfiles_d_path))
-        continue;
-
-      const char *checksum = ostree_repo_file_get_checksum (repof);
-      const char *bn = glnx_basename (path);
-      const gboolean is_known_nonunique = g_hash_table_contains (build->seen_nonunique_objid, bn);
-      if (is_known_nonunique)
+      if (!g_str_equal (path->str, build->tmpfiles_d_path))
         {
-          add_objid (object_to_objid, checksum, path);
-          self->n_nonunique_objid_basenames++;
+          char checksum[OSTREE_SHA256_STRING_LEN+1];
+          ostree_checksum_inplace_from_bytes (csum, checksum);
+          add_objid_for_path (build, checksum, path->str, name);
         }
-      else
-        {
-          const char *existing_path = g_hash_table_lookup (build->seen_objid_to_path, bn);
-          if (!existing_path)
-            {
-              g_hash_table_insert (build->seen_objid_to_path, g_strdup (bn), g_strdup (path));
-              g_hash_table_insert (build->seen_path_to_object, g_strdup (path), g_strdup (checksum));
-              add_objid (object_to_objid, checksum, bn);
-            }
-          else
-            {
-              const char *previous_obj = g_hash_table_lookup (build->seen_path_to_object, existing_path);
-              g_assert (previous_obj);
-              /* Replace the previous basename with a full path */
-              add_objid (object_to_objid, previous_obj, existing_path);
-              /* And remove these two hashes which are only needed for transitioning */
-              g_hash_table_remove (build->seen_path_to_object, existing_path);
-              g_hash_table_remove (build->seen_objid_to_path, bn);
-              /* Add to our nonunique set */
-              g_hash_table_add (build->seen_nonunique_objid, g_strdup (bn));
-              /* And finally our conflicting entry with a full path */
-              add_objid (object_to_objid, checksum, path);
-              self->n_nonunique_objid_basenames++;
-            }
-        }
-      self->n_objid_basenames++;
+      g_string_truncate (path, path_len);
+    }
+
+  g_autoptr(GVariant) dirs = g_variant_get_child_value (dirtree, 1);
+  const guint n_dirs = g_variant_n_children (dirs);
+  for (guint i = 0; i < n_dirs; i++)
+    {
+      const char *name;
+      g_autoptr(GVariant) contents_csum_v = NULL;
+      g_variant_get_child (dirs, i, "(&s@ayay)", &name, &contents_csum_v, NULL);
+      const guchar *csum = ostree_checksum_bytes_peek_validate (contents_csum_v, error);
+      if (!csum)
+        return FALSE;
+      char subdir_checksum[OSTREE_SHA256_STRING_LEN+1];
+      ostree_checksum_inplace_from_bytes (csum, subdir_checksum);
+
+      g_string_append_c (path, '/');
+      g_string_append (path, name);
+      if (!build_objid_map_for_tree (build, repo, subdir_checksum, path,
+                                     cancellable, error))
+        return FALSE;
+      g_string_truncate (path, path_len);
     }
 
   return TRUE;
@@ -386,62 +501,49 @@ write_content_identical_set (OstreeRepo             *repo,
   return TRUE;
 }
 
-/* Taken from ostree-repo-static-delta-compilation.c */
-static guint
-bufhash (const void *b, gsize len)
-{
-  const signed char *p, *e;
-  guint32 h = 5381;
-
-  for (p = (signed char *)b, e = (signed char *)b + len; p != e; p++)
-    h = (h << 5) + h + *p;
+/* Interns xattr sets, assigning each distinct one a 32-bit id in order of
+ * first appearance; the ids index the table in the rojigRPM.  Sets are keyed
+ * by their serialized form, so checking for an existing entry is a single
+ * pass over the bytes rather than walking the (name, value) pairs.
+ */
+typedef struct {
+  GHashTable *ids; /* Map<GBytes, guint32 id> */
+  GVariantBuilder *table;
+  guint32 n_ids;
+} XattrDict;
 
-  return h;
+static XattrDict *
+xattr_dict_new (void)
+{
+  XattrDict *dict = g_new0 (XattrDict, 1);
+  dict->ids = g_hash_table_new_full (g_bytes_hash, g_bytes_equal,
+                                     (GDestroyNotify)g_bytes_unref, NULL);
+  dict->table = g_variant_builder_new (RPMOSTREE_ROJIG_XATTRS_TABLE_VARIANT_FORMAT);
+  return dict;
 }
 
-/* Taken from ostree-repo-static-delta-compilation.c */
-static guint
-xattr_chunk_hash (const void *vp)
+static void
+xattr_dict_free (XattrDict *dict)
 {
-  GVariant *v = (GVariant*)vp;
-  gsize n = g_variant_n_children (v);
-  guint i;
-  guint32 h = 5381;
-
-  for (i = 0; i < n; i++)
-    {
-      const guint8* name;
-      const guint8* value_data;
-      g_autoptr(GVariant) value = NULL;
-      gsize value_len;
-
-      g_variant_get_child (v, i, "(^&ay@ay)",
-                           &name, &value);
-      value_data = g_variant_get_fixed_array (value, &value_len, 1);
-
-      h += g_str_hash (name);
-      h += bufhash (value_data, value_len);
-    }
-
-  return h;
+  g_hash_table_unref (dict->ids);
+  g_variant_builder_unref (dict->table);
+  g_free (dict);
 }
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(XattrDict, xattr_dict_free)
 
-/* Taken from ostree-repo-static-delta-compilation.c */
-static gboolean
-xattr_chunk_equals (const void *one, const void *two)
+static guint32
+xattr_dict_intern (XattrDict *dict,
+                   GVariant  *xattrs)
 {
-  GVariant *v1 = (GVariant*)one;
-  GVariant *v2 = (GVariant*)two;
-  gsize l1 = g_variant_get_size (v1);
-  gsize l2 = g_variant_get_size (v2);
-
-  if (l1 != l2)
-    return FALSE;
-
-  if (l1 == 0)
-    return l2 == 0;
-
-  return memcmp (g_variant_get_data (v1), g_variant_get_data (v2), l1) == 0;
+  g_autoptr(GBytes) key = g_variant_get_data_as_bytes (xattrs);
+  gpointer id_p;
+  if (g_hash_table_lookup_extended (dict->ids, key, NULL, &id_p))
+    return GPOINTER_TO_UINT (id_p);
+
+  const guint32 id = dict->n_ids++;
+  g_variant_builder_add (dict->table, "@a(ayay)", xattrs);
+  g_hash_table_insert (dict->ids, g_steal_pointer (&key), GUINT_TO_POINTER (id));
+  return id;
 }
 
 static int
@@ -457,8 +559,11 @@ cmp_objidxattrs (gconstpointer ap,
   return strcmp (a_objid, b_objid);
 }
 
-/* Walk @pkg, building up a map of content object hash to "objid". */
-static gboolean
+/* Walk @pkg, building up a map of content object hash to "objid". This
+ * only reads from the pkgcache repo, so it's safe to run for multiple
+ * packages in parallel.
+ */
+static PkgBuildObjidMap *
 build_objid_map_for_package (RpmOstreeCommit2RojigContext *self,
                              DnfPackage                   *pkg,
                              GCancellable                 *cancellable,
@@ -468,44 +573,73 @@ build_objid_map_for_package (RpmOstreeCommit2RojigContext *self,
   GLNX_AUTO_PREFIX_ERROR (errmsg, error);
   g_autofree char *cachebranch = rpmostree_get_cache_branch_pkg (pkg);
   g_autofree char *pkg_commit = NULL;
-  g_autoptr(GFile) commit_root = NULL;
-
-  if (!ostree_repo_read_commit (self->pkgcache_repo, cachebranch, &commit_root, &pkg_commit,
-                                cancellable, error))
-    return FALSE;
+  if (!ostree_repo_resolve_rev (self->pkgcache_repo, cachebranch, FALSE, &pkg_commit, error))
+    return NULL;
+  g_autoptr(GVariant) commit = NULL;
+  if (!ostree_repo_load_commit (self->pkgcache_repo, pkg_commit, &commit, NULL, error))
+    return NULL;
+  g_autoptr(GVariant) root_contents_v = g_variant_get_child_value (commit, 6);
+  const guchar *root_csum = ostree_checksum_bytes_peek_validate (root_contents_v, error);
+  if (!root_csum)
+    return NULL;
+  char root_contents[OSTREE_SHA256_STRING_LEN+1];
+  ostree_checksum_inplace_from_bytes (root_csum, root_contents);
 
-  /* Maps a content object checksum to a set of "objid", which is either
-   * a basename (if unique) or a full path.
-   */
-  g_autoptr(GHashTable) object_to_objid = g_hash_table_new_full (g_str_hash, g_str_equal,
-                                                                 g_free, (GDestroyNotify)g_hash_table_unref);
   /* Allocate temporary build state (mostly hash tables) just for this call */
-  { g_autoptr(PkgBuildObjidMap) build = g_new0 (PkgBuildObjidMap, 1);
-    build->package = pkg;
-    build->seen_nonunique_objid = g_hash_table_new_full (g_str_hash, g_str_equal,
-                                                                        g_free, NULL);
-    build->seen_objid_to_path = g_hash_table_new_full (g_str_hash, g_str_equal,
-                                                                      g_free, g_free);
-    build->seen_path_to_object = g_hash_table_new_full (g_str_hash, g_str_equal,
-                                                        g_free, g_free);
-    build->tmpfiles_d_path = g_strconcat ("/usr/lib/tmpfiles.d/pkg-",
-                                          dnf_package_get_name (pkg), ".conf", NULL);
-    if (!build_objid_map_for_tree (self, build, object_to_objid,
-                                   commit_root, cancellable, error))
-      return FALSE;
-  }
+  g_autoptr(PkgBuildObjidMap) build = g_new0 (PkgBuildObjidMap, 1);
+  build->package = pkg;
+  build->seen_nonunique_objid = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                       g_free, NULL);
+  build->seen_objid_to_path = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                     g_free, g_free);
+  build->seen_path_to_object = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                      g_free, g_free);
+  build->tmpfiles_d_path = g_strconcat ("/usr/lib/tmpfiles.d/pkg-",
+                                        dnf_package_get_name (pkg), ".conf", NULL);
+  build->object_to_objid = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                  g_free, (GDestroyNotify)g_hash_table_unref);
+  build->object_to_size = g_hash_table_new (g_str_hash, g_str_equal);
+  g_autoptr(GString) path = g_string_new ("");
+  if (!build_objid_map_for_tree (build, self->pkgcache_repo, root_contents, path,
+                                 cancellable, error))
+    return NULL;
+
+  /* Gather the object sizes here too, since that's also a repo query */
+  GLNX_HASH_TABLE_FOREACH (build->object_to_objid, const char *, checksum)
+    {
+      guint32 objsize = 0;
+      if (!query_objsize_assert_32bit (self->pkgcache_repo, checksum, &objsize, error))
+        return NULL;
+      g_hash_table_insert (build->object_to_size, (char*)checksum, GUINT_TO_POINTER (objsize));
+    }
+
+  /* We don't need the transitional state anymore */
+  g_clear_pointer (&build->seen_nonunique_objid, (GDestroyNotify)g_hash_table_unref);
+  g_clear_pointer (&build->seen_objid_to_path, (GDestroyNotify)g_hash_table_unref);
+  g_clear_pointer (&build->seen_path_to_object, (GDestroyNotify)g_hash_table_unref);
+  return g_steal_pointer (&build);
+}
+
+/* Merge the objid map for a package into the global map; this must be called
+ * in package order since the first package to provide an object wins.
+ */
+static void
+merge_objid_map_for_package (RpmOstreeCommit2RojigContext *self,
+                             PkgBuildObjidMap             *build)
+{
+  DnfPackage *pkg = build->package;
+  self->n_nonunique_objid_basenames += build->n_nonunique_objid_basenames;
+  self->n_objid_basenames += build->n_objid_basenames;
 
   /* Loop over the objects we found in this package */
-  GLNX_HASH_TABLE_FOREACH_IT (object_to_objid, it, char *, checksum,
+  GLNX_HASH_TABLE_FOREACH_IT (build->object_to_objid, it, char *, checksum,
                               GHashTable *, objid_set)
     {
       /* See if this is a "big" object.  If so, we add a mapping from
        * size → checksum, so we can heuristically later try to find
        * "content-identical objects" i.e. they differ only in metadata.
        */
-      guint32 objsize = 0;
-      if (!query_objsize_assert_32bit (self->pkgcache_repo, checksum, &objsize, error))
-        return FALSE;
+      const guint32 objsize = GPOINTER_TO_UINT (g_hash_table_lookup (build->object_to_size, checksum));
       if (objsize >= BIG_OBJ_SIZE)
         {
           /* If two big objects that are actually *different* happen
@@ -524,7 +658,6 @@ build_objid_map_for_package (RpmOstreeCommit2RojigContext *self,
            * duplicate count as a curiosity.
            */
           self->n_duplicate_pkg_content_objs++;
-          g_hash_table_iter_remove (&it);
         }
       else if (!g_hash_table_contains (self->commit_content_objects, checksum))
         {
@@ -536,17 +669,52 @@ build_objid_map_for_package (RpmOstreeCommit2RojigContext *self,
         }
       else
         {
-          /* Add object → pkgobjid to the global map */
-          g_hash_table_iter_steal (&it);
+          /* Add object → pkgobjid to the global map; the size map borrows
+           * the key, so leave the checksum in place.
+           */
           PkgObjid *pkgobjid = g_new (PkgObjid, 1);
           pkgobjid->pkg = g_object_ref (pkg);
-          pkgobjid->objids = g_steal_pointer (&objid_set);
+          pkgobjid->objids = g_hash_table_ref (objid_set);
 
-          g_hash_table_insert (self->content_object_to_pkg_objid, g_steal_pointer (&checksum), pkgobjid);
+          g_hash_table_insert (self->content_object_to_pkg_objid, g_strdup (checksum), pkgobjid);
         }
     }
+}
 
-  return TRUE;
+typedef struct {
+  RpmOstreeCommit2RojigContext *self;
+  GPtrArray *pkglist;
+  PkgBuildObjidMap **builds;
+} BuildObjidMaps;
+
+static gboolean
+build_objid_map_for_package_i (gpointer      user_data,
+                               guint         i,
+                               GCancellable *cancellable,
+                               GError      **error)
+{
+  BuildObjidMaps *data = user_data;
+  data->builds[i] = build_objid_map_for_package (data->self, data->pkglist->pdata[i],
+                                                 cancellable, error);
+  return data->builds[i] != NULL;
+}
+
+typedef struct {
+  OstreeRepo *repo;
+  GPtrArray *checksums;
+  char **contenthashes;
+} ContentonlyHashes;
+
+static gboolean
+contentonly_hash_for_object_i (gpointer      user_data,
+                               guint         i,
+                               GCancellable *cancellable,
+                               GError      **error)
+{
+  ContentonlyHashes *data = user_data;
+  data->contenthashes[i] = contentonly_hash_for_object (data->repo, data->checksums->pdata[i],
+                                                        cancellable, error);
+  return data->contenthashes[i] != NULL;
 }
 
 /* Converts e.g. x86_64 to x86-64 (which is the current value of the RPM %{_isa}
@@ -821,8 +989,7 @@ write_commit2rojig (RpmOstreeCommit2RojigContext *self,
    * here but *also* in the RPM header; we could optimize that, but it's not
    * really worth it)
    */
-  { g_autoptr(GHashTable) xattr_table_hash = g_hash_table_new_full (xattr_chunk_hash, xattr_chunk_equals,
-                                                                    (GDestroyNotify)g_variant_unref, NULL);
+  { g_autoptr(XattrDict) xattr_dict = xattr_dict_new ();
     if (!glnx_shutil_mkdir_p_at (oirpm_tmpd.fd, RPMOSTREE_ROJIG_XATTRS_DIR, 0755, cancellable, error))
       return FALSE;
 
@@ -830,9 +997,6 @@ write_commit2rojig (RpmOstreeCommit2RojigContext *self,
                                                                       (GDestroyNotify) g_ptr_array_unref);
 
     /* First, gather the unique set of xattrs from all pkgobjs */
-    g_autoptr(GVariantBuilder) xattr_table_builder =
-      g_variant_builder_new (RPMOSTREE_ROJIG_XATTRS_TABLE_VARIANT_FORMAT);
-    guint global_xattr_idx = 0;
     GLNX_HASH_TABLE_FOREACH_IT (self->commit_content_objects, it, const char *, checksum,
                                 const char *, unused)
       {
@@ -859,21 +1023,7 @@ write_commit2rojig (RpmOstreeCommit2RojigContext *self,
           }
 
         /* Keep track of the unique xattr set */
-        void *xattr_idx_p;
-        guint this_xattr_idx;
-        if (!g_hash_table_lookup_extended (xattr_table_hash, xattrs, NULL, &xattr_idx_p))
-          {
-            g_variant_builder_add (xattr_table_builder, "@a(ayay)", xattrs);
-            g_hash_table_insert (xattr_table_hash, g_steal_pointer (&xattrs),
-                                 GUINT_TO_POINTER (global_xattr_idx));
-            this_xattr_idx = global_xattr_idx;
-            /* Increment this for the next loop */
-            global_xattr_idx++;
-          }
-        else
-          {
-            this_xattr_idx = GPOINTER_TO_UINT (xattr_idx_p);
-          }
+        const guint32 this_xattr_idx = xattr_dict_intern (xattr_dict, xattrs);
 
         /* Add this to our map of pkg → [objidxattrs] */
         DnfPackage *pkg = pkgobjid->pkg;
@@ -911,12 +1061,12 @@ write_commit2rojig (RpmOstreeCommit2RojigContext *self,
           }
       }
 
-    g_print ("%u unique xattrs\n", g_hash_table_size (xattr_table_hash));
+    g_print ("%u unique xattrs\n", xattr_dict->n_ids);
 
     /* Write the xattr string table */
     if (!glnx_shutil_mkdir_p_at (oirpm_tmpd.fd, RPMOSTREE_ROJIG_XATTRS_DIR, 0755, cancellable, error))
       return FALSE;
-    { g_autoptr(GVariant) xattr_table = g_variant_ref_sink (g_variant_builder_end (xattr_table_builder));
+    { g_autoptr(GVariant) xattr_table = g_variant_ref_sink (g_variant_builder_end (xattr_dict->table));
       if (!glnx_file_replace_contents_at (oirpm_tmpd.fd, RPMOSTREE_ROJIG_XATTRS_TABLE,
                                           g_variant_get_data (xattr_table),
                                           g_variant_get_size (xattr_table),
@@ -1122,12 +1272,20 @@ impl_commit2rojig (RpmOstreeCommit2RojigContext *self,
   /* Sort now, since writing at least requires it, and it aids predictability */
   g_ptr_array_sort (pkglist, compare_pkgs);
 
-  for (guint i = 0; i < pkglist->len; i++)
-    {
-      DnfPackage *pkg = pkglist->pdata[i];
-      if (!build_objid_map_for_package (self, pkg, cancellable, error))
-        return FALSE;
-    }
+  { g_autofree PkgBuildObjidMap **builds = g_new0 (PkgBuildObjidMap*, pkglist->len);
+    BuildObjidMaps data = { self, pkglist, builds };
+    const gboolean built = parallel_for (pkglist->len, build_objid_map_for_package_i, &data,
+                                         cancellable, error);
+    /* Merge in package order regardless of how the builds were scheduled */
+    for (guint i = 0; i < pkglist->len; i++)
+      {
+        g_autoptr(PkgBuildObjidMap) build = g_steal_pointer (&builds[i]);
+        if (built)
+          merge_objid_map_for_package (self, build);
+      }
+    if (!built)
+      return FALSE;
+  }
 
   g_print ("%u content objects in packages\n", g_hash_table_size (self->content_object_to_pkg_objid));
   g_print ("  %u duplicate, %u unused\n",
@@ -1214,6 +1372,25 @@ impl_commit2rojig (RpmOstreeCommit2RojigContext *self,
   g_autoptr(GHashTable) new_big_content_identical = g_hash_table_new_full (g_str_hash, g_str_equal,
                                                                            g_free, (GDestroyNotify)g_ptr_array_unref);
 
+  /* Hashing these is the expensive part, so do it up front in parallel */
+  g_autoptr(GPtrArray) big_checksums = g_ptr_array_new ();
+  GLNX_HASH_TABLE_FOREACH (new_reachable_big, const char *, checksum)
+    g_ptr_array_add (big_checksums, (char*)checksum);
+  g_autoptr(GHashTable) big_contenthashes = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                                   NULL, g_free);
+  { g_autofree char **contenthashes = g_new0 (char*, big_checksums->len);
+    ContentonlyHashes data = { self->repo, big_checksums, contenthashes };
+    const gboolean hashed = parallel_for (big_checksums->len, contentonly_hash_for_object_i,
+                                          &data, cancellable, error);
+    for (guint i = 0; i < big_checksums->len; i++)
+      {
+        if (contenthashes[i])
+          g_hash_table_insert (big_contenthashes, big_checksums->pdata[i], contenthashes[i]);
+      }
+    if (!hashed)
+      return FALSE;
+  }
+
   guint64 oirpm_bytes_big = 0;
   GLNX_HASH_TABLE_FOREACH_IT (new_reachable_big, it, const char *, checksum,
                               void *, unused)
@@ -1223,10 +1400,8 @@ impl_commit2rojig (RpmOstreeCommit2RojigContext *self,
         return FALSE;
       g_assert_cmpint (objsize, >=, BIG_OBJ_SIZE);
 
-      g_autofree char *obj_contenthash =
-        contentonly_hash_for_object (self->repo, checksum, cancellable, error);
-      if (!obj_contenthash)
-        return FALSE;
+      const char *obj_contenthash = g_hash_table_lookup (big_contenthashes, checksum);
+      g_assert (obj_contenthash);
       g_autofree char *objsize_formatted = g_format_size (objsize);
 
       /* This is complex to implement; it would be useful for the grub2-efi data
@@ -300,12 +300,12 @@ rpmostree_context_execute_rojig (RpmOstreeContext     *self,
                                 pkgs_to_import->len, n_requires, dlsize_fmt);
   }
 
-  /* Start the download and import, using the xattr data from the rojigRPM */
-  if (!rpmostree_context_download (self, cancellable, error))
-    return FALSE;
-  g_autoptr(GVariant) xattr_table = rpmostree_rojig_assembler_get_xattr_table (rojig);
-  if (!rpmostree_context_import_rojig (self, xattr_table, pkg_to_xattrs,
-                                       cancellable, error))
+  /* Download and import, using the xattr data from the rojigRPM; each
+   * package is imported as soon as it's downloaded.
+   */
+  g_autoptr(GPtrArray) xattr_table = rpmostree_rojig_assembler_get_xattr_table (rojig);
+  if (!rpmostree_context_download_import_rojig (self, xattr_table, pkg_to_xattrs,
+                                                cancellable, error))
     return FALSE;
 
   /* Last thing is to delete the partial marker, just like
@@ -490,6 +490,28 @@ _rpmhdrs_diff_cmp_end (const GPtrArray *hs1, const GPtrArray *hs2)
   return header_name_cmp (h1, h2);
 }
 
+#define CHANGELOG_INDENTATION "    "
+
+static void
+print_one_changelog_entry (guint64     date,
+                           const char *name,
+                           const char *text)
+{
+  g_autofree char *indented_text = NULL;
+  if (strchr (text, '\n'))
+    {
+      g_auto(GStrv) lines = g_strsplit (text, "\n", 0);
+      indented_text = g_strjoinv ("\n" CHANGELOG_INDENTATION, lines);
+    }
+
+  g_autoptr(GDateTime) dt = g_date_time_new_from_unix_utc (date);
+  g_autofree char *date_time_str = g_date_time_format (dt, "%a %b %d %Y");
+
+  g_print (CHANGELOG_INDENTATION "* %s %s\n"
+           CHANGELOG_INDENTATION "%s\n\n", date_time_str, name,
+           indented_text ?: text);
+}
+
 void
 rpmhdrs_diff_prnt_block (gboolean changelogs, struct RpmHeadersDiff *diff)
 {
@@ -589,8 +611,6 @@ rpmhdrs_diff_prnt_block (gboolean changelogs, struct RpmHeadersDiff *diff)
               uint64_t    nchange_date = 0;
               const char *nchange_name = NULL;
               const char *nchange_text = NULL;
-              GDateTime *dt = NULL;
-              g_autofree char *date_time_str = NULL;
 
               /* Load next new %changelog entry, starting at the newest. */
               rpmtdNext (nchanges_date);
@@ -609,25 +629,8 @@ rpmhdrs_diff_prnt_block (gboolean changelogs, struct RpmHeadersDiff *diff)
                   g_str_equal (ochange_text, nchange_text))
                 break;
 
-#define CHANGELOG_INDENTATION "    "
-
-              g_autofree char *indented_nchange_text = NULL;
-              if (strchr (nchange_text, '\n'))
-                {
-                  g_auto(GStrv) lines = g_strsplit (nchange_text, "\n", 0);
-                  indented_nchange_text = g_strjoinv ("\n" CHANGELOG_INDENTATION, lines);
-                }
-
               /* Otherwise, print. */
-              dt = g_date_time_new_from_unix_utc (nchange_date);
-              date_time_str = g_date_time_format (dt, "%a %b %d %Y");
-              g_date_time_unref (dt);
-
-              g_print (CHANGELOG_INDENTATION "* %s %s\n"
-                       CHANGELOG_INDENTATION "%s\n\n", date_time_str, nchange_name,
-                       indented_nchange_text ?: nchange_text);
-
-#undef CHANGELOG_INDENTATION
+              print_one_changelog_entry (nchange_date, nchange_name, nchange_text);
 
               --ncnum;
             }
@@ -992,6 +995,339 @@ rpmostree_get_refts_for_commit (OstreeRepo                *repo,
   return TRUE;
 }
 
+/* Build the `rpmostree.rpmdb.changelogs` detached commit metadata for the
+ * rpmdb at @dfd/@path: one entry per source RPM (sorted), holding the total
+ * number of %changelog entries and the newest RPMOSTREE_CHANGELOG_MAX_ENTRIES
+ * of them. All integers are big endian.
+ */
+gboolean
+rpmostree_create_rpmdb_changelogs_variant (int              dfd,
+                                           const char      *path,
+                                           GVariant       **out_variant,
+                                           GCancellable    *cancellable,
+                                           GError         **error)
+{
+  g_autofree char *rootfs = glnx_fdrel_abspath (dfd, path);
+  g_autoptr(RpmOstreeRefTs) refts = get_refts_for_rootfs (rootfs, NULL);
+  if (!refts)
+    return glnx_throw (error, "Failed to open rpmdb in %s", rootfs);
+
+  /* srpm -> floating (ua(tss)) */
+  g_autoptr(GHashTable) by_srpm =
+    g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_variant_unref);
+  g_auto(rpmdbMatchIterator) iter = rpmtsInitIterator (refts->ts, RPMDBI_PACKAGES, NULL, 0);
+  if (!iter)
+    return glnx_throw (error, "Failed to open rpmdb in %s", rootfs);
+  Header h;
+  while ((h = rpmdbNextIterator (iter)))
+    {
+      if (g_cancellable_set_error_if_cancelled (cancellable, error))
+        return FALSE;
+
+      const char *name = headerGetString (h, RPMTAG_NAME);
+      if (g_str_equal (name, "gpg-pubkey")) continue; /* rpmdb abstraction leak */
+
+      /* RPMs from the same SRPM share the same changelogs */
+      const char *srpm = headerGetString (h, RPMTAG_SOURCERPM);
+      if (!srpm || g_hash_table_contains (by_srpm, srpm))
+        continue;
+
+      struct rpmtd_s dates_s, names_s, texts_s;
+      _cleanup_rpmtddata_ rpmtd dates = &dates_s;
+      _cleanup_rpmtddata_ rpmtd names = &names_s;
+      _cleanup_rpmtddata_ rpmtd texts = &texts_s;
+      headerGet (h, RPMTAG_CHANGELOGTIME, dates, HEADERGET_MINMEM);
+      headerGet (h, RPMTAG_CHANGELOGNAME, names, HEADERGET_MINMEM);
+      headerGet (h, RPMTAG_CHANGELOGTEXT, texts, HEADERGET_MINMEM);
+
+      const guint n_total = rpmtdCount (dates);
+      GVariantBuilder entries_builder;
+      g_variant_builder_init (&entries_builder, (GVariantType*)"a(tss)");
+      for (guint i = 0; i < MIN (n_total, RPMOSTREE_CHANGELOG_MAX_ENTRIES); i++)
+        {
+          rpmtdNext (dates);
+          rpmtdNext (names);
+          rpmtdNext (texts);
+          g_variant_builder_add (&entries_builder, "(tss)",
+                                 GUINT64_TO_BE (rpmtdGetNumber (dates)),
+                                 rpmtdGetString (names) ?: "",
+                                 rpmtdGetString (texts) ?: "");
+        }
+
+      g_hash_table_insert (by_srpm, g_strdup (srpm),
+                           g_variant_ref_sink (g_variant_new ("(ua(tss))",
+                                                              GUINT32_TO_BE (n_total),
+                                                              &entries_builder)));
+    }
+
+  g_autofree char **srpms = (char**)g_hash_table_get_keys_as_array (by_srpm, NULL);
+  qsort (srpms, g_strv_length (srpms), sizeof (char*), rpmostree_ptrarray_sort_compare_strings);
+
+  GVariantBuilder builder;
+  g_variant_builder_init (&builder, (GVariantType*)"a(sua(tss))");
+  for (char **it = srpms; it && *it; it++)
+    {
+      GVariant *v = g_hash_table_lookup (by_srpm, *it);
+      guint32 n_total;
+      g_autoptr(GVariant) entries = NULL;
+      g_variant_get (v, "(u@a(tss))", &n_total, &entries);
+      g_variant_builder_add (&builder, "(su@a(tss))", *it, n_total, entries);
+    }
+
+  *out_variant = g_variant_ref_sink (g_variant_new ("(ua(sua(tss)))",
+                                                    GUINT32_TO_BE (RPMOSTREE_CHANGELOGS_VERSION),
+                                                    &builder));
+  return TRUE;
+}
+
+/* The detached metadata isn't covered by commit signatures, so composes
+ * record this checksum of @changelogs under `rpmostree.rpmdb.changelogs-sha256`
+ * in the commit metadata itself, and rpmostree_commit_load_changelogs()
+ * verifies it.
+ */
+char *
+rpmostree_changelogs_checksum (GVariant *changelogs)
+{
+  return g_compute_checksum_for_data (G_CHECKSUM_SHA256,
+                                      g_variant_get_data (changelogs),
+                                      g_variant_get_size (changelogs));
+}
+
+/* Store @changelogs (from rpmostree_create_rpmdb_changelogs_variant()) in the
+ * detached metadata of @checksum, preserving anything already there (e.g. GPG
+ * signatures). Keeping it out of the commit object means it is only loaded
+ * when something actually asks for changelogs.
+ */
+gboolean
+rpmostree_commit_write_changelogs (OstreeRepo   *repo,
+                                   const char   *checksum,
+                                   GVariant     *changelogs,
+                                   GCancellable *cancellable,
+                                   GError      **error)
+{
+  g_autoptr(GVariant) detached = NULL;
+  if (!ostree_repo_read_commit_detached_metadata (repo, checksum, &detached,
+                                                  cancellable, error))
+    return FALSE;
+
+  g_autoptr(GVariantDict) dict = g_variant_dict_new (detached);
+  g_variant_dict_insert_value (dict, "rpmostree.rpmdb.changelogs", changelogs);
+  g_autoptr(GVariant) new_detached = g_variant_ref_sink (g_variant_dict_end (dict));
+  return ostree_repo_write_commit_detached_metadata (repo, checksum, new_detached,
+                                                     cancellable, error);
+}
+
+/* Load the changelogs stored by rpmostree_commit_write_changelogs(); sets
+ * @out_changelogs to %NULL if the commit doesn't have any (or doesn't vouch for
+ * them in its metadata). Errors out if they don't match the commit.
+ */
+gboolean
+rpmostree_commit_load_changelogs (OstreeRepo   *repo,
+                                  const char   *checksum,
+                                  GVariant    **out_changelogs,
+                                  GCancellable *cancellable,
+                                  GError      **error)
+{
+  g_autoptr(GVariant) commit = NULL;
+  if (!ostree_repo_load_commit (repo, checksum, &commit, NULL, error))
+    return FALSE;
+  g_autoptr(GVariant) meta = g_variant_get_child_value (commit, 0);
+  const char *expected_checksum;
+  if (!g_variant_lookup (meta, "rpmostree.rpmdb.changelogs-sha256", "&s", &expected_checksum))
+    {
+      *out_changelogs = NULL;
+      return TRUE; /* NB: early return */
+    }
+
+  g_autoptr(GVariant) detached = NULL;
+  if (!ostree_repo_read_commit_detached_metadata (repo, checksum, &detached,
+                                                  cancellable, error))
+    return FALSE;
+
+  g_autoptr(GVariant) changelogs = NULL;
+  if (detached)
+    {
+      g_autoptr(GVariantDict) dict = g_variant_dict_new (detached);
+      changelogs = g_variant_dict_lookup_value (dict, "rpmostree.rpmdb.changelogs",
+                                                G_VARIANT_TYPE ("(ua(sua(tss)))"));
+    }
+  if (changelogs)
+    {
+      guint32 version;
+      g_variant_get_child (changelogs, 0, "u", &version);
+      if (GUINT32_FROM_BE (version) != RPMOSTREE_CHANGELOGS_VERSION)
+        g_clear_pointer (&changelogs, g_variant_unref);
+    }
+  if (changelogs)
+    {
+      g_autofree char *actual_checksum = rpmostree_changelogs_checksum (changelogs);
+      if (!g_str_equal (expected_checksum, actual_checksum))
+        return glnx_throw (error, "Changelogs for commit %s don't match its "
+                           "rpmostree.rpmdb.changelogs-sha256", checksum);
+    }
+
+  *out_changelogs = g_steal_pointer (&changelogs);
+  return TRUE;
+}
+
+static GVariant *
+changelogs_lookup (GVariant   *changelogs,
+                   const char *srpm,
+                   guint32    *out_n_total)
+{
+  g_autoptr(GVariant) srpms = g_variant_get_child_value (changelogs, 1);
+  int pos;
+  if (!srpm || !rpmostree_variant_bsearch_str (srpms, srpm, &pos))
+    return NULL;
+
+  GVariant *entries;
+  guint32 n_total;
+  g_variant_get_child (srpms, pos, "(&su@a(tss))", NULL, &n_total, &entries);
+  *out_n_total = GUINT32_FROM_BE (n_total);
+  return entries;
+}
+
+/* Returns the source RPM of @pkg from @pkgindex, or %NULL if not found. The
+ * string is owned by @pkgindex. */
+static const char *
+pkgindex_get_sourcerpm (GVariant         *pkgindex,
+                        RpmOstreePackage *pkg)
+{
+  guint first, n;
+  if (!rpmostree_pkgindex_lookup (pkgindex, rpm_ostree_package_get_name (pkg), &first, &n))
+    return NULL;
+
+  g_autoptr(GVariant) entries = g_variant_get_child_value (pkgindex, 1);
+  for (guint i = first; i < first + n; i++)
+    {
+      const char *epoch, *version, *release, *arch, *srpm;
+      g_variant_get_child (entries, i, "(s&s&s&s&stt&ss)", NULL, &epoch, &version,
+                           &release, &arch, NULL, NULL, &srpm, NULL);
+      /* same libdnf convention as _rpm_ostree_package_new_from_variant() */
+      g_autofree char *evr = g_str_equal (epoch, "0")
+        ? g_strdup_printf ("%s-%s", version, release)
+        : g_strdup_printf ("%s:%s-%s", epoch, version, release);
+      if (g_str_equal (arch, rpm_ostree_package_get_arch (pkg)) &&
+          g_str_equal (evr, rpm_ostree_package_get_evr (pkg)))
+        return *srpm ? srpm : NULL;
+    }
+
+  return NULL;
+}
+
+/* Like rpmhdrs_diff_prnt_block() with changelogs enabled, but works from
+ * RpmOstreePackage lists (as returned by rpm_ostree_db_diff()) and the
+ * changelogs stored by rpmostree_commit_write_changelogs(), so no rpmdb
+ * needs to be checked out. Only the changelogs of modified packages are
+ * looked at; their source RPMs come from the commits' pkgindex.
+ */
+void
+rpmostree_diff_print_changelogs (GVariant  *old_pkgindex,
+                                 GVariant  *new_pkgindex,
+                                 GVariant  *old_changelogs,
+                                 GVariant  *new_changelogs,
+                                 GPtrArray *removed,
+                                 GPtrArray *added,
+                                 GPtrArray *modified_old,
+                                 GPtrArray *modified_new)
+{
+  g_assert_cmpuint (modified_old->len, ==, modified_new->len);
+
+  gboolean done = FALSE;
+  for (guint i = 0; i < modified_new->len; i++)
+    {
+      RpmOstreePackage *po = modified_old->pdata[i];
+      RpmOstreePackage *pn = modified_new->pdata[i];
+      if (rpm_ostree_package_cmp (po, pn) > 0)
+        continue;
+
+      if (!done)
+        {
+          done = TRUE;
+          g_print ("Upgraded:\n");
+        }
+
+      g_print ("  %s %s.%s -> %s.%s\n", rpm_ostree_package_get_name (po),
+               rpm_ostree_package_get_evr (po), rpm_ostree_package_get_arch (po),
+               rpm_ostree_package_get_evr (pn), rpm_ostree_package_get_arch (pn));
+
+      /* only print once per run of consecutive RPMs from the same SRPM */
+      const char *current_srpm = pkgindex_get_sourcerpm (old_pkgindex, po);
+      const char *next_srpm = (i + 1 < modified_old->len)
+        ? pkgindex_get_sourcerpm (old_pkgindex, modified_old->pdata[i+1]) : NULL;
+      if (g_strcmp0 (current_srpm, next_srpm) == 0)
+        continue;
+
+      guint32 o_total = 0, n_total = 0;
+      g_autoptr(GVariant) o_entries = changelogs_lookup (old_changelogs, current_srpm, &o_total);
+      g_autoptr(GVariant) n_entries =
+        changelogs_lookup (new_changelogs, pkgindex_get_sourcerpm (new_pkgindex, pn), &n_total);
+      if (!o_entries || !n_entries ||
+          g_variant_n_children (o_entries) == 0 || g_variant_n_children (n_entries) == 0)
+        continue;
+
+      /* the latest old %changelog entry */
+      guint64 odate;
+      const char *oname, *otext;
+      g_variant_get_child (o_entries, 0, "(t&s&s)", &odate, &oname, &otext);
+      odate = GUINT64_FROM_BE (odate);
+
+      const guint n = g_variant_n_children (n_entries);
+      guint j = 0;
+      for (; j < n; j++)
+        {
+          guint64 ndate;
+          const char *nname, *ntext;
+          g_variant_get_child (n_entries, j, "(t&s&s)", &ndate, &nname, &ntext);
+          ndate = GUINT64_FROM_BE (ndate);
+
+          /* If we are now older than, or match, the latest old %changelog
+           * then we are done. */
+          if (odate > ndate)
+            break;
+          if (odate == ndate && g_str_equal (oname, nname) && g_str_equal (otext, ntext))
+            break;
+
+          print_one_changelog_entry (ndate, nname, ntext);
+        }
+      if (j == n && n < n_total)
+        g_print (CHANGELOG_INDENTATION "(%u older entries not shown)\n\n", n_total - n);
+    }
+
+  done = FALSE;
+  for (guint i = 0; i < modified_new->len; i++)
+    {
+      RpmOstreePackage *po = modified_old->pdata[i];
+      RpmOstreePackage *pn = modified_new->pdata[i];
+      if (rpm_ostree_package_cmp (po, pn) < 0)
+        continue;
+
+      if (!done)
+        {
+          done = TRUE;
+          g_print ("Downgraded:\n");
+        }
+
+      g_print ("  %s %s.%s -> %s.%s\n", rpm_ostree_package_get_name (po),
+               rpm_ostree_package_get_evr (po), rpm_ostree_package_get_arch (po),
+               rpm_ostree_package_get_evr (pn), rpm_ostree_package_get_arch (pn));
+    }
+
+  for (guint i = 0; i < removed->len; i++)
+    {
+      if (i == 0)
+        g_print ("Removed:\n");
+      g_print ("  %s\n", rpm_ostree_package_get_nevra (removed->pdata[i]));
+    }
+
+  for (guint i = 0; i < added->len; i++)
+    {
+      if (i == 0)
+        g_print ("Added:\n");
+      g_print ("  %s\n", rpm_ostree_package_get_nevra (added->pdata[i]));
+    }
+}
+
 gint
 rpmostree_pkg_array_compare (DnfPackage **p_pkg1,
                              DnfPackage **p_pkg2)
@@ -1221,10 +1557,83 @@ rpmostree_sack_get_sorted_packages (DnfSack *sack)
   return g_steal_pointer (&pkglist);
 }
 
+/* Same hash function as g_str_hash() (djb2), but spelled out here since the
+ * result is serialized into commit metadata and must never change.
+ */
+static guint32
+pkgindex_name_hash (const char *name)
+{
+  guint32 h = 5381;
+  for (const char *p = name; *p; p++)
+    h = (h << 5) + h + (guint8)*p;
+  return h;
+}
+
+static GVariant *
+create_rpmdb_pkgindex_variant (GPtrArray *pkglist)
+{
+  const guint n = pkglist->len;
+
+  /* open-addressed name -> (first entry index + 1) table, at most half full */
+  guint n_slots = 1;
+  while (n_slots < n * 2)
+    n_slots <<= 1;
+  g_autofree guint32 *slots = g_new0 (guint32, n_slots);
+
+  GVariantBuilder entries_builder;
+  g_variant_builder_init (&entries_builder, (GVariantType*)"a" RPMOSTREE_PKGINDEX_ENTRY_FORMAT);
+  const char *prev_name = NULL;
+  for (guint i = 0; i < n; i++)
+    {
+      DnfPackage *pkg = pkglist->pdata[i];
+      const char *name = dnf_package_get_name (pkg);
+
+      g_autofree char *epoch = g_strdup_printf ("%" PRIu64, dnf_package_get_epoch (pkg));
+      g_autofree char *digest = NULL;
+      int chksum_type;
+      const unsigned char *chksum_raw = dnf_package_get_hdr_chksum (pkg, &chksum_type);
+      if (chksum_raw)
+        {
+          g_autofree char *chksum = hy_chksum_str (chksum_raw, chksum_type);
+          digest = g_strconcat (hy_chksum_name (chksum_type), ":", chksum, NULL);
+        }
+      g_variant_builder_add (&entries_builder, RPMOSTREE_PKGINDEX_ENTRY_FORMAT,
+                             name, epoch,
+                             dnf_package_get_version (pkg),
+                             dnf_package_get_release (pkg),
+                             dnf_package_get_arch (pkg),
+                             (guint64)dnf_package_get_installsize (pkg),
+                             (guint64)dnf_package_get_buildtime (pkg),
+                             dnf_package_get_sourcerpm (pkg) ?: "",
+                             digest ?: "");
+
+      /* the list is sorted, so only the first package of each name is indexed */
+      if (prev_name && g_str_equal (prev_name, name))
+        continue;
+      prev_name = name;
+
+      guint32 slot = pkgindex_name_hash (name) & (n_slots - 1);
+      while (slots[slot] != 0)
+        slot = (slot + 1) & (n_slots - 1);
+      slots[slot] = i + 1;
+    }
+
+  g_autoptr(GVariant) slots_v =
+    g_variant_ref_sink (g_variant_new_fixed_array (G_VARIANT_TYPE_UINT32, slots,
+                                                   n_slots, sizeof (guint32)));
+  return g_variant_new ("(u@a" RPMOSTREE_PKGINDEX_ENTRY_FORMAT "@au)",
+                        RPMOSTREE_PKGINDEX_VERSION,
+                        g_variant_builder_end (&entries_builder), slots_v);
+}
+
+/* Generate both the `rpmostree.rpmdb.pkglist` and `rpmostree.rpmdb.pkgindex`
+ * metadata for the rpmdb at @dfd/@path.
+ */
 gboolean
 rpmostree_create_rpmdb_pkglist_variant (int              dfd,
                                         const char      *path,
                                         GVariant       **out_variant,
+                                        GVariant       **out_index, /* allow-none */
                                         GCancellable    *cancellable,
                                         GError         **error)
 {
@@ -1254,9 +1663,115 @@ rpmostree_create_rpmdb_pkglist_variant (int              dfd,
     }
 
   *out_variant = g_variant_ref_sink (g_variant_builder_end (&pkglist_v_builder));
+  if (out_index)
+    *out_index = g_variant_ref_sink (create_rpmdb_pkgindex_variant (pkglist));
   return TRUE;
 }
 
+/* Returns the `rpmostree.rpmdb.pkgindex` from @commit in host byte order, or
+ * %NULL if the commit predates it (or has an index version we don't know).
+ */
+GVariant *
+rpmostree_commit_get_pkgindex (GVariant *commit)
+{
+  g_autoptr(GVariant) meta = g_variant_get_child_value (commit, 0);
+  g_autoptr(GVariantDict) meta_dict = g_variant_dict_new (meta);
+  g_autoptr(GVariant) pkgindex =
+    g_variant_dict_lookup_value (meta_dict, "rpmostree.rpmdb.pkgindex",
+                                 (GVariantType*)RPMOSTREE_PKGINDEX_FORMAT);
+  if (!pkgindex)
+    return NULL;
+
+  /* Server composes canonicalize all metadata to big endian, while layered
+   * commits are written in host order. The version doubles as a byte order
+   * mark to tell them apart. */
+  guint32 version;
+  g_variant_get_child (pkgindex, 0, "u", &version);
+  if (version == GUINT32_SWAP_LE_BE (RPMOSTREE_PKGINDEX_VERSION))
+    {
+      GVariant *swapped = g_variant_byteswap (pkgindex);
+      g_variant_unref (pkgindex);
+      pkgindex = g_variant_ref_sink (swapped);
+      g_variant_get_child (pkgindex, 0, "u", &version);
+    }
+  if (version != RPMOSTREE_PKGINDEX_VERSION)
+    return NULL;
+
+  return g_steal_pointer (&pkgindex);
+}
+
+/* Find the packages named @name in @pkgindex (as returned by
+ * rpmostree_commit_get_pkgindex()) without searching the list. Multiple
+ * packages may share a name (e.g. multilib); they are contiguous, and
+ * @out_first and @out_n describe that range of entries.
+ *
+ * Returns: %TRUE iff found
+ */
+gboolean
+rpmostree_pkgindex_lookup (GVariant   *pkgindex,
+                           const char *name,
+                           guint      *out_first,
+                           guint      *out_n)
+{
+  g_autoptr(GVariant) entries = g_variant_get_child_value (pkgindex, 1);
+  g_autoptr(GVariant) slots_v = g_variant_get_child_value (pkgindex, 2);
+  gsize n_slots;
+  const guint32 *slots = g_variant_get_fixed_array (slots_v, &n_slots, sizeof (guint32));
+  const gsize n_entries = g_variant_n_children (entries);
+  /* the slot count is always a power of two */
+  if (n_slots == 0 || (n_slots & (n_slots - 1)) != 0)
+    return FALSE;
+
+  guint32 slot = pkgindex_name_hash (name) & (n_slots - 1);
+  for (gsize probes = 0; probes < n_slots && slots[slot] != 0; probes++)
+    {
+      const guint32 first = slots[slot] - 1;
+      if (first >= n_entries)
+        return FALSE;
+
+      const char *cur;
+      g_variant_get_child (entries, first, "(&sssssttss)", &cur,
+                           NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+      if (g_str_equal (cur, name))
+        {
+          guint n = 1;
+          while (first + n < n_entries)
+            {
+              g_variant_get_child (entries, first + n, "(&sssssttss)", &cur,
+                                   NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+              if (!g_str_equal (cur, name))
+                break;
+              n++;
+            }
+          *out_first = first;
+          *out_n = n;
+          return TRUE;
+        }
+      slot = (slot + 1) & (n_slots - 1);
+    }
+
+  return FALSE;
+}
+
+/* Returns the total installed size of the packages in @pkgindex (as returned
+ * by rpmostree_commit_get_pkgindex()).
+ */
+guint64
+rpmostree_pkgindex_get_installsize (GVariant *pkgindex)
+{
+  g_autoptr(GVariant) entries = g_variant_get_child_value (pkgindex, 1);
+  const guint n = g_variant_n_children (entries);
+  guint64 total = 0;
+  for (guint i = 0; i < n; i++)
+    {
+      guint64 installsize;
+      g_variant_get_child (entries, i, "(ssssstt&ss)", NULL, NULL, NULL, NULL, NULL,
+                           &installsize, NULL, NULL, NULL);
+      total += installsize;
+    }
+  return total;
+}
+
 /* Simple wrapper around hy_split_nevra() that adds allow-none and GError convention */
 gboolean
 rpmostree_decompose_nevra (const char  *nevra,
@@ -1448,6 +1963,12 @@ rpmostree_get_cache_branch_pkg (DnfPackage *pkg)
                                                  dnf_package_get_arch (pkg));
 }
 
+char *
+rpmostree_get_rojig_branch_for_n_evr_a (const char *name, const char *evr, const char *arch)
+{
+  return get_branch_for_n_evr_a ("rojig", name, evr, arch);
+}
+
 char *
 rpmostree_get_rojig_branch_pkg (DnfPackage *pkg)
 {
@@ -204,16 +204,76 @@ rpmostree_sack_get_packages (DnfSack *sack);
 GPtrArray*
 rpmostree_sack_get_sorted_packages (DnfSack *sack);
 
+/* The `rpmostree.rpmdb.pkgindex` commit metadata: a version, the sorted
+ * entries (name, epoch, version, release, arch, installsize, buildtime,
+ * sourcerpm, header digest), and a hash table of name -> first entry + 1.
+ */
+#define RPMOSTREE_PKGINDEX_VERSION 1
+#define RPMOSTREE_PKGINDEX_ENTRY_FORMAT "(sssssttss)"
+#define RPMOSTREE_PKGINDEX_FORMAT "(ua" RPMOSTREE_PKGINDEX_ENTRY_FORMAT "au)"
+
 gboolean
 rpmostree_create_rpmdb_pkglist_variant (int              dfd,
                                         const char      *path,
                                         GVariant       **out_variant,
+                                        GVariant       **out_index,
                                         GCancellable    *cancellable,
                                         GError         **error);
 
+GVariant *
+rpmostree_commit_get_pkgindex (GVariant *commit);
+
+/* The `rpmostree.rpmdb.changelogs` detached commit metadata */
+#define RPMOSTREE_CHANGELOGS_VERSION 1
+#define RPMOSTREE_CHANGELOG_MAX_ENTRIES 10
+
+gboolean
+rpmostree_create_rpmdb_changelogs_variant (int              dfd,
+                                           const char      *path,
+                                           GVariant       **out_variant,
+                                           GCancellable    *cancellable,
+                                           GError         **error);
+
+char *
+rpmostree_changelogs_checksum (GVariant *changelogs);
+
+gboolean
+rpmostree_commit_write_changelogs (OstreeRepo   *repo,
+                                   const char   *checksum,
+                                   GVariant     *changelogs,
+                                   GCancellable *cancellable,
+                                   GError      **error);
+
+gboolean
+rpmostree_commit_load_changelogs (OstreeRepo   *repo,
+                                  const char   *checksum,
+                                  GVariant    **out_changelogs,
+                                  GCancellable *cancellable,
+                                  GError      **error);
+
+void
+rpmostree_diff_print_changelogs (GVariant  *old_pkgindex,
+                                 GVariant  *new_pkgindex,
+                                 GVariant  *old_changelogs,
+                                 GVariant  *new_changelogs,
+                                 GPtrArray *removed,
+                                 GPtrArray *added,
+                                 GPtrArray *modified_old,
+                                 GPtrArray *modified_new);
+
+gboolean
+rpmostree_pkgindex_lookup (GVariant   *pkgindex,
+                           const char *name,
+                           guint      *out_first,
+                           guint      *out_n);
+
+guint64
+rpmostree_pkgindex_get_installsize (GVariant *pkgindex);
+
 char * rpmostree_get_cache_branch_for_n_evr_a (const char *name, const char *evr, const char *arch);
 char *rpmostree_get_cache_branch_header (Header hdr);
 char *rpmostree_get_rojig_branch_header (Header hdr);
+char *rpmostree_get_rojig_branch_for_n_evr_a (const char *name, const char *evr, const char *arch);
 char *rpmostree_get_cache_branch_pkg (DnfPackage *pkg);
 char *rpmostree_get_rojig_branch_pkg (DnfPackage *pkg);
 
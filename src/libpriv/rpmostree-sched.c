@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config.h"
+
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "rpmostree-sched.h"
+
+/* Not exposed by glibc; see ioprio_set(2) */
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_PRIO_VALUE(class, data) (((class) << IOPRIO_CLASS_SHIFT) | (data))
+#define IOPRIO_CLASS_NONE 0
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_WHO_PROCESS 1
+
+#define BACKGROUND_NICE 19
+
+static volatile gint sched_background;
+static volatile guint sched_max_workers;
+/* The nice value to go back to; captured when entering background mode */
+static volatile gint sched_base_nice;
+
+/* Whether the policy has been applied to this thread */
+static __thread gboolean thread_in_background;
+
+void
+rpmostree_sched_set_background (gboolean background,
+                                guint    max_workers)
+{
+  if (background)
+    sched_base_nice = getpriority (PRIO_PROCESS, 0);
+  sched_max_workers = background ? max_workers : 0;
+  g_atomic_int_set (&sched_background, background ? 1 : 0);
+}
+
+gboolean
+rpmostree_sched_get_background (void)
+{
+  return g_atomic_int_get (&sched_background);
+}
+
+/* Returns the number of parallel workers to use for a pool that would
+ * otherwise use @default_workers. */
+guint
+rpmostree_sched_get_max_workers (guint default_workers)
+{
+  const guint max_workers = sched_max_workers;
+  if (rpmostree_sched_get_background () && max_workers > 0)
+    return MIN (default_workers, max_workers);
+  return default_workers;
+}
+
+/* Errors are ignored here; this is best effort, and failing to e.g. restore
+ * a lower nice value (EACCES without CAP_SYS_NICE) shouldn't fail the work
+ * itself. Only makes raw syscalls, so it's safe to use after fork(). */
+static void
+apply_to_thread (gboolean background)
+{
+  const pid_t tid = syscall (SYS_gettid);
+  (void) setpriority (PRIO_PROCESS, tid, background ? BACKGROUND_NICE : sched_base_nice);
+  (void) syscall (SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid,
+                  background ? IOPRIO_PRIO_VALUE (IOPRIO_CLASS_IDLE, 0)
+                             : IOPRIO_PRIO_VALUE (IOPRIO_CLASS_NONE, 0));
+}
+
+/* Call at the start of work done in a (possibly shared) worker thread. */
+void
+rpmostree_sched_thread_enter (void)
+{
+  const gboolean background = rpmostree_sched_get_background ();
+  if (background == thread_in_background)
+    return;
+  apply_to_thread (background);
+  thread_in_background = background;
+}
+
+/* And at the end, so pool threads don't stay deprioritized for unrelated
+ * work. */
+void
+rpmostree_sched_thread_leave (void)
+{
+  if (!thread_in_background)
+    return;
+  apply_to_thread (FALSE);
+  thread_in_background = FALSE;
+}
+
+/* For GSpawnChildSetupFunc; children inherit the spawning thread's
+ * priorities, but this ensures they match the policy regardless of which
+ * thread they were forked from. */
+void
+rpmostree_sched_child_setup (void)
+{
+  if (rpmostree_sched_get_background ())
+    apply_to_thread (TRUE);
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Process-wide scheduling policy for work done on behalf of a transaction.
+ * In background mode, threads doing that work (and children they spawn) run
+ * at idle IO priority and the lowest CPU priority, and the number of parallel
+ * import workers can be capped.
+ *
+ * Since nice values and IO priorities are per-thread on Linux, the policy is
+ * applied to each worker thread as it picks up a task; see
+ * rpmostree_sched_thread_enter().
+ */
+void     rpmostree_sched_set_background (gboolean background,
+                                         guint    max_workers);
+gboolean rpmostree_sched_get_background (void);
+guint    rpmostree_sched_get_max_workers (guint default_workers);
+
+void     rpmostree_sched_thread_enter (void);
+void     rpmostree_sched_thread_leave (void);
+void     rpmostree_sched_child_setup (void);
+
+G_END_DECLS
@@ -23,6 +23,7 @@
 #include <gio/gio.h>
 #include <systemd/sd-journal.h>
 #include "rpmostree-output.h"
+#include "rpmostree-probes.h"
 #include "rpmostree-util.h"
 #include "rpmostree-bwrap.h"
 #include <err.h>
@@ -332,6 +333,7 @@ dump_buffered_output_noerr (const char *prefix,
 static gboolean
 run_script_in_bwrap_container (int rootfs_fd,
                                GLnxTmpDir *var_lib_rpm_statedir,
+                               const char *selinux_policy_cachedir,
                                gboolean    enable_fuse,
                                const char *name,
                                const char *scriptdesc,
@@ -422,6 +424,10 @@ run_script_in_bwrap_container (int rootfs_fd,
 
   if (var_lib_rpm_statedir)
     rpmostree_bwrap_bind_readwrite (bwrap, var_lib_rpm_statedir->path, "/var/lib/rpm-state");
+  /* This one is in the /var/tmp tmpfs; see semodule-wrapper.sh */
+  if (selinux_policy_cachedir)
+    rpmostree_bwrap_bind_readwrite (bwrap, selinux_policy_cachedir,
+                                    "/var/tmp/rpm-ostree-selinux-policy");
 
   const gboolean debugging_script = g_strcmp0 (g_getenv ("RPMOSTREE_SCRIPT_DEBUG"), pkg_script) == 0;
 
@@ -495,8 +501,12 @@ run_script_in_bwrap_container (int rootfs_fd,
                                          NULL);
     }
 
-
-  if (!rpmostree_bwrap_run (bwrap, cancellable, error))
+  RPMOSTREE_PROBE2 (script__start, name, scriptdesc);
+  const gint64 script_start_usec = g_get_monotonic_time ();
+  const gboolean script_success = rpmostree_bwrap_run (bwrap, cancellable, error);
+  RPMOSTREE_PROBE4 (script__done, name, scriptdesc, strlen (script),
+                    g_get_monotonic_time () - script_start_usec);
+  if (!script_success)
     {
       dump_buffered_output_noerr (pkg_script, &buffered_output);
       /* If errors go to the journal, help the user/admin find them there */
@@ -533,6 +543,7 @@ impl_run_rpm_script (const KnownRpmScriptKind *rpmscript,
                      Header         hdr,
                      int            rootfs_fd,
                      GLnxTmpDir    *var_lib_rpm_statedir,
+                     const char    *selinux_policy_cachedir,
                      gboolean       enable_fuse,
                      GCancellable  *cancellable,
                      GError       **error)
@@ -623,7 +634,8 @@ impl_run_rpm_script (const KnownRpmScriptKind *rpmscript,
     }
 
   guint64 start_time_ms = g_get_monotonic_time () / 1000;
-  if (!run_script_in_bwrap_container (rootfs_fd, var_lib_rpm_statedir, enable_fuse,
+  if (!run_script_in_bwrap_container (rootfs_fd, var_lib_rpm_statedir,
+                                      selinux_policy_cachedir, enable_fuse,
                                       dnf_package_get_name (pkg),
                                       rpmscript->desc, interp, script, script_arg,
                                       -1, cancellable, error))
@@ -650,6 +662,7 @@ run_script (const KnownRpmScriptKind *rpmscript,
             Header                    hdr,
             int                       rootfs_fd,
             GLnxTmpDir               *var_lib_rpm_statedir,
+            const char               *selinux_policy_cachedir,
             gboolean                  enable_fuse,
             gboolean                 *out_did_run,
             GCancellable             *cancellable,
@@ -679,7 +692,7 @@ run_script (const KnownRpmScriptKind *rpmscript,
 
   *out_did_run = TRUE;
   return impl_run_rpm_script (rpmscript, pkg, hdr, rootfs_fd, var_lib_rpm_statedir,
-                              enable_fuse, cancellable, error);
+                              selinux_policy_cachedir, enable_fuse, cancellable, error);
 }
 
 static gboolean
@@ -789,7 +802,9 @@ find_and_write_matching_files (int rootfs_fd, const char *pattern,
 }
 
 /* Execute a supported script.  Note that @cancellable
- * does not currently kill a running script subprocess.
+ * does not currently kill a running script subprocess.  If
+ * @selinux_policy_cachedir is set, it's made available to
+ * semodule-wrapper.sh.
  */
 gboolean
 rpmostree_script_run_sync (DnfPackage    *pkg,
@@ -797,6 +812,7 @@ rpmostree_script_run_sync (DnfPackage    *pkg,
                            RpmOstreeScriptKind kind,
                            int            rootfs_fd,
                            GLnxTmpDir    *var_lib_rpm_statedir,
+                           const char    *selinux_policy_cachedir,
                            gboolean       enable_fuse,
                            guint         *out_n_run,
                            GCancellable  *cancellable,
@@ -820,7 +836,7 @@ rpmostree_script_run_sync (DnfPackage    *pkg,
 
   gboolean did_run = FALSE;
   if (!run_script (scriptkind, pkg, hdr, rootfs_fd,
-                   var_lib_rpm_statedir, enable_fuse,
+                   var_lib_rpm_statedir, selinux_policy_cachedir, enable_fuse,
                    &did_run, cancellable, error))
     return FALSE;
 
@@ -989,7 +1005,7 @@ rpmostree_transfiletriggers_run_sync (Header        hdr,
 
       /* Run it, and log the result */
       guint64 start_time_ms = g_get_monotonic_time () / 1000;
-      if (!run_script_in_bwrap_container (rootfs_fd, NULL, enable_fuse, pkg_name,
+      if (!run_script_in_bwrap_container (rootfs_fd, NULL, NULL, enable_fuse, pkg_name,
                                           "%transfiletriggerin", interp, script, NULL,
                                           fileno (tmpf_file), cancellable, error))
         return FALSE;
@@ -63,6 +63,7 @@ rpmostree_script_run_sync (DnfPackage    *pkg,
                            RpmOstreeScriptKind kind,
                            int            rootfs_fd,
                            GLnxTmpDir    *var_lib_rpm_statedir,
+                           const char    *selinux_policy_cachedir,
                            gboolean       enable_rofiles,
                            guint         *out_n_run,
                            GCancellable  *cancellable,
@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <sys/stat.h>
+#include <libglnx.h>
+
+#include "rpmostree-selabel-cache.h"
+#include "rpmostree-output.h"
+
+struct RpmOstreeSeLabelCache {
+  gint refcount;
+  OstreeSePolicy *sepolicy;
+  char *csum;
+
+  GMutex lock;
+  /* Map<char *key, const char *label>; see make_key().  Labels point into
+   * @labels; unlabeled paths map to the empty string. */
+  GHashTable *entries;
+  /* Set<char *label>; there are few distinct labels, so we intern them */
+  GHashTable *labels;
+
+  volatile gint lookups;
+  volatile gint hits;
+  /* What we've already reported, see rpmostree_selabel_cache_report() */
+  gint reported_lookups;
+  gint reported_hits;
+};
+
+RpmOstreeSeLabelCache *
+rpmostree_selabel_cache_new (OstreeSePolicy *sepolicy)
+{
+  RpmOstreeSeLabelCache *cache = g_new0 (RpmOstreeSeLabelCache, 1);
+  cache->refcount = 1;
+  cache->sepolicy = g_object_ref (sepolicy);
+  cache->csum = g_strdup (ostree_sepolicy_get_csum (sepolicy));
+  g_mutex_init (&cache->lock);
+  cache->entries = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  cache->labels = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  return cache;
+}
+
+RpmOstreeSeLabelCache *
+rpmostree_selabel_cache_ref (RpmOstreeSeLabelCache *cache)
+{
+  g_atomic_int_inc (&cache->refcount);
+  return cache;
+}
+
+void
+rpmostree_selabel_cache_unref (RpmOstreeSeLabelCache *cache)
+{
+  if (!g_atomic_int_dec_and_test (&cache->refcount))
+    return;
+  g_object_unref (cache->sepolicy);
+  g_free (cache->csum);
+  g_hash_table_unref (cache->entries);
+  g_hash_table_unref (cache->labels);
+  g_mutex_clear (&cache->lock);
+  g_free (cache);
+}
+
+/* Returns: (transfer none): The policy we're caching lookups for */
+OstreeSePolicy *
+rpmostree_selabel_cache_get_sepolicy (RpmOstreeSeLabelCache *cache)
+{
+  return cache->sepolicy;
+}
+
+/* Returns: %TRUE if lookups against @sepolicy can be served from @cache */
+gboolean
+rpmostree_selabel_cache_matches (RpmOstreeSeLabelCache *cache,
+                                 OstreeSePolicy        *sepolicy)
+{
+  if (cache->sepolicy == sepolicy)
+    return TRUE;
+  const char *csum = ostree_sepolicy_get_csum (sepolicy);
+  return cache->csum && csum && g_str_equal (cache->csum, csum);
+}
+
+/* File contexts only distinguish on the file type, not the permission bits,
+ * so that's all we key on. */
+static char *
+make_key (const char *path,
+          guint32     mode)
+{
+  return g_strdup_printf ("%o:%s", mode & S_IFMT, path);
+}
+
+/* Look up the label for @path (absolute) with @mode; *out_label is set to
+ * NULL if the policy doesn't label it.  The returned label is valid for the
+ * lifetime of @cache.
+ */
+gboolean
+rpmostree_selabel_cache_lookup (RpmOstreeSeLabelCache *cache,
+                                const char            *path,
+                                guint32                mode,
+                                const char           **out_label,
+                                GError               **error)
+{
+  g_autofree char *key = make_key (path, mode);
+  g_atomic_int_inc (&cache->lookups);
+
+  { g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&cache->lock);
+    const char *label = g_hash_table_lookup (cache->entries, key);
+    if (label)
+      {
+        g_atomic_int_inc (&cache->hits);
+        *out_label = *label ? label : NULL;
+        return TRUE;
+      }
+  }
+
+  /* Do the actual lookup without the lock held; the worst case is two
+   * threads racing to compute the same label. */
+  g_autofree char *new_label = NULL;
+  if (!ostree_sepolicy_get_label (cache->sepolicy, path, mode, &new_label, NULL, error))
+    return FALSE;
+
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&cache->lock);
+  const char *label = g_hash_table_lookup (cache->labels, new_label ?: "");
+  if (!label)
+    {
+      char *owned_label = g_strdup (new_label ?: "");
+      g_hash_table_add (cache->labels, owned_label);
+      label = owned_label;
+    }
+  g_hash_table_replace (cache->entries, g_steal_pointer (&key), (char*)label);
+  *out_label = *label ? label : NULL;
+  return TRUE;
+}
+
+/* Returns a new a(ayay) with @base_xattrs (which may be %NULL), but with
+ * security.selinux set to the policy's label for @path, the same way
+ * libostree does when a commit modifier has a policy.  If the policy doesn't
+ * label @path, any label in @base_xattrs is kept, unless @require_label is
+ * set, in which case it's an error.
+ */
+GVariant *
+rpmostree_selabel_cache_label_xattrs (RpmOstreeSeLabelCache *cache,
+                                      const char            *path,
+                                      guint32                mode,
+                                      GVariant              *base_xattrs,
+                                      gboolean               require_label,
+                                      GError               **error)
+{
+  const char *label = NULL;
+  if (!rpmostree_selabel_cache_lookup (cache, path, mode, &label, error))
+    return NULL;
+  if (!label && require_label)
+    return glnx_null_throw (error, "Failed to look up SELinux label for '%s'", path);
+
+  g_auto(GVariantBuilder) builder;
+  g_variant_builder_init (&builder, (GVariantType*)"a(ayay)");
+  const guint n = base_xattrs ? g_variant_n_children (base_xattrs) : 0;
+  for (guint i = 0; i < n; i++)
+    {
+      const char *name;
+      g_autoptr(GVariant) value = NULL;
+      g_variant_get_child (base_xattrs, i, "(^&ay@ay)", &name, &value);
+      if (label && g_str_equal (name, "security.selinux"))
+        continue;
+      g_variant_builder_add (&builder, "(@ay@ay)",
+                             g_variant_new_bytestring (name), value);
+    }
+  if (label)
+    g_variant_builder_add (&builder, "(@ay@ay)",
+                           g_variant_new_bytestring ("security.selinux"),
+                           g_variant_new_bytestring (label));
+  return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
+/* Account the lookups and cache hits since the last report into the
+ * current operation's statistics. */
+void
+rpmostree_selabel_cache_report (RpmOstreeSeLabelCache *cache)
+{
+  gint n_lookups, n_hits;
+  { g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&cache->lock);
+    const gint lookups = g_atomic_int_get (&cache->lookups);
+    const gint hits = g_atomic_int_get (&cache->hits);
+    n_lookups = lookups - cache->reported_lookups;
+    n_hits = hits - cache->reported_hits;
+    cache->reported_lookups = lookups;
+    cache->reported_hits = hits;
+  }
+  rpmostree_output_counter ("selinux-label-lookups", n_lookups);
+  rpmostree_output_counter ("selinux-label-cache-hits", n_hits);
+}
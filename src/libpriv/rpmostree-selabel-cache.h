@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+#include <ostree.h>
+
+G_BEGIN_DECLS
+
+/* Memoizes SELinux label lookups against one policy.  Label lookups go
+ * through the policy's regex set for every file we import or commit, but
+ * the result only depends on the path and the file type, and the same
+ * paths (in particular directories like /usr/share/doc) are labeled over
+ * and over across packages, relabeling and the final commit.  The cache is
+ * thread-safe, and is keyed to the policy's checksum.
+ */
+typedef struct RpmOstreeSeLabelCache RpmOstreeSeLabelCache;
+
+RpmOstreeSeLabelCache *rpmostree_selabel_cache_new (OstreeSePolicy *sepolicy);
+RpmOstreeSeLabelCache *rpmostree_selabel_cache_ref (RpmOstreeSeLabelCache *cache);
+void rpmostree_selabel_cache_unref (RpmOstreeSeLabelCache *cache);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(RpmOstreeSeLabelCache, rpmostree_selabel_cache_unref)
+
+OstreeSePolicy *rpmostree_selabel_cache_get_sepolicy (RpmOstreeSeLabelCache *cache);
+gboolean rpmostree_selabel_cache_matches (RpmOstreeSeLabelCache *cache,
+                                          OstreeSePolicy        *sepolicy);
+
+gboolean rpmostree_selabel_cache_lookup (RpmOstreeSeLabelCache *cache,
+                                         const char            *path,
+                                         guint32                mode,
+                                         const char           **out_label,
+                                         GError               **error);
+
+GVariant *rpmostree_selabel_cache_label_xattrs (RpmOstreeSeLabelCache *cache,
+                                                const char            *path,
+                                                guint32                mode,
+                                                GVariant              *base_xattrs,
+                                                gboolean               require_label,
+                                                GError               **error);
+
+void rpmostree_selabel_cache_report (RpmOstreeSeLabelCache *cache);
+
+G_END_DECLS
@@ -30,6 +30,7 @@ typedef enum {
   RPMOSTREED_AUTOMATIC_UPDATE_POLICY_NONE,
   RPMOSTREED_AUTOMATIC_UPDATE_POLICY_CHECK,
   RPMOSTREED_AUTOMATIC_UPDATE_POLICY_STAGE,
+  RPMOSTREED_AUTOMATIC_UPDATE_POLICY_ASSEMBLE,
 } RpmostreedAutomaticUpdatePolicy;
 
 typedef enum {
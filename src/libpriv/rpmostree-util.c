@@ -31,6 +31,7 @@
 #include "rpmostree-rust.h"
 #include "rpmostree-origin.h"
 #include "rpmostree-output.h"
+#include "rpmostree-pathrules.h"
 #include "libsd-locale-util.h"
 #include "libglnx.h"
 
@@ -212,17 +213,19 @@ rpmostree_check_size_within_limit (guint64     actual,
 char*
 rpmostree_translate_path_for_ostree (const char *path)
 {
-  if (g_str_has_prefix (path, "etc/"))
+  const guint32 flags =
+    rpmostree_path_rules_match_relative (rpmostree_path_rules_get_default (), path);
+  if (flags & RPMOSTREE_PATH_FLAG_ETC)
     return g_strconcat ("usr/", path, NULL);
-  else if (g_str_has_prefix (path, "boot/"))
+  else if (flags & RPMOSTREE_PATH_FLAG_BOOT)
     return g_strconcat ("usr/lib/ostree-boot/", path + strlen ("boot/"), NULL);
   /* Special hack for https://bugzilla.redhat.com/show_bug.cgi?id=1290659
    * See also commit 4a86bdd19665700fa308461510c9decd63e31a03
    * and rpmostree_postprocess_selinux_policy_store_location().
    */
-  else if (g_str_has_prefix (path, VAR_SELINUX_TARGETED_PATH))
+  else if (flags & RPMOSTREE_PATH_FLAG_VAR_SELINUX)
     return g_strconcat ("usr/etc/selinux/targeted/", path + strlen (VAR_SELINUX_TARGETED_PATH), NULL);
-  else if (g_str_has_prefix (path, "opt/"))
+  else if (flags & RPMOSTREE_PATH_FLAG_OPT)
     return g_strconcat ("usr/lib/", path, NULL);
 
   return NULL;
@@ -845,6 +848,178 @@ rpmostree_commit_content_checksum (GVariant *commit)
   return g_strdup (g_checksum_get_string (hasher));
 }
 
+/* Compute the xattrs for a synthesized path the way the commit modifier
+ * would: the xattr callback's set, plus the SELinux label if we have a
+ * policy.
+ */
+static gboolean
+mtree_get_xattrs (OstreeRepo                  *repo,
+                  RpmOstreeMtreeWriteOptions  *opts,
+                  const char                  *abspath,
+                  GFileInfo                   *file_info,
+                  GVariant                   **out_xattrs,
+                  GError                     **error)
+{
+  g_auto(GVariantBuilder) builder;
+  g_variant_builder_init (&builder, (GVariantType*)"a(ayay)");
+
+  if (opts && opts->xattr_callback)
+    {
+      g_autoptr(GVariant) base_xattrs =
+        opts->xattr_callback (repo, abspath, file_info, opts->xattr_data);
+      const guint n = base_xattrs ? g_variant_n_children (base_xattrs) : 0;
+      for (guint i = 0; i < n; i++)
+        {
+          const char *name;
+          g_autoptr(GVariant) value = NULL;
+          g_variant_get_child (base_xattrs, i, "(^&ay@ay)", &name, &value);
+          /* The policy label below wins */
+          if (opts->sepolicy && g_str_equal (name, "security.selinux"))
+            continue;
+          g_variant_builder_add (&builder, "(@ay@ay)",
+                                 g_variant_new_bytestring (name), value);
+        }
+    }
+
+  if (opts && opts->sepolicy)
+    {
+      const guint32 mode = g_file_info_get_attribute_uint32 (file_info, "unix::mode");
+      g_autofree char *label = NULL;
+      if (!ostree_sepolicy_get_label (opts->sepolicy, abspath, mode, &label, NULL, error))
+        return FALSE;
+      if (!label)
+        return glnx_throw (error, "Failed to look up SELinux label for '%s'", abspath);
+      g_variant_builder_add (&builder, "(@ay@ay)",
+                             g_variant_new_bytestring ("security.selinux"),
+                             g_variant_new_bytestring (label));
+    }
+
+  *out_xattrs = g_variant_ref_sink (g_variant_builder_end (&builder));
+  return TRUE;
+}
+
+/* Returns the subdirectory @name of @parent, creating and labeling it if
+ * needed; sets *out_subdir to NULL if the filter skipped it.
+ */
+static gboolean
+mtree_ensure_dir (OstreeRepo                  *repo,
+                  OstreeMutableTree           *parent,
+                  const char                  *name,
+                  const char                  *abspath,
+                  RpmOstreeMtreeWriteOptions  *opts,
+                  OstreeMutableTree          **out_subdir,
+                  GCancellable                *cancellable,
+                  GError                     **error)
+{
+  OstreeMutableTree *subdir = g_hash_table_lookup (ostree_mutable_tree_get_subdirs (parent), name);
+  if (subdir)
+    {
+      *out_subdir = g_object_ref (subdir);
+      return TRUE;
+    }
+
+  g_autoptr(GFileInfo) file_info = g_file_info_new ();
+  g_file_info_set_file_type (file_info, G_FILE_TYPE_DIRECTORY);
+  g_file_info_set_attribute_uint32 (file_info, "unix::uid", 0);
+  g_file_info_set_attribute_uint32 (file_info, "unix::gid", 0);
+  g_file_info_set_attribute_uint32 (file_info, "unix::mode", S_IFDIR | 0755);
+  if (opts && opts->filter &&
+      opts->filter (repo, abspath, file_info, opts->filter_data) == OSTREE_REPO_COMMIT_FILTER_SKIP)
+    {
+      *out_subdir = NULL;
+      return TRUE;
+    }
+
+  g_autoptr(GVariant) xattrs = NULL;
+  if (!mtree_get_xattrs (repo, opts, abspath, file_info, &xattrs, error))
+    return FALSE;
+  g_autoptr(GVariant) dirmeta = g_variant_ref_sink (ostree_create_directory_metadata (file_info, xattrs));
+  g_autofree guchar *csum = NULL;
+  if (!ostree_repo_write_metadata (repo, OSTREE_OBJECT_TYPE_DIR_META, NULL, dirmeta,
+                                   &csum, cancellable, error))
+    return FALSE;
+  char hexdigest[OSTREE_SHA256_STRING_LEN+1];
+  ostree_checksum_inplace_from_bytes (csum, hexdigest);
+
+  g_autoptr(OstreeMutableTree) new_subdir = NULL;
+  if (!ostree_mutable_tree_ensure_dir (parent, name, &new_subdir, error))
+    return FALSE;
+  ostree_mutable_tree_set_metadata_checksum (new_subdir, hexdigest);
+  *out_subdir = g_steal_pointer (&new_subdir);
+  return TRUE;
+}
+
+/* Write @content as a root-owned regular file at the relative @path in
+ * @mtree, creating any missing parent directories.  This avoids round
+ * tripping synthesized files through a temporary directory just to have
+ * ostree_repo_write_dfd_to_mtree() label them; @opts supplies the same
+ * filter, xattr callback and SELinux policy as the commit modifier.  If the
+ * filter skips the path (or one of its parents), nothing is written.
+ */
+gboolean
+rpmostree_mtree_write_file (OstreeRepo                  *repo,
+                            OstreeMutableTree           *mtree,
+                            const char                  *path,
+                            guint32                      mode,
+                            GBytes                      *content,
+                            RpmOstreeMtreeWriteOptions  *opts,
+                            GCancellable                *cancellable,
+                            GError                     **error)
+{
+  g_assert (path[0] != '/');
+  g_autoptr(GString) abspath = g_string_new ("");
+  g_autoptr(OstreeMutableTree) parent = g_object_ref (mtree);
+  g_auto(GStrv) components = g_strsplit (path, "/", -1);
+  const guint n_components = g_strv_length (components);
+  g_assert_cmpuint (n_components, >, 0);
+
+  for (guint i = 0; i < n_components - 1; i++)
+    {
+      g_string_append_c (abspath, '/');
+      g_string_append (abspath, components[i]);
+      g_autoptr(OstreeMutableTree) subdir = NULL;
+      if (!mtree_ensure_dir (repo, parent, components[i], abspath->str, opts,
+                             &subdir, cancellable, error))
+        return glnx_prefix_error (error, "Writing %s", abspath->str);
+      if (!subdir)
+        return TRUE; /* Filtered out */
+      g_clear_object (&parent);
+      parent = g_steal_pointer (&subdir);
+    }
+  const char *name = components[n_components - 1];
+  g_string_append_c (abspath, '/');
+  g_string_append (abspath, name);
+
+  g_autoptr(GFileInfo) file_info = g_file_info_new ();
+  g_file_info_set_file_type (file_info, G_FILE_TYPE_REGULAR);
+  g_file_info_set_attribute_uint32 (file_info, "unix::uid", 0);
+  g_file_info_set_attribute_uint32 (file_info, "unix::gid", 0);
+  g_file_info_set_attribute_uint32 (file_info, "unix::mode", S_IFREG | mode);
+  g_file_info_set_size (file_info, g_bytes_get_size (content));
+  if (opts && opts->filter &&
+      opts->filter (repo, abspath->str, file_info, opts->filter_data) == OSTREE_REPO_COMMIT_FILTER_SKIP)
+    return TRUE;
+
+  g_autoptr(GVariant) xattrs = NULL;
+  if (!mtree_get_xattrs (repo, opts, abspath->str, file_info, &xattrs, error))
+    return glnx_prefix_error (error, "Writing %s", abspath->str);
+
+  g_autoptr(GInputStream) content_in = g_memory_input_stream_new_from_bytes (content);
+  g_autoptr(GInputStream) object_in = NULL;
+  guint64 object_len;
+  if (!ostree_raw_file_to_content_stream (content_in, file_info, xattrs,
+                                          &object_in, &object_len, cancellable, error))
+    return FALSE;
+  g_autofree guchar *csum = NULL;
+  if (!ostree_repo_write_content (repo, NULL, object_in, object_len, &csum,
+                                  cancellable, error))
+    return glnx_prefix_error (error, "Writing %s", abspath->str);
+  char hexdigest[OSTREE_SHA256_STRING_LEN+1];
+  ostree_checksum_inplace_from_bytes (csum, hexdigest);
+
+  return ostree_mutable_tree_replace_file (parent, name, hexdigest, error);
+}
+
 /* Implementation taken from https://git.gnome.org/browse/libgsystem/tree/src/gsystem-log.c */
 gboolean
 rpmostree_stdout_is_journal (void)
@@ -1196,6 +1371,8 @@ rpmostree_auto_update_policy_to_str (RpmostreedAutomaticUpdatePolicy policy,
       return "check";
     case RPMOSTREED_AUTOMATIC_UPDATE_POLICY_STAGE:
       return "stage";
+    case RPMOSTREED_AUTOMATIC_UPDATE_POLICY_ASSEMBLE:
+      return "assemble";
     default:
       return glnx_null_throw (error, "Invalid policy value %u", policy);
     }
@@ -1213,6 +1390,8 @@ rpmostree_str_to_auto_update_policy (const char *str,
     *out_policy = RPMOSTREED_AUTOMATIC_UPDATE_POLICY_CHECK;
   else if (g_str_equal (str, "stage") || g_str_equal (str, "ex-stage") /* backcompat */)
     *out_policy = RPMOSTREED_AUTOMATIC_UPDATE_POLICY_STAGE;
+  else if (g_str_equal (str, "assemble"))
+    *out_policy = RPMOSTREED_AUTOMATIC_UPDATE_POLICY_ASSEMBLE;
   else
     return glnx_throw (error, "Invalid value for AutomaticUpdatePolicy: '%s'", str);
   return TRUE;
@@ -1233,12 +1412,11 @@ rpmostree_relative_path_is_ostree_compliant (const char *path)
 {
   g_assert (path);
   g_assert (*path != '/');
-  return (g_str_equal (path, "usr")   || (g_str_has_prefix (path, "usr/")
-                                          && !g_str_has_prefix (path, "usr/local/")) ||
-          g_str_equal (path, "bin")   || g_str_has_prefix (path, "bin/")  ||
-          g_str_equal (path, "sbin")  || g_str_has_prefix (path, "sbin/") ||
-          g_str_equal (path, "lib")   || g_str_has_prefix (path, "lib/")  ||
-          g_str_equal (path, "lib64") || g_str_has_prefix (path, "lib64/"));
+  const guint32 flags =
+    rpmostree_path_rules_match_relative (rpmostree_path_rules_get_default (), path);
+  return *path != '\0' &&
+    (flags & (RPMOSTREE_PATH_FLAG_OSTREE_COMPLIANT | RPMOSTREE_PATH_FLAG_USR_LOCAL)) ==
+      RPMOSTREE_PATH_FLAG_OSTREE_COMPLIANT;
 }
 
 char*
@@ -200,6 +200,27 @@ rpmostree_get_deployment_root (OstreeSysroot     *sysroot,
 char *
 rpmostree_commit_content_checksum (GVariant *commit);
 
+/* The subset of an OstreeRepoCommitModifier that applies to synthesized
+ * content; see rpmostree_mtree_write_file().
+ */
+typedef struct {
+  OstreeRepoCommitFilter filter;
+  gpointer filter_data;
+  OstreeRepoCommitModifierXattrCallback xattr_callback;
+  gpointer xattr_data;
+  OstreeSePolicy *sepolicy;
+} RpmOstreeMtreeWriteOptions;
+
+gboolean
+rpmostree_mtree_write_file (OstreeRepo                  *repo,
+                            OstreeMutableTree           *mtree,
+                            const char                  *path,
+                            guint32                      mode,
+                            GBytes                      *content,
+                            RpmOstreeMtreeWriteOptions  *opts,
+                            GCancellable                *cancellable,
+                            GError                     **error);
+
 /* https://github.com/ostreedev/ostree/pull/1132 */
 typedef struct {
   gboolean initialized;
@@ -0,0 +1,78 @@
+#!/usr/bin/bash
+# Used by rpmostree-core.c to memoize `semodule` operations in scripts, such
+# as the policy rebuild from %selinux_modules_install.  Rebuilding the policy
+# takes tens of seconds, but the result only depends on the policy store,
+# the arguments (and modules) passed, and the policy toolchain; when
+# layering, these are usually the same as the last time we assembled.  So we
+# key the resulting policy store on all of those, and reuse it on a match.
+#
+# The cache is bind mounted by rpm-ostree; if it's not there, or this isn't
+# a plain store update, we just run the real semodule.  We log the entries
+# we use, and rpm-ostree prunes the others afterwards.
+set -euo pipefail
+shopt -s nullglob
+
+real=/usr/sbin/semodule.rpmostreesave
+cachedir=/var/tmp/rpm-ostree-selinux-policy
+
+if ! test -d ${cachedir}; then
+    exec ${real} "$@"
+fi
+
+args=("$@")
+store=
+noreload=
+modules=()
+while [ $# -gt 0 ]; do
+    case $1 in
+        -n|--noreload) noreload=1;;
+        -B|--build|-D|--disable_dontaudit|-P|--preserve_tunables|-v|--verbose) ;;
+        -s|--store) test $# -gt 1 || exec ${real} "${args[@]}"; store=$2; shift;;
+        -X|--priority) test $# -gt 1 || exec ${real} "${args[@]}"; shift;;
+        --store=*) store=${1#--store=};;
+        -s*) store=${1#-s};;
+        --priority=*|-X*) ;;
+        -i|--install|-r|--remove|-e|--enable|-d|--disable) ;;
+        --install=*|--remove=*|--enable=*|--disable=*) modules+=("${1#*=}");;
+        -*) exec ${real} "${args[@]}";;
+        *) modules+=("$1");;
+    esac
+    shift
+done
+if [ -z "${store}" ]; then
+    store=$(sed -ne 's/^SELINUXTYPE=//p' /etc/selinux/config 2>/dev/null || true)
+fi
+# We can't do anything about reloading the policy anyways
+if [ -z "${noreload}" ] || [ -z "${store}" ] || ! test -d /etc/selinux/${store}; then
+    exec ${real} "${args[@]}"
+fi
+
+# If we can't hash any of the inputs (e.g. no semanage.conf), just don't cache
+key=$(set +e; {
+    printf '%s\0' "${args[@]}"
+    sha256sum ${real} /usr/lib*/libsemanage.so* /usr/lib*/libsepol.so* \
+              /usr/libexec/selinux/hll/* /etc/selinux/semanage.conf
+    for module in ${modules[@]+"${modules[@]}"}; do
+        if test -f "${module}"; then sha256sum "${module}"; fi
+    done
+    cd /etc/selinux && find ${store} -type f -print0 | LC_ALL=C sort -z | xargs -0 -r sha256sum
+} | sha256sum | cut -d ' ' -f 1) || key=
+if [ -z "${key}" ]; then
+    exec ${real} "${args[@]}"
+fi
+entry=${cachedir}/${key}
+
+# Note we don't copy xattrs; the final commit labels everything anyways.
+if test -d ${entry}; then
+    rm -rf /etc/selinux/${store}
+    cp -r --preserve=mode,timestamps ${entry} /etc/selinux/${store}
+    echo "hit ${key}" >> ${cachedir}/log
+    echo "rpm-ostree-semodule: Reused policy store for:" "${args[@]}"
+    exit 0
+fi
+
+${real} "${args[@]}"
+# Caching is best-effort
+rm -rf ${entry}.tmp
+{ cp -r --preserve=mode,timestamps /etc/selinux/${store} ${entry}.tmp &&
+      mv -T ${entry}.tmp ${entry} && echo "build ${key}" >> ${cachedir}/log; } || rm -rf ${entry}.tmp
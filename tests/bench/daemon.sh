@@ -0,0 +1,58 @@
+#!/bin/bash
+# Benchmark rpm-ostreed's D-Bus API against a scratch sysroot.
+#
+# Usage: daemon.sh [--iterations N] [--output FILE] [OPERATION...]
+#
+# This runs on a private session bus (see tests/utils/setup-session.sh),
+# with rpm-ostreed activated on demand against ${test_tmpdir}/sysroot, which
+# has a deployment of a test OS and a file:// remote with an update
+# available. See rpmostreed-bench.c for the OPERATIONs; by default we run a
+# sequence modeled on what update automation does.
+set -euo pipefail
+
+# Arguments are passed via the environment since ensure_dbus re-executes
+# us inside the session bus.
+if test -z "${RPMOSTREE_USE_SESSION_BUS:-}"; then
+    export BENCH_ITERATIONS=1 BENCH_OUTPUT= BENCH_OPS=
+    while [ $# -ne 0 ]; do
+        case $1 in
+            --iterations) BENCH_ITERATIONS=$2; shift 2;;
+            --output) BENCH_OUTPUT=$(realpath $2); shift 2;;
+            *) break;;
+        esac
+    done
+    BENCH_OPS="$*"
+fi
+
+. ${commondir}/libtest.sh
+ensure_dbus
+
+bench=${RPMOSTREE_DAEMON_BENCH:-${builddir}/tests/bench/rpmostreed-bench}
+ops=(${BENCH_OPS:-status upgrade cached-update-diff status pkgadd:foo pkgremove:foo rollback cleanup status})
+
+cd ${test_tmpdir}
+setup_os_repository "archive" "syslinux" 1>&2
+
+# Give the OS an (empty) rpmdb so that package layering works
+mkdir -p osdata/usr/share/rpm
+rpm --dbpath=${test_tmpdir}/osdata/usr/share/rpm --initdb
+os_repository_new_commit 1 1 1>&2
+
+ostree --repo=sysroot/ostree/repo remote add --no-gpg-verify testos \
+       file://${test_tmpdir}/testos-repo
+ostree --repo=sysroot/ostree/repo pull testos testos/buildmaster/x86_64-runtime 1>&2
+ostree admin --sysroot=sysroot deploy --karg=root=LABEL=rootfs --os=testos \
+       testos:testos/buildmaster/x86_64-runtime 1>&2
+
+# The update target, and a package to layer
+os_repository_new_commit 2 2 1>&2
+build_rpm foo 1>&2
+deployment=$(ls -d sysroot/ostree/deploy/testos/deploy/*.0)
+mkdir -p ${deployment}/etc/yum.repos.d
+cat > ${deployment}/etc/yum.repos.d/bench.repo <<EOF
+[bench]
+baseurl=file://${test_tmpdir}/yumrepo
+gpgcheck=0
+EOF
+
+${bench} --os=testos --iterations=${BENCH_ITERATIONS} ${BENCH_OUTPUT:+--output=${BENCH_OUTPUT}} "${ops[@]}"
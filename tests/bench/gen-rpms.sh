@@ -0,0 +1,130 @@
+#!/bin/bash
+# Generate a local rpm-md repo of synthetic packages for benchmarking.
+#
+# Usage: gen-rpms.sh OUTDIR PROFILE [COUNT]
+#
+# Profiles:
+#   small-files  COUNT packages (default 50) with 2000 small files each
+#   large-files  COUNT packages (default 4) with two 64MiB files each
+#   deep-tree    COUNT packages (default 10) with a 64-level deep directory tree
+#   scripts      COUNT packages (default 50) with CPU-heavy %post scripts
+#
+# The package names are printed on stdout, one per line. Only rpmbuild and
+# createrepo_c are required; no network access is needed.
+set -euo pipefail
+
+outdir=$1; shift
+profile=$1; shift
+count=${1:-}
+
+case ${profile} in
+    small-files) count=${count:-50};;
+    large-files) count=${count:-4};;
+    deep-tree)   count=${count:-10};;
+    scripts)     count=${count:-50};;
+    *) echo "Unknown profile: ${profile}" 1>&2; exit 1;;
+esac
+
+mkdir -p ${outdir}/{specs,packages}
+outdir=$(cd ${outdir} && pwd)
+arch=$(uname -m)
+
+build_spec() {
+    (cd ${outdir}/specs &&
+     rpmbuild --quiet -bb $1.spec \
+        --define "_topdir ${PWD}" \
+        --define "_sourcedir ${PWD}" \
+        --define "_specdir ${PWD}" \
+        --define "_builddir ${PWD}/.build" \
+        --define "_rpmdir ${outdir}/packages" \
+        --define "_buildrootdir ${PWD}" \
+        --define "__os_install_post %{nil}" \
+        --define "debug_package %{nil}") 1>&2
+}
+
+# Scripts need an interpreter in the target root; rather than requiring a
+# distro repo, package the host's bash and the libraries it links to.
+if [ ${profile} == scripts ]; then
+    cat > ${outdir}/specs/bench-runtime.spec <<'EOF'
+Name: bench-runtime
+Summary: Minimal shell runtime for benchmark scripts
+License: GPLv2+
+Version: 1.0
+Release: 1
+AutoReqProv: no
+
+%description
+%{summary}
+
+%install
+mkdir -p %{buildroot}/usr/bin %{buildroot}/usr/lib64
+cp -L $(command -v bash) %{buildroot}/usr/bin/bash
+ln -s bash %{buildroot}/usr/bin/sh
+for lib in $(ldd $(command -v bash) | grep -o '/[^ ]*'); do
+  cp -L ${lib} %{buildroot}/usr/lib64/
+done
+ln -s usr/bin %{buildroot}/bin
+ln -s usr/lib64 %{buildroot}/lib64
+
+%files
+/bin
+/lib64
+/usr/bin/*
+/usr/lib64/*
+EOF
+    build_spec bench-runtime
+    echo bench-runtime
+fi
+
+for i in $(seq 1 ${count}); do
+    name=bench-${profile}-${i}
+    install= post=
+    case ${profile} in
+        small-files)
+            # Spread over directories so we don't end up with one huge dirtree
+            install="for d in \$(seq 1 20); do
+                       mkdir -p %{buildroot}/usr/share/${name}/\$d
+                       for f in \$(seq 1 100); do
+                         echo ${name}-\$d-\$f > %{buildroot}/usr/share/${name}/\$d/\$f
+                       done
+                     done";;
+        large-files)
+            install="head -c 64M /dev/urandom > %{buildroot}/usr/share/${name}/a
+                     head -c 64M /dev/urandom > %{buildroot}/usr/share/${name}/b";;
+        deep-tree)
+            install="p=%{buildroot}/usr/share/${name}
+                     for d in \$(seq 1 64); do
+                       p=\$p/d\$d; mkdir -p \$p; echo \$d > \$p/file
+                     done";;
+        scripts)
+            post="i=0; while test \$i -lt 200000; do i=\$((i+1)); done";;
+    esac
+
+    cat > ${outdir}/specs/${name}.spec <<EOF
+Name: ${name}
+Summary: Synthetic ${profile} benchmark package
+License: GPLv2+
+Version: 1.0
+Release: 1
+BuildArch: ${arch}
+AutoReqProv: no
+${post:+Requires(post): bench-runtime}
+
+%description
+%{summary}
+
+${post:+%post}
+${post}
+
+%install
+mkdir -p %{buildroot}/usr/share/${name}
+${install}
+
+%files
+/usr/share/${name}
+EOF
+    build_spec ${name}
+    echo ${name}
+done
+
+(cd ${outdir} && createrepo_c --no-database . 1>&2)
@@ -0,0 +1,301 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/* Offline benchmark driver for the package import, assembly and commit paths.
+ * It expects a working directory set up by tests/bench/run.sh, i.e. with an
+ * `rpmmd.repos.d` pointing at a local (file://) rpm-md repo, and for each
+ * iteration runs the core against a fresh ostree repo, timing each step with
+ * the same phase accounting used by `compose tree --write-composejson-to`.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <json-glib/json-glib.h>
+#include <libglnx.h>
+
+#include "rpmostree-core.h"
+#include "rpmostree-output.h"
+#include "rpmostree-phase-stats.h"
+#include "rpmostree-postprocess.h"
+
+static char *opt_workdir = ".";
+static char *opt_scenario = "default";
+static char *opt_repos = "bench";
+static int opt_iterations = 3;
+static char *opt_output;
+
+static GOptionEntry option_entries[] = {
+  { "workdir", 0, 0, G_OPTION_ARG_FILENAME, &opt_workdir, "Working directory containing rpmmd.repos.d (default: .)", "DIR" },
+  { "scenario", 0, 0, G_OPTION_ARG_STRING, &opt_scenario, "Name of the scenario, included in the results", "NAME" },
+  { "repos", 0, 0, G_OPTION_ARG_STRING, &opt_repos, "Comma-separated rpm-md repo IDs to enable (default: bench)", "REPOS" },
+  { "iterations", 'n', 0, G_OPTION_ARG_INT, &opt_iterations, "Number of iterations (default: 3)", "N" },
+  { "output", 'o', 0, G_OPTION_ARG_FILENAME, &opt_output, "Write JSON results to FILE instead of stdout", "FILE" },
+  { NULL }
+};
+
+/* The steps we time ourselves; the core's own phases (e.g. "checkout",
+ * "scripts") are nested inside these and reported alongside them. */
+static const char *bench_steps[] = { "context-prepare", "context-import", "context-assemble",
+                                     "context-commit", "compose-commit" };
+
+#define BENCH_STEP(stats, name, expr) \
+  ({ rpmostree_phase_stats_begin (stats, name); \
+     gboolean _r = (expr); \
+     rpmostree_phase_stats_end (stats, name); \
+     _r; })
+
+/* Commit the checkout of @commit to a fresh repo via rpmostree_compose_commit(),
+ * i.e. what `compose tree` does after postprocessing. */
+static gboolean
+run_compose_commit (int                 iter_dfd,
+                    OstreeRepo         *repo,
+                    const char         *commit,
+                    RpmOstreePhaseStats *stats,
+                    GVariantDict       *result,
+                    GCancellable       *cancellable,
+                    GError            **error)
+{
+  OstreeRepoCheckoutAtOptions opts = { OSTREE_REPO_CHECKOUT_MODE_USER,
+                                       OSTREE_REPO_CHECKOUT_OVERWRITE_NONE, };
+  if (!ostree_repo_checkout_at (repo, &opts, iter_dfd, "rootfs", commit,
+                                cancellable, error))
+    return FALSE;
+  glnx_autofd int rootfs_dfd = -1;
+  if (!glnx_opendirat (iter_dfd, "rootfs", TRUE, &rootfs_dfd, error))
+    return FALSE;
+
+  g_autoptr(OstreeRepo) compose_repo =
+    ostree_repo_create_at (iter_dfd, "compose-repo", OSTREE_REPO_MODE_BARE_USER_ONLY,
+                           NULL, cancellable, error);
+  if (!compose_repo)
+    return FALSE;
+
+  g_autoptr(GVariant) metadata = g_variant_ref_sink (g_variant_new ("a{sv}", NULL));
+  g_autofree char *new_revision = NULL;
+  OstreeRepoTransactionStats txn_stats = { 0, };
+  rpmostree_phase_stats_begin (stats, "compose-commit");
+  gboolean ok =
+    ostree_repo_prepare_transaction (compose_repo, NULL, cancellable, error) &&
+    rpmostree_compose_commit (rootfs_dfd, compose_repo, NULL, metadata, NULL, FALSE, NULL,
+                              NULL, &new_revision, cancellable, error) &&
+    ostree_repo_commit_transaction (compose_repo, &txn_stats, cancellable, error);
+  rpmostree_phase_stats_end (stats, "compose-commit");
+  if (!ok)
+    return FALSE;
+
+  g_variant_dict_insert (result, "content-objects", "u", txn_stats.content_objects_total);
+  g_variant_dict_insert (result, "content-bytes", "t", txn_stats.content_bytes_written);
+  return TRUE;
+}
+
+/* Returns a new a{sv} with the results of one iteration */
+static GVariant *
+run_iteration (int                workdir_dfd,
+               guint              iteration,
+               RpmOstreeTreespec *treespec,
+               GCancellable      *cancellable,
+               GError           **error)
+{
+  g_autofree char *iter_name = g_strdup_printf ("iter-%u", iteration);
+  if (!glnx_shutil_rm_rf_at (workdir_dfd, iter_name, cancellable, error))
+    return NULL;
+  if (!glnx_ensure_dir (workdir_dfd, iter_name, 0755, error))
+    return NULL;
+  glnx_autofd int iter_dfd = -1;
+  if (!glnx_opendirat (workdir_dfd, iter_name, TRUE, &iter_dfd, error))
+    return NULL;
+  if (symlinkat ("../rpmmd.repos.d", iter_dfd, "rpmmd.repos.d") < 0)
+    return glnx_null_throw_errno_prefix (error, "symlinkat");
+  if (!glnx_shutil_mkdir_p_at (iter_dfd, "cache/rpm-md", 0755, cancellable, error))
+    return NULL;
+
+  g_autoptr(OstreeRepo) repo =
+    ostree_repo_create_at (iter_dfd, "repo", OSTREE_REPO_MODE_BARE_USER_ONLY, NULL,
+                           cancellable, error);
+  if (!repo)
+    return NULL;
+
+  g_autoptr(RpmOstreePhaseStats) stats = rpmostree_phase_stats_new ();
+  rpmostree_output_set_callback (rpmostree_phase_stats_output_cb, stats);
+
+  g_autoptr(GVariantDict) result = g_variant_dict_new (NULL);
+  g_autofree char *commit = NULL;
+  g_autoptr(RpmOstreeContext) ctx = rpmostree_context_new_tree (iter_dfd, repo, cancellable, error);
+  gboolean ok = ctx != NULL &&
+    rpmostree_context_setup (ctx, NULL, NULL, treespec, cancellable, error) &&
+    BENCH_STEP (stats, "context-prepare", rpmostree_context_prepare (ctx, cancellable, error)) &&
+    rpmostree_context_download (ctx, cancellable, error) &&
+    BENCH_STEP (stats, "context-import", rpmostree_context_import (ctx, cancellable, error)) &&
+    BENCH_STEP (stats, "context-assemble", rpmostree_context_assemble (ctx, cancellable, error)) &&
+    BENCH_STEP (stats, "context-commit", rpmostree_context_commit (ctx, NULL,
+                                                                   RPMOSTREE_ASSEMBLE_TYPE_SERVER_BASE,
+                                                                   &commit, cancellable, error));
+  if (ok)
+    {
+      g_autoptr(GPtrArray) pkgs = rpmostree_context_get_packages (ctx);
+      g_variant_dict_insert (result, "packages", "u", pkgs->len);
+      g_clear_object (&ctx);
+      ok = run_compose_commit (iter_dfd, repo, commit, stats, result, cancellable, error);
+    }
+  rpmostree_output_set_callback (NULL, NULL);
+  if (!ok)
+    {
+      glnx_prefix_error (error, "Iteration %u", iteration);
+      return NULL;
+    }
+
+  g_autoptr(GVariant) usage = g_variant_ref_sink (rpmostree_phase_stats_to_variant (stats));
+  g_variant_dict_insert (result, "iteration", "u", iteration);
+  g_variant_dict_insert_value (result, "usage", usage);
+  for (guint i = 0; i < G_N_ELEMENTS (bench_steps); i++)
+    {
+      RpmOstreeUsage step = { 0, };
+      (void) rpmostree_phase_stats_lookup (stats, bench_steps[i], &step);
+      g_variant_dict_insert (result, bench_steps[i], "d",
+                             ((double)step.elapsed_usec) / G_USEC_PER_SEC);
+    }
+
+  /* Keep the disk usage bounded across iterations */
+  if (!glnx_shutil_rm_rf_at (workdir_dfd, iter_name, cancellable, error))
+    return NULL;
+
+  return g_variant_dict_end (result);
+}
+
+static int
+cmp_double (gconstpointer a, gconstpointer b)
+{
+  double da = *(double*)a, db = *(double*)b;
+  return (da > db) - (da < db);
+}
+
+/* Returns a{sv} of step name -> {min, median, mean} seconds */
+static GVariant *
+summarize (GPtrArray *iterations)
+{
+  g_autoptr(GVariantDict) summary = g_variant_dict_new (NULL);
+  for (guint i = 0; i < G_N_ELEMENTS (bench_steps); i++)
+    {
+      g_autoptr(GArray) values = g_array_new (FALSE, FALSE, sizeof (double));
+      double sum = 0;
+      for (guint j = 0; j < iterations->len; j++)
+        {
+          double v = 0;
+          (void) g_variant_lookup (iterations->pdata[j], bench_steps[i], "d", &v);
+          g_array_append_val (values, v);
+          sum += v;
+        }
+      if (values->len == 0)
+        continue;
+      g_array_sort (values, cmp_double);
+      g_autoptr(GVariantDict) step = g_variant_dict_new (NULL);
+      g_variant_dict_insert (step, "min", "d", g_array_index (values, double, 0));
+      g_variant_dict_insert (step, "median", "d", g_array_index (values, double, values->len / 2));
+      g_variant_dict_insert (step, "mean", "d", sum / values->len);
+      g_variant_dict_insert_value (summary, bench_steps[i], g_variant_dict_end (step));
+    }
+  return g_variant_dict_end (summary);
+}
+
+static gboolean
+write_results (GVariant *results,
+               GError  **error)
+{
+  g_autoptr(JsonNode) node = json_gvariant_serialize (results);
+  g_autoptr(JsonGenerator) generator = json_generator_new ();
+  json_generator_set_pretty (generator, TRUE);
+  json_generator_set_root (generator, node);
+  g_autofree char *buf = json_generator_to_data (generator, NULL);
+  if (!opt_output)
+    {
+      g_print ("%s\n", buf);
+      return TRUE;
+    }
+  return glnx_file_replace_contents_at (AT_FDCWD, opt_output, (guint8*)buf, strlen (buf),
+                                        GLNX_FILE_REPLACE_NODATASYNC, NULL, error);
+}
+
+static gboolean
+run (int      argc,
+     char   **argv,
+     GError **error)
+{
+  g_autoptr(GOptionContext) context = g_option_context_new ("PACKAGE [PACKAGE...]");
+  g_option_context_set_summary (context, "Benchmark import, assembly and commit of local packages");
+  g_option_context_add_main_entries (context, option_entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, error))
+    return FALSE;
+  if (argc < 2)
+    return glnx_throw (error, "At least one PACKAGE must be specified");
+  if (opt_iterations < 1)
+    return glnx_throw (error, "--iterations must be at least 1");
+
+  glnx_autofd int workdir_dfd = -1;
+  if (!glnx_opendirat (AT_FDCWD, opt_workdir, TRUE, &workdir_dfd, error))
+    return FALSE;
+
+  g_autoptr(GKeyFile) keyfile = g_key_file_new ();
+  g_key_file_set_string (keyfile, "tree", "ref", "bench");
+  g_key_file_set_string_list (keyfile, "tree", "packages",
+                              (const char *const*)argv + 1, argc - 1);
+  g_auto(GStrv) repos = g_strsplit (opt_repos, ",", -1);
+  g_key_file_set_string_list (keyfile, "tree", "repos",
+                              (const char *const*)repos, g_strv_length (repos));
+  g_autoptr(RpmOstreeTreespec) treespec = rpmostree_treespec_new_from_keyfile (keyfile, error);
+  if (!treespec)
+    return FALSE;
+
+  g_autoptr(GPtrArray) iterations =
+    g_ptr_array_new_with_free_func ((GDestroyNotify)g_variant_unref);
+  for (int i = 0; i < opt_iterations; i++)
+    {
+      GVariant *result = run_iteration (workdir_dfd, i, treespec, NULL, error);
+      if (!result)
+        return FALSE;
+      g_ptr_array_add (iterations, g_variant_ref_sink (result));
+    }
+
+  g_autoptr(GVariantDict) results = g_variant_dict_new (NULL);
+  g_variant_dict_insert (results, "scenario", "s", opt_scenario);
+  g_variant_dict_insert_value (results, "packages",
+                               g_variant_new_strv ((const char *const*)argv + 1, argc - 1));
+  g_variant_dict_insert_value (results, "summary", summarize (iterations));
+  g_variant_dict_insert_value (results, "iterations",
+                               g_variant_new_array (G_VARIANT_TYPE_VARDICT,
+                                                    (GVariant**)iterations->pdata,
+                                                    iterations->len));
+  g_autoptr(GVariant) results_v = g_variant_ref_sink (g_variant_dict_end (results));
+  return write_results (results_v, error);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  g_autoptr(GError) local_error = NULL;
+  if (!run (argc, argv, &local_error))
+    {
+      g_printerr ("error: %s\n", local_error->message);
+      return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
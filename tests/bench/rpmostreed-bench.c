@@ -0,0 +1,420 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/* Benchmark driver for the daemon's D-Bus API. This speaks raw D-Bus rather
+ * than going through the generated proxies so that what we time (and the
+ * signals we count) is exactly what goes over the wire. It is normally run
+ * by tests/bench/daemon.sh inside a private session bus, where the first call
+ * also measures bus activation of rpm-ostreed against a scratch sysroot.
+ *
+ * Each OPERATION is one of:
+ *   status               GetAll on the Sysroot and OS interfaces
+ *   upgrade              Upgrade transaction
+ *   cached-update-diff   GetCachedUpdateRpmDiff
+ *   pkgadd:PKG[,PKG]     PkgChange transaction adding packages
+ *   pkgremove:PKG[,PKG]  PkgChange transaction removing packages
+ *   rollback             Rollback transaction
+ *   cleanup[:ELEM[,ELEM]] Cleanup transaction (default: pending-deploy,rollback-deploy)
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gio/gio.h>
+#include <json-glib/json-glib.h>
+#include <libglnx.h>
+
+#define BUS_NAME "org.projectatomic.rpmostree1"
+#define SYSROOT_PATH "/org/projectatomic/rpmostree1/Sysroot"
+#define SYSROOT_IFACE BUS_NAME ".Sysroot"
+#define OS_IFACE BUS_NAME ".OS"
+#define TXN_IFACE BUS_NAME ".Transaction"
+
+static gboolean opt_system;
+static char *opt_osname = "";
+static int opt_iterations = 1;
+static char *opt_output;
+
+static GOptionEntry option_entries[] = {
+  { "system", 0, 0, G_OPTION_ARG_NONE, &opt_system, "Use the system bus instead of the session bus", NULL },
+  { "os", 0, 0, G_OPTION_ARG_STRING, &opt_osname, "Operate on provided OSNAME", "OSNAME" },
+  { "iterations", 'n', 0, G_OPTION_ARG_INT, &opt_iterations, "Number of times to run the OPERATIONs (default: 1)", "N" },
+  { "output", 'o', 0, G_OPTION_ARG_FILENAME, &opt_output, "Write JSON results to FILE instead of stdout", "FILE" },
+  { NULL }
+};
+
+static double
+ms_since (gint64 start)
+{
+  return ((double)(g_get_monotonic_time () - start)) / 1000;
+}
+
+/* Signal accounting shared by the bus and transaction connections */
+typedef struct {
+  guint n_signals;
+  GHashTable *counts; /* member --> count */
+  GVariant *statistics; /* Payload of Transaction.Statistics, if any */
+  gboolean finished;
+  gboolean success;
+  char *error_message;
+} SignalTally;
+
+static void
+signal_tally_clear (SignalTally *tally)
+{
+  g_clear_pointer (&tally->counts, g_hash_table_unref);
+  g_clear_pointer (&tally->statistics, g_variant_unref);
+  g_clear_pointer (&tally->error_message, g_free);
+}
+G_DEFINE_AUTO_CLEANUP_CLEAR_FUNC(SignalTally, signal_tally_clear)
+
+static void
+on_signal (GDBusConnection *connection,
+           const char      *sender_name,
+           const char      *object_path,
+           const char      *interface_name,
+           const char      *signal_name,
+           GVariant        *parameters,
+           gpointer         user_data)
+{
+  SignalTally *tally = user_data;
+  tally->n_signals++;
+  if (!tally->counts)
+    tally->counts = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  gpointer n = g_hash_table_lookup (tally->counts, signal_name);
+  g_hash_table_replace (tally->counts, g_strdup (signal_name),
+                        GUINT_TO_POINTER (GPOINTER_TO_UINT (n) + 1));
+
+  if (g_strcmp0 (interface_name, TXN_IFACE) != 0)
+    return;
+  if (g_str_equal (signal_name, "Statistics"))
+    {
+      g_clear_pointer (&tally->statistics, g_variant_unref);
+      g_variant_get (parameters, "(@a{sv})", &tally->statistics);
+    }
+  else if (g_str_equal (signal_name, "Finished"))
+    {
+      tally->finished = TRUE;
+      g_variant_get (parameters, "(bs)", &tally->success, &tally->error_message);
+    }
+}
+
+static void
+tally_to_dict (SignalTally  *tally,
+               const char   *prefix,
+               GVariantDict *dict)
+{
+  g_autofree char *key = g_strconcat (prefix, "signals", NULL);
+  g_variant_dict_insert (dict, key, "u", tally->n_signals);
+
+  g_auto(GVariantBuilder) builder;
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+  if (tally->counts)
+    {
+      GLNX_HASH_TABLE_FOREACH_KV (tally->counts, const char*, name, gpointer, n)
+        g_variant_builder_add (&builder, "{sv}", name,
+                               g_variant_new_uint32 (GPOINTER_TO_UINT (n)));
+    }
+  g_autofree char *counts_key = g_strconcat (prefix, "signal-counts", NULL);
+  g_variant_dict_insert_value (dict, counts_key, g_variant_builder_end (&builder));
+}
+
+static void
+result_set_error (GVariantDict *result,
+                  const char   *message)
+{
+  g_variant_dict_insert (result, "success", "b", FALSE);
+  g_variant_dict_insert (result, "error", "s", message);
+}
+
+/* Connect to a transaction, start it and wait for it to finish. */
+static void
+run_transaction (const char   *address,
+                 gint64        start_time,
+                 GVariantDict *result)
+{
+  g_autoptr(GError) local_error = NULL;
+  g_autoptr(GDBusConnection) peer =
+    g_dbus_connection_new_for_address_sync (address,
+                                            G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT,
+                                            NULL, NULL, &local_error);
+  if (!peer)
+    {
+      result_set_error (result, local_error->message);
+      return;
+    }
+
+  g_auto(SignalTally) tally = { 0, };
+  guint sigid = g_dbus_connection_signal_subscribe (peer, NULL, NULL, NULL, "/", NULL,
+                                                    G_DBUS_SIGNAL_FLAGS_NONE,
+                                                    on_signal, &tally, NULL);
+  g_autoptr(GVariant) started =
+    g_dbus_connection_call_sync (peer, NULL, "/", TXN_IFACE, "Start", NULL,
+                                 (GVariantType*)"(b)", G_DBUS_CALL_FLAGS_NONE, -1,
+                                 NULL, &local_error);
+  if (started)
+    {
+      g_variant_dict_insert (result, "start-ms", "d", ms_since (start_time));
+      while (!tally.finished && !g_dbus_connection_is_closed (peer))
+        g_main_context_iteration (NULL, TRUE);
+    }
+  g_dbus_connection_signal_unsubscribe (peer, sigid);
+
+  tally_to_dict (&tally, "txn-", result);
+  if (tally.statistics)
+    g_variant_dict_insert_value (result, "statistics", tally.statistics);
+  if (!started)
+    result_set_error (result, local_error->message);
+  else if (!tally.finished)
+    result_set_error (result, "Transaction connection closed before Finished");
+  else if (!tally.success)
+    result_set_error (result, tally.error_message);
+  else
+    g_variant_dict_insert (result, "success", "b", TRUE);
+}
+
+static GVariant *
+strv_from_list (const char *list)
+{
+  g_auto(GStrv) elts = g_strsplit (list ?: "", ",", -1);
+  return g_variant_new_strv ((const char *const*)elts, -1);
+}
+
+/* Returns an a{sv} describing the outcome of @op */
+static GVariant *
+run_operation (GDBusConnection *bus,
+               const char      *bus_name,
+               const char      *os_path,
+               const char      *op)
+{
+  g_autoptr(GVariantDict) result = g_variant_dict_new (NULL);
+  g_variant_dict_insert (result, "operation", "s", op);
+
+  g_auto(GStrv) parts = g_strsplit (op, ":", 2);
+  const char *name = parts[0];
+  const char *arg = parts[1];
+  const char *method = NULL;
+  const GVariantType *reply_type = G_VARIANT_TYPE ("(s)");
+  GVariant *params = NULL;
+  g_autoptr(GVariant) empty_opts = g_variant_ref_sink (g_variant_new ("a{sv}", NULL));
+  if (g_str_equal (name, "upgrade"))
+    {
+      method = "Upgrade";
+      params = g_variant_new ("(@a{sv})", empty_opts);
+    }
+  else if (g_str_equal (name, "pkgadd") || g_str_equal (name, "pkgremove"))
+    {
+      gboolean add = g_str_equal (name, "pkgadd");
+      g_autoptr(GVariant) pkgs = g_variant_ref_sink (strv_from_list (arg));
+      g_autoptr(GVariant) none = g_variant_ref_sink (g_variant_new_strv (NULL, 0));
+      method = "PkgChange";
+      params = g_variant_new ("(@a{sv}@as@as)", empty_opts,
+                              add ? pkgs : none, add ? none : pkgs);
+    }
+  else if (g_str_equal (name, "rollback"))
+    {
+      method = "Rollback";
+      params = g_variant_new ("(@a{sv})", empty_opts);
+    }
+  else if (g_str_equal (name, "cleanup"))
+    {
+      method = "Cleanup";
+      params = g_variant_new ("(@as)", strv_from_list (arg ?: "pending-deploy,rollback-deploy"));
+    }
+  else if (g_str_equal (name, "cached-update-diff"))
+    {
+      method = "GetCachedUpdateRpmDiff";
+      params = g_variant_new ("(s)", "");
+      reply_type = G_VARIANT_TYPE ("(a(sua{sv})a{sv})");
+    }
+  else if (!g_str_equal (name, "status"))
+    {
+      result_set_error (result, "Unknown operation");
+      return g_variant_dict_end (result);
+    }
+
+  g_auto(SignalTally) bus_tally = { 0, };
+  guint sigid = g_dbus_connection_signal_subscribe (bus, bus_name, NULL, NULL, NULL, NULL,
+                                                    G_DBUS_SIGNAL_FLAGS_NONE,
+                                                    on_signal, &bus_tally, NULL);
+  g_autoptr(GError) local_error = NULL;
+  const gint64 start_time = g_get_monotonic_time ();
+  if (method == NULL)
+    {
+      /* status: this is what the client fetches to render `rpm-ostree status` */
+      g_autoptr(GVariant) sysroot_props =
+        g_dbus_connection_call_sync (bus, bus_name, SYSROOT_PATH,
+                                     "org.freedesktop.DBus.Properties", "GetAll",
+                                     g_variant_new ("(s)", SYSROOT_IFACE), NULL,
+                                     G_DBUS_CALL_FLAGS_NONE, -1, NULL, &local_error);
+      g_autoptr(GVariant) os_props = !sysroot_props ? NULL :
+        g_dbus_connection_call_sync (bus, bus_name, os_path,
+                                     "org.freedesktop.DBus.Properties", "GetAll",
+                                     g_variant_new ("(s)", OS_IFACE), NULL,
+                                     G_DBUS_CALL_FLAGS_NONE, -1, NULL, &local_error);
+      g_variant_dict_insert (result, "call-ms", "d", ms_since (start_time));
+      if (os_props)
+        {
+          g_variant_dict_insert (result, "reply-bytes", "t",
+                                 g_variant_get_size (sysroot_props) + g_variant_get_size (os_props));
+          g_variant_dict_insert (result, "success", "b", TRUE);
+        }
+      else
+        result_set_error (result, local_error->message);
+    }
+  else
+    {
+      g_autoptr(GVariant) reply =
+        g_dbus_connection_call_sync (bus, bus_name, os_path, OS_IFACE, method,
+                                     params, reply_type, G_DBUS_CALL_FLAGS_NONE, -1,
+                                     NULL, &local_error);
+      g_variant_dict_insert (result, "call-ms", "d", ms_since (start_time));
+      if (!reply)
+        result_set_error (result, local_error->message);
+      else if (g_variant_is_of_type (reply, G_VARIANT_TYPE ("(s)")))
+        {
+          const char *address;
+          g_variant_get (reply, "(&s)", &address);
+          run_transaction (address, start_time, result);
+        }
+      else
+        {
+          g_variant_dict_insert (result, "reply-bytes", "t", g_variant_get_size (reply));
+          g_variant_dict_insert (result, "success", "b", TRUE);
+        }
+    }
+  g_variant_dict_insert (result, "total-ms", "d", ms_since (start_time));
+
+  /* Let PropertiesChanged emitted at the end of the operation arrive */
+  while (g_main_context_iteration (NULL, FALSE))
+    ;
+  g_dbus_connection_signal_unsubscribe (bus, sigid);
+  tally_to_dict (&bus_tally, "bus-", result);
+
+  return g_variant_dict_end (result);
+}
+
+/* Register as a client, which bus-activates the daemon if needed, and look
+ * up the OS object. */
+static gboolean
+connect_daemon (GDBusConnection *bus,
+                const char      *bus_name,
+                GVariantDict    *results,
+                char           **out_os_path,
+                GError         **error)
+{
+  g_autoptr(GVariantBuilder) opts = g_variant_builder_new (G_VARIANT_TYPE ("a{sv}"));
+  g_variant_builder_add (opts, "{sv}", "id", g_variant_new_string ("rpmostreed-bench"));
+
+  const gint64 start_time = g_get_monotonic_time ();
+  g_autoptr(GVariant) reply =
+    g_dbus_connection_call_sync (bus, bus_name, SYSROOT_PATH, SYSROOT_IFACE, "RegisterClient",
+                                 g_variant_new ("(@a{sv})", g_variant_builder_end (opts)),
+                                 (GVariantType*)"()", G_DBUS_CALL_FLAGS_NONE, -1,
+                                 NULL, error);
+  if (!reply)
+    return glnx_prefix_error (error, "RegisterClient");
+  g_variant_dict_insert (results, "activation-ms", "d", ms_since (start_time));
+
+  g_autoptr(GVariant) os_reply =
+    g_dbus_connection_call_sync (bus, bus_name, SYSROOT_PATH, SYSROOT_IFACE, "GetOS",
+                                 g_variant_new ("(s)", opt_osname), (GVariantType*)"(o)",
+                                 G_DBUS_CALL_FLAGS_NONE, -1, NULL, error);
+  if (!os_reply)
+    return glnx_prefix_error (error, "GetOS");
+  g_variant_get (os_reply, "(o)", out_os_path);
+  return TRUE;
+}
+
+static gboolean
+write_results (GVariant *results,
+               GError  **error)
+{
+  g_autoptr(JsonNode) node = json_gvariant_serialize (results);
+  g_autoptr(JsonGenerator) generator = json_generator_new ();
+  json_generator_set_pretty (generator, TRUE);
+  json_generator_set_root (generator, node);
+  g_autofree char *buf = json_generator_to_data (generator, NULL);
+  if (!opt_output)
+    {
+      g_print ("%s\n", buf);
+      return TRUE;
+    }
+  return glnx_file_replace_contents_at (AT_FDCWD, opt_output, (guint8*)buf, strlen (buf),
+                                        GLNX_FILE_REPLACE_NODATASYNC, NULL, error);
+}
+
+static gboolean
+run (int      argc,
+     char   **argv,
+     GError **error)
+{
+  g_autoptr(GOptionContext) context = g_option_context_new ("OPERATION [OPERATION...]");
+  g_option_context_set_summary (context, "Benchmark rpm-ostreed D-Bus operations");
+  g_option_context_add_main_entries (context, option_entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, error))
+    return FALSE;
+  if (argc < 2)
+    return glnx_throw (error, "At least one OPERATION must be specified");
+  if (opt_iterations < 1)
+    return glnx_throw (error, "--iterations must be at least 1");
+
+  g_autoptr(GDBusConnection) bus =
+    g_bus_get_sync (opt_system ? G_BUS_TYPE_SYSTEM : G_BUS_TYPE_SESSION, NULL, error);
+  if (!bus)
+    return FALSE;
+
+  g_autoptr(GVariantDict) results = g_variant_dict_new (NULL);
+  g_autofree char *os_path = NULL;
+  if (!connect_daemon (bus, BUS_NAME, results, &os_path, error))
+    return FALSE;
+
+  g_auto(GVariantBuilder) ops;
+  g_variant_builder_init (&ops, G_VARIANT_TYPE ("aa{sv}"));
+  for (int i = 0; i < opt_iterations; i++)
+    {
+      for (int j = 1; j < argc; j++)
+        {
+          g_autoptr(GVariant) result = g_variant_ref_sink (run_operation (bus, BUS_NAME, os_path, argv[j]));
+          gboolean success = FALSE;
+          (void) g_variant_lookup (result, "success", "b", &success);
+          g_printerr ("%s: %s\n", argv[j], success ? "ok" : "failed");
+          g_variant_builder_add_value (&ops, result);
+        }
+    }
+  g_variant_dict_insert_value (results, "operations", g_variant_builder_end (&ops));
+
+  g_autoptr(GVariant) results_v = g_variant_ref_sink (g_variant_dict_end (results));
+  return write_results (results_v, error);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  g_autoptr(GError) local_error = NULL;
+  if (!run (argc, argv, &local_error))
+    {
+      g_printerr ("error: %s\n", local_error->message);
+      return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,58 @@
+#!/bin/bash
+# Run the offline import/assembly/commit benchmarks.
+#
+# Usage: run.sh [--iterations N] [--output FILE] [PROFILE...]
+#
+# For each profile (see gen-rpms.sh; default: all of them) this generates a
+# local rpm-md repo and runs rpmostree-bench against it, collecting the JSON
+# results into a single array. Set RPMOSTREE_BENCH to the path of the driver
+# if it isn't in the build directory.
+set -euo pipefail
+
+dn=$(cd "$(dirname "$0")" && pwd)
+bench=${RPMOSTREE_BENCH:-${builddir:-$(pwd)}/tests/bench/rpmostree-bench}
+
+iterations=3
+output=
+while [ $# -ne 0 ]; do
+    case $1 in
+        --iterations) iterations=$2; shift 2;;
+        --output) output=$2; shift 2;;
+        *) break;;
+    esac
+done
+profiles=("$@")
+if [ ${#profiles[@]} -eq 0 ]; then
+    profiles=(small-files large-files deep-tree scripts)
+fi
+
+for bin in rpmbuild createrepo_c jq; do
+    if ! command -v ${bin} >/dev/null; then
+        echo "${bin} is required to run the benchmarks" 1>&2
+        exit 1
+    fi
+done
+
+workdir=$(mktemp -d --tmpdir rpmostree-bench.XXXXXX)
+trap 'rm -rf ${workdir}' EXIT
+
+for profile in "${profiles[@]}"; do
+    pdir=${workdir}/${profile}
+    mkdir -p ${pdir}/rpmmd.repos.d
+    mapfile -t pkgs < <(${dn}/gen-rpms.sh ${pdir}/yumrepo ${profile})
+    cat > ${pdir}/rpmmd.repos.d/bench.repo <<EOF
+[bench]
+baseurl=file://${pdir}/yumrepo
+gpgcheck=0
+EOF
+    ${bench} --workdir=${pdir} --scenario=${profile} --iterations=${iterations} \
+             --output=${workdir}/${profile}.json "${pkgs[@]}" 1>&2
+    rm -rf ${pdir}
+done
+
+jq -s . ${workdir}/*.json > ${workdir}/results.json
+if [ -n "${output}" ]; then
+    mv ${workdir}/results.json ${output}
+else
+    jq -c '.[] | {scenario, summary}' < ${workdir}/results.json
+fi
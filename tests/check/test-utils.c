@@ -3,12 +3,17 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <glib-unix.h>
 #include "libglnx.h"
 #include "rpmostree-rpm-util.h"
 #include "rpmostree-core.h"
 #include "rpmostree-importer.h"
+#include "rpmostree-pathrules.h"
+#include "rpmostree-passwd-util.h"
+#include "rpmostree-selabel-cache.h"
+#include "rpmostree-output.h"
 #include "libtest.h"
 
 static void
@@ -151,6 +156,57 @@ test_bsearch_str(void)
   g_assert (!rpmostree_variant_bsearch_str (cool_animals, "earz", &idx));
 }
 
+static void
+test_path_rules (void)
+{
+  g_autoptr(GError) error = NULL;
+  g_autoptr(RpmOstreePathRules) rules = rpmostree_path_rules_new ();
+  rpmostree_path_rules_add (rules, RPMOSTREE_PATH_MATCH_PREFIX, "/var/lib/rpm", 1 << 0);
+  rpmostree_path_rules_add (rules, RPMOSTREE_PATH_MATCH_DIR, "/usr", 1 << 1);
+  rpmostree_path_rules_add (rules, RPMOSTREE_PATH_MATCH_EXACT, "/proc", 1 << 2);
+  g_assert (rpmostree_path_rules_add_regex (rules, "/usr/etc", "\\.LOCK$", 1 << 3, &error));
+  g_assert_no_error (error);
+  g_assert (!rpmostree_path_rules_add_regex (rules, NULL, "(", 1 << 4, &error));
+  g_assert (error);
+
+  g_assert_cmpuint (rpmostree_path_rules_match (rules, "/var/lib/rpm"), ==, 1 << 0);
+  g_assert_cmpuint (rpmostree_path_rules_match (rules, "/var/lib/rpmstate"), ==, 1 << 0);
+  g_assert_cmpuint (rpmostree_path_rules_match (rules, "/var/lib"), ==, 0);
+  g_assert_cmpuint (rpmostree_path_rules_match (rules, "/usr"), ==, 1 << 1);
+  g_assert_cmpuint (rpmostree_path_rules_match (rules, "/usr/bin"), ==, 1 << 1);
+  g_assert_cmpuint (rpmostree_path_rules_match (rules, "/usrx"), ==, 0);
+  g_assert_cmpuint (rpmostree_path_rules_match (rules, "/proc"), ==, 1 << 2);
+  g_assert_cmpuint (rpmostree_path_rules_match (rules, "/proc/1"), ==, 0);
+  g_assert_cmpuint (rpmostree_path_rules_match (rules, "/usr/etc/selinux/x.LOCK"), ==, (1 << 1) | (1 << 3));
+  g_assert_cmpuint (rpmostree_path_rules_match (rules, "/usr/lib/x.LOCK"), ==, 1 << 1);
+  g_assert_cmpuint (rpmostree_path_rules_match_relative (rules, "usr/bin"), ==, 1 << 1);
+  g_assert_cmpuint (rpmostree_path_rules_match_relative (rules, "proc"), ==, 1 << 2);
+
+  g_assert (rpmostree_relative_path_is_ostree_compliant ("usr"));
+  g_assert (rpmostree_relative_path_is_ostree_compliant ("usr/local"));
+  g_assert (!rpmostree_relative_path_is_ostree_compliant ("usr/local/bin"));
+  g_assert (rpmostree_relative_path_is_ostree_compliant ("lib64/libc.so"));
+  g_assert (!rpmostree_relative_path_is_ostree_compliant ("lib6"));
+  g_assert (!rpmostree_relative_path_is_ostree_compliant ("opt/foo"));
+
+  g_autofree char *translated = rpmostree_translate_path_for_ostree ("boot/vmlinuz");
+  g_assert_cmpstr (translated, ==, "usr/lib/ostree-boot/vmlinuz");
+  g_clear_pointer (&translated, g_free);
+  translated = rpmostree_translate_path_for_ostree ("opt/app/bin");
+  g_assert_cmpstr (translated, ==, "usr/lib/opt/app/bin");
+  g_clear_pointer (&translated, g_free);
+  translated = rpmostree_translate_path_for_ostree ("usr/lib/ostree-boot/vmlinuz");
+  g_assert_null (translated);
+
+  /* Only the contents of /opt are moved; /opt itself is a symlink to var/opt */
+  RpmOstreePathRules *default_rules = rpmostree_path_rules_get_default ();
+  g_assert_cmpuint (rpmostree_path_rules_match (default_rules, "/opt") & RPMOSTREE_PATH_FLAG_OPT, ==, 0);
+  g_assert_cmpuint (rpmostree_path_rules_match (default_rules, "/opt/app") & RPMOSTREE_PATH_FLAG_OPT, !=, 0);
+  g_assert_cmpuint (rpmostree_path_rules_match (default_rules, "/optx/app") & RPMOSTREE_PATH_FLAG_OPT, ==, 0);
+  translated = rpmostree_translate_path_for_ostree ("opt");
+  g_assert_null (translated);
+}
+
 static void
 test_variant_to_nevra(void)
 {
@@ -220,6 +276,306 @@ test_variant_to_nevra(void)
   g_assert_cmpstr (tarch, ==, arch);
 }
 
+static void
+test_owner_index (void)
+{
+  g_autoptr(GError) error = NULL;
+  const char *files[] = { "a/sub/file", "b/sub/file", "toplevel", "c/d/e/f" };
+
+  glnx_shutil_rm_rf_at (AT_FDCWD, "owner-index-root", NULL, &error);
+  g_assert_no_error (error);
+  glnx_shutil_mkdir_p_at (AT_FDCWD, "owner-index-root", 0755, NULL, &error);
+  g_assert_no_error (error);
+  glnx_autofd int rootfs_dfd = -1;
+  glnx_opendirat (AT_FDCWD, "owner-index-root", TRUE, &rootfs_dfd, &error);
+  g_assert_no_error (error);
+  for (guint i = 0; i < G_N_ELEMENTS (files); i++)
+    {
+      g_autofree char *dir = g_path_get_dirname (files[i]);
+      if (!g_str_equal (dir, "."))
+        {
+          glnx_shutil_mkdir_p_at (rootfs_dfd, dir, 0755, NULL, &error);
+          g_assert_no_error (error);
+        }
+      glnx_file_replace_contents_at (rootfs_dfd, files[i], (guint8*)"x", 1,
+                                     GLNX_FILE_REPLACE_NODATASYNC, NULL, &error);
+      g_assert_no_error (error);
+    }
+
+  /* If we can, give some files other owners; the first path in the walk wins,
+   * where toplevel entries come first, then each toplevel dir in order */
+  const gboolean can_chown = (getuid () == 0);
+  if (can_chown)
+    {
+      g_assert_cmpint (fchownat (rootfs_dfd, "b/sub/file", 4242, 4343, AT_SYMLINK_NOFOLLOW), ==, 0);
+      g_assert_cmpint (fchownat (rootfs_dfd, "a/sub", 4242, 0, AT_SYMLINK_NOFOLLOW), ==, 0);
+      g_assert_cmpint (fchownat (rootfs_dfd, "c/d/e/f", 0, 4343, AT_SYMLINK_NOFOLLOW), ==, 0);
+      g_assert_cmpint (fchownat (rootfs_dfd, "toplevel", 0, 4444, AT_SYMLINK_NOFOLLOW), ==, 0);
+      g_assert_cmpint (fchownat (rootfs_dfd, "c/d", 0, 4444, AT_SYMLINK_NOFOLLOW), ==, 0);
+    }
+
+  g_autoptr(RpmOstreeOwnerIndex) idx = rpmostree_owner_index_new (rootfs_dfd, NULL, &error);
+  g_assert_no_error (error);
+  g_assert (idx);
+  g_assert_cmpstr (rpmostree_owner_index_lookup_uid (idx, getuid ()), ==, "/");
+  g_assert_cmpstr (rpmostree_owner_index_lookup_gid (idx, getgid ()), ==, "/");
+  g_assert_null (rpmostree_owner_index_lookup_uid (idx, 4141));
+  g_assert_null (rpmostree_owner_index_lookup_gid (idx, 4141));
+  if (can_chown)
+    {
+      g_assert_cmpstr (rpmostree_owner_index_lookup_uid (idx, 4242), ==, "/a/sub");
+      g_assert_cmpstr (rpmostree_owner_index_lookup_gid (idx, 4343), ==, "/b/sub/file");
+      g_assert_cmpstr (rpmostree_owner_index_lookup_gid (idx, 4444), ==, "/toplevel");
+    }
+
+  /* And the walk stops if we're cancelled */
+  g_autoptr(GCancellable) cancellable = g_cancellable_new ();
+  g_cancellable_cancel (cancellable);
+  g_autoptr(RpmOstreeOwnerIndex) cancelled_idx =
+    rpmostree_owner_index_new (rootfs_dfd, cancellable, &error);
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_assert_null (cancelled_idx);
+}
+
+static OstreeRepoCommitFilterResult
+mtree_skip_filter (OstreeRepo *repo,
+                   const char *path,
+                   GFileInfo  *file_info,
+                   gpointer    user_data)
+{
+  if (g_str_equal (path, "/skip") || g_str_has_suffix (path, "/skip"))
+    return OSTREE_REPO_COMMIT_FILTER_SKIP;
+  return OSTREE_REPO_COMMIT_FILTER_ALLOW;
+}
+
+/* Tag everything with its own path */
+static GVariant *
+mtree_path_xattr_cb (OstreeRepo *repo,
+                     const char *path,
+                     GFileInfo  *file_info,
+                     gpointer    user_data)
+{
+  g_auto(GVariantBuilder) builder;
+  g_variant_builder_init (&builder, (GVariantType*)"a(ayay)");
+  g_variant_builder_add (&builder, "(@ay@ay)",
+                         g_variant_new_bytestring ("user.path"),
+                         g_variant_new_bytestring (path));
+  return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
+static void
+assert_path_xattr (GVariant   *xattrs,
+                   const char *path)
+{
+  g_assert_cmpuint (g_variant_n_children (xattrs), ==, 1);
+  const char *name;
+  const char *value;
+  g_variant_get_child (xattrs, 0, "(^&ay^&ay)", &name, &value);
+  g_assert_cmpstr (name, ==, "user.path");
+  g_assert_cmpstr (value, ==, path);
+}
+
+static void
+test_mtree_write_file (void)
+{
+  g_autoptr(GError) error = NULL;
+
+  g_autoptr(OstreeRepo) repo =
+    ostree_repo_create_at (AT_FDCWD, "mtree-repo", OSTREE_REPO_MODE_BARE_USER,
+                           NULL, NULL, &error);
+  g_assert_no_error (error);
+  g_auto(RpmOstreeRepoAutoTransaction) txn = { 0, };
+  rpmostree_repo_auto_transaction_start (&txn, repo, FALSE, NULL, &error);
+  g_assert_no_error (error);
+
+  RpmOstreeMtreeWriteOptions opts = { mtree_skip_filter, NULL, mtree_path_xattr_cb, NULL, NULL };
+  g_autoptr(OstreeMutableTree) mtree = ostree_mutable_tree_new ();
+  g_autoptr(GBytes) content = g_bytes_new_static ("hello\n", strlen ("hello\n"));
+  rpmostree_mtree_write_file (repo, mtree, "usr/share/foo/bar", 0640, content, &opts,
+                              NULL, &error);
+  g_assert_no_error (error);
+
+  /* Each missing parent is created, root-owned and labeled */
+  OstreeMutableTree *dir = mtree;
+  const char *dirs[] = { "/usr", "/usr/share", "/usr/share/foo" };
+  for (guint i = 0; i < G_N_ELEMENTS (dirs); i++)
+    {
+      g_autofree char *name = g_path_get_basename (dirs[i]);
+      dir = g_hash_table_lookup (ostree_mutable_tree_get_subdirs (dir), name);
+      g_assert (dir);
+      const char *meta_csum = ostree_mutable_tree_get_metadata_checksum (dir);
+      g_assert (meta_csum);
+      g_autoptr(GVariant) dirmeta = NULL;
+      ostree_repo_load_variant (repo, OSTREE_OBJECT_TYPE_DIR_META, meta_csum, &dirmeta, &error);
+      g_assert_no_error (error);
+      guint32 uid, gid, mode;
+      g_autoptr(GVariant) xattrs = NULL;
+      g_variant_get (dirmeta, "(uuu@a(ayay))", &uid, &gid, &mode, &xattrs);
+      g_assert_cmpuint (GUINT32_FROM_BE (uid), ==, 0);
+      g_assert_cmpuint (GUINT32_FROM_BE (gid), ==, 0);
+      g_assert_cmpuint (GUINT32_FROM_BE (mode), ==, S_IFDIR | 0755);
+      assert_path_xattr (xattrs, dirs[i]);
+    }
+
+  /* And the file itself */
+  const char *file_csum = g_hash_table_lookup (ostree_mutable_tree_get_files (dir), "bar");
+  g_assert (file_csum);
+  g_autoptr(GInputStream) file_in = NULL;
+  g_autoptr(GFileInfo) file_info = NULL;
+  g_autoptr(GVariant) file_xattrs = NULL;
+  ostree_repo_load_file (repo, file_csum, &file_in, &file_info, &file_xattrs, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_cmpuint (g_file_info_get_attribute_uint32 (file_info, "unix::uid"), ==, 0);
+  g_assert_cmpuint (g_file_info_get_attribute_uint32 (file_info, "unix::mode"), ==, S_IFREG | 0640);
+  g_assert_cmpint (g_file_info_get_size (file_info), ==, strlen ("hello\n"));
+  assert_path_xattr (file_xattrs, "/usr/share/foo/bar");
+
+  /* A skipped file or parent leaves the tree alone */
+  rpmostree_mtree_write_file (repo, mtree, "usr/skip", 0644, content, &opts, NULL, &error);
+  g_assert_no_error (error);
+  rpmostree_mtree_write_file (repo, mtree, "skip/nested/file", 0644, content, &opts, NULL, &error);
+  g_assert_no_error (error);
+  rpmostree_mtree_write_file (repo, mtree, "usr/skip/file", 0644, content, &opts, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_cmpuint (g_hash_table_size (ostree_mutable_tree_get_subdirs (mtree)), ==, 1);
+  g_assert_cmpuint (g_hash_table_size (ostree_mutable_tree_get_files (mtree)), ==, 0);
+  OstreeMutableTree *usr = g_hash_table_lookup (ostree_mutable_tree_get_subdirs (mtree), "usr");
+  g_assert_cmpuint (g_hash_table_size (ostree_mutable_tree_get_subdirs (usr)), ==, 1);
+  g_assert_cmpuint (g_hash_table_size (ostree_mutable_tree_get_files (usr)), ==, 0);
+
+  ostree_repo_commit_transaction (repo, NULL, NULL, &error);
+  g_assert_no_error (error);
+  txn.initialized = FALSE;
+}
+
+static void
+counter_output_cb (RpmOstreeOutputType type,
+                   void               *data,
+                   void               *opaque)
+{
+  GHashTable *counters = opaque;
+  if (type != RPMOSTREE_OUTPUT_COUNTER)
+    return;
+  RpmOstreeOutputCounter *counter = data;
+  g_hash_table_replace (counters, (char*)counter->name, GSIZE_TO_POINTER (counter->value));
+}
+
+static guint64
+get_counter (GHashTable *counters,
+             const char *name)
+{
+  g_assert (g_hash_table_contains (counters, name));
+  return GPOINTER_TO_SIZE (g_hash_table_lookup (counters, name));
+}
+
+static void
+test_selabel_cache (void)
+{
+  g_autoptr(GError) error = NULL;
+
+  /* A rootfs without any policy, so nothing is labeled */
+  glnx_shutil_rm_rf_at (AT_FDCWD, "selabel-root", NULL, &error);
+  g_assert_no_error (error);
+  glnx_shutil_mkdir_p_at (AT_FDCWD, "selabel-root", 0755, NULL, &error);
+  g_assert_no_error (error);
+  glnx_autofd int rootfs_dfd = -1;
+  glnx_opendirat (AT_FDCWD, "selabel-root", TRUE, &rootfs_dfd, &error);
+  g_assert_no_error (error);
+  g_autoptr(OstreeSePolicy) sepolicy = ostree_sepolicy_new_at (rootfs_dfd, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_null (ostree_sepolicy_get_name (sepolicy));
+
+  g_autoptr(RpmOstreeSeLabelCache) cache = rpmostree_selabel_cache_new (sepolicy);
+  g_assert (rpmostree_selabel_cache_get_sepolicy (cache) == sepolicy);
+  g_assert (rpmostree_selabel_cache_matches (cache, sepolicy));
+
+  g_autoptr(GHashTable) counters = g_hash_table_new (g_str_hash, g_str_equal);
+  rpmostree_output_set_callback (counter_output_cb, counters);
+
+  /* Only the file type matters, so the second lookup is a hit but the third
+   * isn't */
+  const char *label = "unset";
+  g_assert (rpmostree_selabel_cache_lookup (cache, "/usr/bin/foo", S_IFREG | 0755, &label, &error));
+  g_assert_no_error (error);
+  g_assert_null (label);
+  g_assert (rpmostree_selabel_cache_lookup (cache, "/usr/bin/foo", S_IFREG | 0644, &label, &error));
+  g_assert_no_error (error);
+  g_assert (rpmostree_selabel_cache_lookup (cache, "/usr/bin/foo", S_IFDIR | 0755, &label, &error));
+  g_assert_no_error (error);
+  rpmostree_selabel_cache_report (cache);
+  g_assert_cmpuint (get_counter (counters, "selinux-label-lookups"), ==, 3);
+  g_assert_cmpuint (get_counter (counters, "selinux-label-cache-hits"), ==, 1);
+
+  /* Reports are deltas since the last one */
+  g_assert (rpmostree_selabel_cache_lookup (cache, "/usr/bin/foo", S_IFDIR | 0700, &label, &error));
+  g_assert_no_error (error);
+  rpmostree_selabel_cache_report (cache);
+  g_assert_cmpuint (get_counter (counters, "selinux-label-lookups"), ==, 1);
+  g_assert_cmpuint (get_counter (counters, "selinux-label-cache-hits"), ==, 1);
+  rpmostree_selabel_cache_report (cache);
+  g_assert_cmpuint (get_counter (counters, "selinux-label-lookups"), ==, 0);
+  g_assert_cmpuint (get_counter (counters, "selinux-label-cache-hits"), ==, 0);
+
+  rpmostree_output_set_callback (NULL, NULL);
+
+  /* Without a label from the policy, the base one is kept, unless we require
+   * one */
+  g_auto(GVariantBuilder) builder;
+  g_variant_builder_init (&builder, (GVariantType*)"a(ayay)");
+  g_variant_builder_add (&builder, "(@ay@ay)",
+                         g_variant_new_bytestring ("user.foo"),
+                         g_variant_new_bytestring ("bar"));
+  g_variant_builder_add (&builder, "(@ay@ay)",
+                         g_variant_new_bytestring ("security.selinux"),
+                         g_variant_new_bytestring ("system_u:object_r:bin_t:s0"));
+  g_autoptr(GVariant) base_xattrs = g_variant_ref_sink (g_variant_builder_end (&builder));
+  g_autoptr(GVariant) xattrs =
+    rpmostree_selabel_cache_label_xattrs (cache, "/usr/bin/foo", S_IFREG | 0755,
+                                          base_xattrs, FALSE, &error);
+  g_assert_no_error (error);
+  g_assert (g_variant_equal (xattrs, base_xattrs));
+  g_autoptr(GVariant) required_xattrs =
+    rpmostree_selabel_cache_label_xattrs (cache, "/usr/bin/foo", S_IFREG | 0755,
+                                          base_xattrs, TRUE, &error);
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_FAILED);
+  g_assert_null (required_xattrs);
+  g_clear_error (&error);
+
+  /* If the host has a policy, check that we label with it and intern labels */
+  glnx_autofd int host_rootfs_dfd = -1;
+  glnx_opendirat (AT_FDCWD, "/", TRUE, &host_rootfs_dfd, &error);
+  g_assert_no_error (error);
+  g_autoptr(OstreeSePolicy) host_sepolicy = ostree_sepolicy_new_at (host_rootfs_dfd, NULL, NULL);
+  if (!host_sepolicy || !ostree_sepolicy_get_name (host_sepolicy))
+    return;
+  g_autoptr(RpmOstreeSeLabelCache) host_cache = rpmostree_selabel_cache_new (host_sepolicy);
+  g_assert (!rpmostree_selabel_cache_matches (host_cache, sepolicy));
+  const char *label_a = NULL;
+  const char *label_b = NULL;
+  g_assert (rpmostree_selabel_cache_lookup (host_cache, "/usr/bin/a", S_IFREG | 0755, &label_a, &error));
+  g_assert_no_error (error);
+  g_assert (rpmostree_selabel_cache_lookup (host_cache, "/usr/bin/b", S_IFREG | 0755, &label_b, &error));
+  g_assert_no_error (error);
+  g_assert (label_a);
+  g_autofree char *expected = NULL;
+  ostree_sepolicy_get_label (host_sepolicy, "/usr/bin/a", S_IFREG | 0755, &expected, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_cmpstr (label_a, ==, expected);
+  /* Same label, same string */
+  g_assert (label_a == label_b);
+
+  g_autoptr(GVariant) host_xattrs =
+    rpmostree_selabel_cache_label_xattrs (host_cache, "/usr/bin/a", S_IFREG | 0755,
+                                          base_xattrs, TRUE, &error);
+  g_assert_no_error (error);
+  g_assert_cmpuint (g_variant_n_children (host_xattrs), ==, 2);
+  const char *name;
+  const char *value;
+  g_variant_get_child (host_xattrs, 1, "(^&ay^&ay)", &name, &value);
+  g_assert_cmpstr (name, ==, "security.selinux");
+  g_assert_cmpstr (value, ==, expected);
+}
+
 int
 main (int   argc,
       char *argv[])
@@ -229,6 +585,10 @@ main (int   argc,
   g_test_add_func ("/utils/varsubst", test_varsubst_string);
   g_test_add_func ("/utils/cachebranch_to_nevra", test_cache_branch_to_nevra);
   g_test_add_func ("/utils/bsearch_str", test_bsearch_str);
+  g_test_add_func ("/utils/path_rules", test_path_rules);
+  g_test_add_func ("/utils/owner_index", test_owner_index);
+  g_test_add_func ("/utils/mtree_write_file", test_mtree_write_file);
+  g_test_add_func ("/utils/selabel_cache", test_selabel_cache);
   g_test_add_func ("/importer/variant_to_nevra", test_variant_to_nevra);
 
   return g_test_run ();
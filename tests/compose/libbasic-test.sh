@@ -101,6 +101,29 @@ assert_file_has_content_literal pkglist.txt 'foobar'
 assert_not_file_has_content pkglist.txt 'foobar-rec'
 echo "ok compose pkglist"
 
+ostree --repo=${repo} show ${treeref} \
+  --print-metadata-key rpmostree.rpmdb.pkgindex > pkgindex.txt
+assert_file_has_content pkgindex.txt "'systemd', '0', "
+assert_file_has_content pkgindex.txt "'systemd-.*\\.src\\.rpm'"
+# plain names are looked up in the pkgindex; globs go through the rpmdb
+rpm-ostree --repo=${repo} db list ${treeref} foobar systemd > db-list-names.txt
+rpm-ostree --repo=${repo} db list ${treeref} 'foobar*' 'system[d]' > db-list-globs.txt
+assert_file_has_content db-list-names.txt '^ foobar-'
+assert_file_has_content db-list-names.txt '^ systemd-'
+assert_not_file_has_content db-list-names.txt 'foobar-rec'
+diff -u db-list-names.txt db-list-globs.txt
+echo "ok compose pkgindex"
+
+ostree --repo=${repo} show ${treeref} \
+  --print-detached-metadata-key rpmostree.rpmdb.changelogs > changelogs.txt
+assert_file_has_content changelogs.txt "'systemd-.*\\.src\\.rpm'"
+# the detached metadata isn't signed; the commit metadata vouches for it
+ostree --repo=${repo} show ${treeref} \
+  --print-metadata-key rpmostree.rpmdb.changelogs-sha256 > changelogs-sha256.txt
+assert_file_has_content changelogs-sha256.txt "^'[0-9a-f]\{64\}'$"
+rpm-ostree --repo=${repo} db diff --changelogs ${treeref} ${treeref}
+echo "ok compose changelogs"
+
 ostree --repo=${repo} cat ${treeref} /usr/share/rpm-ostree/treefile.json > treefile.json
 assert_jq treefile.json '.basearch == "x86_64"'
 echo "ok basearch"
@@ -0,0 +1,39 @@
+#!/bin/bash
+set -xeuo pipefail
+
+dn=$(cd "$(dirname "$0")" && pwd)
+# shellcheck source=libcomposetest.sh
+. "${dn}/libcomposetest.sh"
+
+# Rebuilding the policy in a %post goes through semodule-wrapper.sh, which
+# memoizes the resulting policy store in the pkgcache repo.  Note that in
+# compose the pkgcache repo is opened by fd.
+treefile_append "repos" '["test-repo"]'
+build_rpm foobar-policy post "semodule -nB"
+echo gpgcheck=0 >> yumrepo.repo
+ln "$PWD/yumrepo.repo" config/yumrepo.repo
+treefile_append "packages" '["foobar-policy"]'
+
+policycache=cache/pkgcache-repo/extensions/rpmostree/selinux-policy-cache
+runcompose
+assert_file_has_content ${policycache}/log '^build '
+assert_not_file_has_content ${policycache}/log '^hit '
+key=$(sed -ne 's/^build //p' ${policycache}/log)
+test -d ${policycache}/${key}
+ostree --repo="${repo}" ls "${treeref}" /usr/etc/selinux/targeted/policy > policy.txt
+assert_file_has_content policy.txt 'policy\.'
+echo "ok policy cache build"
+
+runcompose --force-nocache
+assert_file_has_content ${policycache}/log "^hit ${key}\$"
+assert_not_file_has_content ${policycache}/log '^build '
+ostree --repo="${repo}" ls "${treeref}" /usr/etc/selinux/targeted/policy > policy.txt
+assert_file_has_content policy.txt 'policy\.'
+echo "ok policy cache hit"
+
+# Entries no longer used are pruned
+mkdir ${policycache}/stale
+runcompose --force-nocache
+test -d ${policycache}/${key}
+test ! -e ${policycache}/stale
+echo "ok policy cache prune"
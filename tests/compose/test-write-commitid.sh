@@ -22,3 +22,11 @@ for key in ostree-version rpm-ostree-inputhash ostree-content-bytes-written; do
     jq -r '.["'${key}'"]' compose.json >/dev/null
 done
 echo "ok composejson"
+
+# Per-phase timing; see rpmostree_composeutil_timing_variant()
+for key in total depsolve import checkout scripts postprocess commit peak-rss-kb \
+           commit-objects-written commit-objects-reused; do
+    jq -e '.timing["'${key}'"] != null' compose.json >/dev/null
+done
+jq -e '.timing["scripts-per-package"] | type == "object"' compose.json >/dev/null
+echo "ok composejson timing"
@@ -32,6 +32,9 @@ vm_ostreeupdate_create v2
 
 vm_rpmostree cleanup -m
 
+# We change the daemon config below; keep the original to restore at the end
+vm_cmd cp -a /etc/rpm-ostreed.conf /etc/rpm-ostreed.conf.orig
+
 vm_rpmostree status --verbose > status.txt
 assert_file_has_content status.txt 'AutomaticUpdates: disabled'
 vm_change_update_policy stage
@@ -41,11 +44,19 @@ assert_file_has_content_literal status.txt 'AutomaticUpdates: stage; rpm-ostreed
 vm_change_update_policy ex-stage
 vm_rpmostree status > status.txt
 assert_file_has_content_literal status.txt 'AutomaticUpdates: stage; rpm-ostreed-automatic.timer: inactive'
+vm_shell_inline <<EOF
+echo AutomaticUpdatePriority=background >> /etc/rpm-ostreed.conf
+rpm-ostree reload
+EOF
 
 vm_rpmostree upgrade --trigger-automatic-update-policy
 vm_assert_status_jq ".deployments[1][\"booted\"]" \
                     ".deployments[0][\"staged\"]" \
                     ".deployments[0][\"version\"] == \"v2\""
+vm_cmd gdbus call -y -d org.projectatomic.rpmostree1 -o /org/projectatomic/rpmostree1/Sysroot \
+  -m org.freedesktop.DBus.Properties.Get org.projectatomic.rpmostree1.Sysroot RecentTransactions > out.txt
+assert_file_has_content out.txt "'method': <'AutomaticUpdateTrigger'>"
+assert_file_has_content out.txt "'background': <true>"
 vm_rpmostree status -v > status.txt
 assert_file_has_content status.txt "Staged: yes"
 vm_rpmostree upgrade > upgrade.txt
@@ -60,3 +71,43 @@ vm_assert_status_jq ".deployments[0][\"booted\"]" \
 vm_cmd cat /etc/somenewfile > somenewfile.txt
 assert_file_has_content somenewfile.txt new-content-in-etc
 echo "ok autoupdate staged"
+
+# Now the assemble policy: layer a package so there's something to assemble
+vm_build_rpm foo
+vm_rpmostree install foo
+vm_ostreeupdate_create v3
+vm_change_update_policy assemble
+vm_rpmostree status > status.txt
+assert_file_has_content_literal status.txt 'AutomaticUpdates: assemble'
+vm_cmd ostree refs rpmostree/assembled > refs-before.txt
+vm_rpmostree upgrade --trigger-automatic-update-policy
+vm_cmd ostree refs rpmostree/assembled > refs.txt
+comm -13 <(sort refs-before.txt) <(sort refs.txt) > new-refs.txt
+assert_streq "$(wc -l < new-refs.txt)" 1
+prepared=$(vm_cmd ostree rev-parse $(cat new-refs.txt))
+# Nothing was deployed, but it ran in the background
+vm_assert_status_jq ".deployments[0][\"version\"] == \"v2\""
+vm_cmd gdbus call -y -d org.projectatomic.rpmostree1 -o /org/projectatomic/rpmostree1/Sysroot \
+  -m org.freedesktop.DBus.Properties.Get org.projectatomic.rpmostree1.Sysroot RecentTransactions > out.txt
+assert_file_has_content out.txt "'background': <true>"
+vm_rpmostree upgrade > upgrade.txt
+assert_file_has_content_literal upgrade.txt "Using prepared commit ${prepared}"
+assert_streq "$(vm_get_pending_csum)" "${prepared}"
+echo "ok autoupdate assemble"
+
+# Dropping the pending deployment drops the prepared commits too
+vm_rpmostree cleanup -p
+vm_cmd ostree refs rpmostree/assembled > refs.txt
+assert_streq "$(wc -l < refs.txt)" 0
+if vm_cmd ostree show ${prepared}; then
+  assert_not_reached "prepared commit ${prepared} not pruned"
+fi
+echo "ok cleanup assembled"
+
+vm_shell_inline <<EOF
+mv /etc/rpm-ostreed.conf.orig /etc/rpm-ostreed.conf
+rpm-ostree reload
+EOF
+vm_rpmostree status --verbose > status.txt
+assert_file_has_content status.txt 'AutomaticUpdates: disabled'
+echo "ok restore config"
@@ -79,6 +79,15 @@ assert_file_has_content err.txt "See https://github.com/projectatomic/rpm-ostree
 
 echo "ok failed to install in /usr/local"
 
+vm_cmd gdbus call -y -d org.projectatomic.rpmostree1 -o /org/projectatomic/rpmostree1/Sysroot \
+  -m org.freedesktop.DBus.Properties.Get org.projectatomic.rpmostree1.Sysroot RecentTransactions > out.txt
+assert_file_has_content out.txt "'method': <'PkgChange'>"
+assert_file_has_content out.txt "'success': <false>"
+assert_file_has_content out.txt "'phases': <\[{'name': <'"
+assert_file_has_content out.txt "'elapsed-ms': <uint64"
+assert_file_has_content out.txt "'background': <false>"
+echo "ok RecentTransactions"
+
 # Check that trying to install multiple nonexistent pkgs at once provides an
 # error including all of them at once
 fakes="foobar barbaz bazboo"
@@ -162,9 +171,15 @@ assert_streq $rc 77
 # Test that we don't do progress bars if on a tty (with the client)
 # (And use --unchanged-exit-77 to verify that we *don't* exit 77).
 vm_rpmostree install foo-1.0 --unchanged-exit-77 > foo-install.txt
-assert_file_has_content_literal foo-install.txt 'Checking out packages...done'
+assert_file_has_content_literal foo-install.txt 'Staging deployment...done'
 echo "ok install not on a tty"
 
+# Same base and packages as the first install, so we reuse that commit
+assert_file_has_content foo-install.txt 'Using prepared commit'
+vm_cmd ostree refs rpmostree/assembled > refs.txt
+assert_file_has_content refs.txt rpmostree/assembled/
+echo "ok reuse assembled commit"
+
 # check that by default we diff booted vs pending
 vm_rpmostree db diff --format=diff > out.txt
 assert_file_has_content out.txt +foo-1.0
@@ -233,8 +248,9 @@ vm_reboot
 vm_assert_layered_pkg foo absent
 echo "ok pkg foo removed"
 
-vm_rpmostree cleanup -b
+vm_rpmostree cleanup -b > out.txt
 vm_assert_status_jq '.deployments|length == 2'
+assert_file_has_content out.txt "Cleanup timing: prepare [0-9]*ms, refs [0-9]*ms (pkgcache [0-9]*ms)"
 echo "ok baseline cleanup"
 
 vm_rpmostree cleanup -r
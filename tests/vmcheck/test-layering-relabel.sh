@@ -59,6 +59,17 @@ root=$(vm_get_deployment_root 0)
 assert_actual_label $root/usr/bin/foobar install_exec_t
 echo "ok layer selinux pkg"
 
+# layering something else reruns the %post of foobar-selinux on the same
+# policy store, so we should reuse the policy it built last time
+vm_build_rpm bar
+cursor=$(vm_get_journal_cursor)
+vm_rpmostree install bar
+vm_assert_journal_has_content $cursor 'rpm-ostree-semodule: Reused policy store'
+root=$(vm_get_deployment_root 0)
+assert_actual_label $root/usr/bin/foobar install_exec_t
+vm_rpmostree uninstall bar
+echo "ok reuse policy store"
+
 # now let's change the policy
 vm_build_selinux_rpm foobar-selinux /usr/bin/foobar shell_exec_t
 vm_cmd ostree commit -b vmcheck --tree=ref=vmcheck
@@ -43,6 +43,7 @@ assert_livefs_ok() {
     assert_file_has_content livefs-analysis.txt 'livefs OK (dry run)'
 }
 assert_livefs_ok
+assert_file_has_content livefs-analysis.txt 'Packages: modified: 0 removed: 0 added: 1'
 
 vm_assert_status_jq '.deployments|length == 2' \
                     '.deployments[0]["live-replaced"]|not' \
@@ -195,3 +196,29 @@ vm_assert_status_jq '.deployments|length == 3' '.deployments[0]["live-replaced"]
                     '.deployments[1]["live-replaced"]' '.deployments[1]["booted"]'
 echo "ok modifications"
 
+# Fine-grained mode swaps in just the changed files
+reset
+generate_upgrade "mkdir -p vmcheck/usr/newsubdir2 && date > vmcheck/usr/newsubdir2/date.txt"
+vm_rpmostree upgrade
+vm_rpmostree ex livefs -n --i-like-danger --fine-grained &> livefs-analysis.txt
+assert_file_has_content livefs-analysis.txt 'livefs OK (dry run)'
+# /boot and the rpmdb are the same in both commits
+assert_not_file_has_content livefs-analysis.txt 'Kernel/initramfs changed'
+assert_file_has_content livefs-analysis.txt 'Packages: modified: 0 removed: 0 added: 0'
+if vm_rpmostree ex livefs -n --i-like-danger --fine-grained --dangerous-do-not-use-replace &> livefs-analysis.txt; then
+    assert_not_reached "livefs with both replace and fine-grained succeeded?"
+fi
+assert_file_has_content livefs-analysis.txt 'Cannot specify both'
+vm_cmd ls -i /usr/bin/rpm-ostree > inode-before.txt
+vm_rpmostree ex livefs --i-like-danger --fine-grained > livefs.txt
+assert_file_has_content livefs.txt 'Swapped in 2 paths, removed 0'
+vm_cmd cat /${dummy_file_to_modify} > dummyfile.txt
+assert_file_has_content dummyfile.txt "JUST KIDDING DO WHATEVER"
+vm_cmd test -f /usr/newsubdir2/date.txt
+# Unchanged files are left alone
+vm_cmd ls -i /usr/bin/rpm-ostree > inode-after.txt
+assert_streq "$(cat inode-before.txt)" "$(cat inode-after.txt)"
+vm_assert_status_jq '.deployments|length == 3' '.deployments[0]["live-replaced"]|not' \
+                    '.deployments[1]["live-replaced"]' '.deployments[1]["booted"]'
+echo "ok fine-grained modifications"
+
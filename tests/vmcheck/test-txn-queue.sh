@@ -0,0 +1,130 @@
+#!/bin/bash
+#
+# Copyright (C) 2020 Red Hat, Inc.
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation; either
+# version 2 of the License, or (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this library; if not, write to the
+# Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+# Boston, MA 02111-1307, USA.
+
+set -euo pipefail
+
+. ${commondir}/libtest.sh
+. ${commondir}/libvm.sh
+
+set -x
+
+# Test the transaction queue for clients registered with `queue-transactions`.
+# A transaction that's never started keeps the daemon busy for as long as its
+# initiator stays on the bus, so we hold one open and queue requests behind it.
+
+stateroot=$(vm_get_booted_stateroot)
+ospath=/org/projectatomic/rpmostree1/${stateroot//-/_}
+
+vm_run_container --privileged -i -v /var/run/dbus:/var/run/dbus --net=host -- \
+  /bin/bash << EOF
+set -xeuo pipefail
+dnf install -y python3-gobject-base
+python3 -c '
+import time
+from gi.repository import Gio, GLib
+
+NAME = "org.projectatomic.rpmostree1"
+SYSROOT = "/org/projectatomic/rpmostree1/Sysroot"
+QUEUE_MAX = 16
+
+def connect():
+    addr = Gio.dbus_address_get_for_bus_sync(Gio.BusType.SYSTEM, None)
+    return Gio.DBusConnection.new_for_address_sync(addr,
+        Gio.DBusConnectionFlags.AUTHENTICATION_CLIENT |
+        Gio.DBusConnectionFlags.MESSAGE_BUS_CONNECTION, None, None)
+
+def refresh_md_args(n):
+    return GLib.Variant("(a{sv})", ({"initiating-command-line": GLib.Variant("s", "q%d" % n)},))
+
+def refresh_md(conn, n):
+    return conn.call_sync(NAME, "$ospath", NAME + ".OS", "RefreshMd", refresh_md_args(n),
+                          None, Gio.DBusCallFlags.NONE, -1, None)
+
+def refresh_md_queued(conn, n):
+    # the reply only comes once the transaction starts, so do not wait for it
+    conn.call(NAME, "$ospath", NAME + ".OS", "RefreshMd", refresh_md_args(n),
+              None, Gio.DBusCallFlags.NONE, GLib.MAXINT, None, None, None)
+
+def queued(conn):
+    # method calls on a connection are handled in order, so this also
+    # waits for any queueing calls sent before it
+    v = conn.call_sync(NAME, SYSROOT, "org.freedesktop.DBus.Properties", "Get",
+                       GLib.Variant("(ss)", (NAME + ".Sysroot", "QueuedTransactions")),
+                       None, Gio.DBusCallFlags.NONE, -1, None)
+    return v.unpack()[0]
+
+def assert_fails(fn, msg):
+    try:
+        fn()
+    except GLib.Error as e:
+        assert msg in e.message, e.message
+    else:
+        assert False, "expected failure: " + msg
+
+holder = connect()
+refresh_md(holder, 0)
+
+# clients that did not opt in still fail right away
+outsider = connect()
+assert_fails(lambda: refresh_md(outsider, 1), "Transaction in progress")
+assert queued(outsider) == []
+
+queuer = connect()
+queuer.call_sync(NAME, SYSROOT, NAME + ".Sysroot", "RegisterClient",
+                 GLib.Variant("(a{sv})", ({"queue-transactions": GLib.Variant("b", True)},)),
+                 None, Gio.DBusCallFlags.NONE, -1, None)
+
+# identical requests share a queue entry, but each is listed
+refresh_md_queued(queuer, 1)
+refresh_md_queued(queuer, 1)
+refresh_md_queued(queuer, 2)
+q = queued(queuer)
+assert len(q) == 3, q
+assert all(m == "RefreshMd" and p == "$ospath" for (m, _, p) in q), q
+
+# fill the queue up with distinct requests
+for n in range(3, QUEUE_MAX + 1):
+    refresh_md_queued(queuer, n)
+assert len(queued(queuer)) == QUEUE_MAX + 1
+assert_fails(lambda: refresh_md(queuer, QUEUE_MAX + 1), "queue full")
+# but a full queue still takes requests it can merge
+refresh_md_queued(queuer, QUEUE_MAX)
+assert len(queued(queuer)) == QUEUE_MAX + 2
+
+# and outsiders still cannot get ahead of the queue
+assert_fails(lambda: refresh_md(outsider, 1), "Transaction in progress")
+
+# dropping off the bus aborts the held transaction, and the queued ones
+# as their initiator is gone too; the queue should drain
+queuer.close_sync(None)
+holder.close_sync(None)
+for i in range(120):
+    if queued(outsider) == []:
+        break
+    time.sleep(1)
+assert queued(outsider) == []
+'
+EOF
+echo "ok transaction queue"
+
+# and the daemon is back to idle
+vm_rpmostree cleanup -m
+vm_rpmostree status > status.txt
+assert_not_file_has_content status.txt "Transaction:"
+echo "ok queue drained"